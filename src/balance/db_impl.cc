@@ -4,11 +4,15 @@
 #include "balance/table.h"
 #include "util/linked_queue.h"
 #include "util/log.h"
+#include "yukino/perf_context-inl.h"
 #include "yukino/iterator.h"
 #include "yukino/write_batch.h"
 #include "yukino/env.h"
+#include "base/io.h"
 #include "glog/logging.h"
+#include <algorithm>
 #include <list>
+#include <numeric>
 #include <chrono>
 
 #if defined(CHECK_OK)
@@ -27,22 +31,34 @@ DBImpl::DBImpl(const Options &options, const std::string &name)
     , comparator_(options_.comparator)
     , snapshot_dummy_(0)
     , versions_(new VersionSet(name, DCHECK_NOTNULL(options.comparator),
-                               DCHECK_NOTNULL(options.env)))
+                               DCHECK_NOTNULL(options.env),
+                               options.max_manifest_file_size))
     , shutting_down_(nullptr)
     , files_(name) {
 }
 
 DBImpl::~DBImpl() {
+    if (options_.flush_on_close && log_.get()) {
+        auto rs = Flush(FlushOptions());
+        if (!rs.ok()) {
+            LOG(ERROR) << "Flush on close fail, cause: " << rs.ToString();
+        }
+    }
+
     DLOG(INFO) << "Shutting down, last_tx_id: " << versions_->last_tx_id();
     {
         std::unique_lock<std::mutex> lock(mutex_);
 
         shutting_down_.store(this, std::memory_order_release);
+        gc_cv_.notify_all();
         while (background_active_) {
             background_cv_.wait(lock);
             //std::this_thread::yield();
         }
     }
+    if (gc_thread_.joinable()) {
+        gc_thread_.join();
+    }
 
     if (db_lock_.get()) {
         auto rs = db_lock_->Unlock();
@@ -85,6 +101,11 @@ base::Status DBImpl::Open() {
         rs = Recover();
     }
 
+    if (rs.ok() && options_.gc_sweep_rate > 0) {
+        gc_thread_ = std::thread([this]() {
+            this->BackgroundGC();
+        });
+    }
     return rs;
 }
 
@@ -139,7 +160,8 @@ public:
     uint64_t counting_size() const { return counting_size_; }
     
 private:
-    uint64_t tx_id() const { return last_tx_id_ + counting_tx_; }
+    // The last transaction id has been used, so start from next one.
+    uint64_t tx_id() const { return last_tx_id_ + counting_tx_ + 1; }
     
     const uint64_t last_tx_id_;
     uint64_t counting_tx_ = 0;
@@ -153,16 +175,21 @@ private:
 
 base::Status DBImpl::Write(const WriteOptions& options,
                            WriteBatch* updates) {
+    TraceWrite(updates->buf());
+
     base::Status rs;
     // TODO: Wait for checkpoint
 
+    // The log writer is not thread-safe and may be switched by checkpoint,
+    // so append it under the lock, this also keeps the log in tx order.
+    std::unique_lock<std::mutex> lock(mutex_);
+
     // Write-ahead-log fisrt:
     CHECK_OK(log_->Append(updates->buf()));
     if (options.sync) {
         CHECK_OK(log_file_->Sync());
     }
 
-    std::unique_lock<std::mutex> lock(mutex_);
     uint64_t tx_id = versions_->last_tx_id();
 
     WritingHandler handler(tx_id, table_.get());
@@ -181,10 +208,17 @@ base::Status DBImpl::Write(const WriteOptions& options,
 
 base::Status DBImpl::Get(const ReadOptions& options,
                          const base::Slice& key, std::string* value) {
+    PERF_TIMER_GUARD(get_nanos);
+    TraceGet(key);
+
     base::Status rs;
     uint64_t tx_id = 0;
 
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
+    }
     if (options.snapshot) {
         tx_id = static_cast<const SnapshotImpl *>(options.snapshot)->tx_id();
     } else {
@@ -199,9 +233,231 @@ base::Status DBImpl::Get(const ReadOptions& options,
     return rs;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<base::Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<base::Status>* status) {
+    PERF_TIMER_GUARD(get_nanos);
+    for (const auto &key : keys) {
+        TraceGet(key);
+    }
+
+    values->resize(keys.size());
+    status->resize(keys.size());
+    if (keys.empty()) {
+        return;
+    }
+
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto ucmp = comparator_.delegated();
+    std::sort(order.begin(), order.end(), [&keys, ucmp](size_t a, size_t b) {
+        return ucmp->Compare(keys[a], keys[b]) < 0;
+    });
+
+    std::vector<base::Slice> sorted_keys;
+    std::vector<std::string *> sorted_values;
+    sorted_keys.reserve(keys.size());
+    sorted_values.reserve(keys.size());
+    for (auto i : order) {
+        sorted_keys.push_back(keys[i]);
+        sorted_values.push_back(&(*values)[i]);
+    }
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+
+    uint64_t tx_id = 0;
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
+    }
+    if (options.snapshot) {
+        tx_id = static_cast<const SnapshotImpl *>(options.snapshot)->tx_id();
+    } else {
+        tx_id = versions_->last_tx_id();
+    }
+    table_->MultiGet(sorted_keys.data(), sorted_keys.size(), tx_id,
+                     sorted_values.data(), found.get());
+    lock.unlock();
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        (*status)[order[i]] = found[i] ? base::Status::OK()
+                                       : base::Status::NotFound("");
+    }
+}
+
+namespace {
+
+/**
+ * The b+tree pages can be changed by writings when the db mutex be released,
+ * so every moving seeks the table again under the mutex, and the current
+ * entry be copied out.
+ */
+class DBIterator : public Iterator {
+public:
+    DBIterator(Iterator *delegated, const Comparator *comparator,
+               uint64_t tx_id, std::mutex *mutex)
+        : delegated_(DCHECK_NOTNULL(delegated))
+        , comparator_(DCHECK_NOTNULL(comparator))
+        , tx_id_(tx_id)
+        , mutex_(DCHECK_NOTNULL(mutex)) {
+    }
+
+    virtual ~DBIterator() override {}
+
+    virtual bool Valid() const override { return valid_; }
+
+    virtual void SeekToFirst() override {
+        std::unique_lock<std::mutex> lock(*mutex_);
+        delegated_->SeekToFirst();
+        FindNextUserEntry(false);
+    }
+
+    virtual void SeekToLast() override {
+        std::unique_lock<std::mutex> lock(*mutex_);
+        delegated_->SeekToLast();
+        FindPrevUserEntry();
+    }
+
+    virtual void Seek(const base::Slice& target) override {
+        std::unique_lock<std::mutex> lock(*mutex_);
+        SeekInternal(target, tx_id_);
+        FindNextUserEntry(false);
+    }
+
+    virtual void Next() override {
+        DCHECK(valid_);
+        std::unique_lock<std::mutex> lock(*mutex_);
+        // The oldest version of current key, then skip all of its versions.
+        SeekInternal(saved_key_, 0);
+        FindNextUserEntry(true);
+    }
+
+    virtual void Prev() override {
+        DCHECK(valid_);
+        std::unique_lock<std::mutex> lock(*mutex_);
+        // The newest version of current key, the previous one be the last
+        // version of previous key.
+        SeekInternal(saved_key_, kMaxTxId);
+        if (delegated_->Valid()) {
+            delegated_->Prev();
+        } else {
+            delegated_->SeekToLast();
+        }
+        FindPrevUserEntry();
+    }
+
+    virtual base::Slice key() const override {
+        DCHECK(valid_);
+        return saved_key_;
+    }
+
+    virtual base::Slice value() const override {
+        DCHECK(valid_);
+        return saved_value_;
+    }
+
+    virtual base::Status status() const override {
+        return delegated_->status();
+    }
+
+private:
+    static const uint64_t kMaxTxId = UINT64_MAX >> 8;
+
+    void SeekInternal(const base::Slice &key, uint64_t tx_id) {
+        auto packed = InternalKey::Pack(key, tx_id, kFlagFind, "");
+        delegated_->Seek(InternalKey::Parse(packed).key());
+        delete[] packed;
+    }
+
+    void FindNextUserEntry(bool skipping) {
+        for (; delegated_->Valid(); delegated_->Next()) {
+            auto parsed = InternalKey::PartialParse(delegated_->key().data(),
+                                                    delegated_->key().size());
+            if (parsed.tx_id > tx_id_) {
+                continue;
+            }
+            if (skipping && comparator_->Compare(parsed.user_key,
+                                                 saved_key_) == 0) {
+                continue;
+            }
+
+            // The newest visible version of this key.
+            saved_key_.assign(parsed.user_key.data(), parsed.user_key.size());
+            if (parsed.flag == kFlagDeletion) {
+                skipping = true;
+                continue;
+            }
+            saved_value_.assign(delegated_->value().data(),
+                                delegated_->value().size());
+            valid_ = true;
+            return;
+        }
+        valid_ = false;
+    }
+
+    void FindPrevUserEntry() {
+        while (delegated_->Valid()) {
+            auto parsed = InternalKey::PartialParse(delegated_->key().data(),
+                                                    delegated_->key().size());
+            saved_key_.assign(parsed.user_key.data(), parsed.user_key.size());
+
+            SeekInternal(saved_key_, tx_id_);
+            if (delegated_->Valid()) {
+                parsed = InternalKey::PartialParse(delegated_->key().data(),
+                                                   delegated_->key().size());
+                if (parsed.flag == kFlagValue &&
+                    comparator_->Compare(parsed.user_key, saved_key_) == 0) {
+                    saved_value_.assign(delegated_->value().data(),
+                                        delegated_->value().size());
+                    valid_ = true;
+                    return;
+                }
+            }
+
+            // No visible value of this key, step back to the previous key.
+            SeekInternal(saved_key_, kMaxTxId);
+            if (delegated_->Valid()) {
+                delegated_->Prev();
+            } else {
+                delegated_->SeekToLast();
+            }
+        }
+        valid_ = false;
+    }
+
+    std::unique_ptr<Iterator> delegated_;
+    const Comparator *comparator_;
+    const uint64_t tx_id_;
+    std::mutex *mutex_;
+
+    std::string saved_key_;
+    std::string saved_value_;
+    bool valid_ = false;
+}; // class DBIterator
+
+} // namespace
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
-    // TODO:
-    return nullptr;
+    // Iterate in the implicit snapshot if no one, the visible versions
+    // can not be purged in iterating.
+    auto snapshot = options.snapshot;
+    if (!snapshot) {
+        snapshot = GetSnapshot();
+    }
+    auto tx_id = static_cast<const SnapshotImpl *>(snapshot)->tx_id();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto iter = new DBIterator(table_->CreateIterator(),
+                               comparator_.delegated(), tx_id, &mutex_);
+    lock.unlock();
+
+    if (!options.snapshot) {
+        iter->RegisterCleanup([this, snapshot]() {
+            this->ReleaseSnapshot(snapshot);
+        });
+    }
+    return iter;
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -256,7 +512,7 @@ base::Status DBImpl::Recover() {
     db_lock_ = std::unique_ptr<base::FileLock>(lock);
 
     std::string buf;
-    CHECK_OK(base::ReadAll(files_.CurrentFile(), &buf));
+    CHECK_OK(ReadFileToString(env_, files_.CurrentFile(), &buf));
     if (buf.back() != '\n') {
         return base::Status::Corruption("CURRENT file is not with newline.");
     }
@@ -277,6 +533,15 @@ base::Status DBImpl::Recover() {
 
 base::Status DBImpl::Redo(uint64_t log_file_number, uint64_t startup_tx_id) {
     base::Status rs;
+
+    // The log is empty after checkpoint, nothing to redo, and it can not be
+    // mapped.
+    uint64_t file_size = 0;
+    CHECK_OK(env_->GetFileSize(files_.LogFile(log_file_number), &file_size));
+    if (file_size == 0) {
+        return rs;
+    }
+
     base::MappedMemory *rv = nullptr;
     CHECK_OK(env_->CreateRandomAccessFile(files_.LogFile(log_file_number), &rv));
 
@@ -296,6 +561,67 @@ base::Status DBImpl::Redo(uint64_t log_file_number, uint64_t startup_tx_id) {
     return reader.status();
 }
 
+// The loading bypasses the redo-log, it be persisted by one manifest
+// switching at the end.
+base::Status DBImpl::BulkLoad(Iterator* sorted_input,
+                              const BulkLoadOptions& options) {
+    base::Status rs;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (background_active_) {
+        background_cv_.wait(lock);
+    }
+
+    // Hold off checkpoint until the loading finish.
+    background_active_ = true;
+    auto defer = base::Defer([this]() {
+        background_active_ = false;
+        background_cv_.notify_all();
+    });
+
+    // All loaded keys share one transaction.
+    auto tx_id = versions_->last_tx_id() + 1;
+    CHECK_OK(table_->BulkLoad(sorted_input, tx_id, options.fill_factor));
+    CHECK_OK(table_->Flush(true));
+    versions_->AdvacneTxId(1);
+
+    // Switch to new log-file, the old one can not be redone any more.
+    auto prev_log_number = log_file_number_;
+    CHECK_OK(NewLog(versions_->NextFileNumber()));
+
+    VersionPatch patch;
+    patch.set_log_file_number(log_file_number_);
+    patch.set_prev_log_file_number(prev_log_number);
+    return versions_->Apply(&patch, &mutex_);
+}
+
+base::Status DBImpl::Flush(const FlushOptions& options) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!background_status_.ok()) {
+        return background_status_;
+    }
+    if (!options.wait) {
+        if (!background_active_) {
+            ScheduleCheckpoint();
+        }
+        return base::Status::OK();
+    }
+
+    while (background_active_) {
+        background_cv_.wait(lock);
+    }
+
+    // The checkpoint switches to a new log-file, the records before it need
+    // not be redone.
+    background_active_ = true;
+    auto defer = base::Defer([this]() {
+        background_active_ = false;
+        background_cv_.notify_all();
+    });
+    checkpoint_rate_ = 0;
+    return Checkpoint();
+}
+
 void DBImpl::ScheduleCheckpoint() {
     background_active_ = true;
     checkpoint_rate_   = 0;
@@ -326,28 +652,83 @@ void DBImpl::BackgroundCheckpoint() {
                   << duration_cast<milliseconds>(epch).count() << " ms";
     });
 
-
-    if (!CatchError(table_->Flush(true))) {
-        return;
-    }
-    if (!CatchError(PurgingStep(versions_->startup_tx_id()))) {
-        return;
+    CheckpointJobInfo info;
+    info.db_name = name_;
+    info.prev_log_file_number = log_file_number_;
+
+    info.status = Checkpoint();
+    CatchError(kErrorCheckpoint, info.status);
+
+    info.log_file_number = log_file_number_;
+    info.last_tx_id      = versions_->last_tx_id();
+    info.micros = duration_cast<microseconds>(high_resolution_clock::now() -
+                                              start).count();
+    if (!options_.listeners.empty()) {
+        lock.unlock();
+        for (const auto &listener : options_.listeners) {
+            listener->OnCheckpointCompleted(this, info);
+        }
+        lock.lock();
     }
+}
+
+base::Status DBImpl::Checkpoint() {
+    base::Status rs;
+
+    CHECK_OK(table_->Flush(true));
+    CHECK_OK(PurgingStep(OldestTxId(), purging_count_));
 
     // switch new log-file
     auto prev_log_number = log_file_number_;
-    if (!CatchError(NewLog(versions_->NextFileNumber()))) {
-        return;
-    }
+    CHECK_OK(NewLog(versions_->NextFileNumber()));
 
     VersionPatch patch;
     patch.set_log_file_number(log_file_number_);
     patch.set_prev_log_file_number(prev_log_number);
+    return versions_->Apply(&patch, &mutex_);
+}
 
-    CatchError(versions_->Apply(&patch, &mutex_));
+void DBImpl::BackgroundGC() {
+    using namespace std::chrono;
+
+    // Number of keys be swept per step.
+    auto count = std::max(1, options_.gc_sweep_rate *
+                          Config::kGCStepInterval / 1000);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!shutting_down_.load(std::memory_order_acquire)) {
+        gc_cv_.wait_for(lock, milliseconds(Config::kGCStepInterval));
+        if (shutting_down_.load(std::memory_order_acquire)) {
+            break;
+        }
+        if (!background_status_.ok()) {
+            continue;
+        }
+
+        // Read the pages of this step without the mutex first, the writers
+        // and readers are not blocked by the page I/O of the sweeping.
+        base::Handle<Table> table(table_);
+        auto rs = table->Prefetch(purging_point_, Config::kGCPrefetchLeaves,
+                                  &mutex_);
+        if (!CatchError(kErrorGarbageCollection, rs) ||
+            shutting_down_.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        CatchError(kErrorGarbageCollection, PurgingStep(OldestTxId(), count));
+    }
 }
 
-base::Status DBImpl::PurgingStep(uint64_t startup_tx_id) {
+/*
+ * Versions of a user key are ordered by tx_id descending. For a reader at
+ * tx_id >= horizon, the newest version under horizon shadows all older
+ * versions, so they can be dropped. If the newest one is a deletion, no
+ * any reader can see it or the older versions, drop it too.
+ *
+ * The step only stops at the boundary of user keys, so the next step can
+ * start at the first version of next key.
+ */
+base::Status DBImpl::PurgingStep(uint64_t horizon, int count) {
     base::Status rs;
 
     std::unique_ptr<Iterator> iter(table_->CreateIterator());
@@ -359,32 +740,29 @@ base::Status DBImpl::PurgingStep(uint64_t startup_tx_id) {
         iter->Seek(purging_point_);
     }
 
-    auto count = purging_count_;
     std::list<std::string> collection;
-    std::string deletion_key;
-    while (count-- > 0 && iter->Valid() && deletion_key.empty()) {
+    std::string user_key;
+    bool shadowed = false;
+    for (auto first = true; iter->Valid(); iter->Next(), first = false) {
         auto parsed = InternalKey::PartialParse(iter->key().data(),
                                                 iter->key().size());
-        if (!deletion_key.empty()) {
-            if (deletion_key == parsed.user_key.ToString()) {
-                std::string key(parsed.key().data(), parsed.key().size());
-
-                collection.push_back(std::move(key));
-            } else {
-                deletion_key.clear();
+        if (first || parsed.user_key != user_key) {
+            if (count-- <= 0) {
+                break;
             }
+            user_key.assign(parsed.user_key.data(), parsed.user_key.size());
+            shadowed = false;
         }
-        if (parsed.tx_id < startup_tx_id) {
-            std::string key(parsed.key().data(), parsed.key().size());
 
-            collection.push_back(std::move(key));
-        } else if (parsed.flag == kFlagDeletion) {
-            deletion_key.assign(parsed.user_key.data(), parsed.user_key.size());
+        if (parsed.tx_id > horizon) {
+            continue;
+        }
+        if (shadowed || parsed.flag == kFlagDeletion) {
             std::string key(parsed.key().data(), parsed.key().size());
 
             collection.push_back(std::move(key));
         }
-        iter->Next();
+        shadowed = true;
     }
 
     if (iter->Valid()) {
@@ -392,6 +770,7 @@ base::Status DBImpl::PurgingStep(uint64_t startup_tx_id) {
     } else {
         purging_point_.clear();
     }
+    iter.reset();
 
     for (const auto &key : collection) {
         auto parsed = InternalKey::PartialParse(key.data(), key.size());
@@ -402,14 +781,55 @@ base::Status DBImpl::PurgingStep(uint64_t startup_tx_id) {
     return rs;
 }
 
-bool DBImpl::CatchError(const base::Status &status) {
-    if (background_status_.ok() && !status.ok()) {
+uint64_t DBImpl::OldestTxId() const {
+    if (util::Dll::Empty(&snapshot_dummy_)) {
+        return versions_->last_tx_id();
+    }
+
+    // Snapshots be appended in order, the head is the oldest.
+    return snapshot_dummy_.next->tx_id();
+}
+
+base::Status DBImpl::TEST_GarbageCollect() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    base::Status rs;
+    purging_point_.clear();
+    do {
+        CHECK_OK(PurgingStep(OldestTxId(), purging_count_));
+    } while (!purging_point_.empty());
+    return rs;
+}
+
+size_t DBImpl::TEST_NumTableEntries() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    size_t count = 0;
+    std::unique_ptr<Iterator> iter(table_->CreateIterator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    return count;
+}
+
+bool DBImpl::CatchError(BackgroundErrorReason reason,
+                        const base::Status &status) {
+    if (status.ok()) {
+        return true;
+    }
+    if (background_status_.ok()) {
         background_status_ = status;
     }
-    if (!status.ok()) {
-        DLOG(ERROR) << "background error: " << status.ToString();
+    DLOG(ERROR) << "background error: " << status.ToString();
+
+    if (!options_.listeners.empty()) {
+        mutex_.unlock();
+        for (const auto &listener : options_.listeners) {
+            listener->OnBackgroundError(this, reason, status);
+        }
+        mutex_.lock();
     }
-    return status.ok();
+    return false;
 }
 
 base::Status DBImpl::NewTable() {
@@ -418,7 +838,13 @@ base::Status DBImpl::NewTable() {
     CHECK_OK(env_->CreateFileIO(files_.DataFile(), &io));
     storage_io_ = base::make_unique_ptr(io);
 
-    table_ = new Table(comparator_, options_.write_buffer_size);
+    if (!io_queue_.get()) {
+        base::IOQueue *queue = nullptr;
+        CHECK_OK(env_->CreateIOQueue(Config::kWritingQueueDepth, &queue));
+        io_queue_ = base::make_unique_ptr(queue);
+    }
+    table_ = new Table(comparator_, options_.write_buffer_size,
+                       io_queue_.get(), options_.rate_limiter.get());
     return rs;
 }
 
@@ -428,6 +854,9 @@ base::Status DBImpl::NewLog(uint64_t log_file_number) {
 
     base::AppendFile *file = nullptr;
     CHECK_OK(env_->CreateAppendFile(files_.LogFile(log_file_number_), &file));
+    if (options_.wal_bytes_per_sync > 0) {
+        file = new base::IncrementalSyncFile(file, options_.wal_bytes_per_sync);
+    }
 
     log_file_ = base::make_unique_ptr(file);
     log_      = base::make_unique_ptr(new util::Log::Writer(file,
@@ -7,8 +7,11 @@
 #include "base/status.h"
 #include "base/base.h"
 #include "yukino/db.h"
+#include "yukino/listener.h"
 #include "yukino/options.h"
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <thread>
 
 namespace yukino {
@@ -20,6 +23,7 @@ namespace base {
 class Slice;
 class AppendFile;
 class FileLock;
+class IOQueue;
 
 } // namespace base
 
@@ -54,6 +58,13 @@ public:
                                WriteBatch* updates) override;
     virtual base::Status Get(const ReadOptions& options,
                              const base::Slice& key, std::string* value) override;
+    virtual void MultiGet(const ReadOptions& options,
+                          const std::vector<base::Slice>& keys,
+                          std::vector<std::string>* values,
+                          std::vector<base::Status>* status) override;
+    virtual base::Status Flush(const FlushOptions& options) override;
+    virtual base::Status BulkLoad(Iterator* sorted_input,
+                                  const BulkLoadOptions& options) override;
     virtual Iterator* NewIterator(const ReadOptions& options) override;
     virtual const Snapshot* GetSnapshot() override;
     virtual void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -69,7 +80,22 @@ public:
     void AddCheckpointRate(int rate) { checkpoint_rate_ += rate; }
     void ScheduleCheckpoint();
 
-    base::Status PurgingStep(uint64_t startup_tx_id);
+    /**
+     * Sweep keys from purging point, drop the versions can not be seen by
+     * any reader.
+     *
+     * @param horizon the oldest transaction id can be read.
+     * @param count the number of keys to be swept.
+     */
+    base::Status PurgingStep(uint64_t horizon, int count);
+
+    /**
+     * The oldest transaction id can be read: the oldest live snapshot's, or
+     * last transaction id if there is no any snapshot.
+     *
+     * REQUIRES: mutex_ held.
+     */
+    uint64_t OldestTxId() const;
 
     //--------------------------------------------------------------------------
     // For Testing
@@ -84,13 +110,27 @@ public:
 
     VersionSet *TEST_VersionSet() const { return versions_.get(); }
 
+    base::Status TEST_GarbageCollect();
+
+    size_t TEST_NumTableEntries();
+
     // Then engine's name
     constexpr static const auto kName = "yukino.balance";
 
 private:
     void BackgroundCheckpoint();
-
-    bool CatchError(const base::Status &status);
+    void BackgroundGC();
+
+    // REQUIRES: mutex_ held.
+    base::Status Checkpoint();
+
+    /**
+     * Keep the first background error, and notify the listeners.
+     *
+     * REQUIRES: mutex_ held, it may be released for notifying.
+     * @return status.ok()
+     */
+    bool CatchError(BackgroundErrorReason reason, const base::Status &status);
     base::Status NewTable();
     base::Status NewLog(uint64_t log_file_number);
 
@@ -115,6 +155,10 @@ private:
     std::string purging_point_;
     int purging_count_ = Config::kPurgingStepCount;
 
+    std::thread gc_thread_; // background garbage collector
+    std::condition_variable gc_cv_;
+
+    std::unique_ptr<base::IOQueue> io_queue_;
     std::unique_ptr<base::FileIO> storage_io_;
     base::Handle<Table> table_; // The b+tree table with disk storage.
 
@@ -9,13 +9,51 @@
 #include "yukino/options.h"
 #include "yukino/env.h"
 #include "yukino/write_batch.h"
+#include "yukino/listener.h"
+#include "yukino/iterator.h"
 #include "gtest/gtest.h"
 #include <stdio.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
 
 namespace yukino {
 
 namespace balance {
 
+namespace {
+
+class SortedIteratorMock : public Iterator {
+public:
+    SortedIteratorMock(const std::vector<std::string> &keys) : data_(keys) {}
+
+    virtual ~SortedIteratorMock() override {}
+
+    virtual bool Valid() const override { return i_ < data_.size(); }
+    virtual void SeekToFirst() override { i_ = 0; }
+    virtual void SeekToLast() override { i_ = data_.size() - 1; }
+    virtual void Seek(const base::Slice& target) override {
+        DCHECK(false) << "Noreached";
+    }
+    virtual void Next() override { i_++; }
+    virtual void Prev() override { i_--; }
+    virtual base::Slice key() const override {
+        DCHECK(Valid());
+        return data_[i_];
+    }
+    virtual base::Slice value() const override {
+        DCHECK(Valid());
+        return data_[i_];
+    }
+    virtual base::Status status() const override { return base::Status::OK(); }
+
+private:
+    std::vector<std::string> data_;
+    size_t i_ = 0;
+};
+
+} // namespace
+
 class BalanceDBImplTest : public ::testing::Test {
 public:
     BalanceDBImplTest () {
@@ -65,6 +103,34 @@ TEST_F(BalanceDBImplTest, Sanity) {
     ASSERT_EQ("3", dummy);
 }
 
+TEST_F(BalanceDBImplTest, MultiGet) {
+    char key[32];
+    for (int i = 0; i < 1000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%04d", i);
+        auto rs = db_->Put(WriteOptions(), key, key);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    ASSERT_TRUE(db_->Delete(WriteOptions(), "key.0500").ok());
+
+    std::vector<base::Slice> keys = {
+        "key.0999", "key.0001", "key", "key.0500", "key.0002", "key.0001",
+        "key.0501", "zzz",
+    };
+    std::vector<std::string> values;
+    std::vector<base::Status> status;
+    db_->MultiGet(ReadOptions(), keys, &values, &status);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), status.size());
+
+    for (auto i : {0, 1, 4, 5, 6}) {
+        ASSERT_TRUE(status[i].ok()) << keys[i].ToString();
+        EXPECT_EQ(keys[i].ToString(), values[i]);
+    }
+    for (auto i : {2, 3, 7}) {
+        EXPECT_TRUE(status[i].IsNotFound()) << keys[i].ToString();
+    }
+}
+
 TEST_F(BalanceDBImplTest, Checkpoint) {
     static const char *keys[] = {
         "a",
@@ -82,6 +148,37 @@ TEST_F(BalanceDBImplTest, Checkpoint) {
     db_->TEST_WaitForCheckpoint();
 }
 
+TEST_F(BalanceDBImplTest, CheckpointListener) {
+    struct Listener : public EventListener {
+        virtual void OnCheckpointCompleted(DB *db,
+                                           const CheckpointJobInfo &info) override {
+            infos.push_back(info);
+        }
+        std::vector<CheckpointJobInfo> infos;
+    };
+    auto listener = std::make_shared<Listener>();
+
+    delete db_;
+    Env::Default()->DeleteFile(kDBName, true);
+    options_.listeners.push_back(listener);
+    db_ = new DBImpl(options_, kDBName);
+    auto rs = db_->Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = db_->Put(WriteOptions(), "aaa", "1");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    db_->ScheduleCheckpoint();
+    db_->TEST_WaitForCheckpoint();
+
+    ASSERT_EQ(1, listener->infos.size());
+    const auto &info = listener->infos[0];
+    EXPECT_TRUE(info.status.ok()) << info.status.ToString();
+    EXPECT_EQ(std::string(kDBName), info.db_name);
+    EXPECT_LT(info.prev_log_file_number, info.log_file_number);
+    EXPECT_EQ(1, info.last_tx_id);
+}
+
 TEST_F(BalanceDBImplTest, Recover) {
     static const char *keys[] = {
         "b",
@@ -104,6 +201,302 @@ TEST_F(BalanceDBImplTest, Recover) {
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 }
 
+TEST_F(BalanceDBImplTest, ConcurrentWrite) {
+    static const auto kNumThreads = 4;
+    static const auto kNumWrites  = 500;
+
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([this, i]() {
+            char key[32];
+            for (auto j = 0; j < kNumWrites; ++j) {
+                ::snprintf(key, sizeof(key), "key.%d.%05d", i, j);
+                auto rs = db_->Put(WriteOptions(), key, std::string(100, 'v'));
+                ASSERT_TRUE(rs.ok()) << rs.ToString();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    // The records of all writers be in the redo log.
+    delete db_;
+    options_.create_if_missing = false;
+    db_ = new DBImpl(options_, kDBName);
+    auto rs = db_->Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        for (auto j = 0; j < kNumWrites; ++j) {
+            ::snprintf(key, sizeof(key), "key.%d.%05d", i, j);
+            rs = db_->Get(ReadOptions(), key, &value);
+            ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+            EXPECT_EQ(std::string(100, 'v'), value);
+        }
+    }
+}
+
+TEST_F(BalanceDBImplTest, ConcurrentOverwrite) {
+    static const auto kNumThreads = 4;
+    static const auto kNumKeys    = 16;
+    static const auto kNumWrites  = 200;
+
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([this, i]() {
+            char key[32], value[32];
+            for (auto j = 0; j < kNumWrites; ++j) {
+                ::snprintf(key, sizeof(key), "key.%02d", j % kNumKeys);
+                ::snprintf(value, sizeof(value), "value.%d.%05d", i, j);
+                auto rs = db_->Put(WriteOptions(), key, value);
+                ASSERT_TRUE(rs.ok()) << rs.ToString();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    char key[32];
+    std::vector<std::string> values(kNumKeys);
+    for (auto i = 0; i < kNumKeys; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        auto rs = db_->Get(ReadOptions(), key, &values[i]);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+    }
+
+    // The redo log be in tx order, so the replay keeps the last writes.
+    delete db_;
+    options_.create_if_missing = false;
+    db_ = new DBImpl(options_, kDBName);
+    auto rs = db_->Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    for (auto i = 0; i < kNumKeys; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db_->Get(ReadOptions(), key, &value);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(values[i], value) << key;
+    }
+}
+
+TEST_F(BalanceDBImplTest, FlushOnClose) {
+    delete db_;
+    Env::Default()->DeleteFile(kDBName, true);
+    options_.flush_on_close = true;
+    db_ = new DBImpl(options_, kDBName);
+    auto rs = db_->Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = db_->Put(WriteOptions(), "aaa", "1");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = db_->Flush(FlushOptions());
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = db_->Put(WriteOptions(), "bbb", "2");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    delete db_;
+
+    // All of the data be checkpointed, the logs are not needed.
+    std::vector<std::string> children;
+    rs = Env::Default()->GetChildren(kDBName, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    for (const auto &child : children) {
+        if (child.size() > 4 &&
+            child.compare(child.size() - 4, 4, ".log") == 0) {
+            auto path = std::string(kDBName) + "/" + child;
+            ASSERT_EQ(0, ::truncate(path.c_str(), 0));
+        }
+    }
+
+    db_ = new DBImpl(options_, kDBName);
+    rs = db_->Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    rs = db_->Get(ReadOptions(), "aaa", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("1", value);
+    rs = db_->Get(ReadOptions(), "bbb", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("2", value);
+}
+
+TEST_F(BalanceDBImplTest, Iterate) {
+    WriteOptions wr;
+    db_->Put(wr, "a", "1");
+    db_->Put(wr, "b", "2");
+    db_->Put(wr, "c", "3");
+    db_->Put(wr, "d", "4");
+
+    auto snapshot = db_->GetSnapshot();
+    db_->Put(wr, "b", "22");
+    db_->Delete(wr, "c");
+    db_->Put(wr, "e", "5");
+    db_->Delete(wr, "a");
+
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    std::string result;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        result.append(iter->key().ToString() + ":" + iter->value().ToString());
+        result.append(";");
+    }
+    EXPECT_EQ("b:22;d:4;e:5;", result);
+
+    result.clear();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        result.append(iter->key().ToString() + ":" + iter->value().ToString());
+        result.append(";");
+    }
+    EXPECT_EQ("e:5;d:4;b:22;", result);
+
+    iter->Seek("c");
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("d", iter->key().ToString());
+    iter->Prev();
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("b", iter->key().ToString());
+    iter->Prev();
+    EXPECT_FALSE(iter->Valid());
+
+    // The writings after creating be invisible.
+    iter->SeekToFirst();
+    db_->Put(wr, "a", "11");
+    db_->Delete(wr, "d");
+    result.clear();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        result.append(iter->key().ToString() + ":" + iter->value().ToString());
+        result.append(";");
+    }
+    EXPECT_EQ("b:22;d:4;e:5;", result);
+    iter.reset();
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    iter.reset(db_->NewIterator(options));
+    result.clear();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        result.append(iter->key().ToString() + ":" + iter->value().ToString());
+        result.append(";");
+    }
+    EXPECT_EQ("a:1;b:2;c:3;d:4;", result);
+
+    result.clear();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        result.append(iter->key().ToString() + ":" + iter->value().ToString());
+        result.append(";");
+    }
+    EXPECT_EQ("d:4;c:3;b:2;a:1;", result);
+    iter.reset();
+    db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(BalanceDBImplTest, BulkLoad) {
+    delete db_;
+    db_ = nullptr;
+    Env::Default()->DeleteFile(kDBName, true);
+
+    static const auto kN = 1000;
+    char key[32];
+    std::vector<std::string> keys;
+    for (auto i = 0; i < kN; ++i) {
+        ::snprintf(key, sizeof(key), "k.%06d", i);
+        keys.push_back(key);
+    }
+
+    Options options;
+    options.engine_name = DBImpl::kName;
+    options.create_if_missing = true;
+
+    DB *db = nullptr;
+    auto rs = DB::Open(options, kDBName, &db);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<DB> holder(db);
+
+    SortedIteratorMock input(keys);
+    BulkLoadOptions load_options;
+    load_options.fill_factor = 0.8f;
+    rs = db->BulkLoad(&input, load_options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // Only the empty database can be loaded.
+    SortedIteratorMock again(keys);
+    EXPECT_FALSE(db->BulkLoad(&again, load_options).ok());
+
+    // The loaded keys be persisted without the redo log.
+    for (auto i = 0; i < 2; ++i) {
+        std::string value;
+        for (const auto &k : keys) {
+            rs = db->Get(ReadOptions(), k, &value);
+            ASSERT_TRUE(rs.ok()) << k << ": " << rs.ToString();
+            EXPECT_EQ(k, value);
+        }
+
+        std::unique_ptr<Iterator> iter(db->NewIterator(ReadOptions()));
+        auto expected = keys.begin();
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            ASSERT_TRUE(expected != keys.end());
+            EXPECT_EQ(*expected, iter->key().ToString());
+            EXPECT_EQ(*expected, iter->value().ToString());
+            ++expected;
+        }
+        EXPECT_TRUE(expected == keys.end());
+        iter.reset();
+
+        holder.reset();
+        rs = DB::Open(options, kDBName, &db);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        holder.reset(db);
+    }
+}
+
+TEST_F(BalanceDBImplTest, GarbageCollect) {
+    char value[32];
+    for (auto i = 0; i < 10; ++i) {
+        snprintf(value, sizeof(value), "v.%d", i);
+        auto rs = db_->Put(WriteOptions(), "aaa", value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    auto snapshot = db_->GetSnapshot();
+    for (auto i = 10; i < 20; ++i) {
+        snprintf(value, sizeof(value), "v.%d", i);
+        auto rs = db_->Put(WriteOptions(), "aaa", value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    auto rs = db_->Delete(WriteOptions(), "bbb");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = db_->TEST_GarbageCollect();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // versions after snapshot, the newest one before snapshot and deletion.
+    EXPECT_EQ(12, db_->TEST_NumTableEntries());
+
+    std::string dummy;
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    rs = db_->Get(read_options, "aaa", &dummy);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("v.9", dummy);
+
+    rs = db_->Get(ReadOptions(), "aaa", &dummy);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("v.19", dummy);
+
+    db_->ReleaseSnapshot(snapshot);
+    rs = db_->TEST_GarbageCollect();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(1, db_->TEST_NumTableEntries());
+
+    rs = db_->Get(ReadOptions(), "aaa", &dummy);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("v.19", dummy);
+}
+
 } // namespace balance
 
 } // namespace yukino
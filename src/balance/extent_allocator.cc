@@ -0,0 +1,104 @@
+#include "balance/extent_allocator.h"
+#include "glog/logging.h"
+
+namespace yukino {
+
+namespace balance {
+
+bool ExtentAllocator::Allocate(uint64_t num_blocks, uint64_t *index) {
+    DCHECK_GT(num_blocks, 0);
+
+    // Next-fit: try the extent at hint pointer first.
+    auto iter = extents_.upper_bound(hint_);
+    if (iter != extents_.begin()) {
+        auto prev = iter;
+        --prev;
+
+        if (prev->first + prev->second >= hint_ + num_blocks) {
+            Take(prev, hint_, num_blocks);
+            *index = hint_;
+            hint_ += num_blocks;
+            return true;
+        }
+    }
+
+    // Best-fit: the smallest extent large enough.
+    auto found = size_classes_.lower_bound({num_blocks, 0});
+    if (found == size_classes_.end()) {
+        return false;
+    }
+    auto start = found->second;
+    Take(extents_.find(start), start, num_blocks);
+
+    *index = start;
+    hint_  = start + num_blocks;
+    return true;
+}
+
+void ExtentAllocator::Free(uint64_t index, uint64_t num_blocks) {
+    DCHECK_GT(num_blocks, 0);
+
+    auto next = extents_.lower_bound(index);
+    DCHECK(next == extents_.end() || next->first >= index + num_blocks)
+        << "Double free block: " << index;
+
+    // Merge with next extent.
+    if (next != extents_.end() && next->first == index + num_blocks) {
+        num_blocks += next->second;
+        Erase(next++);
+    }
+
+    // Merge with prev extent.
+    if (next != extents_.begin()) {
+        auto prev = next;
+        --prev;
+
+        DCHECK_LE(prev->first + prev->second, index)
+            << "Double free block: " << index;
+        if (prev->first + prev->second == index) {
+            index = prev->first;
+            num_blocks += prev->second;
+            Erase(prev);
+        }
+    }
+    Insert(index, num_blocks);
+}
+
+void ExtentAllocator::Reset() {
+    extents_.clear();
+    size_classes_.clear();
+    hint_ = 0;
+    num_free_blocks_ = 0;
+}
+
+void ExtentAllocator::Insert(uint64_t index, uint64_t num_blocks) {
+    extents_.emplace(index, num_blocks);
+    size_classes_.emplace(num_blocks, index);
+    num_free_blocks_ += num_blocks;
+}
+
+void ExtentAllocator::Erase(ExtentIterator iter) {
+    size_classes_.erase(std::make_pair(iter->second, iter->first));
+    num_free_blocks_ -= iter->second;
+    extents_.erase(iter);
+}
+
+void ExtentAllocator::Take(ExtentIterator iter, uint64_t index,
+                           uint64_t num_blocks) {
+    auto start = iter->first;
+    auto end   = iter->first + iter->second;
+    DCHECK_LE(start, index);
+    DCHECK_LE(index + num_blocks, end);
+
+    Erase(iter);
+    if (start < index) {
+        Insert(start, index - start);
+    }
+    if (index + num_blocks < end) {
+        Insert(index + num_blocks, end - index - num_blocks);
+    }
+}
+
+} // namespace balance
+
+} // namespace yukino
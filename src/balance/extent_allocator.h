@@ -0,0 +1,75 @@
+#ifndef YUKINO_BALANCE_EXTENT_ALLOCATOR_H_
+#define YUKINO_BALANCE_EXTENT_ALLOCATOR_H_
+
+#include "base/base.h"
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace yukino {
+
+namespace balance {
+
+/**
+ * The free space manager of b+tree DATA file.
+ *
+ * Free blocks are kept as extents: [index, index + length). The extents be
+ * indexed by start index (for coalescing) and by length (size classes, for
+ * best-fit). All operations are O(log(number of extents)).
+ *
+ * Allocation prefers the extent at the hint pointer (the end of last
+ * allocation), so continuous writing be sequential on disk.
+ */
+class ExtentAllocator : public base::DisableCopyAssign {
+public:
+    ExtentAllocator() {}
+
+    /**
+     * Allocate contiguous blocks.
+     *
+     * @param num_blocks number of blocks for allocating.
+     * @param index the first block index of allocated extent.
+     * @return true - ok; false - no any extent large enough.
+     */
+    bool Allocate(uint64_t num_blocks, uint64_t *index);
+
+    /**
+     * Free contiguous blocks, the adjacent extents will be merged.
+     * The blocks must not be free.
+     */
+    void Free(uint64_t index, uint64_t num_blocks);
+
+    /**
+     * Clear all extents.
+     */
+    void Reset();
+
+    uint64_t num_free_blocks() const { return num_free_blocks_; }
+
+    size_t num_extents() const { return extents_.size(); }
+
+    uint64_t hint() const { return hint_; }
+
+private:
+    typedef std::map<uint64_t, uint64_t>::iterator ExtentIterator;
+
+    void Insert(uint64_t index, uint64_t num_blocks);
+    void Erase(ExtentIterator iter);
+    void Take(ExtentIterator iter, uint64_t index, uint64_t num_blocks);
+
+    // index -> length
+    std::map<uint64_t, uint64_t> extents_;
+
+    // (length, index)
+    std::set<std::pair<uint64_t, uint64_t>> size_classes_;
+
+    uint64_t hint_ = 0;
+    uint64_t num_free_blocks_ = 0;
+}; // class ExtentAllocator
+
+} // namespace balance
+
+} // namespace yukino
+
+#endif // YUKINO_BALANCE_EXTENT_ALLOCATOR_H_
@@ -0,0 +1,91 @@
+// The YukinoDB Unit Test Suite
+//
+//  extent_allocator_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "balance/extent_allocator.h"
+#include "gtest/gtest.h"
+
+namespace yukino {
+
+namespace balance {
+
+class ExtentAllocatorTest : public ::testing::Test {
+public:
+    ExtentAllocatorTest () {
+    }
+
+    virtual void SetUp() override {
+    }
+
+    virtual void TearDown() override {
+        allocator_.Reset();
+    }
+
+    ExtentAllocator allocator_;
+};
+
+TEST_F(ExtentAllocatorTest, Sanity) {
+    uint64_t index = 0;
+    EXPECT_FALSE(allocator_.Allocate(1, &index));
+
+    allocator_.Free(0, 16);
+    EXPECT_EQ(16, allocator_.num_free_blocks());
+    EXPECT_EQ(1, allocator_.num_extents());
+
+    ASSERT_TRUE(allocator_.Allocate(4, &index));
+    EXPECT_EQ(0, index);
+    ASSERT_TRUE(allocator_.Allocate(4, &index));
+    EXPECT_EQ(4, index);
+    EXPECT_EQ(8, allocator_.num_free_blocks());
+
+    EXPECT_FALSE(allocator_.Allocate(9, &index));
+    ASSERT_TRUE(allocator_.Allocate(8, &index));
+    EXPECT_EQ(8, index);
+    EXPECT_EQ(0, allocator_.num_free_blocks());
+    EXPECT_EQ(0, allocator_.num_extents());
+}
+
+TEST_F(ExtentAllocatorTest, Coalescing) {
+    allocator_.Free(0, 1);
+    allocator_.Free(2, 1);
+    allocator_.Free(4, 1);
+    EXPECT_EQ(3, allocator_.num_extents());
+
+    allocator_.Free(1, 1);
+    EXPECT_EQ(2, allocator_.num_extents());
+    allocator_.Free(3, 1);
+    EXPECT_EQ(1, allocator_.num_extents());
+    EXPECT_EQ(5, allocator_.num_free_blocks());
+
+    uint64_t index = 0;
+    ASSERT_TRUE(allocator_.Allocate(5, &index));
+    EXPECT_EQ(0, index);
+}
+
+TEST_F(ExtentAllocatorTest, BestFit) {
+    allocator_.Free(0, 8);
+    allocator_.Free(10, 2);
+    allocator_.Free(20, 4);
+
+    uint64_t index = 0;
+    ASSERT_TRUE(allocator_.Allocate(8, &index));
+    EXPECT_EQ(0, index);
+
+    ASSERT_TRUE(allocator_.Allocate(3, &index));
+    EXPECT_EQ(20, index);
+
+    // Sequential: next allocation be at the hint.
+    ASSERT_TRUE(allocator_.Allocate(1, &index));
+    EXPECT_EQ(23, index);
+
+    ASSERT_TRUE(allocator_.Allocate(2, &index));
+    EXPECT_EQ(10, index);
+    EXPECT_EQ(0, allocator_.num_free_blocks());
+}
+
+} // namespace balance
+
+} // namespace yukino
@@ -1,4 +1,5 @@
 #include "balance/format.h"
+#include "yukino/perf_context-inl.h"
 #include "util/area-inl.h"
 #include "util/area.h"
 #include "base/io-inl.h"
@@ -10,12 +11,17 @@ namespace yukino {
 
 namespace balance {
 
+// milliseconds() takes it by reference.
+const int Config::kGCStepInterval;
+
 /*virtual*/ InternalKeyComparator::~InternalKeyComparator() {
 
 }
 
 /*virtual*/ int InternalKeyComparator::Compare(const base::Slice& a,
                                                const base::Slice& b) const {
+    PERF_COUNTER_ADD(user_key_comparison_count, 1);
+
     base::BufferedReader rda(a.data(), a.size()), rdb(b.data(), b.size());
     auto key_a = rda.Read(a.size() - Config::kTxIdSize);
     auto key_b = rdb.Read(b.size() - Config::kTxIdSize);
@@ -29,10 +29,27 @@ struct Config final {
     static const uint32_t kMinPageSize = 256;
 
     static const int kHoldCachedPage = 7;
+    static const int kMaxClockSweep  = 32;
+    static const int kHoldPurgePage  = 16;
+
+    // The max step of DATA file growing.
+    static const size_t kMaxGrowingSize = 4 * base::kMB;
+
+    // The max size of one batched writing in checkpoint.
+    static const size_t kMaxBatchingSize = 1 * base::kMB;
+
+    // The max number of batched writings be in flight in checkpoint.
+    static const size_t kWritingQueueDepth = 64;
 
     static const int kCheckpointThreshold = 4 * base::kMB;
     static const int kPurgingStepCount = 100;
 
+    // Interval of background garbage collecting steps, in milliseconds.
+    static const int kGCStepInterval = 100;
+
+    // Number of leaves be read before a garbage collecting step.
+    static const int kGCPrefetchLeaves = 4;
+
     Config() = delete;
     ~Config() = delete;
 };
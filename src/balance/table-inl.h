@@ -3,6 +3,8 @@
 
 #include "balance/table.h"
 #include "util/linked_queue.h"
+#include "yukino/perf_context-inl.h"
+#include <chrono>
 
 namespace yukino {
 
@@ -47,11 +49,29 @@ inline void Table::FreePage(Page *page) {
     page->entries.clear();
     page->dirty = 0;
 
-    auto entry = new CacheEntry(page);
+    // Move the page out of the cache ring, it will be deleted at purging.
+    CacheEntry *entry = nullptr;
+    auto found = cache_map_.find(page->id);
+    if (found != cache_map_.end() && found->second->page.get() == page) {
+        entry = found->second;
+        CachedRemove(entry);
+    } else {
+        entry = new CacheEntry(page);
+    }
     util::Dll::InsertTail(&cache_purge_, entry);
     CatchError(CachedPurge());
 }
 
+inline void Table::CachedRemove(CacheEntry *entry) {
+    DCHECK_GT(num_cached_pages_, 0);
+    DCHECK_GE(cache_size_, entry->charge);
+
+    util::Dll::Remove(entry);
+    cache_map_.erase(entry->page->id);
+    cache_size_ -= entry->charge;
+    num_cached_pages_--;
+}
+
 inline void Table::ClearPage(const Page *page) const {
     for (const auto &entry : page->entries) {
         delete[] entry.key;
@@ -94,11 +114,20 @@ inline base::Status Table::CachedGet(uint64_t page_id, Page **rv, bool cached) {
 
     auto found = cache_map_.find(page_id);
     if (found != cache_map_.end()) {
+        // Just mark it, the CLOCK hand will give it a second chance.
+        found->second->referenced = true;
+        cache_stats_.hits++;
+        PERF_COUNTER_ADD(page_cache_hit_count, 1);
         *rv = found->second->page.get();
         return rs;
     }
 
-    CHECK_OK(ReadPage(page_id, rv));
+    cache_stats_.misses++;
+    PERF_COUNTER_ADD(page_cache_miss_count, 1);
+    {
+        PERF_TIMER_GUARD(page_read_nanos);
+        CHECK_OK(ReadPage(page_id, rv));
+    }
 
     // Hold this page, if cached is false.
     base::Handle<Page> hold(*rv);
@@ -111,6 +140,14 @@ inline int Table::Comparator::operator()(const char *a, const char *b) const {
     return comparator.Compare(j.key(), k.key());
 }
 
+inline Table::CacheStats Table::cache_stats() const {
+    auto stats = cache_stats_;
+    stats.num_pages  = num_cached_pages_;
+    stats.size       = cache_size_;
+    stats.num_purges = num_purge_pages_;
+    return stats;
+}
+
 inline float Table::ApproximateLargeRatio() const {
     auto num_pages = static_cast<float>(id_map_.size());
     float num_blocks = 0;
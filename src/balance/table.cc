@@ -6,6 +6,9 @@
 #include "base/crc32.h"
 #include "base/varint_encoding.h"
 #include "yukino/iterator.h"
+#include "yukino/rate_limiter.h"
+#include <string.h>
+#include <algorithm>
 #include <map>
 
 namespace yukino {
@@ -82,13 +85,44 @@ struct PhysicalBlock {
         + sizeof(uint16_t);  // len
 
     static const char kZeroHeader[kHeaderSize];
+
+    /**
+     * Append a block: header and payload into the buffer.
+     *
+     * @param data payload data.
+     * @param len payload length.
+     * @param type block type.
+     * @param np the next block number.
+     * @param buf output buffer.
+     */
+    static void Append(const char *data, uint16_t len, uint8_t type,
+                       uint32_t np, std::string *buf) {
+        auto begin = buf->size();
+
+        buf->resize(begin + kHeaderSize);
+        auto header = &(*buf)[begin];
+        memcpy(header + sizeof(uint32_t), &len, sizeof(len));
+        memcpy(header + kTypeOffset, &type, sizeof(type));
+        memcpy(header + kTypeOffset + 1, &np, sizeof(np));
+        buf->append(data, len);
+
+        // crc32 for: len, type, next and payload.
+        base::CRC32 crc;
+        crc.Update(buf->data() + begin + sizeof(uint32_t),
+                   kHeaderSize - sizeof(uint32_t) + len);
+        auto checksum = crc.digest();
+        memcpy(&(*buf)[begin], &checksum, sizeof(checksum));
+    }
 };
 
 const char PhysicalBlock::kZeroHeader[PhysicalBlock::kHeaderSize] = {0};
 
-Table::Table(InternalKeyComparator comparator, size_t max_cache_size)
+Table::Table(InternalKeyComparator comparator, size_t max_cache_size,
+             base::IOQueue *io_queue, RateLimiter *rate_limiter)
     : comparator_(comparator)
     , bitmap_(0)
+    , io_queue_(io_queue)
+    , rate_limiter_(rate_limiter)
     , cache_dummy_(nullptr)
     , cache_purge_(nullptr)
     , max_cache_size_(max_cache_size) {
@@ -194,7 +228,23 @@ bool Table::Get(const base::Slice &key, uint64_t tx_id, std::string *value) {
         iter.Seek(packed);
         delete[] packed;
     }
+    return GetFound(iter, key, value);
+}
+
+void Table::MultiGet(const base::Slice *keys, size_t n, uint64_t tx_id,
+                     std::string **values, bool *found) {
+    Tree::Iterator iter(tree_.get());
+    for (size_t i = 0; i < n; ++i) {
+        auto packed = InternalKey::Pack(keys[i], tx_id, kFlagFind, "");
+        iter.SeekForward(packed);
+        delete[] packed;
+
+        found[i] = GetFound(iter, keys[i], values[i]);
+    }
+}
 
+bool Table::GetFound(const Tree::Iterator &iter, const base::Slice &key,
+                     std::string *value) const {
     if (!iter.Valid()) {
         return false;
     }
@@ -235,9 +285,199 @@ bool Table::Purge(const base::Slice &key, uint64_t tx_id, std::string *value) {
     return rv;
 }
 
+/*
+ * Bottom-up bulk loading:
+ *
+ * The first pass counts the input, so the shape of tree can be computed and
+ * all page ids be assigned before writing: level 0 (leaves) first, then level
+ * 1, ... the root is the last one. The second pass packs pages from left to
+ * right, each page be written once it's full, so only one building page per
+ * level be kept in memory.
+ *
+ * A non-leaf page needs two children at least: if the last page of a level
+ * has only one child, it borrows one from its left sibling.
+ */
+base::Status Table::BulkLoad(Iterator *input, uint64_t tx_id,
+                             float fill_factor) {
+    base::Status rs;
+
+    if (fill_factor <= 0 || fill_factor > 1) {
+        return base::Status::InvalidArgument("fill_factor out of range.");
+    }
+    auto old_root = tree_->TEST_GetRoot();
+    if (old_root->size() > 0) {
+        return base::Status::InvalidArgument("Bulk loading needs empty table.");
+    }
+
+    // First pass: count and check the input.
+    uint64_t num_entries = 0;
+    std::string last_key;
+    for (input->SeekToFirst(); input->Valid(); input->Next()) {
+        if (num_entries > 0 &&
+            comparator_.delegated()->Compare(last_key, input->key()) >= 0) {
+            return base::Status::InvalidArgument("Input is not sorted.");
+        }
+        last_key.assign(input->key().data(), input->key().size());
+        num_entries++;
+    }
+    CHECK_OK(input->status());
+    if (num_entries == 0) {
+        return rs;
+    }
+
+    const auto order = tree_->order();
+    DCHECK_GE(order, 2);
+    const auto leaf_cap = std::max(1, static_cast<int>(order * fill_factor));
+    const auto fanout = std::max(3, static_cast<int>((order + 1) *
+                                                     fill_factor));
+
+    // Number of pages and first page id of each level.
+    std::vector<uint64_t> num_pages {(num_entries + leaf_cap - 1) / leaf_cap};
+    while (num_pages.back() > 1) {
+        num_pages.push_back((num_pages.back() + fanout - 1) / fanout);
+    }
+    std::vector<uint64_t> first_ids;
+    for (auto n : num_pages) {
+        first_ids.push_back(next_page_id_);
+        next_page_id_ += n;
+    }
+
+    auto parent_of = [&](size_t level, uint64_t i) -> uint64_t {
+        if (level + 1 == num_pages.size()) {
+            return 0; // root
+        }
+        auto n = num_pages[level];
+        auto group = i / fanout;
+        if (n % fanout == 1 && i == n - 2) {
+            group++; // Lend it to the last page.
+        }
+        return first_ids[level + 1] + group;
+    };
+
+    struct Level {
+        base::Handle<Page> page; // building page
+        uint64_t index = 0;      // index of building page in level
+    };
+    std::vector<Level> levels(num_pages.size());
+
+    auto new_page = [&](size_t level) {
+        auto &l = levels[level];
+        l.page = new Page(first_ids[level] + l.index,
+                          level == 0 ? leaf_cap : fanout);
+        l.page->parent = parent_of(level, l.index);
+        if (level == 0 && l.index + 1 < num_pages[0]) {
+            l.page->link = l.page->id + 1; // sibling
+        }
+    };
+
+    // Write the building page of level, and add it to parent page as a
+    // child, the parent page be written too if all children are added.
+    base::Handle<Page> root;
+    auto finish = [&](size_t level) -> base::Status {
+        base::Status rs;
+        for (;;) {
+            auto &l = levels[level];
+            base::Handle<Page> page(l.page);
+            l.page = nullptr;
+
+            const char *high_key = nullptr;
+            if (level == 0) {
+                high_key = DuplicateKey(page->back().key);
+            } else {
+                // The last child be linked by page, not entry.
+                high_key = page->back().key;
+                page->link = page->back().link;
+                page->entries.pop_back();
+            }
+
+            auto ws = WritePage(page.get());
+            page->dirty = 0;
+            if (!ws.ok()) {
+                delete[] high_key;
+                return ws;
+            }
+            auto index = l.index++;
+
+            if (level + 1 == levels.size()) {
+                delete[] high_key;
+                root = page;
+                return rs;
+            }
+            ClearPage(page.get());
+
+            auto &parent = levels[level + 1];
+            if (parent.page.is_null()) {
+                new_page(level + 1);
+            }
+            DCHECK_EQ(page->parent, parent.page->id);
+            parent.page->entries.push_back(Entry{high_key, page->id});
+
+            auto next = index + 1;
+            if (next < num_pages[level] &&
+                parent_of(level, next) == page->parent) {
+                return rs;
+            }
+            level++;
+        }
+    };
+
+    // Second pass: packs and writes pages.
+    batching_ = true;
+    uint64_t count = 0;
+    for (input->SeekToFirst(); input->Valid(); input->Next()) {
+        if (++count > num_entries) {
+            rs = base::Status::Corruption("Input changed in bulk loading.");
+            break;
+        }
+
+        auto &leaf = levels[0];
+        if (leaf.page.is_null()) {
+            new_page(0);
+        }
+        auto key = InternalKey::Pack(input->key(), tx_id, kFlagValue,
+                                     input->value());
+        leaf.page->entries.push_back(Entry{key, 0});
+        if (leaf.page->size() == static_cast<size_t>(leaf_cap)) {
+            rs = finish(0);
+            if (!rs.ok()) {
+                break;
+            }
+        }
+    }
+    if (rs.ok() && !levels[0].page.is_null()) {
+        rs = finish(0);
+    }
+    batching_ = false;
+
+    auto ws = FlushBatchedBlocks();
+    if (ws.ok()) {
+        ws = WaitForWriting(false);
+    }
+    for (auto &l : levels) {
+        if (!l.page.is_null()) {
+            ClearPage(l.page.get());
+        }
+    }
+    if (!rs.ok()) {
+        return rs;
+    }
+    CHECK_OK(ws);
+    if (root.is_null()) {
+        return base::Status::Corruption("Input changed in bulk loading.");
+    }
+
+    // Switch to the new root, the old empty root can be freed.
+    CHECK_OK(CachedActivity(root.get(), true));
+    tree_->TEST_Attach(root.get());
+    FreePage(old_root);
+    return rs;
+}
+
 base::Status Table::Flush(bool sync) {
     base::Status rs;
 
+    // Batch the dirty pages to a few large sequential writing.
+    batching_ = true;
     for (auto entry = cache_dummy_.next; entry != &cache_dummy_;
          entry = entry->next) {
         if (entry->page->dirty > 0 && entry->page->size() > 0) {
@@ -245,13 +485,28 @@ base::Status Table::Flush(bool sync) {
             if (rs.ok()) {
                 entry->page->dirty = 0;
             } else {
-                return rs;
+                break;
             }
         }
     }
+    batching_ = false;
 
-    if (rs.ok() && sync) {
-        file_->Sync();
+    auto ws = FlushBatchedBlocks();
+    if (ws.ok()) {
+        ws = WaitForWriting(rs.ok() && sync);
+    }
+    if (!rs.ok()) {
+        return rs;
+    }
+    CHECK_OK(ws);
+
+    if (sync) {
+        if (!io_queue_) {
+            CHECK_OK(file_->Sync());
+        }
+
+        // All pages be persisted, obsolete chunks can be reused now.
+        CHECK_OK(ReleaseObsoleteChunks());
     }
     return rs;
 }
@@ -293,6 +548,75 @@ private:
 
 } // namespace
 
+base::Status Table::Prefetch(const base::Slice &key, int num_leaves,
+                             std::mutex *mutex) {
+    base::Status rs;
+
+    const char *packed = key.empty() ? nullptr : InternalKey::Pack(key, "");
+    auto defer = base::Defer([packed]() {
+        delete[] packed;
+    });
+
+    Comparator cmp(comparator_);
+    // Every reading loads one page, or finds the page be changed.
+    auto max_readings = num_leaves + 16;
+    for (auto i = 0; i < max_readings; ++i) {
+        uint64_t missing = 0;
+        auto page = tree_->TEST_GetRoot();
+        while (!missing && !page->is_leaf()) {
+            uint64_t child = 0;
+            if (packed) {
+                auto j = page->FindGreaterOrEqual(packed, cmp);
+                child = page->GetChild(j < 0 ? nullptr : &page->entries[j]);
+            } else {
+                child = page->size() > 0 ? page->child(0) : page->link;
+            }
+
+            auto found = cache_map_.find(child);
+            if (found == cache_map_.end()) {
+                missing = child;
+            } else {
+                page = found->second->page.get();
+            }
+        }
+        for (auto j = 1; !missing && j < num_leaves && page->link; ++j) {
+            auto found = cache_map_.find(page->link);
+            if (found == cache_map_.end()) {
+                missing = page->link;
+            } else {
+                page = found->second->page.get();
+            }
+        }
+        if (!missing) {
+            break;
+        }
+
+        auto found = metadata_.find(missing);
+        DCHECK(found != metadata_.end());
+        auto meta = found->second;
+
+        // The file reading is thread-safe.
+        std::string buf;
+        mutex->unlock();
+        auto read = ReadChunk(meta.addr, &buf);
+        mutex->lock();
+
+        // The page be loaded, written back or freed meanwhile.
+        found = metadata_.find(missing);
+        if (cache_map_.find(missing) != cache_map_.end() ||
+            found == metadata_.end() || found->second.addr != meta.addr ||
+            found->second.ts != meta.ts) {
+            continue;
+        }
+        CHECK_OK(read);
+
+        Page *rv = nullptr;
+        CHECK_OK(ParsePage(missing, buf, &rv));
+        CHECK_OK(CachedActivity(rv, true));
+    }
+    return rs;
+}
+
 Iterator *Table::CreateIterator() const {
     auto iter = new TableIterator(tree_.get());
 
@@ -340,13 +664,19 @@ base::Status Table::WritePage(const Page *page) {
 
     uint64_t addr = 0;
     CHECK_OK(WriteChunk(w.buf(), w.len(), &addr));
-    id_map_[page->id] = addr;
+
+    // The old copy of page can be reused after next synchronous flush.
+    auto &old_addr = id_map_[page->id];
+    if (old_addr != 0) {
+        obsolete_chunks_.push_back(old_addr);
+    }
+    old_addr = addr;
 
     PageMetadata meta;
     meta.addr   = addr;
     meta.parent = page->parent;
     meta.ts     = NowMicroseconds();
-    metadata_.emplace(page->id, meta);
+    metadata_[page->id] = meta;
     return rs;
 }
 
@@ -356,13 +686,22 @@ base::Status Table::WriteChunk(const char *buf, size_t len, uint64_t *addr) {
     DCHECK_LT(PhysicalBlock::kHeaderSize, page_size_);
     const auto block_payload_size = page_size_ - PhysicalBlock::kHeaderSize;
     const auto num_blocks = (len + block_payload_size - 1) / block_payload_size;
+
+    // All blocks of chunk are contiguous.
+    uint64_t first = 0;
+    CHECK_OK(MakeRoomForChunk(num_blocks, &first));
+
     std::vector<uint64_t> blocks(num_blocks);
     for (auto i = 0; i < num_blocks; ++i) {
-        CHECK_OK(MakeRoomForPage(&blocks[i]));
+        blocks[i] = first + i * page_size_;
         SetUsed(blocks[i]);
     }
     blocks.push_back(0);
 
+    // Make all blocks in memory, then write them once.
+    std::string chunk;
+    chunk.reserve(num_blocks * page_size_);
+
     auto left = len;
     size_t offset = 0;
     auto type = PhysicalBlock::kZeroType;
@@ -385,37 +724,103 @@ base::Status Table::WriteChunk(const char *buf, size_t len, uint64_t *addr) {
         }
 
         DCHECK_LT(len, Config::kMaxPageSize);
-        CHECK_OK(WriteBlock(buf + offset, len, type, blocks[i], blocks[i + 1]));
+        DCHECK_EQ(0, blocks[i + 1] % page_size_);
+        auto np = static_cast<uint32_t>(blocks[i + 1] / page_size_);
+        PhysicalBlock::Append(buf + offset, static_cast<uint16_t>(len), type,
+                              np, &chunk);
         left   -= len;
         offset += len;
     }
     DCHECK_EQ(0, left);
 
-    *addr = blocks[0];
+    CHECK_OK(WriteBlocks(first, chunk));
+    *addr = first;
     return rs;
 }
 
-base::Status Table::WriteBlock(const char *buf, uint16_t len, uint8_t type,
-                               uint64_t addr, uint64_t next) {
-    DCHECK_EQ(0, next % page_size_);
-    auto np = static_cast<uint32_t>(next) / page_size_;
+base::Status Table::WriteBlocks(uint64_t addr, const std::string &blocks) {
+    base::Status rs;
+
+    if (!batching_) {
+        return file_->WriteAt(addr, blocks.data(), blocks.size());
+    }
 
+    if (!batched_blocks_.empty()) {
+        // Padding the last block, so the next block can be appended.
+        auto end = batched_addr_ + batched_blocks_.size();
+        end = (end + page_size_ - 1) / page_size_ * page_size_;
+
+        auto size = batched_blocks_.size() + blocks.size();
+        if (end == addr && size <= Config::kMaxBatchingSize) {
+            batched_blocks_.resize(end - batched_addr_);
+            batched_blocks_.append(blocks);
+            return rs;
+        }
+        CHECK_OK(FlushBatchedBlocks());
+    }
+
+    batched_addr_ = addr;
+    batched_blocks_.assign(blocks);
+    return rs;
+}
+
+base::Status Table::FlushBatchedBlocks() {
     base::Status rs;
-    base::CRC32 crc;
 
-    crc.Update(&len, sizeof(len));
-    crc.Update(&type, sizeof(type));
-    crc.Update(&np, sizeof(np));
+    if (!batched_blocks_.empty()) {
+        if (rate_limiter_) {
+            rate_limiter_->Request(static_cast<int64_t>(batched_blocks_.size()),
+                                   RateLimiter::kPriorityHigh);
+        }
+        if (io_queue_) {
+            writing_blocks_.emplace_back();
+            auto blocks = &writing_blocks_.back();
+            blocks->swap(batched_blocks_);
+            rs = io_queue_->WriteAsync(file_, batched_addr_, blocks->data(),
+                                       blocks->size(), blocks);
+        } else {
+            rs = file_->WriteAt(batched_addr_, batched_blocks_.data(),
+                                batched_blocks_.size());
+        }
+        batched_blocks_.clear();
+    }
+    return rs;
+}
 
-    crc.Update(buf, len);
+/**
+ * Submit the queued writing, and the syncing if need, by one system call,
+ * then wait for all of them finished.
+ */
+base::Status Table::WaitForWriting(bool sync) {
+    base::Status rs;
+    if (!io_queue_) {
+        return rs;
+    }
 
-    CHECK_OK(file_->Seek(addr));
-    CHECK_OK(file_->WriteFixed32(crc.digest())); // crc32
-    CHECK_OK(file_->WriteFixed16(len));          // len
-    CHECK_OK(file_->WriteByte(type));            // type
-    CHECK_OK(file_->WriteFixed32(np));           // next
+    if (sync) {
+        rs = io_queue_->Fsync(file_, nullptr);
+    }
+    if (rs.ok()) {
+        rs = io_queue_->Submit();
+    }
 
-    CHECK_OK(file_->Write(buf, len, nullptr));   // payload data
+    std::vector<base::IOQueue::Completion> completions;
+    auto ps = io_queue_->Poll(io_queue_->in_flight(), &completions);
+    if (rs.ok()) {
+        rs = ps;
+    }
+    for (const auto &completion : completions) {
+        auto blocks = static_cast<const std::string *>(completion.tag);
+        auto expected = blocks ? static_cast<int64_t>(blocks->size()) : 0;
+        if (rs.ok() && completion.result != expected) {
+            rs = base::Status::IOError(completion.result < 0 ?
+                                       strerror(static_cast<int>(-completion.result)) :
+                                       "Short writing.");
+        }
+    }
+    if (ps.ok()) {
+        writing_blocks_.clear();
+    }
     return rs;
 }
 
@@ -423,59 +828,61 @@ base::Status Table::ReadChunk(uint64_t addr, std::string *buf) {
     base::Status rs;
 
     uint8_t type = 0;
+    std::string block(page_size_, '\0');
     buf->clear();
     do {
-        CHECK_OK(file_->Seek(addr));
-
-        uint32_t checksum = 0;
-        CHECK_OK(file_->ReadFixed32(&checksum));
-
-        base::VerifiedReader<base::CRC32> rd(file_);
-        uint16_t len = 0;
-        CHECK_OK(rd.ReadFixed16(&len));
-
-        CHECK_OK(rd.Read(&type, 1));
-        uint32_t np = 0;
-        CHECK_OK(rd.ReadFixed32(&np));
-        addr = np * page_size_; DCHECK_LT(addr, file_size_);
+        DCHECK_LT(addr, file_size_);
+        CHECK_OK(file_->ReadAt(addr, &block[0], page_size_));
+
+        base::BufferedReader rd(block.data(), block.size());
+        auto checksum = rd.ReadFixed32();
+        auto len      = rd.ReadFixed16();
+        type          = rd.ReadByte();
+        auto np       = rd.ReadFixed32();
+        if (len > page_size_ - PhysicalBlock::kHeaderSize) {
+            return base::Status::Corruption("Block length too large.");
+        }
 
-        auto begin = buf->size();
-        buf->resize(buf->size() + len);
-        CHECK_OK(rd.Read(&(*buf)[begin], len));
+        PERF_COUNTER_ADD(block_read_count, 1);
+        PERF_COUNTER_ADD(block_read_byte, page_size_);
 
-        if (checksum != rd.digest()) {
-            rs = base::Status::IOError("CRC32 verify fail!");
-            break;
+        PerfTimer checksum_timer(&ThreadPerfContext().checksum_nanos);
+        base::CRC32 crc;
+        crc.Update(block.data() + sizeof(uint32_t),
+                   PhysicalBlock::kHeaderSize - sizeof(uint32_t) + len);
+        checksum_timer.Stop();
+        if (checksum != crc.digest()) {
+            return base::Status::IOError("CRC32 verify fail!");
         }
+
+        buf->append(block.data() + PhysicalBlock::kHeaderSize, len);
+        addr = static_cast<uint64_t>(np) * page_size_;
     } while (type == PhysicalBlock::kFirstType ||
              type == PhysicalBlock::kMiddleType);
     return rs;
 }
 
-base::Status Table::MakeRoomForPage(uint64_t *addr) {
+base::Status Table::MakeRoomForChunk(uint64_t num_blocks, uint64_t *addr) {
     base::Status rs;
 
-    int index = 0;
-    for (auto bits : bitmap_.bits()) {
-        auto i = base::Bits::FindFirstZero32(bits);
-        if (i >= 0 && i < 32) {
-            //bitmap_[(index + 31) / 32] |= (1 << i);
-            index += i;
-            break;
-        }
-        index += 32;
-    }
-
-    // The first page is header.
-    if (index >= (file_size_ / page_size_) - 1) {
-
-        // Allocate new file space.
-        file_size_ += page_size_;
-        CHECK_OK(file_->Truncate(file_size_));
-
-        if (bitmap_.num_buckets() < ((index + 31) / 32) + 1) {
-            bitmap_.AddBucket(0u);
-        }
+    uint64_t index = 0;
+    if (!free_space_.Allocate(num_blocks, &index)) {
+        // Allocate new file space: the growing step doubles with the file
+        // size, and be limited by Config::kMaxGrowingSize.
+        auto num_file_blocks = file_size_ / page_size_ - 1;
+        auto max_growing = std::max<uint64_t>(1,
+                                              Config::kMaxGrowingSize /
+                                              page_size_);
+        auto growing = std::max(num_blocks,
+                                std::min(num_file_blocks, max_growing));
+
+        CHECK_OK(file_->Preallocate(file_size_, growing * page_size_));
+        file_size_ += growing * page_size_;
+        bitmap_.Resize(static_cast<int>(num_file_blocks + growing));
+        free_space_.Free(num_file_blocks, growing);
+
+        auto ok = free_space_.Allocate(num_blocks, &index);
+        DCHECK(ok);
     }
 
     *DCHECK_NOTNULL(addr) = (index + 1) * page_size_;
@@ -489,32 +896,59 @@ base::Status Table::FreeRoomForPage(uint64_t id) {
         return rs;
     }
 
+    // Don't reuse it until next synchronous flush.
+    obsolete_chunks_.push_back(addr);
+    return rs;
+}
+
+base::Status Table::FreeChunk(uint64_t addr) {
+    base::Status rs;
+
+    std::vector<uint64_t> blocks;
+    CHECK_OK(ReadChunkBlocks(addr, &blocks));
+
+    // Clear the first block's header, so the chunk can not be found by
+    // ScanPage() any more.
+    CHECK_OK(file_->WriteAt(addr, PhysicalBlock::kZeroHeader,
+                            PhysicalBlock::kHeaderSize));
+    for (auto block : blocks) {
+        DCHECK(TestUsed(block));
+        ClearUsed(block);
+        free_space_.Free(Addr2Index(block), 1);
+    }
+    return rs;
+}
+
+base::Status Table::ReadChunkBlocks(uint64_t addr,
+                                    std::vector<uint64_t> *blocks) {
+    base::Status rs;
+
     static_assert(sizeof(PhysicalBlock::Type) == 1,
                   "PhysicalBlock::Type too big");
 
-    std::vector<uint64_t> will_free;
+    char header[PhysicalBlock::kHeaderSize];
     PhysicalBlock::Type type = PhysicalBlock::kZeroType;
     do {
-        will_free.push_back(addr);
-
-        CHECK_OK(file_->Seek(addr + PhysicalBlock::kTypeOffset));
-        CHECK_OK(file_->Read(&type, sizeof(type)));
+        blocks->push_back(addr);
+
+        CHECK_OK(file_->ReadAt(addr, header, sizeof(header)));
+        base::BufferedReader rd(header + PhysicalBlock::kTypeOffset,
+                                sizeof(header) - PhysicalBlock::kTypeOffset);
+        type = static_cast<PhysicalBlock::Type>(rd.ReadByte());
+        addr = static_cast<uint64_t>(rd.ReadFixed32()) * page_size_;
+    } while ((type == PhysicalBlock::kFirstType ||
+              type == PhysicalBlock::kMiddleType) &&
+             addr != 0 && addr < file_size_);
+    return rs;
+}
 
-        uint32_t np = 0;
-        CHECK_OK(file_->ReadFixed32(&np));
-        if (np != 0) {
-            addr = np * page_size_;
-        }
-    } while (type == PhysicalBlock::kFirstType ||
-             type == PhysicalBlock::kMiddleType);
+base::Status Table::ReleaseObsoleteChunks() {
+    base::Status rs;
 
-    for (auto addr : will_free) {
-        CHECK_OK(file_->Seek(addr));
-        CHECK_OK(file_->Write(PhysicalBlock::kZeroHeader,
-                              PhysicalBlock::kHeaderSize, nullptr));
-        DCHECK(TestUsed(addr));
-        ClearUsed(addr);
+    for (auto addr : obsolete_chunks_) {
+        CHECK_OK(FreeChunk(addr));
     }
+    obsolete_chunks_.clear();
     return rs;
 }
 
@@ -543,7 +977,24 @@ base::Status Table::LoadTree() {
     for (auto addr = page_size_; addr < file_size_; addr += page_size_) {
         ScanPage(addr);
     }
+
+    // Make free extents from unused blocks.
+    free_space_.Reset();
+    for (uint64_t i = 0; i < num_pages;) {
+        if (bitmap_.test(static_cast<int>(i))) {
+            ++i;
+            continue;
+        }
+        auto start = i;
+        while (i < num_pages && !bitmap_.test(static_cast<int>(i))) {
+            ++i;
+        }
+        free_space_.Free(start, i - start);
+    }
+
     for (const auto &entry : metadata_) {
+        id_map_[entry.first] = entry.second.addr;
+
         if (entry.second.parent == -1) {
             if (root_id != -1) {
                 return base::Status::Corruption("Double root pages!");
@@ -560,10 +1011,12 @@ base::Status Table::LoadTree() {
     }
 
     // Clear cache first, has a unused root page.
-    cache_map_.clear();
-    auto purge = cache_dummy_.next;
-    util::Dll::Remove(purge);
-    delete purge;
+    while (!util::Dll::Empty(&cache_dummy_)) {
+        auto purge = util::Dll::Head(&cache_dummy_);
+        CachedRemove(purge);
+        ClearPage(purge->page.get());
+        delete purge;
+    }
 
 
     Page *root = nullptr;
@@ -576,10 +1029,14 @@ base::Status Table::LoadTree() {
 
 base::Status Table::ScanPage(uint64_t addr) {
     base::Status rs;
-    CHECK_OK(file_->Seek(addr + PhysicalBlock::kTypeOffset));
 
-    PhysicalBlock::Type type = PhysicalBlock::kZeroType;
-    CHECK_OK(file_->Read(&type, sizeof(type)));
+    // Block header and page header:
+    char buf[PhysicalBlock::kHeaderSize + 1 + sizeof(uint64_t) * 3];
+    CHECK_OK(file_->ReadAt(addr, buf, sizeof(buf)));
+
+    base::BufferedReader rd(buf + PhysicalBlock::kTypeOffset,
+                            sizeof(buf) - PhysicalBlock::kTypeOffset);
+    auto type = rd.ReadByte();
     if (type == PhysicalBlock::kZeroType ||
         type == PhysicalBlock::kLastType ||
         type == PhysicalBlock::kMiddleType) {
@@ -588,30 +1045,39 @@ base::Status Table::ScanPage(uint64_t addr) {
     }
 
     // Go to payload:
-    CHECK_OK(file_->Seek(addr + PhysicalBlock::kHeaderSize));
+    rd.ReadFixed32(); // Ignore next
 
-    uint64_t id = 0;
-    uint8_t  page_type = 0;
     PageMetadata meta;
-
     meta.addr = addr;
-    CHECK_OK(file_->Read(&page_type, sizeof(page_type)));
+
+    auto page_type = rd.ReadByte();
     DCHECK_NE(Config::kPageTypeZero, page_type);
-    CHECK_OK(file_->ReadFixed64(&id));
-    CHECK_OK(file_->ReadFixed64(&meta.parent));
-    CHECK_OK(file_->ReadFixed64(&meta.ts));
+    auto id     = rd.ReadFixed64();
+    meta.parent = rd.ReadFixed64();
+    meta.ts     = rd.ReadFixed64();
 
     auto found = metadata_.find(id);
     if (found == metadata_.end()) {
         metadata_.emplace(id, meta);
     } else {
-        if (meta.ts > found->second.ts) {
-            metadata_.emplace(id, meta);
-            ClearUsed(found->second.addr);
+        if (meta.ts <= found->second.ts) {
+            // The old copy of page, it's free space.
+            return rs;
+        }
+
+        std::vector<uint64_t> blocks;
+        CHECK_OK(ReadChunkBlocks(found->second.addr, &blocks));
+        for (auto block : blocks) {
+            ClearUsed(block);
         }
+        found->second = meta;
     }
 
-    SetUsed(addr);
+    std::vector<uint64_t> blocks;
+    CHECK_OK(ReadChunkBlocks(addr, &blocks));
+    for (auto block : blocks) {
+        SetUsed(block);
+    }
     return rs;
 }
 
@@ -630,13 +1096,18 @@ Table::ReadPage(uint64_t id, Page **rv) {
 
     std::string buf;
     CHECK_OK(ReadChunk(meta.addr, &buf));
+    return ParsePage(id, buf, rv);
+}
+
+base::Status Table::ParsePage(uint64_t id, const std::string &buf, Page **rv) {
+    base::Status rs;
 
     base::BufferedReader rd(buf.data(), buf.size());
 
     uint8_t  type      = rd.ReadByte(); // type;
-    uint64_t dummy     = rd.ReadFixed64(); // Ignore id
+    rd.ReadFixed64(); // Ignore id
     uint64_t parent_id = rd.ReadFixed64(); // parent
-    dummy = rd.ReadFixed64(); //
+    rd.ReadFixed64(); // Ignore ts
 
     //==========================================================================
     // Payload:
@@ -679,41 +1150,94 @@ base::Status Table::CachedActivity(Page *page, bool cached) {
 
     auto entry = new CacheEntry(DCHECK_NOTNULL(page));
     if (cached) {
+        entry->charge = ApproximatePageSize(page);
         cache_map_.emplace(page->id, entry);
         util::Dll::InsertHead(&cache_dummy_, entry);
+
+        cache_size_ += entry->charge;
+        num_cached_pages_++;
     } else {
         util::Dll::InsertTail(&cache_purge_, entry);
+        num_purge_pages_++;
+    }
+
+    while (num_cached_pages_ > Config::kHoldCachedPage &&
+           cache_size_ > max_cache_size_) {
+        bool evicted = false;
+        CHECK_OK(CachedEvict(&evicted));
+        if (!evicted) {
+            // All pages be pinned.
+            break;
+        }
     }
 
-    cache_size_ += ApproximatePageSize(page);
-    if (util::Dll::Count(&cache_dummy_) > Config::kHoldCachedPage &&
-        cache_size_ > max_cache_size_) {
+    if (num_purge_pages_ < purge_threshold_) {
+        return rs;
+    }
+    return CachedPurge();
+}
+
+/*
+ * CLOCK replacement:
+ *
+ * The hand sweeps from the ring's tail. Referenced or pinned pages get a
+ * second chance, dirty pages are skipped too: they will be written back by
+ * Flush() at next checkpoint. The sweep is bounded by Config::kMaxClockSweep,
+ * if it can not find any clean page, the first unpinned dirty page be written
+ * back and evicted.
+ */
+base::Status Table::CachedEvict(bool *evicted) {
+    base::Status rs;
+
+    CacheEntry *victim = nullptr, *dirty = nullptr;
+    auto sweep = std::min<size_t>(num_cached_pages_, Config::kMaxClockSweep);
+    for (size_t i = 0; i < sweep; ++i) {
+        auto entry = util::Dll::Tail(&cache_dummy_);
 
-        auto oldest = cache_dummy_.prev;
-        if (oldest->page && oldest->page->dirty > 0 &&
-            oldest->page->size() > 0) {
-            CHECK_OK(WritePage(oldest->page.get()));
+        util::Dll::Remove(entry);
+        util::Dll::InsertHead(&cache_dummy_, entry);
+        if (entry->referenced || entry->page->ref_count() > 1) {
+            entry->referenced = false;
+            continue;
+        }
+        if (entry->page->dirty > 0 && entry->page->size() > 0) {
+            if (!dirty) {
+                dirty = entry;
+            }
+            continue;
         }
 
-        util::Dll::Remove(oldest);
-        util::Dll::InsertTail(&cache_purge_, oldest);
+        victim = entry;
+        break;
+    }
+
+    if (!victim && dirty) {
+        CHECK_OK(WritePage(dirty->page.get()));
+        dirty->page->dirty = 0;
+        cache_stats_.write_backs++;
 
-        cache_size_ -= ApproximatePageSize(oldest->page.get());
+        victim = dirty;
     }
 
-    return CachedPurge();
+    *evicted = (victim != nullptr);
+    if (victim) {
+        CachedRemove(victim);
+        ClearPage(victim->page.get());
+        delete victim;
+
+        cache_stats_.evictions++;
+    }
+    return rs;
 }
 
 base::Status Table::CachedPurge() {
     base::Status rs;
 
-    for (auto purge = cache_purge_.next; purge != &cache_purge_;
-         purge = purge->next) {
+    auto purge = cache_purge_.next;
+    while (purge != &cache_purge_) {
+        auto next = purge->next;
 
         if (purge->page->ref_count() == 1) {
-            cache_map_.erase(purge->page->id);
-
-            auto next = purge->next;
             util::Dll::Remove(purge);
 
             if (purge->page->dirty > 0) {
@@ -721,10 +1245,14 @@ base::Status Table::CachedPurge() {
             }
             ClearPage(purge->page.get());
             delete purge;
-
-            purge = next;
+            num_purge_pages_--;
         }
+        purge = next;
     }
+
+    // The pinned pages be swept again after the list doubled.
+    purge_threshold_ = std::max<size_t>(num_purge_pages_ * 2,
+                                        Config::kHoldPurgePage);
     return rs;
 }
 
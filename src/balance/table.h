@@ -2,23 +2,28 @@
 #define YUKINO_BALANCE_TABLE_H_
 
 #include "balance/format.h"
+#include "balance/extent_allocator.h"
 #include "util/btree.h"
 #include "util/bloom_filter.h"
 #include "base/ref_counted.h"
 #include "base/status.h"
 #include "base/base.h"
 #include <vector>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <unordered_map>
 
 namespace yukino {
 
 class Iterator;
+class RateLimiter;
 
 namespace base {
 
 class MappedMemory;
 class FileIO;
+class IOQueue;
 class Slice;
 
 } // namespace base
@@ -27,7 +32,15 @@ namespace balance {
 
 class Table : public base::ReferenceCounted<Table> {
 public:
-    Table(InternalKeyComparator comparator, size_t max_cache_size);
+    /**
+     * @param io_queue if it's not null, the dirty pages be written back by
+     *        it, many writings can be submitted in one system call.
+     * @param rate_limiter if it's not null, the page writing be throttled
+     *        by it.
+     */
+    Table(InternalKeyComparator comparator, size_t max_cache_size,
+          base::IOQueue *io_queue = nullptr,
+          RateLimiter *rate_limiter = nullptr);
     ~Table();
 
     base::Status Create(uint32_t page_size, uint32_t version, int order,
@@ -51,6 +64,17 @@ public:
 
     bool Get(const base::Slice &key, uint64_t tx_id, std::string *value);
 
+    /**
+     * Batched Get(), the keys in the same leaf page share one tree descent.
+     *
+     * @param keys the keys must be ascending.
+     * @param tx_id transaction id of all keys.
+     * @param values values[i] be set if keys[i] be found.
+     * @param found found[i] - is keys[i] be found?
+     */
+    void MultiGet(const base::Slice *keys, size_t n, uint64_t tx_id,
+                  std::string **values, bool *found);
+
     /**
      * In-place delete
      *
@@ -62,6 +86,17 @@ public:
 
     //bool Purge(const base::Slice &key, std::string *value);
 
+    /**
+     * Bulk load sorted key-value pairs into the empty table. The b+tree be
+     * built from bottom to up: leaf pages be packed from left to right, then
+     * the non-leaf levels. Pages are written by large sequential writing.
+     *
+     * @param input sorted input, the user keys must be ascending and unique.
+     * @param tx_id transaction id of all loaded keys.
+     * @param fill_factor (0, 1] the ratio of used entries in each page.
+     */
+    base::Status BulkLoad(Iterator *input, uint64_t tx_id, float fill_factor);
+
     /**
      * Flush all page to disk.
      *
@@ -69,6 +104,20 @@ public:
      */
     base::Status Flush(bool sync);
 
+    /**
+     * Read the pages on the path of key and the following leaves into the
+     * cache, so the next operations from key need no I/O. The mutex be
+     * released during reading, the read page be dropped if it was changed
+     * meanwhile.
+     *
+     * REQUIRES: mutex held.
+     *
+     * @param key the internal key as the iterator's, empty: the first leaf.
+     * @param num_leaves number of leaves from the leaf of key.
+     */
+    base::Status Prefetch(const base::Slice &key, int num_leaves,
+                          std::mutex *mutex);
+
     /**
      * Create internal iterator.
      *
@@ -94,6 +143,21 @@ public:
     inline float ApproximateUsageRatio() const;
 
     inline base::Status status() const { return status_; }
+
+    struct CacheStats {
+        uint64_t hits        = 0; // page found in cache.
+        uint64_t misses      = 0; // page read from file.
+        uint64_t evictions   = 0; // page dropped from cache.
+        uint64_t write_backs = 0; // dirty page written by eviction.
+        size_t   num_pages   = 0; // number of cached pages.
+        size_t   size        = 0; // approximate bytes of cached pages.
+        size_t   num_purges  = 0; // number of uncached pages to be purged.
+    };
+
+    /**
+     * Statistics of the page cache.
+     */
+    inline CacheStats cache_stats() const;
     //--------------------------------------------------------------------------
     // Testing:
     //--------------------------------------------------------------------------
@@ -151,6 +215,12 @@ private:
         CacheEntry *prev;
         base::Handle<Page> page;
 
+        // Approximate size charged to cache_size_.
+        size_t charge = 0;
+
+        // CLOCK reference bit, set on every cache hit.
+        bool referenced = false;
+
         CacheEntry(Page *p)
             : page(p) {
             next = this;
@@ -164,19 +234,27 @@ private:
         uint64_t ts;
     };
 
+    bool GetFound(const Tree::Iterator &iter, const base::Slice &key,
+                  std::string *value) const;
+
     base::Status InitFile(int order);
     base::Status LoadTree();
     base::Status ScanPage(uint64_t addr);
     base::Status ReadPage(uint64_t id, Page **rv);
+    base::Status ParsePage(uint64_t id, const std::string &buf, Page **rv);
 
     base::Status WritePage(const Page *page);
     base::Status WriteChunk(const char *buf, size_t len, uint64_t *addr);
-    base::Status WriteBlock(const char *buf, uint16_t len, uint8_t type,
-                            uint64_t addr, uint64_t next);
+    base::Status WriteBlocks(uint64_t addr, const std::string &blocks);
+    base::Status FlushBatchedBlocks();
+    base::Status WaitForWriting(bool sync);
     base::Status ReadChunk(uint64_t addr, std::string *buf);
 
-    base::Status MakeRoomForPage(uint64_t *addr);
+    base::Status MakeRoomForChunk(uint64_t num_blocks, uint64_t *addr);
     base::Status FreeRoomForPage(uint64_t id);
+    base::Status FreeChunk(uint64_t addr);
+    base::Status ReadChunkBlocks(uint64_t addr, std::vector<uint64_t> *blocks);
+    base::Status ReleaseObsoleteChunks();
 
     inline Page *AllocatePage(int num_entries);
     inline void FreePage(Page *page);
@@ -185,7 +263,9 @@ private:
 
     base::Status CachedGet(uint64_t page_id, Page **rv, bool cached);
     base::Status CachedActivity(Page *page, bool cached);
+    base::Status CachedEvict(bool *evicted);
     base::Status CachedPurge();
+    inline void CachedRemove(CacheEntry *entry);
 
     inline void ClearPage(const Page *page) const;
 
@@ -204,18 +284,42 @@ private:
     // file usage bitmap
     util::Bitmap<uint32_t> bitmap_;
 
+    // free extents of file
+    ExtentAllocator free_space_;
+
+    // chunks of old page copies, they are free after synchronous flush.
+    std::vector<uint64_t> obsolete_chunks_;
+
+    // batched blocks for flushing: contiguous blocks from batched_addr_.
+    bool batching_ = false;
+    uint64_t batched_addr_ = 0;
+    std::string batched_blocks_;
+
+    // the asynchronous writing blocks, they must be valid until finished.
+    base::IOQueue *io_queue_;
+    std::deque<std::string> writing_blocks_;
+
+    RateLimiter *rate_limiter_;
+
     // page_id -> physical address
     std::unordered_map<uint64_t, uint64_t> id_map_;
 
     // page_id -> page metadatas
     std::map<uint64_t, PageMetadata> metadata_;
 
-    // cache
-    std::map<uint64_t, CacheEntry*> cache_map_;
+    // cache: page_id -> entry, the entries make a CLOCK ring at cache_dummy_,
+    // the hand is ring's tail.
+    std::unordered_map<uint64_t, CacheEntry*> cache_map_;
     CacheEntry cache_dummy_;
     CacheEntry cache_purge_;
+    // The purge list be swept when it grows to purge_threshold_, so the
+    // sweeping is amortized O(1) for every uncached page.
+    size_t num_purge_pages_ = 0;
+    size_t purge_threshold_ = Config::kHoldPurgePage;
     size_t cache_size_ = 0;
+    size_t num_cached_pages_ = 0;
     const size_t max_cache_size_;
+    CacheStats cache_stats_;
 
     InternalKeyComparator comparator_;
 
@@ -9,15 +9,55 @@
 #include "balance/table.h"
 #include "balance/format.h"
 #include "base/mem_io.h"
+#include "base/io.h"
 #include "yukino/iterator.h"
 #include "yukino/comparator.h"
+#include "yukino/env.h"
 #include "gtest/gtest.h"
 #include <stdio.h>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace yukino {
 
 namespace balance {
 
+namespace {
+
+class SortedIteratorMock : public Iterator {
+public:
+    SortedIteratorMock(const std::vector<std::string> &keys) : data_(keys) {}
+
+    virtual ~SortedIteratorMock() override {}
+
+    virtual bool Valid() const override {
+        return i_ >= 0 && i_ < static_cast<int64_t>(data_.size());
+    }
+    virtual void SeekToFirst() override { i_ = 0; }
+    virtual void SeekToLast() override { i_ = data_.size() - 1; }
+    virtual void Seek(const base::Slice& target) override {
+        DCHECK(false) << "Noreached";
+    }
+    virtual void Next() override { i_++; }
+    virtual void Prev() override { i_--; }
+    virtual base::Slice key() const override {
+        DCHECK(Valid());
+        return data_[i_];
+    }
+    virtual base::Slice value() const override {
+        DCHECK(Valid());
+        return data_[i_];
+    }
+    virtual base::Status status() const override { return base::Status::OK(); }
+
+private:
+    std::vector<std::string> data_;
+    int64_t i_ = 0;
+};
+
+} // namespace
+
 class BtreeTableTest : public ::testing::Test {
 public:
     BtreeTableTest () {
@@ -191,6 +231,65 @@ TEST_F(BtreeTableTest, MutilReopen) {
     }
 }
 
+TEST_F(BtreeTableTest, IOQueueWriteback) {
+    base::IOQueue *rv = nullptr;
+    auto rs = Env::Default()->CreateIOQueue(4, &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::IOQueue> queue(rv);
+
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, -1, queue.get());
+    rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 3, &io_);
+    ASSERT_TRUE(rs.ok());
+
+    char key[32];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "k.%05d", i);
+        ASSERT_FALSE(table_->Put(key, i, kFlagValue, key, nullptr));
+    }
+    rs = table_->Flush(true);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(0, queue->in_flight());
+
+    table_ = new Table(comparator, -1);
+    rs = table_->Open(&io_, io_.buf().size());
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(key, sizeof(key), "k.%05d", i);
+        ASSERT_TRUE(table_->Get(key, 1000, &value)) << key;
+        EXPECT_EQ(key, value);
+    }
+}
+
+TEST_F(BtreeTableTest, CheckpointPlainWrites) {
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    ASSERT_FALSE(table_->Put("a", 0, kFlagValue, "1", nullptr));
+    ASSERT_FALSE(table_->Put("c", 0, kFlagValue, "3", nullptr));
+    ASSERT_TRUE(table_->Flush(true).ok());
+
+    // Insert and erase in the checkpointed leaf, without any splitting or
+    // merging, the next checkpoint must write it again.
+    ASSERT_FALSE(table_->Put("b", 1, kFlagValue, "2", nullptr));
+    ASSERT_TRUE(table_->Purge("a", 0, nullptr));
+    ASSERT_TRUE(table_->Flush(true).ok());
+
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, -1);
+    rs = table_->Open(&io_, io_.buf().size());
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    EXPECT_FALSE(table_->Get("a", 1, &value));
+    ASSERT_TRUE(table_->Get("b", 1, &value));
+    EXPECT_EQ("2", value);
+    ASSERT_TRUE(table_->Get("c", 1, &value));
+    EXPECT_EQ("3", value);
+}
+
 TEST_F(BtreeTableTest, ChunkRW) {
     auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 3, &io_);
     ASSERT_TRUE(rs.ok());
@@ -316,6 +415,217 @@ TEST_F(BtreeTableTest, FreePage) {
     }
 }
 
+TEST_F(BtreeTableTest, PageCache) {
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, 16 * base::kKB);
+
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    static const auto kN = 1000;
+    char key[32];
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_FALSE(table_->Put(key, i, kFlagValue, key, nullptr));
+    }
+    ASSERT_TRUE(table_->Flush(false).ok());
+
+    std::string value;
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_TRUE(table_->Get(key, kN, &value)) << key;
+        EXPECT_EQ(key, value);
+    }
+    ASSERT_TRUE(table_->status().ok()) << table_->status().ToString();
+
+    auto stats = table_->cache_stats();
+    EXPECT_LT(0, stats.hits);
+    EXPECT_LT(0, stats.misses);
+    EXPECT_LT(0, stats.evictions);
+    EXPECT_GE(16 * base::kKB + kPageSize * Config::kMaxClockSweep, stats.size);
+}
+
+TEST_F(BtreeTableTest, PurgeUncachedPages) {
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, 4 * base::kKB);
+
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    static const auto kN = 1000;
+    char key[32];
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_FALSE(table_->Put(key, i, kFlagValue, key, nullptr));
+    }
+    ASSERT_TRUE(table_->Flush(false).ok());
+
+    // The iterator reads the leaf pages without caching them, the released
+    // ones be purged in batches.
+    auto misses = table_->cache_stats().misses;
+    std::unique_ptr<Iterator> iter(table_->CreateIterator());
+    auto n = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        EXPECT_GE(static_cast<size_t>(Config::kHoldPurgePage),
+                  table_->cache_stats().num_purges);
+        n++;
+    }
+    ASSERT_TRUE(iter->status().ok()) << iter->status().ToString();
+    EXPECT_EQ(kN, n);
+    EXPECT_LT(misses + Config::kHoldPurgePage, table_->cache_stats().misses);
+}
+
+TEST_F(BtreeTableTest, Prefetch) {
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, 16 * base::kKB);
+
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    static const auto kN = 1000;
+    char key[32];
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_FALSE(table_->Put(key, i, kFlagValue, key, nullptr));
+    }
+    ASSERT_TRUE(table_->Flush(false).ok());
+
+    std::string middle;
+    {
+        auto packed = InternalKey::Pack("k.000500", kN, kFlagFind, "");
+        std::unique_ptr<Iterator> iter(table_->CreateIterator());
+        iter->Seek(InternalKey::Parse(packed).key());
+        delete[] packed;
+        ASSERT_TRUE(iter->Valid());
+        middle = iter->key().ToString();
+    }
+
+    // Read the tail, the head pages be evicted.
+    std::string value;
+    for (auto i = kN - 200; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_TRUE(table_->Get(key, kN, &value)) << key;
+    }
+
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    rs = table_->Prefetch("", 2, &mutex);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = table_->Prefetch(middle, 1, &mutex);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // No any page be read.
+    auto misses = table_->cache_stats().misses;
+    std::unique_ptr<Iterator> iter(table_->CreateIterator());
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("k.000000", iter->value().ToString());
+    iter->Seek(middle);
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("k.000500", iter->value().ToString());
+    EXPECT_EQ(misses, table_->cache_stats().misses);
+}
+
+TEST_F(BtreeTableTest, SpaceReusing) {
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    static const auto kN = 100;
+    char key[32];
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+        ASSERT_FALSE(table_->Put(key, i, kFlagValue, key, nullptr));
+    }
+    ASSERT_TRUE(table_->Flush(true).ok());
+    auto size = io_.buf().size();
+
+    for (auto i = 0; i < kN; ++i) {
+        ASSERT_FALSE(table_->Put("x", kN, kFlagValue, "x", nullptr));
+        ASSERT_TRUE(table_->Purge("x", kN, nullptr));
+        ASSERT_TRUE(table_->Flush(true).ok());
+    }
+    EXPECT_GE(size * 2, io_.buf().size());
+
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, -1);
+
+    rs = table_->Open(&io_, io_.buf().size());
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::unique_ptr<Iterator> iter(table_->CreateIterator());
+    iter->SeekToFirst();
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+
+        ASSERT_TRUE(iter->Valid());
+        EXPECT_EQ(key, iter->value().ToString());
+        iter->Next();
+    }
+    EXPECT_FALSE(iter->Valid());
+}
+
+TEST_F(BtreeTableTest, BulkLoad) {
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    static const auto kN = 1000;
+    char key[32];
+    std::vector<std::string> keys;
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i * 2);
+        keys.push_back(key);
+    }
+
+    SortedIteratorMock input(keys);
+    rs = table_->BulkLoad(&input, 1, 0.8f);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    for (const auto &k : keys) {
+        ASSERT_TRUE(table_->Get(k, 1, &value)) << k;
+        EXPECT_EQ(k, value);
+    }
+    EXPECT_FALSE(table_->Get("k.000001", 1, &value));
+
+    // The loaded tree can be updated as usual.
+    for (auto i = 0; i < kN; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i * 2 + 1);
+        ASSERT_FALSE(table_->Put(key, 2, kFlagValue, key, nullptr));
+    }
+    ASSERT_TRUE(table_->Flush(true).ok());
+
+    InternalKeyComparator comparator(BytewiseCompartor());
+    table_ = new Table(comparator, -1);
+
+    rs = table_->Open(&io_, io_.buf().size());
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::unique_ptr<Iterator> iter(table_->CreateIterator());
+    iter->SeekToFirst();
+    for (auto i = 0; i < kN * 2; ++i) {
+        snprintf(key, sizeof(key), "k.%06d", i);
+
+        ASSERT_TRUE(iter->Valid());
+        EXPECT_EQ(key, iter->value().ToString());
+        iter->Next();
+    }
+    EXPECT_FALSE(iter->Valid());
+}
+
+TEST_F(BtreeTableTest, BulkLoadUnsorted) {
+    auto rs = table_->Create(kPageSize, Config::kBtreeFileVersion, 7, &io_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    SortedIteratorMock unsorted({"a", "c", "b"});
+    rs = table_->BulkLoad(&unsorted, 1, 1.0f);
+    EXPECT_FALSE(rs.ok());
+
+    ASSERT_FALSE(table_->Put("a", 1, kFlagValue, "1", nullptr));
+    SortedIteratorMock sorted({"b", "c"});
+    rs = table_->BulkLoad(&sorted, 2, 1.0f);
+    EXPECT_FALSE(rs.ok());
+}
+
 } // namespace balance
 
 } // namespace yukino
@@ -2,6 +2,8 @@
 #include "util/log.h"
 #include "base/io.h"
 #include "yukino/env.h"
+#include <condition_variable>
+#include <vector>
 
 #if defined(CHECK_OK)
 #   undef CHECK_OK
@@ -12,22 +14,108 @@ namespace yukino {
 
 namespace balance {
 
+struct VersionSet::Writer {
+    explicit Writer(VersionPatch *p) : patch(p) {}
+
+    VersionPatch *patch;
+    bool done = false;
+    base::Status status;
+    std::condition_variable_any cv;
+};
+
 base::Status VersionSet::Apply(VersionPatch *patch, std::mutex *mutex) {
-    base::Status rs;
+    Writer w(patch);
+    writers_.push_back(&w);
+    while (!w.done && &w != writers_.front()) {
+        // Only one thread without mutex, it is always the front.
+        DCHECK_NOTNULL(mutex);
+        w.cv.wait(*mutex);
+    }
+    if (w.done) {
+        return w.status;
+    }
+
+    // The leader writes all of the waiting patches in order, the last one
+    // has the newest state.
+    std::vector<Writer *> group(writers_.begin(), writers_.end());
 
-    if (!manifest_log_ && !manifest_file_) {
-        CHECK_OK(CreateManifest(NextFileNumber()));
+    uint64_t new_manifest_file_number = 0;
+    if (!manifest_log_ || manifest_file_size_ >= max_manifest_file_size_) {
+        new_manifest_file_number = NextFileNumber();
+    }
+    std::vector<std::string> records;
+    for (auto writer : group) {
+        writer->patch->set_last_file_number(last_file_number_);
+        writer->patch->set_last_tx_id(last_tx_id_);
+        records.push_back(writer->patch->Encode());
     }
-    patch->set_last_file_number(last_file_number_);
-    patch->set_last_tx_id(last_tx_id_);
+
+    std::unique_ptr<base::AppendFile> file;
+    std::unique_ptr<util::LogWriter> log;
+    size_t written = 0;
+    base::Status rs;
 
     if (mutex) mutex->unlock();
-    CHECK_OK(manifest_log_->Append(patch->Encode()));
-    CHECK_OK(manifest_file_->Sync());
+    if (new_manifest_file_number != 0) {
+        rs = CreateManifest(new_manifest_file_number, &file, &log);
+    }
+    auto target_file = file ? file.get() : manifest_file_.get();
+    auto target_log  = log  ? log.get()  : manifest_log_.get();
+    for (const auto &record : records) {
+        if (!rs.ok()) {
+            break;
+        }
+        rs = target_log->Append(record);
+        written += record.size();
+    }
+    if (rs.ok()) {
+        rs = target_file->Sync();
+    }
+    if (rs.ok() && new_manifest_file_number != 0) {
+        rs = SetCurrentFile(new_manifest_file_number);
+    }
     if (mutex) mutex->lock();
 
-    log_file_number_      = patch->log_file_number_;
-    prev_log_file_number_ = patch->prev_log_file_number_;
+    if (!rs.ok()) {
+        // The manifest may end with a partial record, start a new one at the
+        // next time.
+        manifest_log_.reset();
+        manifest_file_.reset();
+        if (new_manifest_file_number != 0) {
+            log.reset();
+            file.reset();
+            env_->DeleteFile(files_.ManifestFile(new_manifest_file_number),
+                             false);
+        }
+    } else {
+        if (new_manifest_file_number != 0) {
+            if (manifest_file_number_ != 0) {
+                env_->DeleteFile(files_.ManifestFile(manifest_file_number_),
+                                 false);
+            }
+            manifest_log_  = std::move(log);
+            manifest_file_ = std::move(file);
+            manifest_file_number_ = new_manifest_file_number;
+            manifest_file_size_ = 0;
+        }
+        manifest_file_size_ += written;
+
+        log_file_number_      = group.back()->patch->log_file_number_;
+        prev_log_file_number_ = group.back()->patch->prev_log_file_number_;
+    }
+
+    for (auto writer : group) {
+        DCHECK_EQ(writer, writers_.front());
+        writers_.pop_front();
+        if (writer != &w) {
+            writer->status = rs;
+            writer->done = true;
+            writer->cv.notify_one();
+        }
+    }
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
     return rs;
 }
 
@@ -63,23 +151,33 @@ base::Status VersionSet::Recover(uint64_t manifest_file_number) {
         prev_log_file_number_ = patch.prev_log_file_number_;
     }
     startup_tx_id_ = last_tx_id_;
+    manifest_file_number_ = manifest_file_number;
 
     return reader.status();
 }
 
-base::Status VersionSet::CreateManifest(uint64_t file_number) {
+base::Status VersionSet::CreateManifest(uint64_t file_number,
+                                        std::unique_ptr<base::AppendFile> *file,
+                                        std::unique_ptr<util::LogWriter> *log) {
     base::Status rs;
-    manifest_file_number_ = file_number;
 
     base::AppendFile *rv;
     CHECK_OK(env_->CreateAppendFile(files_.ManifestFile(file_number), &rv));
-    manifest_file_ = base::make_unique_ptr(rv);
-    manifest_log_  = base::make_unique_ptr(new util::LogWriter(
-                                           manifest_file_.get(),
-                                           util::Log::kDefaultBlockSize));
+    *file = base::make_unique_ptr(rv);
+    *log  = base::make_unique_ptr(new util::LogWriter(
+                                  rv, util::Log::kDefaultBlockSize));
+    return rs;
+}
+
+base::Status VersionSet::SetCurrentFile(uint64_t file_number) {
+    base::Status rs;
 
+    // Write a new one and rename it to CURRENT, the reader never sees the
+    // half written one. The temporary file be synced before the renaming.
+    auto tmp_file_name = files_.CurrentFile() + ".tmp";
     auto buf = base::Strings::Sprintf("%" PRIu64 "\n", file_number);
-    return base::WriteAll(files_.CurrentFile(), buf, nullptr);
+    CHECK_OK(WriteStringToFile(env_, buf, tmp_file_name));
+    return env_->RenameFile(tmp_file_name, files_.CurrentFile());
 }
 
 
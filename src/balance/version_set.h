@@ -4,6 +4,8 @@
 #include "balance/format.h"
 #include "base/status.h"
 #include "base/base.h"
+#include <mutex>
+#include <deque>
 
 namespace yukino {
 
@@ -29,12 +31,25 @@ class VersionPatch;
 
 class VersionSet : public base::DisableCopyAssign {
 public:
-    VersionSet(const std::string name, const Comparator *comparator, Env *env)
+    VersionSet(const std::string name, const Comparator *comparator, Env *env,
+               uint64_t max_manifest_file_size)
         : files_(name)
         , comparator_(comparator)
-        , env_(env) {
+        , env_(env)
+        , max_manifest_file_size_(max_manifest_file_size) {
     }
 
+    /**
+     * Write the patch to manifest. Every patch has the whole state, so the
+     * manifest be switched to a new one started by this patch, once it grows
+     * larger than max_manifest_file_size, and the old one be deleted.
+     *
+     * The concurrent callers be queued, the front one writes all of the
+     * waiting patches and syncs once, the others wait for its result.
+     *
+     * REQUIRES: mutex held, it be released during the writing. The mutex can
+     * be nullptr if there is only one thread.
+     */
     base::Status Apply(VersionPatch *patch, std::mutex *mutex);
 
     base::Status Recover(uint64_t manifest_file_number);
@@ -52,7 +67,10 @@ public:
     uint64_t log_file_number() const { return log_file_number_; }
 
 private:
-    base::Status CreateManifest(uint64_t file_number);
+    base::Status CreateManifest(uint64_t file_number,
+                                std::unique_ptr<base::AppendFile> *file,
+                                std::unique_ptr<util::LogWriter> *log);
+    base::Status SetCurrentFile(uint64_t file_number);
 
     uint64_t startup_tx_id_ = 0;    // The startup transaction id.
 
@@ -65,10 +83,15 @@ private:
     std::unique_ptr<util::LogWriter> manifest_log_;
     std::unique_ptr<base::AppendFile> manifest_file_;
     uint64_t manifest_file_number_ = 0;
+    uint64_t manifest_file_size_ = 0;
+
+    struct Writer;
+    std::deque<Writer *> writers_; // The waiting callers of Apply().
 
     const Files files_;
     Env * const env_;
     const Comparator * const comparator_;
+    const uint64_t max_manifest_file_size_;
 };
 
 class VersionPatch : public base::DisableCopyAssign {
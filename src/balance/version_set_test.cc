@@ -0,0 +1,101 @@
+// The YukinoDB Unit Test Suite
+//
+//  version_set_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "balance/version_set.h"
+#include "util/log.h"
+#include "yukino/comparator.h"
+#include "yukino/env.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace balance {
+
+class BalanceVersionSetTest : public ::testing::Test {
+public:
+    BalanceVersionSetTest () {
+    }
+
+    virtual void SetUp() override {
+        Env::Default()->DeleteFile(kDBName, true);
+        ASSERT_TRUE(Env::Default()->CreateDir(kDBName).ok());
+    }
+
+    virtual void TearDown() override {
+        Env::Default()->DeleteFile(kDBName, true);
+    }
+
+    constexpr static const auto kDBName = "demo_versions";
+};
+
+TEST_F(BalanceVersionSetTest, ConcurrentApply) {
+    static const auto kNumThreads = 4;
+    static const auto kNumApplies = 100;
+
+    // Small manifest for switching many times.
+    VersionSet versions(kDBName, BytewiseCompartor(), Env::Default(), 256);
+
+    VersionPatch patch;
+    patch.set_comparator(BytewiseCompartor()->Name());
+    patch.set_log_file_number(versions.NextFileNumber());
+    auto rs = versions.Apply(&patch, nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::mutex mutex;
+    uint64_t last_log_number = 0;
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([&]() {
+            for (auto j = 0; j < kNumApplies; ++j) {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                // The patches be written in the order of Apply().
+                VersionPatch patch;
+                patch.set_prev_log_file_number(versions.log_file_number());
+                last_log_number = versions.NextFileNumber();
+                patch.set_log_file_number(last_log_number);
+                auto rs = versions.Apply(&patch, &mutex);
+                ASSERT_TRUE(rs.ok()) << rs.ToString();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(last_log_number, versions.log_file_number());
+
+    std::vector<std::string> children;
+    rs = Env::Default()->GetChildren(kDBName, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto num_manifests = 0;
+    for (const auto &child : children) {
+        if (child.find(Files::kManifestName) == 0) {
+            num_manifests++;
+        }
+    }
+    EXPECT_EQ(1, num_manifests);
+
+    std::string buf;
+    rs = ReadFileToString(Env::Default(),
+                          std::string(kDBName) + "/" + Files::kCurrentName,
+                          &buf);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    VersionSet recovered(kDBName, BytewiseCompartor(), Env::Default(), 256);
+    rs = recovered.Recover(::atoll(buf.c_str()));
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(last_log_number, recovered.log_file_number());
+}
+
+} // namespace balance
+
+} // namespace yukino
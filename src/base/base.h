@@ -3,6 +3,7 @@
 
 #include <utility>
 #include <string>
+#include <memory>
 
 namespace yukino {
 
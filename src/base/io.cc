@@ -198,9 +198,70 @@ bool BufferedWriter::Advance(size_t add) {
     return true;
 }
 
+RandomAccessFile::~RandomAccessFile() {
+}
+
+MappedRandomAccessFile::~MappedRandomAccessFile() {
+}
+
+Status MappedRandomAccessFile::Read(uint64_t offset, size_t n, Slice *result,
+                                    std::string *scratch) const {
+    if (offset + n > mmap_->size()) {
+        return Status::IOError("Read out of the file.");
+    }
+    *result = Slice(reinterpret_cast<const char *>(mmap_->buf(offset)), n);
+    return Status::OK();
+}
+
 AppendFile::~AppendFile() {
 }
 
+IncrementalSyncFile::~IncrementalSyncFile() {
+}
+
+Status IncrementalSyncFile::Write(const void *data, size_t size,
+                                  size_t *written) {
+    auto rs = file_->Write(data, size, written);
+    if (!rs.ok()) {
+        return rs;
+    }
+    return MaybeRangeSync();
+}
+
+Status IncrementalSyncFile::Skip(size_t count) {
+    auto rs = file_->Skip(count);
+    if (!rs.ok()) {
+        return rs;
+    }
+    return MaybeRangeSync();
+}
+
+Status IncrementalSyncFile::Sync() {
+    auto rs = file_->Sync();
+    if (rs.ok()) {
+        synced_ = file_->active();
+    }
+    return rs;
+}
+
+Status IncrementalSyncFile::MaybeRangeSync() {
+    // Only the whole pages, the last partial page will be written again.
+    static const uint64_t kPageSize = 4 * kKB;
+
+    auto end = file_->active() / kPageSize * kPageSize;
+    if (end < synced_ + bytes_per_sync_) {
+        return Status::OK();
+    }
+    auto rs = file_->RangeSync(synced_, end - synced_);
+    if (rs.ok()) {
+        synced_ = end;
+    }
+    return rs;
+}
+
+IOQueue::~IOQueue() {
+}
+
 FileLock::~FileLock() {
 }
 
@@ -5,6 +5,8 @@
 #include "base/slice.h"
 #include "base/base.h"
 #include "glog/logging.h"
+#include <memory>
+#include <vector>
 
 namespace yukino {
 
@@ -171,7 +173,7 @@ public:
     typename Checksum::DigestTy
     digest() const { return checker_.digest(); }
 
-    Writer *delegated() const {
+    Reader *delegated() const {
         return delegated_;
     }
 
@@ -253,6 +255,57 @@ private:
     std::string file_name_;
 };
 
+/**
+ * The read-only file be read at any offset, it may be shared by threads.
+ */
+class RandomAccessFile : public DisableCopyAssign {
+public:
+    virtual ~RandomAccessFile();
+
+    /**
+     * Read n bytes at the offset.
+     *
+     * @param result points to the scratch, or to the memory owned by the
+     *        file, it's valid until the file or the scratch be changed.
+     * @param scratch be resized for the data if it need be copied.
+     */
+    virtual Status Read(uint64_t offset, size_t n, Slice *result,
+                        std::string *scratch) const = 0;
+
+    virtual uint64_t size() const = 0;
+
+    virtual const std::string &file_name() const = 0;
+
+    /**
+     * The OS file descriptor for asynchronous I/O, or -1 if the file has
+     * no one.
+     */
+    virtual int native_handle() const { return -1; }
+};
+
+/**
+ * The random access file on the mapped memory, no copying for reading.
+ */
+class MappedRandomAccessFile : public RandomAccessFile {
+public:
+    explicit MappedRandomAccessFile(const MappedMemory *mmap)
+        : mmap_(DCHECK_NOTNULL(mmap)) {}
+
+    virtual ~MappedRandomAccessFile() override;
+
+    virtual Status Read(uint64_t offset, size_t n, Slice *result,
+                        std::string *scratch) const override;
+
+    virtual uint64_t size() const override { return mmap_->size(); }
+
+    virtual const std::string &file_name() const override {
+        return mmap_->file_name();
+    }
+
+private:
+    const MappedMemory *mmap_;
+};
+
 class AppendFile : public Writer {
 public:
     virtual ~AppendFile();
@@ -260,6 +313,73 @@ public:
     virtual Status Close() = 0;
     virtual Status Flush() = 0;
     virtual Status Sync() = 0;
+
+    /**
+     * Start writing back the written data of [offset, offset + n) without
+     * waiting for it, so the final Sync() has less to do.
+     */
+    virtual Status RangeSync(uint64_t offset, uint64_t n) {
+        return Status::OK();
+    }
+
+    /**
+     * Reserve disk space for [offset, offset + len), the file size is not
+     * changed. The unused space be released on Close().
+     */
+    virtual Status Allocate(uint64_t offset, uint64_t len) {
+        return Status::OK();
+    }
+
+    /**
+     * The OS file descriptor for asynchronous I/O, or -1 if the file has
+     * no one. The data must be flushed before using it.
+     */
+    virtual int native_handle() const { return -1; }
+};
+
+/**
+ * The file be range synced after every bytes_per_sync bytes written, so
+ * the dirty pages be written back smoothly, instead of by one huge Sync().
+ */
+class IncrementalSyncFile : public AppendFile {
+public:
+    IncrementalSyncFile(AppendFile *file, uint64_t bytes_per_sync)
+        : file_(DCHECK_NOTNULL(file))
+        , bytes_per_sync_(bytes_per_sync) {
+        DCHECK_GT(bytes_per_sync_, 0);
+    }
+
+    virtual ~IncrementalSyncFile() override;
+
+    virtual Status Write(const void *data, size_t size,
+                         size_t *written) override;
+
+    virtual Status Skip(size_t count) override;
+
+    virtual size_t active() const override { return file_->active(); }
+
+    virtual Status Close() override { return file_->Close(); }
+    virtual Status Flush() override { return file_->Flush(); }
+    virtual Status Sync() override;
+
+    virtual Status RangeSync(uint64_t offset, uint64_t n) override {
+        return file_->RangeSync(offset, n);
+    }
+
+    virtual Status Allocate(uint64_t offset, uint64_t len) override {
+        return file_->Allocate(offset, len);
+    }
+
+    virtual int native_handle() const override {
+        return file_->native_handle();
+    }
+
+private:
+    Status MaybeRangeSync();
+
+    std::unique_ptr<AppendFile> file_;
+    const uint64_t bytes_per_sync_;
+    uint64_t synced_ = 0;
 };
 
 /**
@@ -271,6 +391,98 @@ public:
 
     virtual Status Truncate(uint64_t offset) = 0;
     virtual Status Seek(uint64_t offset) = 0;
+
+    /**
+     * Preallocate disk space for [offset, offset + len), the file will be
+     * extended if it's too small. The new space reads as zero.
+     */
+    virtual Status Preallocate(uint64_t offset, uint64_t len) = 0;
+
+    /**
+     * Write data at the offset, the file position is not changed.
+     */
+    virtual Status WriteAt(uint64_t offset, const void *data, size_t size) = 0;
+
+    /**
+     * Read data at the offset, the file position is not changed, so the
+     * concurrent readers need not to share it.
+     */
+    virtual Status ReadAt(uint64_t offset, void *buf, size_t size) const = 0;
+};
+
+/**
+ * The asynchronous I/O queue. Requests be queued by ReadAsync(),
+ * WriteAsync() and Fsync(), then be submitted together by one Submit(), and
+ * be finished in any order. Their results be got by Poll().
+ *
+ * At most depth() requests can be in the queue, the queuing waits for some
+ * requests finished if it's full.
+ *
+ * The queue will only be accessed by one thread at a time.
+ *
+ * Only the balance checkpoint uses it for now. The lsm reads have no block
+ * cache to keep the prefetched blocks, the compaction inputs be O_DIRECT
+ * files without a descriptor for the queue, and the redo-log be synced once
+ * per write, so there is nothing to batch for them yet.
+ */
+class IOQueue : public DisableCopyAssign {
+public:
+    struct Completion {
+        void   *tag;
+        // Transferred bytes, or -errno for failure.
+        int64_t result;
+    };
+
+    virtual ~IOQueue();
+
+    /**
+     * Queue reading n bytes at the offset of the file.
+     *
+     * @param buf it must be valid until the request finished.
+     * @param tag the tag of this request's completion.
+     */
+    virtual Status ReadAsync(const RandomAccessFile *file, uint64_t offset,
+                             size_t n, char *buf, void *tag) = 0;
+
+    /**
+     * Queue writing n bytes at the offset of the file.
+     *
+     * @param data it must be valid until the request finished.
+     * @param tag the tag of this request's completion.
+     */
+    virtual Status WriteAsync(FileIO *file, uint64_t offset, const void *data,
+                              size_t n, void *tag) = 0;
+
+    /**
+     * Queue syncing the file. It starts after all requests queued before it
+     * finished, so the writing and syncing can be submitted together.
+     */
+    virtual Status Fsync(AppendFile *file, void *tag) = 0;
+
+    /**
+     * Submit all queued requests, by one system call if it's possible.
+     */
+    virtual Status Submit() = 0;
+
+    /**
+     * Wait for at least min_completions submitted requests finished, and
+     * append their completions to the vector.
+     */
+    virtual Status Poll(size_t min_completions,
+                        std::vector<Completion> *completions) = 0;
+
+    /**
+     * Number of the queued requests whose completions be not got.
+     */
+    virtual size_t in_flight() const = 0;
+
+    virtual size_t depth() const = 0;
+
+    /**
+     * Are requests executed by the kernel asynchronously? Or executed in
+     * Submit() one by one.
+     */
+    virtual bool asynchronous() const = 0;
 };
 
 class FileLock : public DisableCopyAssign {
@@ -92,6 +92,29 @@ Status StringIO::Seek(uint64_t offset) {
     return Status::OK();
 }
 
+Status StringIO::Preallocate(uint64_t offset, uint64_t len) {
+    if (offset + len > buf_.size()) {
+        buf_.resize(offset + len);
+    }
+    return Status::OK();
+}
+
+Status StringIO::WriteAt(uint64_t offset, const void *data, size_t size) {
+    if (offset + size > buf_.size()) {
+        buf_.resize(offset + size);
+    }
+    ::memcpy(&buf_[offset], data, size);
+    return Status::OK();
+}
+
+Status StringIO::ReadAt(uint64_t offset, void *buf, size_t size) const {
+    if (offset + size > buf_.size()) {
+        return Status::IOError("EOF");
+    }
+    ::memcpy(buf, buf_.data() + offset, size);
+    return Status::OK();
+}
+
 } // namespace base
     
 } // namespace yukino
\ No newline at end of file
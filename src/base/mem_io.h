@@ -42,6 +42,11 @@ public:
 
     virtual base::Status Truncate(uint64_t offset) override;
     virtual base::Status Seek(uint64_t offset) override;
+    virtual base::Status Preallocate(uint64_t offset, uint64_t len) override;
+    virtual base::Status WriteAt(uint64_t offset, const void *data,
+                                 size_t size) override;
+    virtual base::Status ReadAt(uint64_t offset, void *buf,
+                                size_t size) const override;
 
     const std::string &buf() const { return buf_; }
     std::string *mutable_buf() { return &buf_; }
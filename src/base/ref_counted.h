@@ -19,6 +19,10 @@ struct EmptyDeleter {
     static void Delete(T */*p*/) { /*DO NOTHING*/ }
 };
 
+/**
+ * Not thread-safe reference counting, the owners must be serialized by a
+ * lock, as the db mutex.
+ */
 template <class T, class Deleter = DefautlDeleter>
 class ReferenceCounted : public DisableCopyAssign {
 public:
@@ -38,6 +42,10 @@ private:
     mutable int counter_ = 0;
 };
 
+/**
+ * Thread-safe reference counting. The counter starts at zero, and only the
+ * last Release() deletes the object, after the writes of all other owners.
+ */
 template <class T, class Deleter = DefautlDeleter>
 class AtomicReferenceCounted : public DisableCopyAssign {
 public:
@@ -48,17 +56,19 @@ public:
     }
 
     void Release() const {
-        if (std::atomic_fetch_sub_explicit(&counter_, 1,
-                                           std::memory_order_relaxed) == 1) {
+        // The object may be deleted, so check the old value.
+        auto old = std::atomic_fetch_sub_explicit(&counter_, 1,
+                                                  std::memory_order_acq_rel);
+        DCHECK_GE(old, 1);
+        if (old == 1) {
             Deleter::Delete(static_cast<T*>(const_cast<AtomicReferenceCounted*>(this)));
         }
-        DCHECK_GE(counter_.load(std::memory_order_relaxed), 0);
     }
 
     int ref_count() const { return counter_.load(std::memory_order_relaxed); }
 
 private:
-    mutable std::atomic<int> counter_;
+    mutable std::atomic<int> counter_{0};
 };
 
 /**
@@ -73,11 +83,11 @@ public:
         if (naked_) naked_->AddRef();
     }
 
-    explicit Handle(const Handle<T> &other) : naked_(other.naked_) {
+    Handle(const Handle<T> &other) : naked_(other.naked_) {
         if (naked_) naked_->AddRef();
     }
 
-    explicit Handle(Handle<T> &&other) : naked_(other.naked_) {
+    Handle(Handle<T> &&other) : naked_(other.naked_) {
         other.naked_ = nullptr;
     }
 
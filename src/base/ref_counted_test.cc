@@ -9,6 +9,10 @@
 #include "gtest/gtest.h"
 #include "glog/logging.h"
 #include <stdio.h>
+#include <string.h>
+#include <new>
+#include <thread>
+#include <vector>
 
 namespace yukino {
 
@@ -84,6 +88,43 @@ TEST(ReferenceCountedTest, AtomicReference) {
     EXPECT_EQ(1, n);
 }
 
+TEST(ReferenceCountedTest, AtomicInitialCount) {
+    int n = 0;
+    alignas(AtomicTestStub) char buf[sizeof(AtomicTestStub)];
+    ::memset(buf, 0xff, sizeof(buf));
+
+    // The counter be zero even if the memory is dirty.
+    auto stub = new (buf) AtomicTestStub(&n);
+    EXPECT_EQ(0, stub->ref_count());
+    stub->~AtomicTestStub();
+}
+
+TEST(ReferenceCountedTest, AtomicConcurrentRelease) {
+    static const auto kNumThreads = 4;
+    static const auto kNumCopies = 10000;
+
+    for (auto i = 0; i < 10; ++i) {
+        int n = 0;
+        base::Handle<const AtomicTestStub> h(new AtomicTestStub(&n));
+
+        std::vector<std::thread> threads;
+        for (auto j = 0; j < kNumThreads; ++j) {
+            threads.emplace_back([h]() {
+                for (auto k = 0; k < kNumCopies; ++k) {
+                    base::Handle<const AtomicTestStub> copied(h);
+                }
+            });
+        }
+        h = nullptr;
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        // The last releasing thread deletes it.
+        EXPECT_EQ(1, n);
+    }
+}
+
 } // namespace base
 
 } // namespace yukino
@@ -2,6 +2,7 @@
 #define YUKINO_API_SLICE_H_
 
 #include <stddef.h>
+#include <string.h>
 #include <assert.h>
 #include <string>
 
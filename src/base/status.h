@@ -50,6 +50,12 @@ public:
     // Returns true iff the status indicates an IOError.
     bool IsIOError() const { return code() == kIOError; }
 
+    // Returns true iff the status indicates a NotSupported error.
+    bool IsNotSupported() const { return code() == kNotSupported; }
+
+    // Returns true iff the status indicates an InvalidArgument error.
+    bool IsInvalidArgument() const { return code() == kInvalidArgument; }
+
     // Return a string representation of this status suitable for printing.
     // Returns the string "OK" for success.
     std::string ToString() const;
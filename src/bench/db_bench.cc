@@ -0,0 +1,612 @@
+#include "bench/histogram.h"
+#include "lsm/db_impl.h"
+#include "balance/db_impl.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/iterator.h"
+#include "yukino/options.h"
+#include "yukino/rate_limiter.h"
+#include "yukino/write_batch.h"
+#include "base/slice.h"
+#include "base/base.h"
+#include "glog/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Comma-separated list of operations to run in the specified order:
+//
+//   fillseq      -- write N values in sequential key order
+//   fillrandom   -- write N values in random key order
+//   overwrite    -- overwrite N values in random key order
+//   readrandom   -- read N times in random order
+//   multireadrandom -- read N times in random order, --batch_size keys per
+//                      MultiGet()
+//   readmissing  -- read N missing keys in random order
+//   seekrandom   -- N random seeks
+//   readseq      -- read N times sequentially
+//   deleterandom -- delete N keys in random order
+//
+// Usage:
+//
+//   db_bench --engine=balance --benchmarks=fillrandom,readrandom --threads=4
+//
+// Build: the "db_bench" target of the Xcode project or of CMakeLists.txt.
+
+namespace yukino {
+
+namespace bench {
+
+namespace {
+
+struct Flags {
+    std::string benchmarks = "fillseq,fillrandom,overwrite,readrandom,"
+                             "readmissing,seekrandom,readseq,deleterandom";
+    std::string engine = lsm::DBImpl::kName;
+    std::string db = "/tmp/yukino_bench";
+    int64_t num = 1000000;
+    int64_t reads = -1; // -1: same as num
+    int threads = 1;
+    int key_size = 16;
+    int value_size = 100;
+    int batch_size = 1;
+    bool sync = false;
+    bool use_existing_db = false;
+    size_t write_buffer_size = 0; // 0: default
+    size_t block_size = 0;        // 0: default
+    bool use_mmap_reads = true;
+    bool use_mem_env = false; // Keep all files in memory.
+    int64_t rate_limiter_bytes_per_sec = 0; // 0: no limiter
+    uint64_t seed = 301;
+} FLAGS;
+
+bool ParseFlag(const char *arg, Flags *flags) {
+    char buf[1024];
+    long long n = 0;
+    char junk;
+
+    if (sscanf(arg, "--benchmarks=%1023s", buf) == 1) {
+        flags->benchmarks = buf;
+    } else if (sscanf(arg, "--engine=%1023s", buf) == 1) {
+        flags->engine = buf;
+        if (flags->engine == "lsm") {
+            flags->engine = lsm::DBImpl::kName;
+        } else if (flags->engine == "balance") {
+            flags->engine = balance::DBImpl::kName;
+        }
+    } else if (sscanf(arg, "--db=%1023s", buf) == 1) {
+        flags->db = buf;
+    } else if (sscanf(arg, "--num=%lld%c", &n, &junk) == 1) {
+        flags->num = n;
+    } else if (sscanf(arg, "--reads=%lld%c", &n, &junk) == 1) {
+        flags->reads = n;
+    } else if (sscanf(arg, "--threads=%lld%c", &n, &junk) == 1) {
+        flags->threads = static_cast<int>(n);
+    } else if (sscanf(arg, "--key_size=%lld%c", &n, &junk) == 1) {
+        flags->key_size = static_cast<int>(n);
+    } else if (sscanf(arg, "--value_size=%lld%c", &n, &junk) == 1) {
+        flags->value_size = static_cast<int>(n);
+    } else if (sscanf(arg, "--batch_size=%lld%c", &n, &junk) == 1) {
+        flags->batch_size = static_cast<int>(n);
+    } else if (sscanf(arg, "--sync=%lld%c", &n, &junk) == 1) {
+        flags->sync = (n != 0);
+    } else if (sscanf(arg, "--use_existing_db=%lld%c", &n, &junk) == 1) {
+        flags->use_existing_db = (n != 0);
+    } else if (sscanf(arg, "--write_buffer_size=%lld%c", &n, &junk) == 1) {
+        flags->write_buffer_size = static_cast<size_t>(n);
+    } else if (sscanf(arg, "--block_size=%lld%c", &n, &junk) == 1) {
+        flags->block_size = static_cast<size_t>(n);
+    } else if (sscanf(arg, "--use_mmap_reads=%lld%c", &n, &junk) == 1) {
+        flags->use_mmap_reads = (n != 0);
+    } else if (sscanf(arg, "--use_mem_env=%lld%c", &n, &junk) == 1) {
+        flags->use_mem_env = (n != 0);
+    } else if (sscanf(arg, "--rate_limiter_bytes_per_sec=%lld%c", &n,
+                      &junk) == 1) {
+        flags->rate_limiter_bytes_per_sec = n;
+    } else if (sscanf(arg, "--seed=%lld%c", &n, &junk) == 1) {
+        flags->seed = static_cast<uint64_t>(n);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline uint64_t NowMicros() {
+    using namespace std::chrono;
+
+    auto now = steady_clock::now();
+    return duration_cast<microseconds>(now.time_since_epoch()).count();
+}
+
+/**
+ * Values are slices of a random buffer, so each value is different.
+ */
+class ValueGenerator {
+public:
+    ValueGenerator(uint64_t seed) {
+        std::mt19937_64 rnd(seed);
+        data_.resize(1 * base::kMB);
+        for (auto &c : data_) {
+            c = static_cast<char>(' ' + rnd() % 95);
+        }
+    }
+
+    base::Slice Generate(size_t len) {
+        if (pos_ + len > data_.size()) {
+            pos_ = 0;
+            DCHECK_LT(len, data_.size());
+        }
+        pos_ += len;
+        return base::Slice(data_.data() + pos_ - len, len);
+    }
+
+private:
+    std::string data_;
+    size_t pos_ = 0;
+};
+
+class Stats {
+public:
+    void Start() {
+        start_ = NowMicros();
+        last_op_finish_ = start_;
+    }
+
+    void Stop() { finish_ = NowMicros(); }
+
+    void FinishedOps(int64_t num_ops) {
+        auto now = NowMicros();
+        hist_.Add(static_cast<double>(now - last_op_finish_));
+        last_op_finish_ = now;
+        done_ += num_ops;
+    }
+
+    void AddBytes(int64_t n) { bytes_ += n; }
+
+    void AddMessage(const std::string &msg) {
+        if (!message_.empty()) {
+            message_.append(" ");
+        }
+        message_.append(msg);
+    }
+
+    void Merge(const Stats &other) {
+        hist_.Merge(other.hist_);
+        done_  += other.done_;
+        bytes_ += other.bytes_;
+        start_  = std::min(start_, other.start_);
+        finish_ = std::max(finish_, other.finish_);
+        if (message_.empty()) {
+            message_ = other.message_;
+        }
+    }
+
+    void Report(const std::string &name) {
+        if (done_ < 1) {
+            fprintf(stdout, "%-12s : %s\n", name.c_str(), message_.c_str());
+            fflush(stdout);
+            return;
+        }
+        auto elapsed = std::max(finish_ - start_, static_cast<uint64_t>(1)) *
+                       1e-6;
+
+        std::string extra;
+        if (bytes_ > 0) {
+            extra = base::Strings::Sprintf("%6.1f MB/s",
+                                           (bytes_ / 1048576.0) / elapsed);
+        }
+        if (!message_.empty()) {
+            extra.append(extra.empty() ? "" : " ").append(message_);
+        }
+
+        fprintf(stdout, "%-12s : %11.3f micros/op %10.0f ops/sec; %s\n",
+                name.c_str(), elapsed * 1e6 / done_, done_ / elapsed,
+                extra.c_str());
+        fprintf(stdout, "Latency (micros per call):\n%s\n",
+                hist_.ToString().c_str());
+        fflush(stdout);
+    }
+
+private:
+    Histogram hist_;
+    uint64_t start_ = 0;
+    uint64_t finish_ = 0;
+    uint64_t last_op_finish_ = 0;
+    int64_t done_ = 0;
+    int64_t bytes_ = 0;
+    std::string message_;
+};
+
+struct ThreadState {
+    int tid;
+    std::mt19937_64 rand;
+    Stats stats;
+    ValueGenerator gen;
+
+    ThreadState(int index, uint64_t seed)
+        : tid(index)
+        , rand(seed + index)
+        , gen(seed + index) {
+    }
+};
+
+class Benchmark {
+public:
+    typedef void (Benchmark::*Method)(ThreadState *);
+
+    Benchmark()
+        : num_(FLAGS.num)
+        , reads_(FLAGS.reads < 0 ? FLAGS.num : FLAGS.reads) {
+        if (FLAGS.use_mem_env) {
+            mem_env_.reset(NewMemEnv(Env::Default()));
+            env_ = mem_env_.get();
+        }
+        if (!FLAGS.use_existing_db) {
+            env_->DeleteFile(FLAGS.db, true);
+        }
+    }
+
+    ~Benchmark() { delete db_; }
+
+    void Run() {
+        PrintHeader();
+        Open();
+
+        const char *benchmarks = FLAGS.benchmarks.c_str();
+        while (benchmarks != nullptr) {
+            auto sep = strchr(benchmarks, ',');
+            std::string name;
+            if (sep == nullptr) {
+                name = benchmarks;
+                benchmarks = nullptr;
+            } else {
+                name = std::string(benchmarks, sep - benchmarks);
+                benchmarks = sep + 1;
+            }
+
+            Method method = nullptr;
+            bool fresh_db = false;
+            if (name == "fillseq") {
+                fresh_db = true;
+                method = &Benchmark::WriteSeq;
+            } else if (name == "fillrandom") {
+                fresh_db = true;
+                method = &Benchmark::WriteRandom;
+            } else if (name == "overwrite") {
+                method = &Benchmark::WriteRandom;
+            } else if (name == "readrandom") {
+                method = &Benchmark::ReadRandom;
+            } else if (name == "multireadrandom") {
+                method = &Benchmark::MultiReadRandom;
+            } else if (name == "readmissing") {
+                method = &Benchmark::ReadMissing;
+            } else if (name == "seekrandom") {
+                method = &Benchmark::SeekRandom;
+            } else if (name == "readseq") {
+                method = &Benchmark::ReadSequential;
+            } else if (name == "deleterandom") {
+                method = &Benchmark::DeleteRandom;
+            } else if (!name.empty()) {
+                fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+                continue;
+            }
+
+            if (fresh_db && FLAGS.use_existing_db) {
+                fprintf(stdout, "%-12s : skipped (--use_existing_db is true)\n",
+                        name.c_str());
+                continue;
+            }
+            if (fresh_db) {
+                delete db_;
+                db_ = nullptr;
+                env_->DeleteFile(FLAGS.db, true);
+                Open();
+            }
+            if (method) {
+                RunBenchmark(name, method);
+            }
+        }
+    }
+
+private:
+    void PrintHeader() {
+        fprintf(stdout, "Engine:     %s\n", FLAGS.engine.c_str());
+        fprintf(stdout, "Keys:       %d bytes each\n", FLAGS.key_size);
+        fprintf(stdout, "Values:     %d bytes each\n", FLAGS.value_size);
+        fprintf(stdout, "Entries:    %" PRId64 "\n", num_);
+        fprintf(stdout, "Threads:    %d\n", FLAGS.threads);
+        fprintf(stdout, "Batch:      %d\n", FLAGS.batch_size);
+        fprintf(stdout, "Sync:       %s\n", FLAGS.sync ? "true" : "false");
+        fprintf(stdout, "Env:        %s\n",
+                FLAGS.use_mem_env ? "memory" : "default");
+#if !defined(NDEBUG)
+        fprintf(stdout, "WARNING: Assertions are enabled; "
+                "benchmarks unnecessarily slow\n");
+#endif
+        fprintf(stdout, "------------------------------------------------\n");
+    }
+
+    void Open() {
+        Options options;
+        options.engine_name = FLAGS.engine.c_str();
+        options.create_if_missing = true;
+        options.env = env_;
+        if (FLAGS.write_buffer_size > 0) {
+            options.write_buffer_size = FLAGS.write_buffer_size;
+        }
+        if (FLAGS.block_size > 0) {
+            options.block_size = FLAGS.block_size;
+        }
+        options.use_mmap_reads = FLAGS.use_mmap_reads;
+        if (FLAGS.rate_limiter_bytes_per_sec > 0) {
+            options.rate_limiter.reset(
+                    NewGenericRateLimiter(FLAGS.rate_limiter_bytes_per_sec));
+        }
+
+        auto rs = DB::Open(options, FLAGS.db, &db_);
+        if (!rs.ok()) {
+            fprintf(stderr, "open error: %s\n", rs.ToString().c_str());
+            exit(1);
+        }
+    }
+
+    void RunBenchmark(const std::string &name, Method method) {
+        struct Shared {
+            std::mutex mutex;
+            std::condition_variable cv;
+            int num_initialized = 0;
+            int num_done = 0;
+            bool start = false;
+        } shared;
+
+        std::vector<std::unique_ptr<ThreadState>> states;
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < FLAGS.threads; ++i) {
+            states.emplace_back(new ThreadState(i, FLAGS.seed));
+        }
+        for (auto i = 0; i < FLAGS.threads; ++i) {
+            auto state = states[i].get();
+            threads.emplace_back([this, method, state, &shared]() {
+                {
+                    std::unique_lock<std::mutex> lock(shared.mutex);
+                    shared.num_initialized++;
+                    shared.cv.notify_all();
+                    while (!shared.start) {
+                        shared.cv.wait(lock);
+                    }
+                }
+
+                state->stats.Start();
+                (this->*method)(state);
+                state->stats.Stop();
+            });
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(shared.mutex);
+            while (shared.num_initialized < FLAGS.threads) {
+                shared.cv.wait(lock);
+            }
+            shared.start = true;
+            shared.cv.notify_all();
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        for (auto i = 1; i < FLAGS.threads; ++i) {
+            states[0]->stats.Merge(states[i]->stats);
+        }
+        states[0]->stats.Report(name);
+    }
+
+    std::string MakeKey(uint64_t k) const {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%016" PRIu64, k);
+
+        std::string key(buf);
+        auto key_size = static_cast<size_t>(FLAGS.key_size);
+        if (key.size() < key_size) {
+            key.insert(0, key_size - key.size(), '0');
+        } else if (key.size() > key_size) {
+            key.erase(0, key.size() - key_size);
+        }
+        return key;
+    }
+
+    void DoWrite(ThreadState *thread, bool seq) {
+        if (num_ != FLAGS.num) {
+            thread->stats.AddMessage(base::Strings::Sprintf("(%" PRId64 " ops)",
+                                                            num_));
+        }
+
+        WriteOptions options;
+        options.sync = FLAGS.sync;
+
+        WriteBatch batch;
+        int64_t bytes = 0;
+        for (int64_t i = 0; i < num_; i += FLAGS.batch_size) {
+            batch.Clear();
+            for (auto j = 0; j < FLAGS.batch_size; ++j) {
+                auto k = seq ? i + j : thread->rand() % FLAGS.num;
+                auto key = MakeKey(k);
+                batch.Put(key, thread->gen.Generate(FLAGS.value_size));
+                bytes += FLAGS.value_size + key.size();
+            }
+
+            auto rs = db_->Write(options, &batch);
+            if (!rs.ok()) {
+                fprintf(stderr, "put error: %s\n", rs.ToString().c_str());
+                exit(1);
+            }
+            thread->stats.FinishedOps(FLAGS.batch_size);
+        }
+        thread->stats.AddBytes(bytes);
+    }
+
+    void WriteSeq(ThreadState *thread) { DoWrite(thread, true); }
+
+    void WriteRandom(ThreadState *thread) { DoWrite(thread, false); }
+
+    void ReadRandom(ThreadState *thread) {
+        ReadOptions options;
+        std::string value;
+        int64_t found = 0;
+        for (int64_t i = 0; i < reads_; ++i) {
+            auto key = MakeKey(thread->rand() % FLAGS.num);
+            if (db_->Get(options, key, &value).ok()) {
+                found++;
+            }
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddMessage(base::Strings::Sprintf("(%" PRId64
+                                                        " of %" PRId64
+                                                        " found)",
+                                                        found, reads_));
+    }
+
+    void MultiReadRandom(ThreadState *thread) {
+        ReadOptions options;
+        std::vector<std::string> keys;
+        std::vector<base::Slice> slices;
+        std::vector<std::string> values;
+        std::vector<base::Status> status;
+        int64_t found = 0;
+        for (int64_t i = 0; i < reads_; i += FLAGS.batch_size) {
+            auto n = std::min<int64_t>(FLAGS.batch_size, reads_ - i);
+            keys.clear();
+            slices.clear();
+            for (int64_t j = 0; j < n; ++j) {
+                keys.push_back(MakeKey(thread->rand() % FLAGS.num));
+            }
+            for (const auto &key : keys) {
+                slices.push_back(key);
+            }
+
+            db_->MultiGet(options, slices, &values, &status);
+            for (const auto &rs : status) {
+                if (rs.ok()) {
+                    found++;
+                }
+            }
+            thread->stats.FinishedOps(n);
+        }
+        thread->stats.AddMessage(base::Strings::Sprintf("(%" PRId64
+                                                        " of %" PRId64
+                                                        " found)",
+                                                        found, reads_));
+    }
+
+    void ReadMissing(ThreadState *thread) {
+        ReadOptions options;
+        std::string value;
+        for (int64_t i = 0; i < reads_; ++i) {
+            auto key = MakeKey(thread->rand() % FLAGS.num) + ".";
+            db_->Get(options, key, &value);
+            thread->stats.FinishedOps(1);
+        }
+    }
+
+    void SeekRandom(ThreadState *thread) {
+        ReadOptions options;
+        std::unique_ptr<Iterator> iter(db_->NewIterator(options));
+        if (!iter) {
+            thread->stats.AddMessage("(iterator not supported)");
+            return;
+        }
+
+        int64_t found = 0;
+        for (int64_t i = 0; i < reads_; ++i) {
+            auto key = MakeKey(thread->rand() % FLAGS.num);
+            iter->Seek(key);
+            if (iter->Valid() && iter->key().compare(key) == 0) {
+                found++;
+            }
+            thread->stats.FinishedOps(1);
+        }
+        thread->stats.AddMessage(base::Strings::Sprintf("(%" PRId64
+                                                        " of %" PRId64
+                                                        " found)",
+                                                        found, reads_));
+    }
+
+    void ReadSequential(ThreadState *thread) {
+        ReadOptions options;
+        std::unique_ptr<Iterator> iter(db_->NewIterator(options));
+        if (!iter) {
+            thread->stats.AddMessage("(iterator not supported)");
+            return;
+        }
+
+        int64_t i = 0, bytes = 0;
+        for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
+            bytes += iter->key().size() + iter->value().size();
+            thread->stats.FinishedOps(1);
+            ++i;
+        }
+        thread->stats.AddBytes(bytes);
+    }
+
+    void DeleteRandom(ThreadState *thread) {
+        WriteOptions options;
+        options.sync = FLAGS.sync;
+
+        WriteBatch batch;
+        for (int64_t i = 0; i < num_; i += FLAGS.batch_size) {
+            batch.Clear();
+            for (auto j = 0; j < FLAGS.batch_size; ++j) {
+                batch.Delete(MakeKey(thread->rand() % FLAGS.num));
+            }
+
+            auto rs = db_->Write(options, &batch);
+            if (!rs.ok()) {
+                fprintf(stderr, "delete error: %s\n", rs.ToString().c_str());
+                exit(1);
+            }
+            thread->stats.FinishedOps(FLAGS.batch_size);
+        }
+    }
+
+    DB *db_ = nullptr;
+    const int64_t num_;
+    const int64_t reads_;
+    std::unique_ptr<Env> mem_env_; // Deleted after the db_.
+    Env *env_ = Env::Default();
+};
+
+} // namespace
+
+} // namespace bench
+
+} // namespace yukino
+
+int main(int argc, char *argv[]) {
+    using yukino::bench::FLAGS;
+
+    google::InitGoogleLogging(argv[0]);
+    for (auto i = 1; i < argc; ++i) {
+        if (!yukino::bench::ParseFlag(argv[i], &FLAGS)) {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS.num <= 0 || FLAGS.threads <= 0 || FLAGS.batch_size <= 0 ||
+        FLAGS.key_size < 8 || FLAGS.value_size < 0) {
+        fprintf(stderr, "Invalid flags value\n");
+        return 1;
+    }
+
+    yukino::bench::Benchmark benchmark;
+    benchmark.Run();
+    return 0;
+}
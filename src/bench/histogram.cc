@@ -0,0 +1,116 @@
+#include "bench/histogram.h"
+#include "base/base.h"
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+namespace yukino {
+
+namespace bench {
+
+/*static*/ double Histogram::BucketLimit(int i) {
+    // 1, 2, 3, ... then grows by 12.5% per bucket, the last one is infinite.
+    static const struct Limits {
+        double value[kNumBuckets];
+
+        Limits() {
+            double limit = 1;
+            for (auto j = 0; j < kNumBuckets - 1; ++j) {
+                value[j] = limit;
+                limit = std::max(limit + 1, floor(limit * 1.125));
+            }
+            value[kNumBuckets - 1] = DBL_MAX;
+        }
+    } limits;
+
+    return limits.value[i];
+}
+
+void Histogram::Clear() {
+    min_ = BucketLimit(kNumBuckets - 1);
+    max_ = 0;
+    num_ = 0;
+    sum_ = 0;
+    sum_squares_ = 0;
+    std::fill(buckets_, buckets_ + kNumBuckets, 0);
+}
+
+void Histogram::Add(double value) {
+    // Linear search is fine, the most values are in the first buckets.
+    auto i = 0;
+    while (i < kNumBuckets - 1 && BucketLimit(i) <= value) {
+        i++;
+    }
+    buckets_[i]++;
+
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+    num_++;
+    sum_ += value;
+    sum_squares_ += value * value;
+}
+
+void Histogram::Merge(const Histogram &other) {
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    num_ += other.num_;
+    sum_ += other.sum_;
+    sum_squares_ += other.sum_squares_;
+    for (auto i = 0; i < kNumBuckets; ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+}
+
+double Histogram::Percentile(double p) const {
+    if (num_ == 0) {
+        return 0;
+    }
+    auto threshold = num_ * (p / 100.0);
+
+    double sum = 0;
+    for (auto i = 0; i < kNumBuckets; ++i) {
+        sum += buckets_[i];
+        if (sum < threshold) {
+            continue;
+        }
+
+        // Interpolate in the bucket.
+        auto left_point  = (i == 0) ? 0 : BucketLimit(i - 1);
+        auto right_point = std::min(BucketLimit(i), max_);
+        auto left_sum    = sum - buckets_[i];
+        auto pos = (threshold - left_sum) / buckets_[i];
+        auto rv  = left_point + (right_point - left_point) * pos;
+        return std::max(min_, std::min(rv, max_));
+    }
+    return max_;
+}
+
+double Histogram::Average() const {
+    return num_ == 0 ? 0 : sum_ / num_;
+}
+
+double Histogram::StandardDeviation() const {
+    if (num_ == 0) {
+        return 0;
+    }
+    auto variance = (sum_squares_ * num_ - sum_ * sum_) /
+                    (static_cast<double>(num_) * num_);
+    return sqrt(std::max(0.0, variance));
+}
+
+std::string Histogram::ToString() const {
+    return base::Strings::Sprintf("Count: %llu Average: %.4f StdDev: %.2f\n"
+                                  "Min: %.4f Max: %.4f\n"
+                                  "Percentiles: P50: %.2f P75: %.2f "
+                                  "P99: %.2f P99.9: %.2f P99.99: %.2f\n",
+                                  static_cast<unsigned long long>(num_),
+                                  Average(), StandardDeviation(),
+                                  num_ == 0 ? 0 : min_, max_,
+                                  Percentile(50), Percentile(75),
+                                  Percentile(99), Percentile(99.9),
+                                  Percentile(99.99));
+}
+
+} // namespace bench
+
+} // namespace yukino
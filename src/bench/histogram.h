@@ -0,0 +1,58 @@
+#ifndef YUKINO_BENCH_HISTOGRAM_H_
+#define YUKINO_BENCH_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace yukino {
+
+namespace bench {
+
+/**
+ * The latency histogram for benchmarks.
+ *
+ * Values (usually micros) be counted in buckets with exponential growing
+ * limits, so the memory is fixed, and percentiles be interpolated in bucket.
+ */
+class Histogram {
+public:
+    Histogram() { Clear(); }
+
+    void Clear();
+    void Add(double value);
+    void Merge(const Histogram &other);
+
+    /**
+     * @param p percent of values, in [0, 100].
+     * @return the approximate value, p% of values are less than it.
+     */
+    double Percentile(double p) const;
+
+    double Average() const;
+    double StandardDeviation() const;
+
+    double min() const { return min_; }
+    double max() const { return max_; }
+    uint64_t num() const { return num_; }
+
+    std::string ToString() const;
+
+    static const int kNumBuckets = 160;
+
+private:
+    static double BucketLimit(int i);
+
+    double min_;
+    double max_;
+    uint64_t num_;
+    double sum_;
+    double sum_squares_;
+
+    uint64_t buckets_[kNumBuckets];
+}; // class Histogram
+
+} // namespace bench
+
+} // namespace yukino
+
+#endif // YUKINO_BENCH_HISTOGRAM_H_
@@ -0,0 +1,676 @@
+#include "util/skiplist.h"
+#include "util/btree.h"
+#include "util/shared_ttree-inl.h"
+#include "util/shared_ttree.h"
+#include "util/area-inl.h"
+#include "util/area.h"
+#include "util/bloom_filter.h"
+#include "util/hashs.h"
+#include "yukino/comparator.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "base/crc32.h"
+#include "base/varint_encoding.h"
+#include "base/slice.h"
+#include "base/base.h"
+#include "glog/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the hot data structures and codecs. Every case is run
+// with growing iterations until it takes --min_time seconds, then reports:
+//
+//   name/arg...   ns/iteration   iterations   [items/s or bytes/s] [label]
+//
+// Cases:
+//
+//   skiplist/{insert,lookup,scan}/count/key_size
+//   btree/{insert,lookup,scan}/count/key_size/order
+//   ttree/{insert,lookup}/count/key_size
+//   area/{fixed,batch,mixed}/size_or_count  (malloc/* for the baseline)
+//   bloom/{add,probe}/bits_per_key          (probe label: false positive rate)
+//   crc32/bytes
+//   varint{32,64}/{encode,decode}/encoded_length
+//   hash/{js,bkdr,elf,ap,rs,djb}/bytes
+//
+// Usage:
+//
+//   micro_bench --filter=btree/ --min_time=1
+//
+// Build: the "micro_bench" target of the Xcode project or of CMakeLists.txt.
+
+namespace yukino {
+
+namespace bench {
+
+namespace {
+
+struct Flags {
+    std::string filter;      // substring of case name, empty: all
+    double min_time = 0.5;   // seconds
+    uint64_t seed = 301;
+} FLAGS;
+
+bool ParseFlag(const char *arg, Flags *flags) {
+    char buf[1024];
+    double d = 0;
+    long long n = 0;
+    char junk;
+
+    if (sscanf(arg, "--filter=%1023s", buf) == 1) {
+        flags->filter = buf;
+    } else if (sscanf(arg, "--min_time=%lf%c", &d, &junk) == 1) {
+        flags->min_time = d;
+    } else if (sscanf(arg, "--seed=%lld%c", &n, &junk) == 1) {
+        flags->seed = static_cast<uint64_t>(n);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline uint64_t NowNanos() {
+    using namespace std::chrono;
+
+    auto now = steady_clock::now();
+    return duration_cast<nanoseconds>(now.time_since_epoch()).count();
+}
+
+// Keep the result alive, so the compiler can not drop the measured code.
+template<class T>
+inline void DoNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class State : public base::DisableCopyAssign {
+public:
+    State(const std::vector<int64_t> &args, int64_t iterations)
+        : args_(args)
+        , iterations_(iterations) {
+    }
+
+    /**
+     * The measured loop: while (state->KeepRunning()) { ... }, the setup
+     * before the first call is not timed.
+     */
+    bool KeepRunning() {
+        if (count_ == 0) {
+            start_ = NowNanos();
+        }
+        if (count_ < iterations_) {
+            count_++;
+            return true;
+        }
+        elapsed_ = NowNanos() - start_;
+        return false;
+    }
+
+    int64_t arg(int i) const { return args_[i]; }
+    int64_t iterations() const { return iterations_; }
+    uint64_t elapsed_nanos() const { return elapsed_; }
+
+    void SetItemsProcessed(int64_t n) { items_ = n; }
+    int64_t items_processed() const { return items_; }
+
+    void SetBytesProcessed(int64_t n) { bytes_ = n; }
+    int64_t bytes_processed() const { return bytes_; }
+
+    void SetLabel(const std::string &label) { label_ = label; }
+    const std::string &label() const { return label_; }
+
+private:
+    const std::vector<int64_t> args_;
+    const int64_t iterations_;
+    int64_t count_ = 0;
+    uint64_t start_ = 0;
+    uint64_t elapsed_ = 0;
+
+    int64_t items_ = 0;
+    int64_t bytes_ = 0;
+    std::string label_;
+};
+
+struct Case {
+    std::string name;
+    std::function<void (State *)> fn;
+    std::vector<std::vector<int64_t>> args;
+};
+
+//------------------------------------------------------------------------------
+// Keys
+//------------------------------------------------------------------------------
+
+// Random unique keys in fixed size, the sequence is decided by --seed.
+std::vector<std::string> RandomKeys(int64_t count, int key_size,
+                                    uint64_t seed = FLAGS.seed) {
+    std::mt19937_64 rand(seed);
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (int64_t i = 0; i < count; ++i) {
+        // Prefix the index for uniqueness, the rest are random bytes.
+        auto key = base::Strings::Sprintf("%016" PRIx64, rand());
+        key.resize(key_size, 'x');
+        auto tail = base::Strings::Sprintf("%08" PRIx64, i);
+        if (key_size >= 8) {
+            key.replace(0, 8, tail.substr(tail.size() - 8));
+        }
+        keys.push_back(std::move(key));
+    }
+    return keys;
+}
+
+int StringCompare(const std::string &a, const std::string &b) {
+    return a.compare(b);
+}
+
+//------------------------------------------------------------------------------
+// util::SkipList
+//------------------------------------------------------------------------------
+
+typedef util::SkipList<std::string, std::function<int (const std::string &,
+                                                       const std::string &)>>
+        StringSkipList;
+
+void SkipListInsert(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    while (state->KeepRunning()) {
+        StringSkipList list(StringCompare);
+        for (auto key : keys) {
+            list.Put(std::move(key));
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+void SkipListLookup(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    StringSkipList list(StringCompare);
+    for (auto key : keys) {
+        list.Put(std::move(key));
+    }
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        DoNotOptimize(list.Contains(keys[i++ % keys.size()]));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+void SkipListScan(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    StringSkipList list(StringCompare);
+    for (auto key : keys) {
+        list.Put(std::move(key));
+    }
+
+    StringSkipList::Iterator iter(&list);
+    while (state->KeepRunning()) {
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+            DoNotOptimize(iter.key().data());
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+//------------------------------------------------------------------------------
+// util::BTree
+//------------------------------------------------------------------------------
+
+typedef util::BTree<std::string, std::function<int (const std::string &,
+                                                    const std::string &)>>
+        StringBTree;
+
+void BTreeInsert(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    auto order = static_cast<int>(state->arg(2));
+
+    std::string old;
+    while (state->KeepRunning()) {
+        StringBTree tree(order, StringCompare);
+        for (const auto &key : keys) {
+            tree.Put(key, &old);
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+void BTreeLookup(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    StringBTree tree(static_cast<int>(state->arg(2)), StringCompare);
+
+    std::string old;
+    for (const auto &key : keys) {
+        tree.Put(key, &old);
+    }
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        DoNotOptimize(std::get<1>(tree.FindGreaterOrEqual(keys[i++ % keys.size()])));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+void BTreeScan(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    StringBTree tree(static_cast<int>(state->arg(2)), StringCompare);
+
+    std::string old;
+    for (const auto &key : keys) {
+        tree.Put(key, &old);
+    }
+
+    StringBTree::Iterator iter(&tree);
+    while (state->KeepRunning()) {
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+            DoNotOptimize(iter.key().data());
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+//------------------------------------------------------------------------------
+// util::SharedTTree
+//------------------------------------------------------------------------------
+
+class TTreeFixture : public base::DisableCopyAssign {
+public:
+    enum { kPageSize = 4 * base::kKB, };
+
+    TTreeFixture(int64_t count, int key_size)
+        : size_(((count * (key_size + 16) * 3) / kPageSize + 16) * kPageSize)
+        , buf_(new char[size_])
+        , mmap_(":memory:", buf_.get(), size_)
+        , tree_(BytewiseCompartor(), kPageSize) {
+        ::memset(buf_.get(), 0, size_);
+        CHECK(tree_.Init(&mmap_).ok());
+    }
+
+    util::SharedTTree *tree() { return &tree_; }
+
+private:
+    const size_t size_;
+    std::unique_ptr<char[]> buf_;
+    base::MappedMemory mmap_;
+    util::SharedTTree tree_;
+};
+
+void TTreeInsert(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    while (state->KeepRunning()) {
+        TTreeFixture fixture(state->arg(0), static_cast<int>(state->arg(1)));
+
+        base::Status rs;
+        for (const auto &key : keys) {
+            fixture.tree()->Put(key, nullptr, &rs);
+        }
+        CHECK(rs.ok()) << rs.ToString();
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+void TTreeLookup(State *state) {
+    auto keys = RandomKeys(state->arg(0), static_cast<int>(state->arg(1)));
+    TTreeFixture fixture(state->arg(0), static_cast<int>(state->arg(1)));
+
+    base::Status rs;
+    for (const auto &key : keys) {
+        fixture.tree()->Put(key, nullptr, &rs);
+    }
+    CHECK(rs.ok()) << rs.ToString();
+
+    size_t i = 0;
+    base::Slice value;
+    std::string scratch;
+    while (state->KeepRunning()) {
+        DoNotOptimize(fixture.tree()->Get(keys[i++ % keys.size()], &value,
+                                          &scratch));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+//------------------------------------------------------------------------------
+// util::Area
+//------------------------------------------------------------------------------
+
+struct AreaAllocator {
+    util::Area area {4 * base::kKB};
+
+    void *Allocate(size_t size) { return area.Allocate(size); }
+    void Free(void *p) { area.Free(p); }
+};
+
+struct MallocAllocator {
+    void *Allocate(size_t size) { return ::malloc(size); }
+    void Free(void *p) { ::free(p); }
+};
+
+// Allocate and free the same size immediately.
+template<class T>
+void AllocFixed(State *state) {
+    T allocator;
+    auto size = static_cast<size_t>(state->arg(0));
+    while (state->KeepRunning()) {
+        auto p = allocator.Allocate(size);
+        DoNotOptimize(p);
+        allocator.Free(p);
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+// Allocate a batch of chunks, then free them all.
+template<class T>
+void AllocBatch(State *state) {
+    T allocator;
+    std::vector<void *> chunks(state->arg(0));
+    while (state->KeepRunning()) {
+        for (auto &p : chunks) {
+            p = allocator.Allocate(64);
+        }
+        for (auto p : chunks) {
+            allocator.Free(p);
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+// Random sizes and random free order, like keys in the memory table.
+template<class T>
+void AllocMixed(State *state) {
+    T allocator;
+    std::mt19937 rand(static_cast<uint32_t>(FLAGS.seed));
+
+    std::vector<size_t> sizes(state->arg(0));
+    for (auto &size : sizes) {
+        size = 8 + rand() % 1024;
+    }
+    std::vector<size_t> order(sizes.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), rand);
+
+    std::vector<void *> chunks(sizes.size());
+    while (state->KeepRunning()) {
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            chunks[i] = allocator.Allocate(sizes[i]);
+        }
+        for (auto i : order) {
+            allocator.Free(chunks[i]);
+        }
+    }
+    state->SetItemsProcessed(state->iterations() * state->arg(0));
+}
+
+//------------------------------------------------------------------------------
+// util::BloomFilter
+//------------------------------------------------------------------------------
+
+static const int64_t kBloomKeys = 100000;
+
+void BloomAdd(State *state) {
+    auto keys = RandomKeys(kBloomKeys, 16);
+    util::BloomFilter<> filter(static_cast<int>(kBloomKeys * state->arg(0)));
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        filter.Offer(keys[i++ % keys.size()]);
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+void BloomProbe(State *state) {
+    auto keys = RandomKeys(kBloomKeys, 16);
+    util::BloomFilter<> filter(static_cast<int>(kBloomKeys * state->arg(0)));
+    for (const auto &key : keys) {
+        filter.Offer(key);
+    }
+
+    // The other seed makes missing keys.
+    auto missing = RandomKeys(kBloomKeys, 16, FLAGS.seed + 1);
+    int64_t false_positive = 0;
+    for (const auto &key : missing) {
+        false_positive += filter.Test(key) ? 1 : 0;
+    }
+    state->SetLabel(base::Strings::Sprintf("fp=%.2f%%",
+        false_positive * 100.0 / missing.size()));
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        // Half hits and half misses.
+        auto j = i++;
+        DoNotOptimize(filter.Test(j % 2 ? keys[j % keys.size()]
+                                        : missing[j % missing.size()]));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+//------------------------------------------------------------------------------
+// base::CRC32
+//------------------------------------------------------------------------------
+
+void Checksum(State *state) {
+    std::string buf(state->arg(0), 'x');
+
+    base::CRC32 crc32;
+    while (state->KeepRunning()) {
+        crc32.Update(buf.data(), buf.size());
+        DoNotOptimize(crc32.digest());
+    }
+    state->SetBytesProcessed(state->iterations() * state->arg(0));
+}
+
+//------------------------------------------------------------------------------
+// base::Varint32/Varint64
+//------------------------------------------------------------------------------
+
+static const size_t kNumVarints = 1024;
+
+// Random values those encoded length are exactly len.
+template<class T>
+std::vector<T> VarintValues(int len) {
+    std::mt19937_64 rand(FLAGS.seed);
+    std::vector<T> values(kNumVarints);
+    for (auto &value : values) {
+        auto bits = std::min(7 * len, static_cast<int>(sizeof(T) * 8));
+        auto high = uint64_t(1) << (7 * (len - 1));
+        auto mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+        value = static_cast<T>((rand() & mask) | high);
+    }
+    return values;
+}
+
+template<class Codec, class T>
+void VarintEncode(State *state) {
+    auto values = VarintValues<T>(static_cast<int>(state->arg(0)));
+    char buf[Codec::kMaxLen];
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        DoNotOptimize(Codec::Encode(buf, values[i++ % kNumVarints]));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+template<class Codec, class T>
+void VarintDecode(State *state) {
+    auto values = VarintValues<T>(static_cast<int>(state->arg(0)));
+    std::string buf(kNumVarints * Codec::kMaxLen, 0);
+    std::vector<size_t> offsets;
+    size_t offset = 0;
+    for (auto value : values) {
+        offsets.push_back(offset);
+        offset += Codec::Encode(&buf[offset], value);
+    }
+
+    size_t i = 0, len = 0;
+    while (state->KeepRunning()) {
+        DoNotOptimize(Codec::Decode(&buf[offsets[i++ % kNumVarints]], &len));
+    }
+    state->SetItemsProcessed(state->iterations());
+}
+
+//------------------------------------------------------------------------------
+// util::StringHash
+//------------------------------------------------------------------------------
+
+template<uint32_t (*Hash)(const char *, size_t)>
+void HashString(State *state) {
+    auto keys = RandomKeys(1024, static_cast<int>(state->arg(0)));
+
+    size_t i = 0;
+    while (state->KeepRunning()) {
+        const auto &key = keys[i++ % keys.size()];
+        DoNotOptimize(Hash(key.data(), key.size()));
+    }
+    state->SetBytesProcessed(state->iterations() * state->arg(0));
+}
+
+//------------------------------------------------------------------------------
+// Runner
+//------------------------------------------------------------------------------
+
+std::vector<Case> AllCases() {
+    typedef std::vector<std::vector<int64_t>> Args;
+
+    const Args kTreeArgs       = {{1000, 16}, {100000, 16}, {100000, 64}};
+    const Args kTreeLookupArgs = {{100000, 16}, {1000000, 16}, {100000, 64}};
+    const Args kBTreeArgs      = {{100000, 16, 32}, {100000, 16, 128},
+                                  {100000, 64, 128}};
+    const Args kTTreeArgs      = {{10000, 16}, {10000, 64}};
+
+    using util::StringHash;
+    return std::vector<Case> {
+        {"skiplist/insert",  SkipListInsert, kTreeArgs},
+        {"skiplist/lookup",  SkipListLookup, kTreeLookupArgs},
+        {"skiplist/scan",    SkipListScan, kTreeArgs},
+
+        {"btree/insert",     BTreeInsert, kBTreeArgs},
+        {"btree/lookup",     BTreeLookup, kBTreeArgs},
+        {"btree/scan",       BTreeScan, kBTreeArgs},
+
+        {"ttree/insert",     TTreeInsert, kTTreeArgs},
+        {"ttree/lookup",     TTreeLookup, kTTreeArgs},
+
+        {"area/fixed",       AllocFixed<AreaAllocator>, {{16}, {128}, {1024}}},
+        {"malloc/fixed",     AllocFixed<MallocAllocator>, {{16}, {128}, {1024}}},
+        {"area/batch",       AllocBatch<AreaAllocator>, {{1000}, {100000}}},
+        {"malloc/batch",     AllocBatch<MallocAllocator>, {{1000}, {100000}}},
+        {"area/mixed",       AllocMixed<AreaAllocator>, {{1000}, {100000}}},
+        {"malloc/mixed",     AllocMixed<MallocAllocator>, {{1000}, {100000}}},
+
+        {"bloom/add",        BloomAdd, {{8}, {16}}},
+        {"bloom/probe",      BloomProbe, {{8}, {10}, {16}}},
+
+        {"crc32",            Checksum, {{64}, {4096}, {1024 * 1024}}},
+
+        {"varint32/encode",  VarintEncode<base::Varint32, uint32_t>, {{1}, {3}, {5}}},
+        {"varint32/decode",  VarintDecode<base::Varint32, uint32_t>, {{1}, {3}, {5}}},
+        {"varint64/encode",  VarintEncode<base::Varint64, uint64_t>, {{1}, {5}, {10}}},
+        {"varint64/decode",  VarintDecode<base::Varint64, uint64_t>, {{1}, {5}, {10}}},
+
+        {"hash/js",          HashString<StringHash::JS>, {{16}, {256}}},
+        {"hash/bkdr",        HashString<StringHash::BKDR>, {{16}, {256}}},
+        {"hash/elf",         HashString<StringHash::ELF>, {{16}, {256}}},
+        {"hash/ap",          HashString<StringHash::AP>, {{16}, {256}}},
+        {"hash/rs",          HashString<StringHash::RS>, {{16}, {256}}},
+        {"hash/djb",         HashString<StringHash::DJB>, {{16}, {256}}},
+    };
+}
+
+std::string FormatRate(double n, const char *unit) {
+    static const char *kPrefixes[] = {"", "k", "M", "G", "T"};
+    static const int kNumPrefixes = sizeof(kPrefixes) / sizeof(kPrefixes[0]);
+
+    auto i = 0;
+    while (n >= 1000 && i < kNumPrefixes - 1) {
+        n /= 1000;
+        i++;
+    }
+    return base::Strings::Sprintf("%.2f %s%s/s", n, kPrefixes[i], unit);
+}
+
+void RunCase(const Case &c, const std::vector<int64_t> &args) {
+    auto name = c.name;
+    for (auto arg : args) {
+        name.append(base::Strings::Sprintf("/%" PRId64, arg));
+    }
+    if (!FLAGS.filter.empty() && name.find(FLAGS.filter) == std::string::npos) {
+        return;
+    }
+
+    // Grow the iterations until the case takes min_time.
+    const uint64_t min_nanos = static_cast<uint64_t>(FLAGS.min_time * 1e9);
+    int64_t iterations = 1;
+    for (;;) {
+        State state(args, iterations);
+        c.fn(&state);
+
+        auto elapsed = std::max<uint64_t>(state.elapsed_nanos(), 1);
+        if (elapsed >= min_nanos || iterations >= 1000000000LL) {
+            std::string rate;
+            auto seconds = elapsed / 1e9;
+            if (state.bytes_processed() > 0) {
+                rate = FormatRate(state.bytes_processed() / seconds, "B");
+            } else if (state.items_processed() > 0) {
+                rate = FormatRate(state.items_processed() / seconds, "item");
+            }
+            fprintf(stdout, "%-32s %14.1f ns %12" PRId64 " %18s %s\n",
+                    name.c_str(), static_cast<double>(elapsed) / iterations,
+                    iterations, rate.c_str(), state.label().c_str());
+            fflush(stdout);
+            return;
+        }
+
+        // Predict the iterations with 40% more, but grow at most 10x.
+        auto predicted = static_cast<double>(min_nanos) * 1.4 / elapsed *
+                         iterations;
+        iterations = std::max(iterations + 1,
+                              std::min(static_cast<int64_t>(predicted),
+                                       iterations * 10));
+    }
+}
+
+} // namespace
+
+} // namespace bench
+
+} // namespace yukino
+
+int main(int argc, char *argv[]) {
+    using yukino::bench::FLAGS;
+
+    google::InitGoogleLogging(argv[0]);
+    for (auto i = 1; i < argc; ++i) {
+        if (!yukino::bench::ParseFlag(argv[i], &FLAGS)) {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS.min_time <= 0) {
+        fprintf(stderr, "Invalid flags value\n");
+        return 1;
+    }
+
+#if !defined(NDEBUG)
+    fprintf(stdout, "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    fprintf(stdout, "%-32s %17s %12s %18s\n", "Case", "Time", "Iterations",
+            "Rate");
+    fprintf(stdout, "------------------------------------------------"
+                    "------------------------------------\n");
+    for (const auto &c : yukino::bench::AllCases()) {
+        for (const auto &args : c.args) {
+            yukino::bench::RunCase(c, args);
+        }
+    }
+    return 0;
+}
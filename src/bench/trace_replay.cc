@@ -0,0 +1,134 @@
+#include "lsm/db_impl.h"
+#include "balance/db_impl.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/options.h"
+#include "yukino/trace.h"
+#include "base/base.h"
+#include "glog/logging.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <memory>
+#include <string>
+
+// Re-issue a trace recorded by DB::StartTrace() against any engine.
+//
+// Usage:
+//
+//   trace_replay --trace=/tmp/yukino.trace --engine=balance --threads=8
+//
+// --speed=1 replays at the recorded speed, --speed=10 ten times faster, and
+// --speed=0 as fast as possible. The db be destroyed first, unless
+// --use_existing_db=1.
+
+namespace yukino {
+
+namespace bench {
+
+namespace {
+
+struct Flags {
+    std::string trace;
+    std::string engine = lsm::DBImpl::kName;
+    std::string db = "/tmp/yukino_replay";
+    int threads = 1;
+    double speed = 1.0;
+    bool use_existing_db = false;
+} FLAGS;
+
+bool ParseFlag(const char *arg, Flags *flags) {
+    char buf[1024];
+    long long n = 0;
+    double d = 0;
+    char junk;
+
+    if (sscanf(arg, "--trace=%1023s", buf) == 1) {
+        flags->trace = buf;
+    } else if (sscanf(arg, "--engine=%1023s", buf) == 1) {
+        flags->engine = buf;
+        if (flags->engine == "lsm") {
+            flags->engine = lsm::DBImpl::kName;
+        } else if (flags->engine == "balance") {
+            flags->engine = balance::DBImpl::kName;
+        }
+    } else if (sscanf(arg, "--db=%1023s", buf) == 1) {
+        flags->db = buf;
+    } else if (sscanf(arg, "--threads=%lld%c", &n, &junk) == 1) {
+        flags->threads = static_cast<int>(n);
+    } else if (sscanf(arg, "--speed=%lf%c", &d, &junk) == 1) {
+        flags->speed = d;
+    } else if (sscanf(arg, "--use_existing_db=%lld%c", &n, &junk) == 1) {
+        flags->use_existing_db = (n != 0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+} // namespace bench
+
+} // namespace yukino
+
+int main(int argc, char *argv[]) {
+    using namespace yukino;
+    using yukino::bench::FLAGS;
+
+    google::InitGoogleLogging(argv[0]);
+    for (auto i = 1; i < argc; ++i) {
+        if (!yukino::bench::ParseFlag(argv[i], &FLAGS)) {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS.trace.empty() || FLAGS.threads <= 0 || FLAGS.speed < 0) {
+        fprintf(stderr, "Invalid flags value\n");
+        return 1;
+    }
+
+    if (!FLAGS.use_existing_db) {
+        Env::Default()->DeleteFile(FLAGS.db, true);
+    }
+
+    Options options;
+    options.create_if_missing = true;
+    options.engine_name = FLAGS.engine.c_str();
+
+    DB *db = nullptr;
+    auto rs = DB::Open(options, FLAGS.db, &db);
+    if (!rs.ok()) {
+        fprintf(stderr, "open error: %s\n", rs.ToString().c_str());
+        return 1;
+    }
+    std::unique_ptr<DB> holder(db);
+
+    fprintf(stdout, "Engine:     %s\n", FLAGS.engine.c_str());
+    fprintf(stdout, "Trace:      %s\n", FLAGS.trace.c_str());
+    fprintf(stdout, "Threads:    %d\n", FLAGS.threads);
+    fprintf(stdout, "Speed:      %g\n", FLAGS.speed);
+#if !defined(NDEBUG)
+    fprintf(stdout, "WARNING: Assertions are enabled; "
+            "benchmarks unnecessarily slow\n");
+#endif
+
+    ReplayOptions replay_options;
+    replay_options.threads = FLAGS.threads;
+    replay_options.speed   = FLAGS.speed;
+
+    ReplayStats stats;
+    rs = ReplayTrace(db, Env::Default(), FLAGS.trace, replay_options, &stats);
+    if (!rs.ok()) {
+        fprintf(stderr, "replay error: %s\n", rs.ToString().c_str());
+    }
+
+    auto ops = stats.writes + stats.gets + stats.seeks;
+    auto seconds = stats.micros / 1e6;
+    fprintf(stdout, "writes: %" PRIu64 ", gets: %" PRIu64 ", seeks: %" PRIu64
+            "\n", stats.writes, stats.gets, stats.seeks);
+    fprintf(stdout, "not found: %" PRIu64 ", failed: %" PRIu64 "\n",
+            stats.not_found, stats.failed);
+    fprintf(stdout, "%" PRIu64 " ops in %.3f seconds, %.1f ops/sec\n", ops,
+            seconds, seconds > 0 ? ops / seconds : 0.0);
+    return rs.ok() ? 0 : 1;
+}
@@ -0,0 +1,587 @@
+#include "bench/histogram.h"
+#include "lsm/db_impl.h"
+#include "balance/db_impl.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/iterator.h"
+#include "yukino/options.h"
+#include "yukino/write_batch.h"
+#include "base/slice.h"
+#include "base/base.h"
+#include "glog/logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// YCSB core workloads:
+//
+//   a -- update heavy:     50% read, 50% update,            zipfian
+//   b -- read mostly:      95% read, 5% update,             zipfian
+//   c -- read only:        100% read,                       zipfian
+//   d -- read latest:      95% read, 5% insert,             latest
+//   e -- short ranges:     95% scan, 5% insert,             zipfian
+//   f -- read-modify-write: 50% read, 50% read-modify-write, zipfian
+//
+// Usage:
+//
+//   ycsb --engine=balance --workloads=a,b,c --records=100000 --threads=8
+//
+// The records be loaded first (unless --use_existing_db=1), then every
+// workload runs --warmup_seconds without recording, then --operations.
+// Throughput be reported every --report_interval seconds. With --trace=path
+// the workloads (not the loading) be recorded for the trace_replay.
+
+namespace yukino {
+
+namespace bench {
+
+namespace {
+
+struct Flags {
+    std::string workloads = "a,b,c,d,e,f";
+    std::string engine = lsm::DBImpl::kName;
+    std::string db = "/tmp/yukino_ycsb";
+    std::string distribution; // empty: workload's default
+    std::string trace;        // record the workloads into the trace file
+    int64_t records = 100000;
+    int64_t operations = 100000;
+    int threads = 4;
+    int value_size = 100;
+    int max_scan_length = 100;
+    double zipfian_constant = 0.99;
+    int warmup_seconds = 1;
+    int report_interval = 1;
+    bool sync = false;
+    bool use_existing_db = false;
+    uint64_t seed = 301;
+} FLAGS;
+
+bool ParseFlag(const char *arg, Flags *flags) {
+    char buf[1024];
+    long long n = 0;
+    double d = 0;
+    char junk;
+
+    if (sscanf(arg, "--workloads=%1023s", buf) == 1) {
+        flags->workloads = buf;
+    } else if (sscanf(arg, "--engine=%1023s", buf) == 1) {
+        flags->engine = buf;
+        if (flags->engine == "lsm") {
+            flags->engine = lsm::DBImpl::kName;
+        } else if (flags->engine == "balance") {
+            flags->engine = balance::DBImpl::kName;
+        }
+    } else if (sscanf(arg, "--db=%1023s", buf) == 1) {
+        flags->db = buf;
+    } else if (sscanf(arg, "--distribution=%1023s", buf) == 1) {
+        flags->distribution = buf;
+    } else if (sscanf(arg, "--trace=%1023s", buf) == 1) {
+        flags->trace = buf;
+    } else if (sscanf(arg, "--records=%lld%c", &n, &junk) == 1) {
+        flags->records = n;
+    } else if (sscanf(arg, "--operations=%lld%c", &n, &junk) == 1) {
+        flags->operations = n;
+    } else if (sscanf(arg, "--threads=%lld%c", &n, &junk) == 1) {
+        flags->threads = static_cast<int>(n);
+    } else if (sscanf(arg, "--value_size=%lld%c", &n, &junk) == 1) {
+        flags->value_size = static_cast<int>(n);
+    } else if (sscanf(arg, "--max_scan_length=%lld%c", &n, &junk) == 1) {
+        flags->max_scan_length = static_cast<int>(n);
+    } else if (sscanf(arg, "--zipfian_constant=%lf%c", &d, &junk) == 1) {
+        flags->zipfian_constant = d;
+    } else if (sscanf(arg, "--warmup_seconds=%lld%c", &n, &junk) == 1) {
+        flags->warmup_seconds = static_cast<int>(n);
+    } else if (sscanf(arg, "--report_interval=%lld%c", &n, &junk) == 1) {
+        flags->report_interval = static_cast<int>(n);
+    } else if (sscanf(arg, "--sync=%lld%c", &n, &junk) == 1) {
+        flags->sync = (n != 0);
+    } else if (sscanf(arg, "--use_existing_db=%lld%c", &n, &junk) == 1) {
+        flags->use_existing_db = (n != 0);
+    } else if (sscanf(arg, "--seed=%lld%c", &n, &junk) == 1) {
+        flags->seed = static_cast<uint64_t>(n);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline uint64_t NowMicros() {
+    using namespace std::chrono;
+
+    auto now = steady_clock::now();
+    return duration_cast<microseconds>(now.time_since_epoch()).count();
+}
+
+inline uint64_t FNVHash64(uint64_t value) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto i = 0; i < 8; ++i) {
+        hash ^= (value & 0xff);
+        hash *= 1099511628211ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+/**
+ * Zipfian distribution over [0, items), item 0 is the most popular one.
+ *
+ * From "Quickly Generating Billion-Record Synthetic Databases", Jim Gray et
+ * al, SIGMOD 1994, as YCSB does. The number of items can grow, the zeta be
+ * updated incrementally.
+ */
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t items, double theta)
+        : theta_(theta)
+        , alpha_(1.0 / (1.0 - theta))
+        , zeta2_(Zeta(0, 2, theta, 0)) {
+        Grow(items);
+    }
+
+    uint64_t Next(std::mt19937_64 *rnd, uint64_t items) {
+        if (items > items_) {
+            Grow(items);
+        }
+
+        auto u  = std::uniform_real_distribution<double>(0, 1)(*rnd);
+        auto uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, theta_)) {
+            return 1;
+        }
+        auto rv = static_cast<uint64_t>(items_ *
+                                        pow(eta_ * u - eta_ + 1, alpha_));
+        return std::min(rv, items_ - 1);
+    }
+
+private:
+    static double Zeta(uint64_t from, uint64_t to, double theta,
+                       double initial) {
+        auto sum = initial;
+        for (auto i = from; i < to; ++i) {
+            sum += 1 / pow(i + 1, theta);
+        }
+        return sum;
+    }
+
+    void Grow(uint64_t items) {
+        zetan_ = Zeta(items_, items, theta_, zetan_);
+        items_ = items;
+        eta_   = (1 - pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+
+    const double theta_;
+    const double alpha_;
+    const double zeta2_;
+    uint64_t items_ = 0;
+    double zetan_ = 0;
+    double eta_ = 0;
+};
+
+enum Distribution {
+    kUniform,
+    kZipfian,
+    kLatest,
+};
+
+enum Operation {
+    kRead,
+    kUpdate,
+    kInsert,
+    kScan,
+    kReadModifyWrite,
+    kMaxOperation,
+};
+
+const char *kOperationNames[kMaxOperation] = {
+    "READ", "UPDATE", "INSERT", "SCAN", "READ-MODIFY-WRITE",
+};
+
+struct Workload {
+    char name;
+    double proportions[kMaxOperation];
+    Distribution distribution;
+};
+
+const Workload kWorkloads[] = {
+    {'a', {0.50, 0.50, 0,    0,    0},    kZipfian},
+    {'b', {0.95, 0.05, 0,    0,    0},    kZipfian},
+    {'c', {1.00, 0,    0,    0,    0},    kZipfian},
+    {'d', {0.95, 0,    0.05, 0,    0},    kLatest},
+    {'e', {0,    0,    0.05, 0.95, 0},    kZipfian},
+    {'f', {0.50, 0,    0,    0,    0.50}, kZipfian},
+};
+
+struct ThreadState {
+    std::mt19937_64 rand;
+    ZipfianGenerator zipfian;
+    Histogram hist[kMaxOperation];
+    std::string value;
+    int64_t failed = 0;
+
+    ThreadState(int index, uint64_t seed, uint64_t items)
+        : rand(seed + index)
+        , zipfian(items, FLAGS.zipfian_constant) {
+    }
+};
+
+class Driver {
+public:
+    Driver() {
+        if (!FLAGS.use_existing_db) {
+            Env::Default()->DeleteFile(FLAGS.db, true);
+        }
+
+        Options options;
+        options.engine_name = FLAGS.engine.c_str();
+        options.create_if_missing = true;
+        auto rs = DB::Open(options, FLAGS.db, &db_);
+        if (!rs.ok()) {
+            fprintf(stderr, "open error: %s\n", rs.ToString().c_str());
+            exit(1);
+        }
+
+        write_options_.sync = FLAGS.sync;
+        inserted_.store(FLAGS.records, std::memory_order_relaxed);
+        next_insert_.store(FLAGS.records, std::memory_order_relaxed);
+    }
+
+    ~Driver() { delete db_; }
+
+    void StartTrace() {
+        auto rs = db_->StartTrace(FLAGS.trace);
+        if (!rs.ok()) {
+            fprintf(stderr, "trace error: %s\n", rs.ToString().c_str());
+            exit(1);
+        }
+        fprintf(stdout, "Tracing workloads to %s\n", FLAGS.trace.c_str());
+    }
+
+    void Load() {
+        fprintf(stdout, "Loading %" PRId64 " records...\n", FLAGS.records);
+
+        std::atomic<int64_t> next(0);
+        auto start = NowMicros();
+        RunThreads([this, &next](ThreadState *state) {
+            int64_t i;
+            while ((i = next.fetch_add(1)) < FLAGS.records) {
+                Insert(state, i);
+            }
+        });
+
+        auto elapsed = (NowMicros() - start) * 1e-6;
+        fprintf(stdout, "Loaded in %.2f s, %.0f ops/sec\n", elapsed,
+                FLAGS.records / elapsed);
+    }
+
+    void Run(const Workload &workload) {
+        workload_ = &workload;
+        distribution_ = workload.distribution;
+        if (FLAGS.distribution == "uniform") {
+            distribution_ = kUniform;
+        } else if (FLAGS.distribution == "zipfian") {
+            distribution_ = kZipfian;
+        } else if (FLAGS.distribution == "latest") {
+            distribution_ = kLatest;
+        }
+
+        fprintf(stdout, "------------------------------------------------\n");
+        fprintf(stdout, "Workload %c: %" PRId64 " operations, %d threads\n",
+                workload.name, FLAGS.operations, FLAGS.threads);
+        fflush(stdout);
+
+        // Warm up: run the workload for a while, without recording.
+        if (FLAGS.warmup_seconds > 0) {
+            auto deadline = NowMicros() + FLAGS.warmup_seconds * 1000000ULL;
+            RunThreads([this, deadline](ThreadState *state) {
+                while (NowMicros() < deadline) {
+                    DoOperation(state, false);
+                }
+            });
+        }
+
+        std::atomic<int64_t> next(0);
+        std::atomic<bool> done(false);
+        done_ops_.store(0, std::memory_order_relaxed);
+
+        auto start = NowMicros();
+        std::thread reporter([this, &done, start]() {
+            ReportTimeSeries(&done, start);
+        });
+
+        std::vector<std::unique_ptr<ThreadState>> states;
+        RunThreads([this, &next](ThreadState *state) {
+            while (next.fetch_add(1) < FLAGS.operations) {
+                DoOperation(state, true);
+                done_ops_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }, &states);
+
+        auto elapsed = (NowMicros() - start) * 1e-6;
+        done.store(true, std::memory_order_release);
+        reporter.join();
+
+        fprintf(stdout, "[OVERALL] RunTime(s): %.3f\n", elapsed);
+        fprintf(stdout, "[OVERALL] Throughput(ops/sec): %.0f\n",
+                FLAGS.operations / elapsed);
+
+        int64_t failed = 0;
+        for (auto i = 0; i < kMaxOperation; ++i) {
+            Histogram hist;
+            for (const auto &state : states) {
+                hist.Merge(state->hist[i]);
+            }
+            if (hist.num() == 0) {
+                continue;
+            }
+            fprintf(stdout, "[%s] Operations: %" PRIu64 " Average(us): %.2f "
+                    "P50(us): %.2f P99(us): %.2f P99.9(us): %.2f "
+                    "Max(us): %.0f\n", kOperationNames[i], hist.num(),
+                    hist.Average(), hist.Percentile(50), hist.Percentile(99),
+                    hist.Percentile(99.9), hist.max());
+        }
+        for (const auto &state : states) {
+            failed += state->failed;
+        }
+        if (failed > 0) {
+            fprintf(stdout, "[OVERALL] Failed: %" PRId64 "\n", failed);
+        }
+        fflush(stdout);
+    }
+
+private:
+    template<class Callback>
+    void RunThreads(Callback callback,
+                    std::vector<std::unique_ptr<ThreadState>> *rv = nullptr) {
+        std::vector<std::unique_ptr<ThreadState>> states;
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < FLAGS.threads; ++i) {
+            auto items = std::max<uint64_t>(1, inserted_.load());
+            states.emplace_back(new ThreadState(i, FLAGS.seed, items));
+        }
+        for (auto i = 0; i < FLAGS.threads; ++i) {
+            auto state = states[i].get();
+            threads.emplace_back([&callback, state]() { callback(state); });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        if (rv) {
+            rv->swap(states);
+        }
+    }
+
+    void ReportTimeSeries(std::atomic<bool> *done, uint64_t start) {
+        const auto interval = std::max(1, FLAGS.report_interval) * 1000000ULL;
+
+        auto next = start + interval;
+        int64_t last_ops = 0;
+        while (!done->load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            auto now = NowMicros();
+            if (now < next) {
+                continue;
+            }
+
+            auto ops = done_ops_.load(std::memory_order_relaxed);
+            fprintf(stdout, "%4" PRIu64 " sec: %" PRId64 " operations; "
+                    "%.0f current ops/sec\n", (now - start) / 1000000, ops,
+                    (ops - last_ops) * 1e6 / (now - next + interval));
+            fflush(stdout);
+            last_ops = ops;
+            next = now + interval;
+        }
+    }
+
+    std::string MakeKey(uint64_t keynum) const {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "user%020" PRIu64, FNVHash64(keynum));
+        return buf;
+    }
+
+    uint64_t NextKeyNum(ThreadState *state) {
+        auto items = std::max<uint64_t>(1, inserted_.load(
+                                               std::memory_order_acquire));
+        switch (distribution_) {
+            case kUniform:
+                return state->rand() % items;
+            case kZipfian:
+                return state->zipfian.Next(&state->rand, items);
+            case kLatest:
+                return items - 1 - state->zipfian.Next(&state->rand, items);
+            default:
+                DCHECK(false) << "Noreached";
+                return 0;
+        }
+    }
+
+    const std::string &NextValue(ThreadState *state) {
+        state->value.resize(FLAGS.value_size);
+        for (auto &c : state->value) {
+            c = static_cast<char>('a' + state->rand() % 26);
+        }
+        return state->value;
+    }
+
+    Operation NextOperation(ThreadState *state) const {
+        auto p = std::uniform_real_distribution<double>(0, 1)(state->rand);
+        for (auto i = 0; i < kMaxOperation; ++i) {
+            if (p < workload_->proportions[i]) {
+                return static_cast<Operation>(i);
+            }
+            p -= workload_->proportions[i];
+        }
+        return kRead;
+    }
+
+    void DoOperation(ThreadState *state, bool recording) {
+        auto op = NextOperation(state);
+
+        auto start = NowMicros();
+        bool ok = true;
+        switch (op) {
+            case kRead:
+                ok = Read(state, NextKeyNum(state));
+                break;
+            case kUpdate:
+                ok = Update(state, NextKeyNum(state));
+                break;
+            case kInsert:
+                ok = Insert(state, next_insert_.fetch_add(1));
+                break;
+            case kScan:
+                ok = Scan(state, NextKeyNum(state));
+                break;
+            case kReadModifyWrite: {
+                auto keynum = NextKeyNum(state);
+                ok = Read(state, keynum) && Update(state, keynum);
+            } break;
+            default:
+                DCHECK(false) << "Noreached";
+                break;
+        }
+        if (recording) {
+            state->hist[op].Add(static_cast<double>(NowMicros() - start));
+            if (!ok) {
+                state->failed++;
+            }
+        }
+    }
+
+    bool Read(ThreadState *state, uint64_t keynum) {
+        std::string value;
+        auto rs = db_->Get(ReadOptions(), MakeKey(keynum), &value);
+        return rs.ok() || rs.IsNotFound();
+    }
+
+    bool Update(ThreadState *state, uint64_t keynum) {
+        return db_->Put(write_options_, MakeKey(keynum),
+                        NextValue(state)).ok();
+    }
+
+    bool Insert(ThreadState *state, uint64_t keynum) {
+        auto rs = db_->Put(write_options_, MakeKey(keynum), NextValue(state));
+
+        // Acknowledge the inserted key, the inserting is almost in order.
+        auto inserted = inserted_.load(std::memory_order_relaxed);
+        while (inserted < keynum + 1 &&
+               !inserted_.compare_exchange_weak(inserted, keynum + 1)) {
+        }
+        return rs.ok();
+    }
+
+    bool Scan(ThreadState *state, uint64_t keynum) {
+        std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+        if (!iter) {
+            // The engine has no iterator.
+            return false;
+        }
+
+        auto len = 1 + state->rand() % FLAGS.max_scan_length;
+        iter->Seek(MakeKey(keynum));
+        for (uint64_t i = 0; i < len && iter->Valid(); ++i) {
+            iter->Next();
+        }
+        return iter->status().ok();
+    }
+
+    DB *db_ = nullptr;
+    WriteOptions write_options_;
+
+    const Workload *workload_ = nullptr;
+    Distribution distribution_ = kZipfian;
+
+    std::atomic<uint64_t> inserted_;
+    std::atomic<uint64_t> next_insert_;
+    std::atomic<int64_t> done_ops_;
+};
+
+} // namespace
+
+} // namespace bench
+
+} // namespace yukino
+
+int main(int argc, char *argv[]) {
+    using yukino::bench::FLAGS;
+    using yukino::bench::kWorkloads;
+
+    google::InitGoogleLogging(argv[0]);
+    for (auto i = 1; i < argc; ++i) {
+        if (!yukino::bench::ParseFlag(argv[i], &FLAGS)) {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    if (FLAGS.records <= 0 || FLAGS.threads <= 0 || FLAGS.operations < 0 ||
+        FLAGS.value_size < 0 || FLAGS.max_scan_length <= 0 ||
+        FLAGS.zipfian_constant <= 0 || FLAGS.zipfian_constant >= 1) {
+        fprintf(stderr, "Invalid flags value\n");
+        return 1;
+    }
+
+    fprintf(stdout, "Engine:     %s\n", FLAGS.engine.c_str());
+    fprintf(stdout, "Records:    %" PRId64 "\n", FLAGS.records);
+    fprintf(stdout, "Values:     %d bytes each\n", FLAGS.value_size);
+#if !defined(NDEBUG)
+    fprintf(stdout, "WARNING: Assertions are enabled; "
+            "benchmarks unnecessarily slow\n");
+#endif
+
+    yukino::bench::Driver driver;
+    if (!FLAGS.use_existing_db) {
+        driver.Load();
+    }
+    if (!FLAGS.trace.empty()) {
+        driver.StartTrace();
+    }
+    for (auto c : FLAGS.workloads) {
+        if (c == ',') {
+            continue;
+        }
+
+        auto found = false;
+        for (const auto &workload : kWorkloads) {
+            if (workload.name == c) {
+                driver.Run(workload);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "unknown workload '%c'\n", c);
+        }
+    }
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "lsm/block.h"
 #include "lsm/chunk.h"
 #include "yukino/comparator.h"
+#include "yukino/perf_context-inl.h"
 #include "base/io-inl.h"
 #include "base/io.h"
 #include "base/crc32.h"
@@ -258,6 +259,8 @@ void BlockIterator::SeekToLast() {
 }
 
 void BlockIterator::Seek(const base::Slice& target) {
+    PERF_COUNTER_ADD(block_seek_count, 1);
+
     bool found = false;
     int32_t i;
     Pair pair;
@@ -343,6 +346,7 @@ const uint8_t *BlockIterator::PrepareRead(size_t i) {
 
     auto entry = base_ + restarts_[i];
     auto end   = (i == num_restarts_ - 1) ? data_end_ : base_ + restarts_[i+1];
+    PERF_COUNTER_ADD(block_decode_byte, end - entry);
 
     Pair pair;
     std::string last_key;
@@ -22,6 +22,10 @@ static const uint8_t kFlagValue    = 0;
 static const uint8_t kFlagDeletion = 1;
 static const uint8_t kFlagValueForSeek = kFlagValue;
 
+// The version of all keys in the sst files built by SstFileWriter, the real
+// version be assigned on ingestion, see FileMetadata::global_version.
+static const uint64_t kExternalFileVersion = 0;
+
 static const uint32_t kFileVersion = 0x00010001;
 static const uint32_t kMagicNumber = 0xa000000a;
 static const int kRestartInterval = 32;
@@ -2,9 +2,11 @@
 #define YUKINO_LSM_CHUNK_H_
 
 #include "lsm/format.h"
+#include "base/status.h"
 #include "base/slice.h"
 #include "base/base.h"
 #include <memory>
+#include <string>
 
 namespace yukino {
 
@@ -98,6 +100,24 @@ private:
 
 static_assert(sizeof(InternalKey) == sizeof(Chunk), "Fixed subclass size.");
 
+/**
+ * One key of the MultiGet(), the lookups are sorted by user key, and be
+ * probed from the newest memory table to the sst files.
+ */
+struct KeyLookup {
+    KeyLookup(InternalKey &&lookup_key, std::string *rv_value,
+              base::Status *rv_status)
+        : key(std::move(lookup_key))
+        , value(rv_value)
+        , status(rv_status) {
+    }
+
+    InternalKey   key;     // the user key and the read version.
+    std::string  *value;
+    base::Status *status;
+    bool          done = false; // the value or deletion has be found.
+};
+
 } // namespace lsm
 
 } // namespace yukino
@@ -11,6 +11,7 @@
 #include "yukino/options.h"
 #include "yukino/iterator.h"
 #include "glog/logging.h"
+#include <algorithm>
 
 namespace yukino {
 
@@ -27,16 +28,31 @@ Compaction::Compaction(const std::string &db_name,
 Compaction::~Compaction() {
 }
 
-base::Status Compaction::AddOriginFile(uint64_t number, uint64_t size) {
-    std::unique_ptr<Iterator> iter(cache_->CreateIterator(ReadOptions(), number,
-                                                          size));
+base::Status Compaction::AddOriginFile(uint64_t number, uint64_t size,
+                                       uint64_t global_version) {
+    std::unique_ptr<Iterator> iter(
+        cache_->CreateCompactionIterator(number, size, global_version));
     if (!iter->status().ok()) {
         return iter->status();
     }
     AddOriginIterator(iter.release());
+    origin_file_numbers_.insert(number);
     return base::Status::OK();
 }
 
+void Compaction::AddMovedFile(uint64_t number, uint64_t size) {
+    DCHECK(origin_iters_.empty());
+    origin_file_numbers_.insert(number);
+    origin_size_ += size;
+    target_size_ += size;
+    trivial_move_ = true;
+}
+
+void Compaction::AddUnderlyingRange(const base::Slice &smallest,
+                                    const base::Slice &largest) {
+    underlying_ranges_.emplace_back(smallest.ToString(), largest.ToString());
+}
+
 base::Status Compaction::Compact(TableBuilder *builder) {
     DCHECK_NOTNULL(builder);
 
@@ -55,30 +71,57 @@ base::Status Compaction::Compact(TableBuilder *builder) {
 
     origin_size_ = 0;
     target_size_ = 0;
-    base::Slice deletion_key;
+    records_in_ = 0;
+    records_dropped_ = 0;
+
+    auto ucmp = comparator_.delegated();
+    std::sort(underlying_ranges_.begin(), underlying_ranges_.end(),
+              [ucmp](const std::pair<std::string, std::string> &a,
+                     const std::pair<std::string, std::string> &b) {
+        return ucmp->Compare(a.first, b.first) < 0;
+    });
+    underlying_pos_ = 0;
+    underlying_largest_ = nullptr;
+
+    std::string current_user_key;
+    bool has_current_user_key = false;
+    bool first_of_key = true;
+    uint64_t last_version_for_key = 0;
     for (; merger->Valid(); merger->Next()) {
         DCHECK_GE(merger->key().size(), Tag::kTagSize);
 
         origin_size_ += (merger->key().size() + merger->value().size());
+        records_in_++;
 
         base::BufferedReader rd(merger->key().data(), merger->key().size());
         auto user_key = rd.Read(merger->key().size() - Tag::kTagSize);
         auto tag = Tag::Decode(rd.ReadFixed64());
         DCHECK_EQ(0, rd.active());
 
-        if (tag.version < oldest_version_) {
-            continue;
+        if (!has_current_user_key ||
+            comparator_.delegated()->Compare(user_key, current_user_key) != 0) {
+            current_user_key.assign(user_key.data(), user_key.size());
+            has_current_user_key = true;
+            first_of_key = true;
         }
 
-        if (tag.flag == kFlagDeletion) {
-            deletion_key = user_key;
-            continue;
+        auto drop = false;
+        if (!first_of_key && last_version_for_key <= oldest_version_) {
+            // Shadowed by a newer version, and no snapshot can see this one.
+            drop = true;
+        } else if (tag.flag == kFlagDeletion &&
+                   tag.version <= oldest_version_ &&
+                   IsBaseForKey(user_key)) {
+            // The older versions of this key be dropped by the rule above in
+            // this compaction, no one can be covered by the deletion later.
+            drop = true;
         }
+        last_version_for_key = tag.version;
+        first_of_key = false;
 
-        if (comparator_.delegated()->Compare(user_key, deletion_key) == 0) {
+        if (drop) {
+            records_dropped_++;
             continue;
-        } else {
-            deletion_key = base::Slice();
         }
 
         auto chunk = Chunk::CreateKeyValue(merger->key(), merger->value());
@@ -95,6 +138,25 @@ base::Status Compaction::Compact(TableBuilder *builder) {
     return builder->Finalize();
 }
 
+bool Compaction::IsBaseForKey(const base::Slice &user_key) {
+    // The ranges may be overlapped. The keys be ascending, so a started range
+    // never be asked again, and only the largest end of them matters.
+    auto ucmp = comparator_.delegated();
+    while (underlying_pos_ < underlying_ranges_.size()) {
+        const auto &range = underlying_ranges_[underlying_pos_];
+        if (ucmp->Compare(range.first, user_key) > 0) {
+            break;
+        }
+        if (!underlying_largest_ ||
+            ucmp->Compare(range.second, *underlying_largest_) > 0) {
+            underlying_largest_ = &range.second;
+        }
+        underlying_pos_++;
+    }
+    return !underlying_largest_ ||
+           ucmp->Compare(user_key, *underlying_largest_) > 0;
+}
+
 } // namespace lsm
     
 } // namespace yukino
\ No newline at end of file
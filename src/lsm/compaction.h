@@ -5,6 +5,7 @@
 #include "lsm/chunk.h"
 #include "base/status.h"
 #include "base/base.h"
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <set>
@@ -32,13 +33,17 @@ public:
                const InternalKeyComparator &comparator, TableCache *cache);
     ~Compaction();
 
-    base::Status AddOriginFile(uint64_t number, uint64_t size);
+    base::Status AddOriginFile(uint64_t number, uint64_t size,
+                               uint64_t global_version = 0);
 
     void AddOriginIterator(Iterator *iter) { origin_iters_.push_back(iter); }
 
     /**
      * Compact starts >= compaction_point
-     * Compact version < oldest_version
+     *
+     * The versions of a key shadowed by a newer one <= oldest_version be
+     * dropped, and the deletions <= oldest_version be dropped too, if there
+     * is no underlying range has the key.
      *
      * REQUIRES: AddOriginIterator or AddOriginFile
      * REQUIRES: set_target
@@ -51,10 +56,31 @@ public:
 
     void set_target_level(int level) { target_level_ = level; }
 
+    void set_origin_level(int level) { origin_level_ = level; }
+
+    /**
+     * The oldest version can be read by any snapshot, the default is no
+     * snapshot at all.
+     */
     void set_oldest_version(uint64_t version) { oldest_version_ = version; }
 
+    /**
+     * Add the user key range of a live file that is not in this compaction,
+     * it may has older versions of the keys in the range.
+     */
+    void AddUnderlyingRange(const base::Slice &smallest,
+                            const base::Slice &largest);
+
     void set_compaction_point(const base::Slice &key) { compaction_point_ = key; }
 
+    /**
+     * The file be moved to the target level by the version patch, instead of
+     * rewriting, the compaction has nothing to compact.
+     */
+    void AddMovedFile(uint64_t number, uint64_t size);
+
+    bool is_trivial_move() const { return trivial_move_; }
+
     const std::set<uint64_t> &origin_files() const {
         return origin_file_numbers_;
     }
@@ -63,14 +89,26 @@ public:
 
     int target_level() const { return target_level_; }
 
+    int origin_level() const { return origin_level_; }
+
     // REQUIRES: Compact
     uint64_t origin_size() const { return origin_size_; }
 
     // REQUIRES: Compact
     uint64_t target_size() const { return target_size_; }
 
+    // REQUIRES: Compact
+    uint64_t records_in() const { return records_in_; }
+
+    // The records be dropped: old versions or deleted.
+    // REQUIRES: Compact
+    uint64_t records_dropped() const { return records_dropped_; }
 
 private:
+    // No older version of the user key can exist out of this compaction.
+    // The keys must be asked in ascending order.
+    bool IsBaseForKey(const base::Slice &user_key);
+
     std::string db_name_;
     TableCache *cache_;
 
@@ -78,12 +116,23 @@ private:
     std::set<uint64_t> origin_file_numbers_;
     std::vector<Iterator*> origin_iters_;
 
-    uint64_t oldest_version_ = 0;
+    // Sorted by the smallest key in Compact(), the ranges before
+    // underlying_pos_ be started at or before the last asked key, and
+    // underlying_largest_ be the largest end of them.
+    std::vector<std::pair<std::string, std::string>> underlying_ranges_;
+    size_t underlying_pos_ = 0;
+    const std::string *underlying_largest_ = nullptr;
+
+    uint64_t oldest_version_ = UINT64_MAX;
     base::Slice compaction_point_;
 
     uint64_t origin_size_ = 0;
     uint64_t target_size_ = 0;
+    uint64_t records_in_ = 0;
+    uint64_t records_dropped_ = 0;
     int target_level_ = 0;
+    int origin_level_ = 0;
+    bool trivial_move_ = false;
 
     InternalKeyComparator comparator_;
 };
@@ -166,6 +166,121 @@ TEST_F(CompactionTest, Deletion) {
     EXPECT_EQ(key.key_slice(), iter.key());
 }
 
+TEST_F(CompactionTest, OldVersions) {
+    auto t1 = Build({
+        InternalKey::CreateKey("a", "a.5", 5, kFlagValue),
+        InternalKey::CreateKey("a", "a.3", 3, kFlagValue),
+        InternalKey::CreateKey("b", "b.4", 4, kFlagDeletion),
+    });
+
+    auto t2 = Build({
+        InternalKey::CreateKey("a", "a.2", 2, kFlagValue),
+        InternalKey::CreateKey("a", "a.1", 1, kFlagValue),
+        InternalKey::CreateKey("b", "b.1", 1, kFlagValue),
+    });
+
+    auto mm1 = base::MappedMemory::Attach(&t1);
+    auto mm2 = base::MappedMemory::Attach(&t2);
+
+    Table tt1(&internal_comparator_, &mm1);
+    Table tt2(&internal_comparator_, &mm2);
+
+    ASSERT_TRUE(tt1.Init().ok());
+    ASSERT_TRUE(tt2.Init().ok());
+
+    // The oldest snapshot is version 3: "a.3" must be kept for it, "a.2"
+    // and "a.1" be shadowed. The deletion of "b" is not visible to the
+    // snapshot, so "b.1" must be kept.
+    compaction_->AddOriginIterator(new Table::Iterator(&tt1));
+    compaction_->AddOriginIterator(new Table::Iterator(&tt2));
+    compaction_->set_oldest_version(3);
+    auto tn = Compact();
+    EXPECT_EQ(2, compaction_->records_dropped());
+
+    auto mm = base::MappedMemory::Attach(&tn);
+    Table tt(&internal_comparator_, &mm);
+    auto rs = tt.Init();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::vector<std::string> values;
+    Table::Iterator iter(&tt);
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        values.push_back(iter.value().ToString());
+    }
+    std::vector<std::string> expected = {"a.5", "a.3", "b.4", "b.1"};
+    EXPECT_EQ(expected, values);
+}
+
+TEST_F(CompactionTest, DeletionNotBase) {
+    auto t1 = Build({
+        InternalKey::CreateKey("a", "a.2", 2, kFlagValue),
+        InternalKey::CreateKey("b", "b.3", 3, kFlagDeletion),
+        InternalKey::CreateKey("c", "c.4", 4, kFlagDeletion),
+    });
+
+    auto mm1 = base::MappedMemory::Attach(&t1);
+    Table tt1(&internal_comparator_, &mm1);
+    ASSERT_TRUE(tt1.Init().ok());
+
+    // An underlying file may has older "b", the deletion must be kept.
+    compaction_->AddOriginIterator(new Table::Iterator(&tt1));
+    compaction_->AddUnderlyingRange("aa", "bb");
+    auto tn = Compact();
+    EXPECT_EQ(1, compaction_->records_dropped());
+
+    auto mm = base::MappedMemory::Attach(&tn);
+    Table tt(&internal_comparator_, &mm);
+    auto rs = tt.Init();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    Table::Iterator iter(&tt);
+    iter.SeekToFirst();
+    ASSERT_TRUE(iter.Valid());
+    EXPECT_EQ("a.2", iter.value().ToString());
+    iter.Next();
+    ASSERT_TRUE(iter.Valid());
+    EXPECT_EQ("b", InternalKey::ExtractUserKey(iter.key()).ToString());
+    EXPECT_EQ(kFlagDeletion, InternalKey::ExtractTag(iter.key()).flag);
+    iter.Next();
+    EXPECT_FALSE(iter.Valid());
+}
+
+TEST_F(CompactionTest, OverlappedUnderlyingRanges) {
+    auto t1 = Build({
+        InternalKey::CreateKey("b", "b.2", 2, kFlagDeletion),
+        InternalKey::CreateKey("d", "d.3", 3, kFlagDeletion),
+        InternalKey::CreateKey("f", "f.4", 4, kFlagDeletion),
+        InternalKey::CreateKey("h", "h.5", 5, kFlagDeletion),
+        InternalKey::CreateKey("k", "k.6", 6, kFlagDeletion),
+    });
+
+    auto mm1 = base::MappedMemory::Attach(&t1);
+    Table tt1(&internal_comparator_, &mm1);
+    ASSERT_TRUE(tt1.Init().ok());
+
+    // Unordered and overlapped: "d" and "h" be covered by the long range
+    // after the short one inside it ends.
+    compaction_->AddOriginIterator(new Table::Iterator(&tt1));
+    compaction_->AddUnderlyingRange("e", "e");
+    compaction_->AddUnderlyingRange("c", "i");
+    compaction_->AddUnderlyingRange("cc", "cd");
+    auto tn = Compact();
+    EXPECT_EQ(2, compaction_->records_dropped());
+
+    auto mm = base::MappedMemory::Attach(&tn);
+    Table tt(&internal_comparator_, &mm);
+    auto rs = tt.Init();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::vector<std::string> values;
+    Table::Iterator iter(&tt);
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        values.push_back(iter.value().ToString());
+    }
+    std::vector<std::string> expected = {"d.3", "f.4", "h.5"};
+    EXPECT_EQ(expected, values);
+}
+
 } // namespace lsm
 
 } // namespace yukino
@@ -2,16 +2,21 @@
 #include "lsm/db_iter.h"
 #include "lsm/builtin.h"
 #include "lsm/format.h"
+#include "lsm/table.h"
 #include "lsm/table_cache.h"
 #include "lsm/table_builder.h"
 #include "lsm/version.h"
 #include "lsm/compaction.h"
+#include "util/rate_limiter.h"
 #include "util/log.h"
+#include "yukino/perf_context-inl.h"
 #include "yukino/iterator.h"
 #include "yukino/write_batch.h"
 #include "yukino/options.h"
 #include "yukino/env.h"
+#include "base/io.h"
 #include "glog/logging.h"
+#include <algorithm>
 #include <chrono>
 #include <map>
 
@@ -74,15 +79,241 @@ private:
     MemoryTable *mutable_;
 };
 
+/**
+ * Replay the redo log in three stages, they run in parallel (but not the
+ * applying itself, only one apply thread, the memory table must be inserted
+ * in the log order):
+ *
+ * - The caller reads the log and verifies the checksums, the records be
+ *   packed into batches.
+ * - The apply thread inserts the batches into the memory table in the log
+ *   order, a full memory table be handed to the flush thread.
+ * - The flush thread dumps the full memory tables to level-0, so the replaying
+ *   does not grow one huge memory table.
+ */
+class DBImpl::RedoPipeline {
+public:
+    RedoPipeline(DBImpl *db, uint64_t last_version)
+        : db_(db)
+        , last_version_(last_version)
+        , batch_size_(BatchSize(db->write_buffer_size_)) {
+    }
+
+    ~RedoPipeline() {
+        Close();
+    }
+
+    void Start() {
+        apply_thread_ = std::thread([this]() { this->ApplyWork(); });
+        flush_thread_ = std::thread([this]() { this->FlushWork(); });
+    }
+
+    /**
+     * Add a record to the pending batch, blocks if too many batches be
+     * waiting for applying.
+     */
+    base::Status Add(const base::Slice &record) {
+        batch_.append(record.data(), record.size());
+        if (batch_.size() < batch_size_) {
+            return base::Status::OK();
+        }
+        return Submit();
+    }
+
+    /**
+     * Wait for all of the batches be applied and flushed.
+     */
+    base::Status Finish() {
+        base::Status rs;
+        if (!batch_.empty()) {
+            rs = Submit();
+        }
+        Close();
+        return rs.ok() ? status_ : rs;
+    }
+
+    uint64_t counting_version() const { return counting_version_; }
+
+    // The memory table has the records not flushed.
+    MemoryTable *mutable_table() const { return mutable_.get(); }
+
+    const std::vector<base::Handle<FileMetadata>> &level0_files() const {
+        return level0_files_;
+    }
+
+private:
+    static size_t BatchSize(size_t write_buffer_size) {
+        size_t max_batch_size = kMaxBatchSize;
+        return std::min(max_batch_size, write_buffer_size / 4 + 1);
+    }
+
+    base::Status Submit() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (batches_.size() >= kMaxPendingBatches && status_.ok()) {
+            cv_.wait(lock);
+        }
+        if (!status_.ok()) {
+            return status_;
+        }
+        batches_.push_back(std::move(batch_));
+        batch_.clear();
+        cv_.notify_all();
+        return base::Status::OK();
+    }
+
+    void Close() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            closed_ = true;
+            cv_.notify_all();
+        }
+        if (apply_thread_.joinable()) {
+            apply_thread_.join();
+        }
+        if (flush_thread_.joinable()) {
+            flush_thread_.join();
+        }
+    }
+
+    void ApplyWork() {
+        base::Handle<MemoryTable> table(db_->mutable_);
+        auto version = last_version_;
+        auto flushed = false;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (status_.ok()) {
+            while (batches_.empty() && !closed_ && status_.ok()) {
+                cv_.wait(lock);
+            }
+            if (batches_.empty() || !status_.ok()) {
+                break;
+            }
+            auto batch = std::move(batches_.front());
+            batches_.pop_front();
+            cv_.notify_all();
+            lock.unlock();
+
+            // The batch has several WriteBatch records, they can be iterated
+            // as one.
+            WritingHandler handler(version + 1, table.get());
+            auto rs = WriteBatch::Iterate(batch.data(), batch.size(), &handler);
+            version += handler.counting_version();
+
+            lock.lock();
+            if (!rs.ok()) {
+                status_ = rs;
+                break;
+            }
+            if (table->memory_usage_size() <= db_->write_buffer_size_) {
+                continue;
+            }
+
+            while (flushing_.get() && status_.ok()) {
+                cv_.wait(lock);
+            }
+            flushing_ = table;
+            flushed = true;
+            cv_.notify_all();
+
+            lock.unlock();
+            table = new MemoryTable(*db_->internal_comparator_);
+            lock.lock();
+        }
+
+        // The last memory table be flushed too if any one flushed, then the
+        // redo log can be dropped.
+        if (flushed && status_.ok()) {
+            while (flushing_.get() && status_.ok()) {
+                cv_.wait(lock);
+            }
+            flushing_ = table;
+            mutable_  = new MemoryTable(*db_->internal_comparator_);
+        } else {
+            mutable_ = table;
+        }
+        counting_version_ = version - last_version_;
+        apply_done_ = true;
+        cv_.notify_all();
+    }
+
+    void FlushWork() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            while (!flushing_.get() && !apply_done_ && status_.ok()) {
+                cv_.wait(lock);
+            }
+            if (!flushing_.get() || !status_.ok()) {
+                break;
+            }
+            base::Handle<MemoryTable> table(flushing_);
+            lock.unlock();
+
+            base::Status rs;
+            base::Handle<FileMetadata> metadata;
+            if (table->memory_usage_size() > 0) {
+                // Only this thread generates the file numbers in replaying.
+                metadata = new FileMetadata(db_->versions_->GenerateFileNumber());
+                LOG(INFO) << "Level0 table flush in recovery, target file "
+                          << "number: " << metadata->number;
+
+                uint64_t num_entries = 0;
+                std::unique_ptr<Iterator> iter(table->NewIterator());
+                rs = db_->BuildTable(iter.get(),
+                                     table->memory_usage_size(),
+                                     metadata.get(), &num_entries);
+            }
+
+            lock.lock();
+            flushing_ = nullptr;
+            if (!rs.ok()) {
+                status_ = rs;
+            } else if (metadata.get()) {
+                level0_files_.push_back(metadata);
+            }
+            cv_.notify_all();
+        }
+    }
+
+    static const size_t kMaxBatchSize = 256 * base::kKB;
+    static const size_t kMaxPendingBatches = 4;
+
+    DBImpl *const db_;
+    const uint64_t last_version_;
+    const size_t batch_size_;
+
+    std::string batch_; // Only for the caller
+    std::thread apply_thread_;
+    std::thread flush_thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> batches_;
+    bool closed_ = false;
+    bool apply_done_ = false;
+    base::Handle<MemoryTable> flushing_;
+    base::Handle<MemoryTable> mutable_;
+    uint64_t counting_version_ = 0;
+    std::vector<base::Handle<FileMetadata>> level0_files_;
+    base::Status status_;
+};
+
 DBImpl::DBImpl(const Options &opt, const std::string &name)
     : env_(DCHECK_NOTNULL(opt.env))
+    , db_name_(name)
     , block_size_(opt.block_size)
     , block_restart_interval_(opt.block_restart_interval)
-    , db_name_(name)
-    , internal_comparator_(new InternalKeyComparator(opt.comparator))
+    , use_direct_io_(opt.use_direct_io_for_flush_and_compaction)
+    , rate_limiter_(opt.rate_limiter)
+    , bytes_per_sync_(opt.bytes_per_sync)
+    , wal_bytes_per_sync_(opt.wal_bytes_per_sync)
+    , allow_fallocate_(opt.allow_fallocate)
+    , recycle_log_file_num_(opt.recycle_log_file_num)
+    , flush_on_close_(opt.flush_on_close)
+    , write_buffer_size_(opt.write_buffer_size)
+    , listeners_(opt.listeners)
     , table_cache_(new TableCache(db_name_, opt))
     , versions_(new VersionSet(db_name_, opt, table_cache_.get()))
-    , write_buffer_size_(opt.write_buffer_size) {
+    , internal_comparator_(new InternalKeyComparator(opt.comparator)) {
 
     mutable_ = new MemoryTable(*internal_comparator_);
 }
@@ -126,6 +357,13 @@ base::Status DBImpl::Open(const Options &opt) {
 }
 
 DBImpl::~DBImpl() {
+    if (flush_on_close_ && log_.get()) {
+        auto rs = Flush(FlushOptions());
+        if (!rs.ok()) {
+            LOG(ERROR) << "Flush on close fail, cause: " << rs.ToString();
+        }
+    }
+
     DLOG(INFO) << "Shutting down, last_version: " << versions_->last_version();
     {
         std::unique_lock<std::mutex> lock(mutex_);
@@ -161,70 +399,155 @@ base::Status DBImpl::Delete(const WriteOptions& options,
 
 base::Status DBImpl::Write(const WriteOptions& options,
                            WriteBatch* updates) {
-    uint64_t last_version = 0;
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        last_version = versions_->last_version();
+    TraceWrite(updates->buf());
 
-        auto rs = MakeRoomForWrite(false, &lock);
-        if (!rs.ok()) {
-            return rs;
-        }
-    }
-    auto rs = log_->Append(updates->buf());
+    // The log writer and the skip list are not thread-safe, and the versions
+    // must not be overlapped, so the concurrent writers take turns to be the
+    // logger. The logger does the I/O without the mutex_, the readers and
+    // the background work are not blocked by it.
+    std::unique_lock<std::mutex> lock(mutex_);
+    AcquireLogger(&lock);
+    auto rs = MakeRoomForWrite(false, &lock);
     if (!rs.ok()) {
+        ReleaseLogger();
         return rs;
     }
+    uint64_t last_version = versions_->last_version();
+    base::Handle<MemoryTable> table(mutable_);
+    lock.unlock();
 
-    if (options.sync) {
+    rs = log_->Append(updates->buf());
+    if (rs.ok() && options.sync) {
         rs = log_file_->Sync();
-        if (!rs.ok()) {
-            return rs;
-        }
     }
 
-    WritingHandler handler(last_version + 1, mutable_.get());
-    updates->Iterate(&handler);
+    WritingHandler handler(last_version + 1, table.get());
+    if (rs.ok()) {
+        updates->Iterate(&handler);
+    }
 
-    mutex_.lock();
+    lock.lock();
     versions_->AdvanceVersion(handler.counting_version());
-    mutex_.unlock();
-    return base::Status::OK();
+    ReleaseLogger();
+    return rs;
 }
 
 base::Status DBImpl::Get(const ReadOptions& options,
                          const base::Slice& key, std::string* value) {
+    PERF_TIMER_GUARD(get_nanos);
+    TraceGet(key);
+
     uint64_t last_version = 0;
 
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
+    }
     if (options.snapshot) {
         last_version = SnapshotImpl::DownCast(options.snapshot)->version();
     } else {
         last_version = versions_->last_version();
     }
 
+    // The tables be pinned, and be looked up without the mutex. The
+    // reference counting of them is not atomic, so they must be released
+    // with the mutex.
     base::Handle<MemoryTable> mut(mutable_);
     base::Handle<MemoryTable> imm(immtable_);
+    base::Handle<Version> current(versions_->current());
+    lock.unlock();
 
+    // A deletion in the memory tables also ends the lookup, the older values
+    // in the sst files are shadowed.
     base::Status rs;
-    mutex_.unlock();
+    KeyLookup lookup(InternalKey::CreateKey(key, last_version), value, &rs);
+    KeyLookup *lookups[] = {&lookup};
+    mut->MultiGet(lookups, 1);
+    if (!lookup.done && imm.get()) {
+        imm->MultiGet(lookups, 1);
+    }
+    if (!lookup.done) {
+        rs = current->Get(options, lookup.key, value);
+    }
 
-    InternalKey internal_key = InternalKey::CreateKey(key, last_version);
-    rs = mut->Get(internal_key, value);
-    if (rs.IsNotFound()) {
-        if (imm.get()) {
-            rs = imm->Get(internal_key, value);
-        }
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
     }
+    return rs;
+}
 
-    mutex_.lock();
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<base::Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<base::Status>* status) {
+    PERF_TIMER_GUARD(get_nanos);
+    for (const auto &key : keys) {
+        TraceGet(key);
+    }
 
-    if (rs.ok() || !rs.IsNotFound()) {
-        return rs;
+    values->resize(keys.size());
+    status->assign(keys.size(), base::Status::NotFound(""));
+    if (keys.empty()) {
+        return;
+    }
+
+    uint64_t last_version = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
+    }
+    if (options.snapshot) {
+        last_version = SnapshotImpl::DownCast(options.snapshot)->version();
+    } else {
+        last_version = versions_->last_version();
     }
 
+    // Pinned as Get() does, they be released with the mutex.
+    base::Handle<MemoryTable> mut(mutable_);
+    base::Handle<MemoryTable> imm(immtable_);
     base::Handle<Version> current(versions_->current());
-    return current->Get(options, internal_key, value);
+    lock.unlock();
+
+    std::vector<KeyLookup> lookups;
+    lookups.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        lookups.emplace_back(InternalKey::CreateKey(keys[i], last_version),
+                             &(*values)[i], &(*status)[i]);
+    }
+
+    std::vector<KeyLookup *> sorted;
+    sorted.reserve(lookups.size());
+    for (auto &lookup : lookups) {
+        sorted.push_back(&lookup);
+    }
+    auto ucmp = internal_comparator_->delegated();
+    std::sort(sorted.begin(), sorted.end(),
+              [ucmp](const KeyLookup *a, const KeyLookup *b) {
+                  return ucmp->Compare(a->key.user_key_slice(),
+                                       b->key.user_key_slice()) < 0;
+              });
+
+    mut->MultiGet(&sorted[0], sorted.size());
+    if (imm.get()) {
+        imm->MultiGet(&sorted[0], sorted.size());
+    }
+    auto rs = current->MultiGet(options, &sorted[0], sorted.size());
+    if (!rs.ok()) {
+        for (auto lookup : sorted) {
+            if (!lookup->done) {
+                *lookup->status = rs;
+            }
+        }
+    }
+
+    {
+        PERF_TIMER_GUARD(db_mutex_wait_nanos);
+        lock.lock();
+    }
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
@@ -254,18 +577,22 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
 
     auto rv = CreateDBIterator(internal_comparator_.get(), &children[0],
                                children.size(), version);
-    mutable_->AddRef();
-    rv->RegisterCleanup([this]() {
-        mutable_->Release();
+    // Release the pinned tables, but not the current ones, the tables may be
+    // switched before the iterator be deleted.
+    auto pinned_mutable = mutable_.get();
+    pinned_mutable->AddRef();
+    rv->RegisterCleanup([pinned_mutable]() {
+        pinned_mutable->Release();
     });
 
     if (immtable_.get()) {
-        immtable_->AddRef();
-        rv->RegisterCleanup([this] () {
-            immtable_->Release();
+        auto pinned_immtable = immtable_.get();
+        pinned_immtable->AddRef();
+        rv->RegisterCleanup([pinned_immtable] () {
+            pinned_immtable->Release();
         });
     }
-    return rv;
+    return TraceIterator(rv);
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -278,6 +605,163 @@ void DBImpl::ReleaseSnapshot(const Snapshot* snapshot) {
     snapshots_.DeleteSnapshot(SnapshotImpl::DownCast(snapshot));
 }
 
+base::Status DBImpl::IngestExternalFile(
+        const std::vector<std::string>& files,
+        const IngestExternalFileOptions& options) {
+    if (files.empty()) {
+        return base::Status::InvalidArgument("No file to ingest.");
+    }
+
+    struct ExternalFile {
+        std::string file_name;
+        std::string smallest; // user keys
+        std::string largest;
+        base::Handle<FileMetadata> metadata;
+    };
+    std::vector<ExternalFile> externals(files.size());
+
+    auto ucmp = internal_comparator_->delegated();
+    for (size_t i = 0; i < files.size(); ++i) {
+        externals[i].file_name = files[i];
+        auto rs = ReadExternalFile(files[i], &externals[i].smallest,
+                                   &externals[i].largest);
+        if (!rs.ok()) {
+            return rs;
+        }
+    }
+    std::sort(externals.begin(), externals.end(),
+              [ucmp](const ExternalFile &a, const ExternalFile &b) {
+                  return ucmp->Compare(a.smallest, b.smallest) < 0;
+              });
+    for (size_t i = 1; i < externals.size(); ++i) {
+        if (ucmp->Compare(externals[i - 1].largest,
+                          externals[i].smallest) >= 0) {
+            return base::Status::InvalidArgument("Ingested files overlap: " +
+                                                 externals[i - 1].file_name +
+                                                 ", " + externals[i].file_name);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto &external : externals) {
+        external.metadata = new FileMetadata(versions_->GenerateFileNumber());
+        pending_outputs_.insert(external.metadata->number);
+    }
+    lock.unlock();
+
+    base::Status rs;
+    for (const auto &external : externals) {
+        rs = ImportExternalFile(external.file_name, external.metadata->number);
+        if (!rs.ok()) {
+            break;
+        }
+    }
+    lock.lock();
+
+    // The memory tables be read first, their keys in the ingested range must
+    // be flushed, or they will shadow the newer ingested keys.
+    while (rs.ok()) {
+        auto overlap = [this, &externals](MemoryTable *table) {
+            for (const auto &external : externals) {
+                if (OverlapMemoryTable(table, external.smallest,
+                                       external.largest)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        if (!background_error_.ok()) {
+            rs = background_error_;
+        } else if (immtable_.get() && overlap(immtable_.get())) {
+            MaybeScheduleCompaction();
+            if (!background_active_) {
+                rs = base::Status::IOError("Deleting DB during ingestion");
+                break;
+            }
+            background_cv_.wait(lock);
+        } else if (overlap(mutable_.get())) {
+            AcquireLogger(&lock);
+            rs = MakeRoomForWrite(true, &lock);
+            ReleaseLogger();
+        } else {
+            break;
+        }
+    }
+
+    if (rs.ok()) {
+        auto global_version = versions_->AdvanceVersion(1);
+
+        VersionPatch patch;
+        base::Handle<Version> current(versions_->current());
+        for (const auto &external : externals) {
+            auto metadata = external.metadata.get();
+            metadata->global_version = global_version;
+            rs = table_cache_->GetFileMetadata(metadata->number, metadata);
+            if (!rs.ok()) {
+                break;
+            }
+            metadata->ctime = now_microseconds();
+
+            auto level = PickIngestionLevel(current.get(), external.smallest,
+                                            external.largest);
+            patch.CreateFile(level, metadata);
+            LOG(INFO) << "Ingest file: " << external.file_name << " to level "
+                      << level << ", number: " << metadata->number
+                      << ", global version: " << global_version;
+        }
+        if (rs.ok()) {
+            rs = versions_->Apply(&patch, &mutex_);
+        }
+    }
+
+    for (const auto &external : externals) {
+        pending_outputs_.erase(external.metadata->number);
+        if (!rs.ok()) {
+            table_cache_->Invalid(external.metadata->number);
+            env_->DeleteFile(TableFileName(db_name_, external.metadata->number),
+                             false);
+        }
+    }
+    if (!rs.ok()) {
+        return rs;
+    }
+    MaybeScheduleCompaction();
+    lock.unlock();
+
+    if (options.move_files) {
+        for (const auto &external : externals) {
+            env_->DeleteFile(external.file_name, false);
+        }
+    }
+    return rs;
+}
+
+base::Status DBImpl::Flush(const FlushOptions& options) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Switch to a new log, the flushing of immtable_ advances the redo log
+    // number to it.
+    base::Status rs;
+    AcquireLogger(&lock);
+    if (mutable_->memory_usage_size() > 0) {
+        rs = MakeRoomForWrite(true, &lock);
+    }
+    ReleaseLogger();
+    if (!rs.ok() || !options.wait) {
+        return rs;
+    }
+
+    while (immtable_.get() && background_error_.ok()) {
+        MaybeScheduleCompaction();
+        if (!background_active_) {
+            return base::Status::IOError("Deleting DB during flush");
+        }
+        background_cv_.wait(lock);
+    }
+    return background_error_;
+}
+
 base::Status DBImpl::NewDB(const Options &opt) {
     auto rs = env_->CreateDir(db_name_);
     if (!rs.ok()) {
@@ -294,19 +778,22 @@ base::Status DBImpl::NewDB(const Options &opt) {
     log_file_number_ = versions_->GenerateFileNumber();
 
     base::AppendFile *file = nullptr;
-    rs = env_->CreateAppendFile(LogFileName(db_name_, log_file_number_), &file);
+    rs = CreateLogFile(log_file_number_, &file);
     if (!rs.ok()) {
         return rs;
     }
 
     log_file_ = std::unique_ptr<base::AppendFile>(file);
     log_ = std::unique_ptr<util::LogWriter>(new util::Log::Writer(file,
-                                                 util::Log::kDefaultBlockSize));
+                                                 util::Log::kDefaultBlockSize,
+                                                 recycle_log_file_num_ > 0,
+                                                 log_file_number_));
 
     VersionPatch patch(internal_comparator_->delegated()->Name());
     patch.set_prev_log_number(0);
     patch.set_redo_log_number(log_file_number_);
 
+    std::lock_guard<std::mutex> guard(mutex_);
     return versions_->Apply(&patch, &mutex_);
 }
 
@@ -320,7 +807,7 @@ base::Status DBImpl::Recovery() {
     db_lock_ = std::unique_ptr<base::FileLock>(lock);
 
     std::string buf;
-    rs = base::ReadAll(CurrentFileName(db_name_), &buf);
+    rs = ReadFileToString(env_, CurrentFileName(db_name_), &buf);
     if (!rs.ok()) {
         return rs;
     }
@@ -338,52 +825,184 @@ base::Status DBImpl::Recovery() {
     }
 
     DCHECK_GE(logs.size(), 2);
-    rs = Redo(versions_->redo_log_number(), logs[logs.size() - 2]);
+    // The redo log has no key in the ingested files' range when they be
+    // ingested, but the keys written after them must be newer.
+    auto last_version = logs[logs.size() - 2];
+    for (auto i = 0; i < kMaxLevel; ++i) {
+        for (const auto &metadata : versions_->current()->file(i)) {
+            last_version = std::max(last_version, metadata->global_version);
+        }
+    }
+    // The logs newer than the redo log be not in the manifest yet, if the db
+    // was closed before their immutable tables be flushed, so they must be
+    // replayed too, in the log order.
+    std::vector<uint64_t> log_numbers;
+    rs = GetRedoLogs(versions_->redo_log_number(), &log_numbers);
     if (!rs.ok()) {
         return rs;
     }
+    uint64_t offset = 0;
+    bool recycled = false;
+    std::vector<base::Handle<FileMetadata>> level0;
+    for (auto number : log_numbers) {
+        rs = Redo(number, &last_version, &offset, &recycled, &level0);
+        if (!rs.ok()) {
+            return rs;
+        }
+    }
+    if ((log_numbers.size() > 1 || !level0.empty()) &&
+        mutable_->memory_usage_size() > 0) {
+        // Only the last log can be continued, so flush the rest records.
+        base::Handle<FileMetadata> metadata(
+                new FileMetadata(versions_->GenerateFileNumber()));
+        LOG(INFO) << "Level0 table flush in recovery, target file number: "
+                  << metadata->number;
+
+        uint64_t num_entries = 0;
+        std::unique_ptr<Iterator> iter(mutable_->NewIterator());
+        rs = BuildTable(iter.get(), mutable_->memory_usage_size(),
+                        metadata.get(), &num_entries);
+        if (!rs.ok()) {
+            return rs;
+        }
+        level0.push_back(metadata);
+        mutable_ = new MemoryTable(*internal_comparator_);
+    }
     DLOG(INFO) << "Replay ok, last version: " << versions_->last_version();
 
-    log_file_number_ = versions_->redo_log_number();
     base::AppendFile *file = nullptr;
-    rs = env_->CreateAppendFile(LogFileName(db_name_, log_file_number_), &file);
+    if (!level0.empty()) {
+        // The replayed records are all flushed, switch to a new log, and the
+        // old ones be obsolete.
+        log_file_number_ = versions_->GenerateFileNumber();
+        rs = CreateLogFile(log_file_number_, &file);
+        if (!rs.ok()) {
+            return rs;
+        }
+
+        log_file_ = std::unique_ptr<base::AppendFile>(file);
+        log_ = std::unique_ptr<util::LogWriter>(new util::Log::Writer(file,
+                                                 util::Log::kDefaultBlockSize,
+                                                 recycle_log_file_num_ > 0,
+                                                 log_file_number_));
+
+        VersionPatch patch(internal_comparator_->delegated()->Name());
+        for (const auto &metadata : level0) {
+            patch.CreateFile(0, metadata.get());
+        }
+        patch.set_prev_log_number(0);
+        patch.set_redo_log_number(log_file_number_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        rs = versions_->Apply(&patch, &mutex_);
+        if (!rs.ok()) {
+            return rs;
+        }
+        DeleteObsoleteFiles();
+        MaybeScheduleCompaction();
+        return base::Status::OK();
+    }
+
+    log_file_number_ = versions_->redo_log_number();
+    rs = ReopenLogFile(log_file_number_, offset, &file);
     if (!rs.ok()) {
         return rs;
     }
 
+    // Keep the records format of the log, the legacy records after the
+    // recyclable ones be stale.
     log_file_ = std::unique_ptr<base::AppendFile>(file);
     log_ = std::unique_ptr<util::LogWriter>(new util::Log::Writer(file,
-                                                 util::Log::kDefaultBlockSize));
+                                                 util::Log::kDefaultBlockSize,
+                                                 recycle_log_file_num_ > 0 ||
+                                                 recycled,
+                                                 log_file_number_, offset));
+    return base::Status::OK();
+}
+
+base::Status DBImpl::GetRedoLogs(uint64_t redo_log_number,
+                                 std::vector<uint64_t> *log_numbers) {
+    std::vector<std::string> children;
+    auto rs = env_->GetChildren(db_name_, &children);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    // The redo log must be exist, the older ones be obsolete or recycled.
+    log_numbers->push_back(redo_log_number);
+    for (const auto &child : children) {
+        auto rv = Files::ParseName(child);
+        switch (std::get<0>(rv)) {
+        case Files::kLog:
+            if (std::get<1>(rv) > redo_log_number) {
+                log_numbers->push_back(std::get<1>(rv));
+            }
+            // Fall through
+        case Files::kTable:
+        case Files::kManifest:
+            versions_->MarkFileNumberUsed(std::get<1>(rv));
+            break;
+
+        default:
+            break;
+        }
+    }
+    std::sort(log_numbers->begin(), log_numbers->end());
     return base::Status::OK();
 }
 
-base::Status DBImpl::Redo(uint64_t file_number, uint64_t last_version) {
+base::Status DBImpl::Redo(uint64_t file_number, uint64_t *last_version,
+                          uint64_t *offset, bool *recycled,
+                          std::vector<base::Handle<FileMetadata>> *level0) {
+    // The log is empty after flushing, nothing to replay, and it can not be
+    // mapped.
+    uint64_t file_size = 0;
+    auto rs = env_->GetFileSize(LogFileName(db_name_, file_number), &file_size);
+    if (!rs.ok()) {
+        return rs;
+    }
+    if (file_size == 0) {
+        *offset   = 0;
+        *recycled = false;
+        return base::Status::OK();
+    }
+
     base::MappedMemory *rv = nullptr;
-    auto rs = env_->CreateRandomAccessFile(LogFileName(db_name_, file_number),
-                                           &rv);
+    rs = env_->CreateRandomAccessFile(LogFileName(db_name_, file_number), &rv);
     if (!rs.ok()) {
         return rs;
     }
 
     std::unique_ptr<base::MappedMemory> file(rv);
     util::Log::Reader reader(file->buf(), file->size(), true,
-                             util::Log::kDefaultBlockSize);
+                             util::Log::kDefaultBlockSize, file_number);
     base::Slice record;
     std::string buf;
 
-    WritingHandler handler(last_version + 1, mutable_.get());
+    RedoPipeline pipeline(this, *last_version);
+    pipeline.Start();
     while (reader.Read(&record, &buf)) {
         if (!reader.status().ok()) {
             break;
         }
 
-        rs = WriteBatch::Iterate(record.data(), record.size(), &handler);
+        rs = pipeline.Add(record);
         if (!rs.ok()) {
-            return rs;
+            break;
         }
     }
+    rs = pipeline.Finish();
+    if (!rs.ok()) {
+        return rs;
+    }
 
-    versions_->AdvanceVersion(handler.counting_version());
+    mutable_ = pipeline.mutable_table();
+    level0->insert(level0->end(), pipeline.level0_files().begin(),
+                   pipeline.level0_files().end());
+    versions_->AdvanceVersion(pipeline.counting_version());
+    *last_version += pipeline.counting_version();
+    *offset   = reader.offset();
+    *recycled = reader.recycled();
     return reader.status();
 }
 
@@ -415,7 +1034,16 @@ void DBImpl::DeleteObsoleteFiles() {
 
     exists.erase(versions_->redo_log_number());
     exists.erase(versions_->manifest_file_number());
+    if (versions_->pending_manifest_file_number() != 0) {
+        exists.erase(versions_->pending_manifest_file_number());
+    }
     exists.erase(log_file_number_);
+    for (auto number : pending_outputs_) {
+        exists.erase(number);
+    }
+    for (auto number : recycled_logs_) {
+        exists.erase(number);
+    }
     for (auto i = 0; i < kMaxLevel; i++) {
         auto files = versions_->current()->file(i);
 
@@ -425,6 +1053,12 @@ void DBImpl::DeleteObsoleteFiles() {
     }
 
     for (const auto &entry : exists) {
+        if (recyclable_logs_.erase(entry.first) > 0 &&
+            recycled_logs_.size() < recycle_log_file_num_) {
+            DLOG(INFO) << "Recycle obsolete log: " << entry.second;
+            recycled_logs_.push_back(entry.first);
+            continue;
+        }
         auto rs = env_->DeleteFile(db_name_ + "/" + entry.second, false);
         if (rs.ok()) {
             DLOG(INFO) << "Delete obsolete file: " << entry.second;
@@ -451,6 +1085,7 @@ base::Status DBImpl::MakeRoomForWrite(bool force,
             break;
         } else if (allow_delay && background_active_ &&
                    versions_->NumberLevelFiles(0) >= kMaxNumberLevel0File) {
+            SetStallCondition(kStallDelayed);
             mutex_.unlock();
 
             std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -459,13 +1094,22 @@ base::Status DBImpl::MakeRoomForWrite(bool force,
             mutex_.lock();
         } else if (!force &&
                    mutable_->memory_usage_size() <= write_buffer_size_) {
+            if (SetStallCondition(kStallNormal)) {
+                continue; // Check again, the mutex_ had be released.
+            }
             break;
         } else if (immtable_.get()) {
             if (background_active_) {
+                if (SetStallCondition(kStallStopped)) {
+                    continue;
+                }
                 background_cv_.wait(*lock);
             }
         } else if (background_active_ &&
                    versions_->NumberLevelFiles(0) >= kMaxNumberLevel0File) {
+            if (SetStallCondition(kStallStopped)) {
+                continue;
+            }
             LOG(INFO) << "Level-0 files: " << versions_->NumberLevelFiles(0)
                 << " wait...";
             background_cv_.wait(*lock);
@@ -474,8 +1118,7 @@ base::Status DBImpl::MakeRoomForWrite(bool force,
 
             auto new_log_number = versions_->GenerateFileNumber();
             base::AppendFile *file = nullptr;
-            rs = env_->CreateAppendFile(LogFileName(db_name_, new_log_number),
-                                        &file);
+            rs = CreateLogFile(new_log_number, &file);
             if (!rs.ok()) {
                 break;
             }
@@ -483,7 +1126,9 @@ base::Status DBImpl::MakeRoomForWrite(bool force,
             log_file_number_ = new_log_number;
             log_file_ = std::unique_ptr<base::AppendFile>(file);
             log_ = std::unique_ptr<util::LogWriter>(new util::Log::Writer(file,
-                                                 util::Log::kDefaultBlockSize));
+                                                 util::Log::kDefaultBlockSize,
+                                                 recycle_log_file_num_ > 0,
+                                                 log_file_number_));
             immtable_ = mutable_;
             mutable_ = new MemoryTable(*internal_comparator_);
             force = false;
@@ -494,6 +1139,19 @@ base::Status DBImpl::MakeRoomForWrite(bool force,
     return rs;
 }
 
+void DBImpl::AcquireLogger(std::unique_lock<std::mutex> *lock) {
+    while (logging_) {
+        logger_cv_.wait(*lock);
+    }
+    logging_ = true;
+}
+
+void DBImpl::ReleaseLogger() {
+    DCHECK(logging_);
+    logging_ = false;
+    logger_cv_.notify_one();
+}
+
 void DBImpl::MaybeScheduleCompaction() {
     if (background_active_) {
         return; // Compaction is running.
@@ -542,8 +1200,10 @@ void DBImpl::BackgroundCompaction() {
         auto rs = CompactMemoryTable();
         if (!rs.ok()) {
             DLOG(ERROR) << rs.ToString();
+            SetBackgroundError(kErrorFlush, rs);
+        } else {
+            background_error_ = rs;
         }
-        background_error_ = rs;
         return;
     }
 
@@ -553,52 +1213,103 @@ void DBImpl::BackgroundCompaction() {
         VersionPatch patch;
         auto rs = versions_->GetCompaction(&patch, &rv_cpt);
         if (!rs.ok()) {
-            background_error_ = rs;
+            SetBackgroundError(kErrorCompaction, rs);
+            return;
+        }
+        std::unique_ptr<Compaction> compaction(rv_cpt);
+        compaction->set_oldest_version(snapshots_.empty()
+                                       ? versions_->last_version()
+                                       : snapshots_.oldest()->version());
+
+        CompactionJobInfo info;
+        info.db_name      = db_name_;
+        info.input_level  = compaction->origin_level();
+        info.output_level = compaction->target_level();
+        info.input_files.assign(compaction->origin_files().begin(),
+                                compaction->origin_files().end());
+
+        if (compaction->is_trivial_move()) {
+            // Only the version patch, no file be read or written.
+            info.output_files = info.input_files;
+            rs = versions_->Apply(&patch, &mutex_);
+            LOG(INFO) << "Trivial move " << info.input_files.size()
+                      << " files from level " << info.input_level << " to "
+                      << info.output_level << ": " << rs.ToString();
+
+            info.status = rs;
+            if (!listeners_.empty()) {
+                mutex_.unlock();
+                for (const auto &listener : listeners_) {
+                    listener->OnCompactionBegin(this, info);
+                    listener->OnCompactionCompleted(this, info);
+                }
+                mutex_.lock();
+            }
+            if (!rs.ok()) {
+                SetBackgroundError(kErrorCompaction, rs);
+            }
             return;
         }
+        info.output_files.push_back(compaction->target_file_number());
 
         mutex_.unlock();
+        for (const auto &listener : listeners_) {
+            listener->OnCompactionBegin(this, info);
+        }
 
-        std::unique_ptr<Compaction> compaction(rv_cpt);
-
+        auto job_start = high_resolution_clock::now();
         base::AppendFile *rv_file = nullptr;
         std::string file_name(TableFileName(db_name_,
                                             compaction->target_file_number()));
-        rs = env_->CreateAppendFile(file_name, &rv_file);
-        if (!rs.ok()) {
-            background_error_ = rs;
-            return;
-        }
-
-        std::unique_ptr<base::AppendFile> file(rv_file);
-        TableOptions options;
-        options.block_size       = static_cast<uint32_t>(block_size_);
-        options.restart_interval = block_restart_interval_;
-        TableBuilder builder(options, file.get());
-        rs = compaction->Compact(&builder);
-        if (!rs.ok()) {
-            background_error_ = rs;
-            return;
+        rs = CreateTableFile(file_name, RateLimiter::kPriorityLow,
+                             compaction->target_size(), &rv_file);
+        if (rs.ok()) {
+            std::unique_ptr<base::AppendFile> file(rv_file);
+            TableOptions options;
+            options.block_size       = static_cast<uint32_t>(block_size_);
+            options.restart_interval = block_restart_interval_;
+            TableBuilder builder(options, file.get());
+            rs = compaction->Compact(&builder);
+            file->Close();
         }
-
-        file->Close();
         mutex_.lock();
 
         base::Handle<FileMetadata> metadata(new FileMetadata(
                                              compaction->target_file_number()));
-        rs = table_cache_->GetFileMetadata(metadata->number, metadata.get());
-        if (!rs.ok()) {
-            background_error_ = rs;
-            return;
+        // All of the records may be dropped, then there is no output file.
+        auto has_output = compaction->target_size() > 0;
+        if (rs.ok() && has_output) {
+            rs = table_cache_->GetFileMetadata(metadata->number,
+                                               metadata.get());
+        }
+        if (rs.ok()) {
+            if (has_output) {
+                patch.CreateFile(compaction->target_level(), metadata.get());
+            }
+            rs = versions_->Apply(&patch, &mutex_);
+        }
+        if (rs.ok()) {
+            DeleteObsoleteFiles();
+        }
+
+        info.bytes_read      = compaction->origin_size();
+        info.bytes_written   = metadata->size;
+        info.records_in      = compaction->records_in();
+        info.records_dropped = compaction->records_dropped();
+        info.micros = duration_cast<microseconds>(high_resolution_clock::now() -
+                                                  job_start).count();
+        info.status = rs;
+        if (!listeners_.empty()) {
+            mutex_.unlock();
+            for (const auto &listener : listeners_) {
+                listener->OnCompactionCompleted(this, info);
+            }
+            mutex_.lock();
         }
 
-        patch.CreateFile(compaction->target_level(), metadata.get());
-        rs = versions_->Apply(&patch, &mutex_);
         if (!rs.ok()) {
-            background_error_ = rs;
-            return;
+            SetBackgroundError(kErrorCompaction, rs);
         }
-        DeleteObsoleteFiles();
     }
 }
 
@@ -647,8 +1358,28 @@ base::Status DBImpl::WriteLevel0Table(const Version *current,
               << metadata->number;
 
     {
+        using namespace std::chrono;
+
+        FlushJobInfo info;
+        info.db_name     = db_name_;
+        info.file_number = metadata->number;
+
         mutex_.unlock();
-        auto rs = BuildTable(iter.release(), metadata.get());
+        for (const auto &listener : listeners_) {
+            listener->OnFlushBegin(this, info);
+        }
+
+        auto start = high_resolution_clock::now();
+        auto rs = BuildTable(iter.release(), table->memory_usage_size(),
+                             metadata.get(), &info.num_entries);
+
+        info.file_size = metadata->size;
+        info.micros = duration_cast<microseconds>(high_resolution_clock::now() -
+                                                  start).count();
+        info.status = rs;
+        for (const auto &listener : listeners_) {
+            listener->OnFlushCompleted(this, info);
+        }
         mutex_.lock();
 
         if (!rs.ok()) {
@@ -660,10 +1391,13 @@ base::Status DBImpl::WriteLevel0Table(const Version *current,
     return base::Status::OK();
 }
 
-base::Status DBImpl::BuildTable(Iterator *iter, FileMetadata *metadata) {
+base::Status DBImpl::BuildTable(Iterator *iter, uint64_t expected_size,
+                                FileMetadata *metadata,
+                                uint64_t *num_entries) {
     base::AppendFile *rv = nullptr;
     std::string file_name(TableFileName(db_name_, metadata->number));
-    auto rs = env_->CreateAppendFile(file_name, &rv);
+    auto rs = CreateTableFile(file_name, RateLimiter::kPriorityHigh,
+                              expected_size, &rv);
     if (!rs.ok()) {
         return rs;
     }
@@ -694,9 +1428,246 @@ base::Status DBImpl::BuildTable(Iterator *iter, FileMetadata *metadata) {
     }
 
     metadata->ctime = now_microseconds();
+    *num_entries = counter;
     return table_cache_->GetFileMetadata(metadata->number, metadata);
 }
 
+base::Status DBImpl::CreateTableFile(const std::string &file_name,
+                                     RateLimiter::Priority priority,
+                                     uint64_t expected_size,
+                                     base::AppendFile **file) {
+    base::Status rs;
+    if (use_direct_io_) {
+        rs = env_->CreateDirectAppendFile(file_name, file);
+    } else {
+        rs = env_->CreateAppendFile(file_name, file);
+    }
+    if (!rs.ok()) {
+        return rs;
+    }
+    if (allow_fallocate_ && expected_size > 0) {
+        rs = (*file)->Allocate(0, expected_size);
+        if (!rs.ok()) {
+            delete *file;
+            return rs;
+        }
+    }
+    // The direct I/O has no dirty pages.
+    if (bytes_per_sync_ > 0 && !use_direct_io_) {
+        *file = new base::IncrementalSyncFile(*file, bytes_per_sync_);
+    }
+    if (rate_limiter_) {
+        *file = new util::RateLimitedFile(*file, rate_limiter_.get(), priority);
+    }
+    return rs;
+}
+
+base::Status DBImpl::CreateLogFile(uint64_t number, base::AppendFile **file) {
+    auto file_name = LogFileName(db_name_, number);
+    base::Status rs;
+    if (recycled_logs_.empty()) {
+        rs = env_->CreateAppendFile(file_name, file);
+    } else {
+        auto recycled = recycled_logs_.front();
+        recycled_logs_.pop_front();
+
+        // Overwrite the recycled file from the head.
+        rs = env_->RenameFile(LogFileName(db_name_, recycled), file_name);
+        if (rs.ok()) {
+            base::FileIO *io = nullptr;
+            rs = env_->CreateFileIO(file_name, &io);
+            *file = io;
+        }
+    }
+    if (!rs.ok()) {
+        return rs;
+    }
+    if (recycle_log_file_num_ > 0) {
+        recyclable_logs_.insert(number);
+    }
+    return PrepareLogFile(file);
+}
+
+base::Status DBImpl::ReopenLogFile(uint64_t number, uint64_t offset,
+                                   base::AppendFile **file) {
+    base::FileIO *io = nullptr;
+    auto rs = env_->CreateFileIO(LogFileName(db_name_, number), &io);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::FileIO> holder(io);
+
+    rs = io->Truncate(offset);
+    if (!rs.ok()) {
+        return rs;
+    }
+    rs = io->Seek(offset);
+    if (!rs.ok()) {
+        return rs;
+    }
+    *file = holder.release();
+    return PrepareLogFile(file);
+}
+
+base::Status DBImpl::PrepareLogFile(base::AppendFile **file) {
+    base::Status rs;
+    if (allow_fallocate_) {
+        rs = (*file)->Allocate(0, write_buffer_size_);
+        if (!rs.ok()) {
+            delete *file;
+            return rs;
+        }
+    }
+    if (wal_bytes_per_sync_ > 0) {
+        *file = new base::IncrementalSyncFile(*file, wal_bytes_per_sync_);
+    }
+    return rs;
+}
+
+base::Status DBImpl::ReadExternalFile(const std::string &file_name,
+                                      std::string *smallest,
+                                      std::string *largest) {
+    base::MappedMemory *rv = nullptr;
+    auto rs = env_->CreateRandomAccessFile(file_name, &rv);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::MappedMemory> file(rv);
+
+    Table table(internal_comparator_.get(), file.get());
+    rs = table.Init();
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    Table::Iterator iter(&table);
+    iter.SeekToFirst();
+    if (!iter.Valid()) {
+        return iter.status().ok() ?
+               base::Status::Corruption("Empty sst file: " + file_name) :
+               iter.status();
+    }
+    if (InternalKey::ExtractTag(iter.key()).version != kExternalFileVersion) {
+        return base::Status::InvalidArgument("Not a file built by "
+                                             "SstFileWriter: " + file_name);
+    }
+    smallest->assign(InternalKey::ExtractUserKey(iter.key()).ToString());
+
+    iter.SeekToLast();
+    if (!iter.Valid()) {
+        return iter.status();
+    }
+    largest->assign(InternalKey::ExtractUserKey(iter.key()).ToString());
+    return base::Status::OK();
+}
+
+base::Status DBImpl::ImportExternalFile(const std::string &file_name,
+                                        uint64_t number) {
+    auto target = TableFileName(db_name_, number);
+    auto rs = env_->LinkFile(file_name, target);
+    if (rs.ok()) {
+        return rs;
+    }
+
+    // Can not link, e.g. on different devices, copy it.
+    base::MappedMemory *rv = nullptr;
+    rs = env_->CreateRandomAccessFile(file_name, &rv);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::MappedMemory> file(rv);
+
+    base::AppendFile *copied = nullptr;
+    rs = env_->CreateAppendFile(target, &copied);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::AppendFile> holder(copied);
+    rs = copied->Write(file->buf(), file->size(), nullptr);
+    if (rs.ok()) {
+        rs = copied->Sync();
+    }
+    auto close_rs = copied->Close();
+    if (rs.ok()) {
+        rs = close_rs;
+    }
+    if (!rs.ok()) {
+        env_->DeleteFile(target, false);
+    }
+    return rs;
+}
+
+bool DBImpl::OverlapMemoryTable(MemoryTable *table,
+                                const base::Slice &smallest,
+                                const base::Slice &largest) {
+    std::unique_ptr<Iterator> iter(table->NewIterator());
+    iter->Seek(InternalKey::CreateKey(smallest,
+                                      versions_->last_version()).key_slice());
+    if (!iter->Valid()) {
+        return false;
+    }
+    auto ucmp = internal_comparator_->delegated();
+    return ucmp->Compare(InternalKey::ExtractUserKey(iter->key()),
+                         largest) <= 0;
+}
+
+int DBImpl::PickIngestionLevel(const Version *current,
+                               const base::Slice &smallest,
+                               const base::Slice &largest) {
+    auto ucmp = internal_comparator_->delegated();
+
+    // The lowest level that the file and all levels above it have no overlap.
+    auto level = 0;
+    for (auto i = 0; i < kMaxLevel; ++i) {
+        for (const auto &metadata : current->file(i)) {
+            if (ucmp->Compare(largest,
+                              metadata->smallest_key.user_key_slice()) >= 0 &&
+                ucmp->Compare(smallest,
+                              metadata->largest_key.user_key_slice()) <= 0) {
+                return level;
+            }
+        }
+        level = i;
+    }
+    return level;
+}
+
+void DBImpl::SetBackgroundError(BackgroundErrorReason reason,
+                                const base::Status &status) {
+    DCHECK(!status.ok());
+    background_error_ = status;
+
+    if (!listeners_.empty()) {
+        mutex_.unlock();
+        for (const auto &listener : listeners_) {
+            listener->OnBackgroundError(this, reason, status);
+        }
+        mutex_.lock();
+    }
+}
+
+bool DBImpl::SetStallCondition(WriteStallCondition condition) {
+    if (stall_condition_ == condition) {
+        return false;
+    }
+
+    WriteStallInfo info;
+    info.db_name        = db_name_;
+    info.condition      = condition;
+    info.prev_condition = stall_condition_;
+    stall_condition_ = condition;
+
+    if (listeners_.empty()) {
+        return false;
+    }
+    mutex_.unlock();
+    for (const auto &listener : listeners_) {
+        listener->OnStallConditionsChanged(this, info);
+    }
+    mutex_.lock();
+    return true;
+}
+
 void DBImpl::TEST_WaitForBackground() {
     std::unique_lock<std::mutex> lock(mutex_);
     if (background_active_) {
@@ -3,10 +3,15 @@
 
 #include "lsm/memory_table.h"
 #include "yukino/db.h"
+#include "yukino/listener.h"
+#include "yukino/rate_limiter.h"
 #include "base/status.h"
 #include "base/base.h"
 #include <mutex>
+#include <set>
+#include <deque>
 #include <thread>
+#include <condition_variable>
 
 namespace yukino {
 
@@ -115,6 +120,14 @@ public:
         delete x;
     }
 
+    bool empty() const { return dummy_.next() == &dummy_; }
+
+    // The snapshots be created by increasing versions, the head is oldest.
+    const SnapshotImpl *oldest() const {
+        DCHECK(!empty());
+        return dummy_.next();
+    }
+
 private:
     SnapshotImpl dummy_;
 };
@@ -135,6 +148,14 @@ public:
                                WriteBatch* updates) override;
     virtual base::Status Get(const ReadOptions& options,
                              const base::Slice& key, std::string* value) override;
+    virtual void MultiGet(const ReadOptions& options,
+                          const std::vector<base::Slice>& keys,
+                          std::vector<std::string>* values,
+                          std::vector<base::Status>* status) override;
+    virtual base::Status IngestExternalFile(
+            const std::vector<std::string>& files,
+            const IngestExternalFileOptions& options) override;
+    virtual base::Status Flush(const FlushOptions& options) override;
     virtual Iterator* NewIterator(const ReadOptions& options) override;
     virtual const Snapshot* GetSnapshot() override;
     virtual void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -143,17 +164,84 @@ public:
     base::Status Recovery();
     base::Status ReplayVersions(uint64_t file_number,
                                 std::vector<uint64_t> *version);
-    base::Status Redo(uint64_t log_file_number, uint64_t last_version);
+    // The redo log and the newer logs, in the log order. All numbers of
+    // the files in db be marked as used, so the new files in recovery can
+    // not reuse the orphan ones, e.g. an interrupted compaction's output.
+    base::Status GetRedoLogs(uint64_t redo_log_number,
+                             std::vector<uint64_t> *log_numbers);
+    /**
+     * @param last_version the version before the log, it be advanced by the
+     *        replayed records.
+     * @param offset the end offset of the last record in the log.
+     * @param recycled the log has the recyclable records.
+     * @param level0 the level-0 files be flushed during replaying be appended
+     *        to it, the replayed records are all in them if not empty.
+     */
+    base::Status Redo(uint64_t log_file_number, uint64_t *last_version,
+                      uint64_t *offset, bool *recycled,
+                      std::vector<base::Handle<FileMetadata>> *level0);
     void DeleteObsoleteFiles();
 
     base::Status MakeRoomForWrite(bool force, std::unique_lock<std::mutex> *lock);
+    // Wait to be the current logger, only the logger appends the redo-log,
+    // inserts the mutable table and switches them.
+    // REQUIRES: mutex_.lock()
+    void AcquireLogger(std::unique_lock<std::mutex> *lock);
+    // REQUIRES: mutex_.lock()
+    void ReleaseLogger();
     void MaybeScheduleCompaction();
     void BackgroundWork();
     void BackgroundCompaction();
     base::Status CompactMemoryTable();
     base::Status WriteLevel0Table(const Version *current, VersionPatch *patch,
                                   MemoryTable *table);
-    base::Status BuildTable(Iterator *iter, FileMetadata *metadata);
+    base::Status BuildTable(Iterator *iter, uint64_t expected_size,
+                            FileMetadata *metadata, uint64_t *num_entries);
+    // The table file for the flush and compaction outputs, the writing be
+    // throttled by the rate limiter with the priority.
+    base::Status CreateTableFile(const std::string &file_name,
+                                 RateLimiter::Priority priority,
+                                 uint64_t expected_size,
+                                 base::AppendFile **file);
+    // The new redo-log file, renamed from the recycled one if any.
+    base::Status CreateLogFile(uint64_t number, base::AppendFile **file);
+    // Continue the redo-log at the offset, the tail after it be dropped.
+    base::Status ReopenLogFile(uint64_t number, uint64_t offset,
+                               base::AppendFile **file);
+    base::Status PrepareLogFile(base::AppendFile **file);
+
+    /**
+     * Check the file built by SstFileWriter, and get its user key range.
+     */
+    base::Status ReadExternalFile(const std::string &file_name,
+                                  std::string *smallest, std::string *largest);
+
+    /**
+     * Link or copy the external file to the table file "number".
+     */
+    base::Status ImportExternalFile(const std::string &file_name,
+                                    uint64_t number);
+
+    bool OverlapMemoryTable(MemoryTable *table,
+                            const base::Slice &smallest,
+                            const base::Slice &largest);
+
+    // REQUIRES: mutex_.lock()
+    int PickIngestionLevel(const Version *current,
+                           const base::Slice &smallest,
+                           const base::Slice &largest);
+
+    // REQUIRES: mutex_.lock()
+    void SetBackgroundError(BackgroundErrorReason reason,
+                            const base::Status &status);
+
+    /**
+     * Notify the listeners if the stall condition changed.
+     *
+     * REQUIRES: mutex_.lock()
+     * @return true if the mutex_ had be released for notifying.
+     */
+    bool SetStallCondition(WriteStallCondition condition);
 
     // For testing:
     void TEST_WaitForBackground();
@@ -163,17 +251,27 @@ public:
     constexpr static const auto kName = "yukino.lsm";
 
     class WritingHandler;
+    class RedoPipeline;
 private:
 
     Env *env_ = nullptr;
     std::string db_name_;
     const size_t block_size_;
     const int block_restart_interval_;
+    const bool use_direct_io_;
+    const std::shared_ptr<RateLimiter> rate_limiter_;
+    const size_t bytes_per_sync_;
+    const size_t wal_bytes_per_sync_;
+    const bool allow_fallocate_;
+    const size_t recycle_log_file_num_;
+    const bool flush_on_close_;
 
     base::Handle<MemoryTable> mutable_;
     base::Handle<MemoryTable> immtable_;
 
     size_t write_buffer_size_ = 0;
+    const std::vector<std::shared_ptr<EventListener>> listeners_;
+    WriteStallCondition stall_condition_ = kStallNormal;
     base::Status background_error_;
     std::condition_variable background_cv_;
     bool background_active_ = false;
@@ -187,6 +285,16 @@ private:
     std::unique_ptr<util::LogWriter> log_;
     std::unique_ptr<base::AppendFile> log_file_;
     uint64_t log_file_number_ = 0;
+    bool logging_ = false;
+    std::condition_variable logger_cv_;
+
+    // The redo-logs be written in recyclable records from the head, and the
+    // obsolete ones be kept for recycling.
+    std::set<uint64_t> recyclable_logs_;
+    std::deque<uint64_t> recycled_logs_;
+
+    // The table files be imported but not in the version yet.
+    std::set<uint64_t> pending_outputs_;
 
     std::mutex mutex_;
 };
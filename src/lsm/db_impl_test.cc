@@ -6,12 +6,27 @@
 //
 //
 #include "lsm/db_impl.h"
+#include "lsm/builtin.h"
+#include "lsm/format.h"
+#include "util/log.h"
+#include "base/io-inl.h"
+#include "base/io.h"
 #include "yukino/env.h"
 #include "yukino/options.h"
 #include "yukino/write_batch.h"
 #include "yukino/iterator.h"
+#include "yukino/perf_context.h"
+#include "yukino/listener.h"
+#include "yukino/rate_limiter.h"
 #include "gtest/gtest.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace yukino {
 
@@ -23,13 +38,19 @@ public:
     }
 
     virtual void SetUp() override {
+        // Unique directory, the tests can be run in parallel.
+        char dir[] = "/tmp/yukino_lsm_db_impl_test.XXXXXX";
+        ASSERT_TRUE(::mkdtemp(dir) != nullptr);
+        dir_ = dir;
+        name_ = dir_ + "/db";
     }
 
     virtual void TearDown() override {
-        Env::Default()->DeleteFile(kName, true);
+        Env::Default()->DeleteFile(dir_, true);
     }
 
-    constexpr static const auto kName = "demo";
+    std::string dir_;
+    std::string name_;
 };
 
 TEST_F(DBImplTest, Sanity) {
@@ -37,7 +58,7 @@ TEST_F(DBImplTest, Sanity) {
 
     options.create_if_missing = true;
 
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -58,11 +79,11 @@ TEST_F(DBImplTest, UniqueDBLock) {
 
     options.create_if_missing = true;
 
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
-    DBImpl db_miss(options, kName);
+    DBImpl db_miss(options, name_);
     rs = db_miss.Open(options);
     ASSERT_FALSE(rs.ok());
 }
@@ -72,7 +93,7 @@ TEST_F(DBImplTest, Snapshot) {
 
     options.create_if_missing = true;
 
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -104,7 +125,7 @@ TEST_F(DBImplTest, Recovery) {
     options.create_if_missing = true;
 
     {
-        DBImpl db(options, kName);
+        DBImpl db(options, name_);
         auto rs = db.Open(options);
         ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -118,7 +139,7 @@ TEST_F(DBImplTest, Recovery) {
     }
 
     {
-        DBImpl db(options, kName);
+        DBImpl db(options, name_);
         auto rs = db.Open(options);
         ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -129,18 +150,123 @@ TEST_F(DBImplTest, Recovery) {
     }
 }
 
+TEST_F(DBImplTest, ConcurrentWrite) {
+    static const auto kNumThreads = 4;
+    static const auto kNumWrites  = 2000;
+
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = 64 * base::kKB;
+
+    {
+        DBImpl db(options, name_);
+        auto rs = db.Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        // The memory tables be switched by the writers and the flushing.
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < kNumThreads; ++i) {
+            threads.emplace_back([&db, i]() {
+                std::string value(100, 'v');
+                for (auto j = 0; j < kNumWrites; ++j) {
+                    auto key = base::Strings::Sprintf("key.%d.%05d", i, j);
+                    auto rs = db.Put(WriteOptions(), key, value);
+                    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+                    if (j % 500 == 0) {
+                        FlushOptions flush_options;
+                        flush_options.wait = false;
+                        rs = db.Flush(flush_options);
+                        ASSERT_TRUE(rs.ok()) << rs.ToString();
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        for (auto j = 0; j < kNumWrites; ++j) {
+            auto key = base::Strings::Sprintf("key.%d.%05d", i, j);
+            rs = db.Get(ReadOptions(), key, &value);
+            ASSERT_TRUE(rs.ok()) << key << ", " << rs.ToString();
+            EXPECT_EQ(std::string(100, 'v'), value);
+        }
+    }
+}
+
+TEST_F(DBImplTest, ConcurrentOverwrite) {
+    static const auto kNumThreads = 4;
+    static const auto kNumKeys    = 16;
+    static const auto kNumWrites  = 500;
+
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = 4 * base::kKB;
+
+    std::vector<std::string> values(kNumKeys);
+    {
+        DBImpl db(options, name_);
+        auto rs = db.Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        // The versions and the redo log records be in the same order, even
+        // the memory tables be switched meanwhile.
+        std::vector<std::thread> threads;
+        for (auto i = 0; i < kNumThreads; ++i) {
+            threads.emplace_back([&db, i]() {
+                for (auto j = 0; j < kNumWrites; ++j) {
+                    auto key = base::Strings::Sprintf("key.%02d",
+                                                      j % kNumKeys);
+                    auto value = base::Strings::Sprintf("value.%d.%05d", i, j);
+                    auto rs = db.Put(WriteOptions(), key, value);
+                    ASSERT_TRUE(rs.ok()) << rs.ToString();
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        for (auto i = 0; i < kNumKeys; ++i) {
+            auto key = base::Strings::Sprintf("key.%02d", i);
+            rs = db.Get(ReadOptions(), key, &values[i]);
+            ASSERT_TRUE(rs.ok()) << key << ", " << rs.ToString();
+        }
+    }
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    for (auto i = 0; i < kNumKeys; ++i) {
+        auto key = base::Strings::Sprintf("key.%02d", i);
+        rs = db.Get(ReadOptions(), key, &value);
+        ASSERT_TRUE(rs.ok()) << key << ", " << rs.ToString();
+        EXPECT_EQ(values[i], value) << key;
+    }
+}
+
 TEST_F(DBImplTest, Level0Dump) {
     Options options;
 
     options.create_if_missing = true;
     options.write_buffer_size = 128;
 
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
-    auto defer = base::Defer([&options](){
-        options.env->DeleteFile(kName, true);
+    auto defer = base::Defer([this, &options](){
+        options.env->DeleteFile(name_, true);
     });
 
     std::string value(64, '1');
@@ -166,6 +292,214 @@ TEST_F(DBImplTest, Level0Dump) {
     EXPECT_EQ("3", found);
 }
 
+TEST_F(DBImplTest, PreadReads) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+    options.use_mmap_reads = false;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(64, 'v');
+    for (int i = 0; i < 20; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    db.TEST_WaitForBackground();
+
+    std::string found;
+    for (int i = 0; i < 20; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db.Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(value, found);
+    }
+
+    std::unique_ptr<Iterator> iter(db.NewIterator(ReadOptions()));
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    EXPECT_EQ(20, count);
+}
+
+TEST_F(DBImplTest, DirectIOForFlushAndCompaction) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+    options.use_direct_io_for_flush_and_compaction = true;
+    options.compaction_readahead_size = 8 * base::kKB;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // The overlapped level-0 files be compacted, not moved only.
+    char key[32];
+    std::string value(64, 'v');
+    for (int i = 0; i < 40; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i % 8);
+        value[0] = 'a' + i;
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        db.TEST_WaitForBackground();
+    }
+
+    std::string found;
+    for (int i = 32; i < 40; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i % 8);
+        value[0] = 'a' + i;
+        rs = db.Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(value, found);
+    }
+}
+
+TEST_F(DBImplTest, RateLimiter) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+    options.rate_limiter.reset(NewGenericRateLimiter(base::kMB, 10 * 1000));
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(64, 'v');
+    for (int i = 0; i < 40; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i % 8);
+        value[0] = 'a' + i;
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        db.TEST_WaitForBackground();
+    }
+
+    // Flushes and compactions be charged by their priorities.
+    auto limiter = options.rate_limiter.get();
+    EXPECT_LT(0, limiter->GetTotalBytesThrough(RateLimiter::kPriorityHigh));
+    EXPECT_LT(0, limiter->GetTotalBytesThrough(RateLimiter::kPriorityLow));
+
+    std::string found;
+    for (int i = 32; i < 40; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i % 8);
+        value[0] = 'a' + i;
+        rs = db.Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(value, found);
+    }
+}
+
+TEST_F(DBImplTest, IncrementalSync) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 32 * base::kKB;
+    options.bytes_per_sync = 4 * base::kKB;
+    options.wal_bytes_per_sync = 4 * base::kKB;
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    auto rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(100, 'v');
+    for (int i = 0; i < 2000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    db->TEST_WaitForBackground();
+
+    // The preallocated space is not in the files, reopen and replay.
+    db.reset();
+    db.reset(new DBImpl(options, name_));
+    rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string found;
+    for (int i = 0; i < 2000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(value, found);
+    }
+}
+
+TEST_F(DBImplTest, RecycleLogFile) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 32 * base::kKB;
+    options.recycle_log_file_num = 2;
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    auto rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(100, 'v');
+    for (int i = 0; i < 2000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    db->TEST_WaitForBackground();
+
+    // The live log and the recycled ones.
+    std::vector<std::string> children;
+    rs = Env::Default()->GetChildren(name_, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto num_logs = 0;
+    for (const auto &child : children) {
+        if (std::get<0>(Files::ParseName(child)) == Files::kLog) {
+            num_logs++;
+        }
+    }
+    EXPECT_LE(2, num_logs);
+    EXPECT_GE(3, num_logs);
+
+    // The recycled log has the stale records after the new ones.
+    std::string new_value(100, 'n');
+    for (int i = 0; i < 10; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Put(WriteOptions(), key, new_value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+
+    // Reopen twice, the second one replays the records written after the
+    // first recovery.
+    for (int i = 0; i < 2; ++i) {
+        db.reset();
+        db.reset(new DBImpl(options, name_));
+        rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        rs = db->Put(WriteOptions(), "reopened", std::to_string(i));
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+
+    std::string found;
+    for (int i = 0; i < 2000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(i < 10 ? new_value : value, found);
+    }
+    rs = db->Get(ReadOptions(), "reopened", &found);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("1", found);
+}
+
 TEST_F(DBImplTest, DumpThenRecovery) {
     Options options;
 
@@ -174,7 +508,7 @@ TEST_F(DBImplTest, DumpThenRecovery) {
 
     std::string value(64, '2');
     {
-        std::unique_ptr<DBImpl> db(new DBImpl(options, kName));
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
         auto rs = db->Open(options);
         ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -191,7 +525,7 @@ TEST_F(DBImplTest, DumpThenRecovery) {
     }
 
     {
-        std::unique_ptr<DBImpl> db(new DBImpl(options, kName));
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
         auto rs = db->Open(options);
         ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -206,12 +540,283 @@ TEST_F(DBImplTest, DumpThenRecovery) {
     }
 }
 
+TEST_F(DBImplTest, FlushInRedo) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 4 * base::kMB;
+
+    char key[32];
+    std::string value(100, 'v');
+    {
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+        auto rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        for (int i = 0; i < 3000; ++i) {
+            ::snprintf(key, sizeof(key), "key.%05d", i);
+            rs = db->Put(WriteOptions(), key, value);
+            ASSERT_TRUE(rs.ok()) << rs.ToString();
+        }
+    }
+
+    // The log is larger than the memory table, the replaying flushes it to
+    // level-0 files, and switches to a new log.
+    options.write_buffer_size = 64 * base::kKB;
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    auto rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    db->TEST_WaitForBackground();
+
+    std::vector<std::string> children;
+    rs = Env::Default()->GetChildren(name_, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto num_logs = 0, num_tables = 0;
+    for (const auto &child : children) {
+        auto type = std::get<0>(Files::ParseName(child));
+        num_logs   += (type == Files::kLog);
+        num_tables += (type == Files::kTable);
+    }
+    EXPECT_EQ(1, num_logs);
+    EXPECT_LT(1, num_tables);
+
+    rs = db->Put(WriteOptions(), "key.00000", "new");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    db.reset();
+    db.reset(new DBImpl(options, name_));
+    rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string found;
+    for (int i = 0; i < 3000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db->Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(i == 0 ? "new" : value, found);
+    }
+}
+
+TEST_F(DBImplTest, OrphanTablesInRecovery) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 4 * base::kMB;
+
+    char key[32];
+    std::string value(100, 'v');
+    {
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+        auto rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        for (int i = 0; i < 3000; ++i) {
+            ::snprintf(key, sizeof(key), "key.%05d", i);
+            rs = db->Put(WriteOptions(), key, value);
+            ASSERT_TRUE(rs.ok()) << rs.ToString();
+        }
+    }
+
+    // The stale tables be left by the interrupted compactions, the tables
+    // flushed in recovery must not be written over them.
+    for (uint64_t i = 1; i < 40; ++i) {
+        auto file_name = TableFileName(name_, i);
+        if (Env::Default()->FileExists(file_name)) {
+            continue;
+        }
+        auto rs = WriteStringToFile(Env::Default(), "stale", file_name);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+
+    options.write_buffer_size = 64 * base::kKB;
+    for (auto i = 0; i < 2; ++i) {
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+        auto rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        db->TEST_WaitForBackground();
+
+        std::string found;
+        for (int j = 0; j < 3000; ++j) {
+            ::snprintf(key, sizeof(key), "key.%05d", j);
+            rs = db->Get(ReadOptions(), key, &found);
+            ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+            EXPECT_EQ(value, found);
+        }
+    }
+}
+
+TEST_F(DBImplTest, RedoNewerLogs) {
+    Options options;
+
+    options.create_if_missing = true;
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    auto rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = db->Put(WriteOptions(), "aaa", "1");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    db.reset();
+
+    // The log switched before closing, but its immutable table be not
+    // flushed, so it is not in the manifest.
+    uint64_t max_number = 0;
+    std::vector<std::string> children;
+    rs = Env::Default()->GetChildren(name_, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    for (const auto &child : children) {
+        max_number = std::max(max_number, std::get<1>(Files::ParseName(child)));
+    }
+    auto log_number = max_number + 10;
+    {
+        base::AppendFile *file = nullptr;
+        rs = Env::Default()->CreateAppendFile(LogFileName(name_, log_number),
+                                              &file);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        std::unique_ptr<base::AppendFile> holder(file);
+        util::Log::Writer log(file, util::Log::kDefaultBlockSize);
+
+        WriteBatch batch;
+        batch.Put("aaa", "3");
+        batch.Put("bbb", "2");
+        ASSERT_TRUE(log.Append(batch.buf()).ok());
+        ASSERT_TRUE(file->Sync().ok());
+    }
+
+    // Reopen twice, the second one reads the flushed records.
+    for (int i = 0; i < 2; ++i) {
+        db.reset(new DBImpl(options, name_));
+        rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        std::string found;
+        rs = db->Get(ReadOptions(), "aaa", &found);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        EXPECT_EQ("3", found);
+        rs = db->Get(ReadOptions(), "bbb", &found);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        EXPECT_EQ("2", found);
+
+        // The replayed logs be obsolete after flushing.
+        EXPECT_FALSE(Env::Default()->FileExists(LogFileName(name_,
+                                                            log_number)));
+        db.reset();
+    }
+}
+
+TEST_F(DBImplTest, FlushOnClose) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.flush_on_close = true;
+
+    {
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+        auto rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        rs = db->Put(WriteOptions(), "aaa", "1");
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        rs = db->Flush(FlushOptions());
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        // Nothing to flush.
+        rs = db->Flush(FlushOptions());
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        rs = db->Put(WriteOptions(), "bbb", "2");
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+
+    // All of the data be in the table files, the logs are not needed.
+    std::vector<std::string> children;
+    auto rs = Env::Default()->GetChildren(name_, &children);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    for (const auto &child : children) {
+        if (std::get<0>(Files::ParseName(child)) == Files::kLog) {
+            auto path = std::string(name_) + "/" + child;
+            ASSERT_EQ(0, ::truncate(path.c_str(), 0));
+        }
+    }
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string found;
+    rs = db->Get(ReadOptions(), "aaa", &found);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("1", found);
+    rs = db->Get(ReadOptions(), "bbb", &found);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("2", found);
+}
+
+TEST_F(DBImplTest, ManifestRollover) {
+    Options options;
+
+    options.create_if_missing = true;
+    // Every patch switches to a new manifest.
+    options.max_manifest_file_size = 1;
+
+    auto manifests = [this](std::vector<uint64_t> *numbers) {
+        std::vector<std::string> children;
+        auto rs = Env::Default()->GetChildren(name_, &children);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        numbers->clear();
+        for (const auto &child : children) {
+            auto rv = Files::ParseName(child);
+            if (std::get<0>(rv) == Files::kManifest) {
+                numbers->push_back(std::get<1>(rv));
+            }
+        }
+    };
+
+    std::vector<uint64_t> numbers;
+    {
+        std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+        auto rs = db->Open(options);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        uint64_t last_manifest = 0;
+        for (auto i = 0; i < 3; ++i) {
+            auto key = base::Strings::Sprintf("k.%d", i);
+            rs = db->Put(WriteOptions(), key, "v");
+            ASSERT_TRUE(rs.ok()) << rs.ToString();
+            rs = db->Flush(FlushOptions());
+            ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+            // The old manifest be deleted after the switching.
+            manifests(&numbers);
+            ASSERT_EQ(1, numbers.size());
+            EXPECT_LT(last_manifest, numbers[0]);
+            last_manifest = numbers[0];
+        }
+    }
+
+    std::string buf;
+    auto rs = base::ReadAll(CurrentFileName(name_), &buf);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(base::Strings::Sprintf("%" PRIu64 "\n", numbers[0]), buf);
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string found;
+    for (auto i = 0; i < 3; ++i) {
+        auto key = base::Strings::Sprintf("k.%d", i);
+        rs = db->Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        EXPECT_EQ("v", found);
+    }
+}
+
 TEST_F(DBImplTest, DBIterator) {
     Options options;
 
     options.create_if_missing = true;
 
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -234,6 +839,48 @@ TEST_F(DBImplTest, DBIterator) {
     }
 }
 
+TEST_F(DBImplTest, IteratorPinsMemoryTables) {
+    Options options;
+
+    options.create_if_missing = true;
+    options.write_buffer_size = 32 * base::kKB;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(100, 'v');
+    for (int i = 0; i < 100; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    std::unique_ptr<Iterator> iter(db.NewIterator(ReadOptions()));
+
+    // The memory tables be switched and flushed after the iterator created.
+    for (int i = 100; i < 2000; ++i) {
+        ::snprintf(key, sizeof(key), "key.%05d", i);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    db.TEST_WaitForBackground();
+
+    auto count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    EXPECT_EQ(100, count);
+    iter.reset();
+
+    iter.reset(db.NewIterator(ReadOptions()));
+    count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    EXPECT_EQ(2000, count);
+}
+
 TEST_F(DBImplTest, DISABLED_LargeWriteForDumping) {
     Options options;
 
@@ -243,7 +890,7 @@ TEST_F(DBImplTest, DISABLED_LargeWriteForDumping) {
     WriteOptions write_options;
 
     std::string value(128, 'f');
-    DBImpl db(options, kName);
+    DBImpl db(options, name_);
     auto rs = db.Open(options);
     ASSERT_TRUE(rs.ok()) << rs.ToString();
 
@@ -259,6 +906,291 @@ TEST_F(DBImplTest, DISABLED_LargeWriteForDumping) {
     db.TEST_DumpVersions();
 }
 
+TEST_F(DBImplTest, PerfContext) {
+    Options options;
+
+    options.create_if_missing = true;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = db.Put(WriteOptions(), "aaa", "1");
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string buf;
+    SetPerfLevel(kPerfDisable);
+    GetPerfContext()->Reset();
+    rs = db.Get(ReadOptions(), "aaa", &buf);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(0, GetPerfContext()->user_key_comparison_count);
+    EXPECT_EQ(0, GetPerfContext()->memtable_probe_count);
+    EXPECT_EQ("", GetPerfContext()->ToString());
+
+    SetPerfLevel(kPerfEnableTime);
+    rs = db.Get(ReadOptions(), "aaa", &buf);
+    SetPerfLevel(kPerfDisable);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_LT(0, GetPerfContext()->user_key_comparison_count);
+    EXPECT_EQ(1, GetPerfContext()->memtable_probe_count);
+    EXPECT_EQ(0, GetPerfContext()->table_probe_count);
+    EXPECT_LT(0, GetPerfContext()->get_nanos);
+    EXPECT_NE(std::string::npos,
+              GetPerfContext()->ToString().find("memtable_probe_count = 1"));
+
+    GetPerfContext()->Reset();
+    EXPECT_EQ(0, GetPerfContext()->get_nanos);
+}
+
+namespace {
+
+class TestListener : public EventListener {
+public:
+    virtual void OnFlushBegin(DB *db, const FlushJobInfo &info) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        flush_begin++;
+    }
+
+    virtual void OnFlushCompleted(DB *db, const FlushJobInfo &info) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        flushes.push_back(info);
+    }
+
+    virtual void OnCompactionBegin(DB *db,
+                                   const CompactionJobInfo &info) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        compaction_begin++;
+    }
+
+    virtual void OnCompactionCompleted(DB *db,
+                                       const CompactionJobInfo &info) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        compactions.push_back(info);
+    }
+
+    std::mutex mutex;
+    int flush_begin = 0;
+    int compaction_begin = 0;
+    std::vector<FlushJobInfo> flushes;
+    std::vector<CompactionJobInfo> compactions;
+};
+
+} // namespace
+
+TEST_F(DBImplTest, EventListener) {
+    Options options;
+
+    auto listener = std::make_shared<TestListener>();
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+    options.listeners.push_back(listener);
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // The level-0 files must be overlapped, or they will be moved only.
+    char key[32];
+    std::string value(200, 'v');
+    for (int i = 0; i < 16; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i % 2);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        db.TEST_WaitForBackground();
+    }
+
+    std::unique_lock<std::mutex> lock(listener->mutex);
+    ASSERT_LE(kMaxNumberLevel0File, listener->flushes.size());
+    EXPECT_EQ(listener->flush_begin, listener->flushes.size());
+    for (const auto &info : listener->flushes) {
+        EXPECT_TRUE(info.status.ok()) << info.status.ToString();
+        EXPECT_EQ(std::string(name_), info.db_name);
+        EXPECT_LT(0, info.file_number);
+        EXPECT_LT(0, info.file_size);
+        EXPECT_EQ(1, info.num_entries);
+    }
+
+    ASSERT_LE(1, listener->compactions.size());
+    EXPECT_EQ(listener->compaction_begin, listener->compactions.size());
+    const auto &info = listener->compactions[0];
+    EXPECT_TRUE(info.status.ok()) << info.status.ToString();
+    EXPECT_EQ(0, info.input_level);
+    EXPECT_EQ(1, info.output_level);
+    EXPECT_EQ((kMaxNumberLevel0File + 1) / 2, info.input_files.size());
+    EXPECT_EQ(1, info.output_files.size());
+    EXPECT_EQ(info.input_files.size(), info.records_in);
+    EXPECT_LT(0, info.bytes_read);
+    EXPECT_LT(0, info.bytes_written);
+}
+
+TEST_F(DBImplTest, TrivialMove) {
+    Options options;
+
+    auto listener = std::make_shared<TestListener>();
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+    options.listeners.push_back(listener);
+
+    std::unique_ptr<DBImpl> db(new DBImpl(options, name_));
+    auto rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    std::string value(200, 'v');
+    for (int i = 0; i < 16; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db->Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        db->TEST_WaitForBackground();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(listener->mutex);
+        ASSERT_LE(1, listener->compactions.size());
+        const auto &info = listener->compactions[0];
+        EXPECT_TRUE(info.status.ok()) << info.status.ToString();
+        EXPECT_EQ(0, info.input_level);
+        EXPECT_EQ(1, info.output_level);
+        EXPECT_EQ((kMaxNumberLevel0File + 1) / 2, info.input_files.size());
+        EXPECT_EQ(info.input_files, info.output_files);
+        EXPECT_EQ(0, info.bytes_read);
+        EXPECT_EQ(0, info.bytes_written);
+    }
+
+    db.reset();
+    db.reset(new DBImpl(options, name_));
+    rs = db->Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string found;
+    for (int i = 0; i < 16; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db->Get(ReadOptions(), key, &found);
+        ASSERT_TRUE(rs.ok()) << key << ": " << rs.ToString();
+        EXPECT_EQ(value, found);
+    }
+}
+
+TEST_F(DBImplTest, MultiGet) {
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = 128;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // Each key be dumped to a level-0 table, and some be compacted.
+    char key[32];
+    for (int i = 0; i < 16; ++i) {
+        ::snprintf(key, sizeof(key), "key.%02d", i);
+        rs = db.Put(WriteOptions(), key, std::string(200, 'a' + i));
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        db.TEST_WaitForBackground();
+    }
+
+    auto snapshot = db.GetSnapshot();
+    ASSERT_TRUE(db.Put(WriteOptions(), "key.03", "3").ok());
+    ASSERT_TRUE(db.Delete(WriteOptions(), "key.05").ok());
+
+    std::vector<base::Slice> keys = {
+        "key.07", "key.03", "key", "key.05", "key.00", "key.07", "key.15",
+        "zzz",
+    };
+    std::vector<std::string> values;
+    std::vector<base::Status> status;
+    db.MultiGet(ReadOptions(), keys, &values, &status);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), status.size());
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string value;
+        rs = db.Get(ReadOptions(), keys[i], &value);
+        EXPECT_EQ(rs.ok(), status[i].ok()) << keys[i].ToString();
+        EXPECT_EQ(rs.IsNotFound(), status[i].IsNotFound())
+                << keys[i].ToString();
+        if (rs.ok()) {
+            EXPECT_EQ(value, values[i]) << keys[i].ToString();
+        }
+    }
+    EXPECT_EQ(std::string(200, 'h'), values[0]);
+    EXPECT_EQ("3", values[1]);
+    EXPECT_TRUE(status[2].IsNotFound());
+    EXPECT_TRUE(status[3].IsNotFound());
+    EXPECT_EQ(std::string(200, 'a'), values[4]);
+    EXPECT_EQ(values[0], values[5]);
+    EXPECT_EQ(std::string(200, 'p'), values[6]);
+    EXPECT_TRUE(status[7].IsNotFound());
+
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    db.MultiGet(read_options, keys, &values, &status);
+    ASSERT_TRUE(status[1].ok()) << status[1].ToString();
+    EXPECT_EQ(std::string(200, 'd'), values[1]);
+    ASSERT_TRUE(status[3].ok()) << status[3].ToString();
+    EXPECT_EQ(std::string(200, 'f'), values[3]);
+    db.ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBImplTest, ConcurrentReadSstFiles) {
+    static const auto kNumThreads = 4;
+    static const auto kNumKeys    = 200;
+
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = 4 * base::kKB;
+
+    DBImpl db(options, name_);
+    auto rs = db.Open(options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value(100, 'v');
+    for (auto i = 0; i < kNumKeys; ++i) {
+        auto key = base::Strings::Sprintf("key.%05d", i);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    db.TEST_WaitForBackground();
+
+    // The readers probe the sst files without the db mutex, and the writer
+    // switches the versions meanwhile.
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([&db, i]() {
+            std::string value;
+            for (auto j = 0; j < kNumKeys; ++j) {
+                auto key = base::Strings::Sprintf("key.%05d",
+                                                  (i + j) % kNumKeys);
+                if (j % 2) {
+                    auto rs = db.Get(ReadOptions(), key, &value);
+                    ASSERT_TRUE(rs.ok()) << key << ", " << rs.ToString();
+                    EXPECT_EQ(std::string(100, 'v'), value);
+                    continue;
+                }
+                std::vector<base::Slice> keys = {key, "zzz"};
+                std::vector<std::string> values;
+                std::vector<base::Status> status;
+                db.MultiGet(ReadOptions(), keys, &values, &status);
+                ASSERT_TRUE(status[0].ok()) << key << ", "
+                                            << status[0].ToString();
+                EXPECT_EQ(std::string(100, 'v'), values[0]);
+                EXPECT_TRUE(status[1].IsNotFound());
+            }
+        });
+    }
+    for (auto i = 0; i < kNumKeys; ++i) {
+        auto key = base::Strings::Sprintf("other.%05d", i);
+        rs = db.Put(WriteOptions(), key, value);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
 } // namespace lsm
 
 } // namespace yukino
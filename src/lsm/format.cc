@@ -1,4 +1,5 @@
 #include "lsm/format.h"
+#include "yukino/perf_context-inl.h"
 #include "base/io-inl.h"
 #include "base/io.h"
 #include "glog/logging.h"
@@ -17,6 +18,8 @@ InternalKeyComparator::~InternalKeyComparator() {
 }
 
 int InternalKeyComparator::Compare(const base::Slice& a, const base::Slice& b) const {
+    PERF_COUNTER_ADD(user_key_comparison_count, 1);
+
     base::BufferedReader ra(a.data(), a.size());
     base::BufferedReader rb(b.data(), b.size());
 
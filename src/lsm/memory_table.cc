@@ -2,6 +2,7 @@
 #include "lsm/memory_table.h"
 #include "lsm/format.h"
 #include "lsm/builtin.h"
+#include "yukino/perf_context-inl.h"
 #include "yukino/iterator.h"
 #include "base/slice.h"
 #include "base/status.h"
@@ -39,6 +40,7 @@ base::Status MemoryTable::Get(const base::Slice &key, uint64_t version,
 }
 
 base::Status MemoryTable::Get(const InternalKey &key, std::string *value) {
+    PERF_COUNTER_ADD(memtable_probe_count, 1);
 
     Table::Iterator iter(&table_);
     iter.Seek(key);
@@ -65,6 +67,50 @@ base::Status MemoryTable::Get(const InternalKey &key, std::string *value) {
     return base::Status::OK();
 }
 
+void MemoryTable::MultiGet(KeyLookup **lookups, size_t n) {
+    PERF_COUNTER_ADD(memtable_probe_count, 1);
+
+    auto ucmp = comparator_.delegated();
+    KeyComparator cmp(comparator_);
+    Table::Iterator iter(&table_);
+    for (size_t i = 0; i < n; ++i) {
+        auto lookup = lookups[i];
+        if (lookup->done) {
+            continue;
+        }
+
+        // The keys are ascending, if the iterator is already at or past the
+        // key, it's also the seeking result of this key.
+        if (!iter.Valid() || cmp(iter.key(), lookup->key) < 0) {
+            iter.Seek(lookup->key);
+        }
+        if (!iter.Valid()) {
+            break;
+        }
+        if (ucmp->Compare(lookup->key.user_key_slice(),
+                          iter.key().user_key_slice()) != 0) {
+            continue;
+        }
+
+        auto tag = iter.key().tag();
+        switch (tag.flag) {
+            case kFlagValue:
+                lookup->value->assign(iter.key().value_slice().ToString());
+                *lookup->status = base::Status::OK();
+                break;
+
+            case kFlagDeletion:
+                *lookup->status = base::Status::NotFound("InternalKey deletion");
+                break;
+
+            default:
+                DLOG(FATAL) << "noreached";
+                break;
+        }
+        lookup->done = true;
+    }
+}
+
 class MemoryTableIterator : public Iterator {
 public:
     MemoryTableIterator(const MemoryTable::Table::Iterator &iter)
@@ -35,6 +35,13 @@ public:
 
     base::Status Get(const InternalKey &key, std::string *value);
 
+    /**
+     * Probe all the not done keys in one pass.
+     *
+     * @param lookups sorted by user key.
+     */
+    void MultiGet(KeyLookup **lookups, size_t n);
+
     Iterator *NewIterator();
 
     struct KeyComparator {
@@ -1,6 +1,7 @@
 #include "base/slice.h"
 #include "base/status.h"
 #include "yukino/comparator.h"
+#include "yukino/perf_context-inl.h"
 #include "lsm/merger.h"
 #include "glog/logging.h"
 
@@ -104,6 +105,8 @@ void MergingIterator::SeekToLast() {
 }
 
 void MergingIterator::Seek(const base::Slice& target) {
+    PERF_COUNTER_ADD(merge_child_seek_count, num_children_);
+
     for (size_t i = 0; i < num_children_; ++i) {
         auto child = &children_[i];
 
@@ -1,6 +1,7 @@
 #include "lsm/table.h"
 #include "lsm/builtin.h"
 #include "yukino/comparator.h"
+#include "yukino/perf_context-inl.h"
 #include "base/io-inl.h"
 #include "base/io.h"
 #include "base/varint_encoding.h"
@@ -13,34 +14,47 @@ namespace yukino {
 namespace lsm {
 
 Table::Table(const Comparator *comparator, base::MappedMemory *mmap)
-    : mmap_(DCHECK_NOTNULL(mmap))
+    : mapped_file_(new base::MappedRandomAccessFile(DCHECK_NOTNULL(mmap)))
+    , file_(mapped_file_.get())
     , comparator_(comparator) {
 
-    DCHECK(mmap_->Valid());
+    DCHECK(mmap->Valid());
+}
+
+Table::Table(const Comparator *comparator, base::RandomAccessFile *file)
+    : file_(DCHECK_NOTNULL(file))
+    , comparator_(comparator) {
 }
 
 Table::~Table() {
 }
 
 base::Status Table::Init() {
-    if (mmap_->size() < kFooterFixedSize) {
+    if (file_->size() < kFooterFixedSize) {
         return base::Status::IOError("SST file is too small.");
     }
 
-    const uint8_t *magic_number = mmap_->buf(mmap_->size() - sizeof(uint32_t));
+    std::string scratch;
+    base::Slice footer;
+    auto rs = file_->Read(file_->size() - kFooterFixedSize, kFooterFixedSize,
+                          &footer, &scratch);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    auto magic_number = footer.data() + kFooterFixedSize - sizeof(uint32_t);
     if (*reinterpret_cast<const uint32_t *>(magic_number) != kMagicNumber) {
         return base::Status::IOError("Not valid SST file(bad magic number).");
     }
 
-    const uint8_t *footer = mmap_->buf(mmap_->size() - kFooterFixedSize);
-    base::BufferedReader reader(footer, kFooterFixedSize);
+    base::BufferedReader reader(footer.data(), kFooterFixedSize);
 
     file_version_ = reader.ReadVarint32();
     restart_interval_ = reader.ReadVarint32();
     block_size_ = reader.ReadVarint32();
 
     auto index_handle = ReadHandle(&reader);
-    if (index_handle.offset() + index_handle.size() > mmap_->size()) {
+    if (index_handle.offset() + index_handle.size() > file_->size()) {
         return base::Status::IOError("Not valid SST file(bad index handle).");
     }
 
@@ -56,30 +70,52 @@ BlockHandle Table::ReadHandle(base::BufferedReader *reader) {
     return handle;
 }
 
-bool Table::VerifyBlock(const BlockHandle &handle, char *type) const {
+bool Table::VerifyBlock(const base::Slice &block, char *type) const {
+    PERF_COUNTER_ADD(block_read_count, 1);
+    PERF_COUNTER_ADD(block_read_byte, block.size());
+    PERF_TIMER_GUARD(checksum_nanos);
+
+    if (block.size() < kTrailerSize) {
+        return false;
+    }
+
     base::CRC32 crc32;
 
-    crc32.Update(mmap_->buf(handle.offset()),
-                 handle.size() - sizeof(base::CRC32::DigestTy));
+    crc32.Update(block.data(), block.size() - sizeof(base::CRC32::DigestTy));
 
     auto verified = crc32.digest();
 
-    base::BufferedReader reader(mmap_->buf(handle.offset() + handle.size() -
-                                           kTrailerSize), kTrailerSize);
+    base::BufferedReader reader(block.data() + block.size() - kTrailerSize,
+                                kTrailerSize);
     *type = reader.ReadByte();
 
     return verified == reader.ReadFixed32();
 }
 
+base::Status Table::ReadBlock(const BlockHandle &handle, std::string *scratch,
+                              base::Slice *block, char *type) const {
+    auto rs = file_->Read(handle.offset(), handle.size(), block, scratch);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    if (!VerifyBlock(*block, type)) {
+        return base::Status::IOError("Block CRC32 checksum fail!");
+    }
+    return base::Status::OK();
+}
+
 base::Status Table::LoadIndex(const BlockHandle &index_handle,
                               std::vector<Table::IndexEntry> *index) {
 
+    std::string scratch;
+    base::Slice block;
     char type = 0;
-    if (!VerifyBlock(index_handle, &type)) {
-        return base::Status::IOError("Block CRC32 checksum fail!");
+    auto rs = ReadBlock(index_handle, &scratch, &block, &type);
+    if (!rs.ok()) {
+        return rs;
     }
-    BlockIterator iter(comparator_, mmap_->buf(index_handle.offset()),
-                       index_handle.size());
+    BlockIterator iter(comparator_, block.data(), block.size());
     for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
         size_t len = 0;
 
@@ -139,9 +175,7 @@ void TableIterator::Seek(const base::Slice& target) {
         } else if (rv > 0) {
             left = middle + 1;
         } else {
-            SeekByHandle(entry.handle, true);
-            block_idx_ = middle;
-            block_iter_->Seek(target);
+            SeekInBlock(middle, target);
             return;
         }
     }
@@ -151,9 +185,7 @@ void TableIterator::Seek(const base::Slice& target) {
         auto rv = owned_->comparator_->Compare(target, entry.key);
 
         if (rv < 0) {
-            SeekByHandle(entry.handle, true);
-            block_idx_ = i;
-            block_iter_->Seek(target);
+            SeekInBlock(i, target);
             return;
         }
     }
@@ -208,19 +240,40 @@ base::Status TableIterator::status() const {
     return status_;
 }
 
+void TableIterator::SeekInBlock(int64_t idx, const base::Slice &target) {
+    const auto &handle = owned_->index_[idx].handle;
+
+    // Seeking the sorted keys lands in the same block again and again, the
+    // loaded block needs no verifying and rebuilding.
+    if (!block_iter_ || handle.offset() != loaded_offset_) {
+        SeekByHandle(handle, true);
+        if (!status_.ok()) {
+            return;
+        }
+    }
+    block_idx_ = idx;
+    block_iter_->Seek(target);
+}
+
 void TableIterator::SeekByHandle(const BlockHandle &handle, bool to_first) {
+    // The block_buf_ may be overwritten.
+    block_iter_.reset();
+    loaded_offset_ = static_cast<uint64_t>(-1);
+
+    base::Slice block;
     char type = 0;
-    if (!owned_->VerifyBlock(handle, &type) || type != kTypeData) {
-        status_ = base::Status::IOError("Block CRC32 checksum fail!");
+    auto rs = owned_->ReadBlock(handle, &block_buf_, &block, &type);
+    if (rs.ok() && type != kTypeData) {
+        rs = base::Status::IOError("Block CRC32 checksum fail!");
+    }
+    if (!rs.ok()) {
+        status_ = rs;
         return;
     }
 
-    auto block_base = owned_->mmap_->buf(handle.offset());
-
-    std::unique_ptr<Iterator> block_iter(new BlockIterator(owned_->comparator_,
-                                                           block_base,
-                                                           handle.size()));
-    block_iter_.swap(block_iter);
+    block_iter_.reset(new BlockIterator(owned_->comparator_, block.data(),
+                                        block.size()));
+    loaded_offset_ = handle.offset();
 
     if (to_first) {
         block_iter_->SeekToFirst();
@@ -5,6 +5,8 @@
 #include "base/status.h"
 #include "base/base.h"
 #include "yukino/iterator.h"
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace yukino {
@@ -14,6 +16,7 @@ class Comparator;
 namespace base {
 
 class MappedMemory;
+class RandomAccessFile;
 class BufferedReader;
 
 } // namespace base
@@ -31,13 +34,23 @@ public:
     };
 
     Table(const Comparator *comparator, base::MappedMemory *mmap);
+    Table(const Comparator *comparator, base::RandomAccessFile *file);
     virtual ~Table();
 
     base::Status Init();
 
     BlockHandle ReadHandle(base::BufferedReader *reader);
 
-    bool VerifyBlock(const BlockHandle &handle, char *type) const;
+    bool VerifyBlock(const base::Slice &block, char *type) const;
+
+    /**
+     * Read and verify the block.
+     *
+     * @param scratch the block may be read into it, the mapped file needs
+     *        no copying.
+     */
+    base::Status ReadBlock(const BlockHandle &handle, std::string *scratch,
+                           base::Slice *block, char *type) const;
 
     base::Status LoadIndex(const BlockHandle &handle,
                            std::vector<IndexEntry> *index);
@@ -52,7 +65,8 @@ public:
     friend class ChunkIterator;
 
 private:
-    base::MappedMemory *mmap_;
+    std::unique_ptr<base::RandomAccessFile> mapped_file_;
+    base::RandomAccessFile *file_;
     const Comparator *comparator_;
     std::vector<IndexEntry> index_;
 
@@ -79,10 +93,13 @@ public:
 
 private:
     void SeekByHandle(const BlockHandle &handle, bool to_first);
+    void SeekInBlock(int64_t idx, const base::Slice &target);
 
     const Table *owned_;
     std::unique_ptr<Iterator> block_iter_;
     int64_t block_idx_;
+    uint64_t loaded_offset_ = static_cast<uint64_t>(-1); // of block_iter_
+    std::string block_buf_; // of block_iter_, if the file is not mapped.
     base::Status status_;
     Direction direction_ = kForward;
 };
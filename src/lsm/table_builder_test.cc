@@ -9,6 +9,7 @@
 #include "lsm/table.h"
 #include "lsm/chunk.h"
 #include "yukino/comparator.h"
+#include "yukino/env.h"
 #include "base/mem_io.h"
 #include "base/io-inl.h"
 #include "base/io.h"
@@ -219,6 +220,52 @@ TEST_F(TableBuilderTest, LargeBlock) {
     EXPECT_EQ(blob_1block, iter.value());
 }
 
+TEST_F(TableBuilderTest, PreadFile) {
+    char key[32];
+    for (int i = 0; i < 100; ++i) {
+        ::snprintf(key, sizeof(key), "key.%03d", i);
+        auto rs = builder_->Append(Chunk::CreateKeyValue(key, key));
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    auto rs = builder_->Finalize();
+    ASSERT_TRUE(rs.ok());
+
+    static const char *kFileName = "demo.sst";
+    rs = base::WriteAll(kFileName, writer_->buf(), nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    base::RandomAccessFile *rv = nullptr;
+    rs = Env::Default()->CreateRandomAccessFile(kFileName, &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::RandomAccessFile> file(rv);
+    Env::Default()->DeleteFile(kFileName, false);
+    EXPECT_EQ(writer_->buf().size(), file->size());
+
+    Table table(BytewiseCompartor(), file.get());
+    rs = table.Init();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    Table::Iterator iter(&table);
+    int i = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        ::snprintf(key, sizeof(key), "key.%03d", i++);
+        EXPECT_EQ(key, iter.key());
+        EXPECT_EQ(key, iter.value());
+    }
+    EXPECT_EQ(100, i);
+    EXPECT_TRUE(iter.status().ok()) << iter.status().ToString();
+
+    for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+        ::snprintf(key, sizeof(key), "key.%03d", --i);
+        EXPECT_EQ(key, iter.key());
+    }
+    EXPECT_EQ(0, i);
+
+    iter.Seek("key.050");
+    ASSERT_TRUE(iter.Valid());
+    EXPECT_EQ("key.050", iter.key());
+}
+
 int FindLessOrEqual(int *a, int n, int k) {
 
     int left = 0, right = n - 1, middle = 0;
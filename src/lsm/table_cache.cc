@@ -2,49 +2,197 @@
 #include "lsm/table.h"
 #include "lsm/version.h"
 #include "lsm/chunk.h"
+#include "lsm/builtin.h"
+#include "yukino/perf_context-inl.h"
 #include "yukino/options.h"
+#include "yukino/comparator.h"
 #include "yukino/env.h"
+#include "base/io.h"
+#include <memory>
 
 namespace yukino {
 
 namespace lsm {
 
+namespace {
+
+// Read the keys of an ingested file with its global version.
+class GlobalVersionIterator : public Iterator {
+public:
+    GlobalVersionIterator(Iterator *iter, const Comparator *ucmp,
+                          uint64_t global_version)
+        : iter_(iter)
+        , ucmp_(ucmp)
+        , global_version_(global_version) {
+    }
+
+    virtual ~GlobalVersionIterator() override {}
+
+    virtual bool Valid() const override { return iter_->Valid(); }
+
+    virtual void SeekToFirst() override {
+        iter_->SeekToFirst();
+        Update();
+    }
+
+    virtual void SeekToLast() override {
+        iter_->SeekToLast();
+        Update();
+    }
+
+    virtual void Seek(const base::Slice& target) override {
+        // Every user key appears once in the file, the key in the file be
+        // skipped if its global version is newer than the target.
+        iter_->Seek(target);
+        if (iter_->Valid() &&
+            InternalKey::ExtractTag(target).version < global_version_ &&
+            ucmp_->Compare(InternalKey::ExtractUserKey(target),
+                           InternalKey::ExtractUserKey(iter_->key())) == 0) {
+            iter_->Next();
+        }
+        Update();
+    }
+
+    virtual void Next() override {
+        iter_->Next();
+        Update();
+    }
+
+    virtual void Prev() override {
+        iter_->Prev();
+        Update();
+    }
+
+    virtual base::Slice key() const override { return key_; }
+
+    virtual base::Slice value() const override { return iter_->value(); }
+
+    virtual base::Status status() const override { return iter_->status(); }
+
+private:
+    void Update() {
+        if (!iter_->Valid()) {
+            return;
+        }
+
+        auto user_key = InternalKey::ExtractUserKey(iter_->key());
+        auto tag = InternalKey::ExtractTag(iter_->key());
+        DCHECK_EQ(kExternalFileVersion, tag.version);
+
+        key_.assign(user_key.data(), user_key.size());
+        tag.version = global_version_;
+        auto encoded = tag.Encode();
+        key_.append(reinterpret_cast<const char *>(&encoded), sizeof(encoded));
+    }
+
+    std::unique_ptr<Iterator> iter_;
+    const Comparator *ucmp_;
+    const uint64_t global_version_;
+    std::string key_;
+};
+
+} // namespace
+
 TableCache::TableCache(const std::string &db_name, const Options &options)
     : env_(options.env)
     , db_name_(db_name)
-    , comparator_(options.comparator) {
+    , comparator_(options.comparator)
+    , use_mmap_reads_(options.use_mmap_reads)
+    , use_direct_io_(options.use_direct_io_for_flush_and_compaction)
+    , compaction_readahead_size_(options.compaction_readahead_size) {
 }
 
 Iterator *TableCache::CreateIterator(const ReadOptions &options,
-                                     uint64_t file_number, uint64_t file_size) {
+                                     uint64_t file_number, uint64_t file_size,
+                                     uint64_t global_version) {
     base::Handle<CacheEntry> entry;
 
+    std::unique_lock<std::mutex> lock(mutex_);
     auto found = cached_.find(file_number);
     if (found == cached_.end()) {
+        lock.unlock();
+        PERF_COUNTER_ADD(table_cache_miss_count, 1);
+
         entry = new CacheEntry;
         entry->file_name = TableFileName(db_name_, file_number);
 
-        auto rs = env_->CreateRandomAccessFile(entry->file_name, &entry->mmap);
+        base::Status rs;
+        if (use_mmap_reads_) {
+            rs = env_->CreateRandomAccessFile(entry->file_name, &entry->mmap);
+            if (rs.ok()) {
+                entry->table = new Table(&comparator_, entry->mmap);
+            }
+        } else {
+            rs = env_->CreateRandomAccessFile(entry->file_name, &entry->file);
+            if (rs.ok()) {
+                entry->table = new Table(&comparator_, entry->file);
+            }
+        }
         if (!rs.ok()) {
             return CreateErrorIterator(rs);
         }
-        entry->table = new Table(&comparator_, entry->mmap);
         rs = entry->table->Init();
         if (!rs.ok()) {
             return CreateErrorIterator(rs);
         }
 
-        cached_.emplace(file_number, entry);
+        // Another thread may open it meanwhile, the first one be cached.
+        lock.lock();
+        entry = cached_.emplace(file_number, entry).first->second;
+        lock.unlock();
     } else {
+        PERF_COUNTER_ADD(table_cache_hit_count, 1);
         entry = found->second;
+        lock.unlock();
     }
 
-    auto iter = new Table::Iterator(entry->table);
+    Iterator *iter = new Table::Iterator(entry->table);
+    if (global_version != 0) {
+        iter = new GlobalVersionIterator(iter, comparator_.delegated(),
+                                         global_version);
+    }
     entry->AddRef();
     iter->RegisterCleanup([entry]() { entry->Release(); });
     return iter;
 }
 
+Iterator *TableCache::CreateCompactionIterator(uint64_t file_number,
+                                               uint64_t file_size,
+                                               uint64_t global_version) {
+    if (!use_direct_io_) {
+        return CreateIterator(ReadOptions(), file_number, file_size,
+                              global_version);
+    }
+
+    base::RandomAccessFile *rv = nullptr;
+    auto rs = env_->CreateDirectRandomAccessFile(TableFileName(db_name_,
+                                                               file_number),
+                                                 compaction_readahead_size_,
+                                                 &rv);
+    if (!rs.ok()) {
+        return CreateErrorIterator(rs);
+    }
+    std::unique_ptr<base::RandomAccessFile> file(rv);
+    std::unique_ptr<Table> table(new Table(&comparator_, file.get()));
+    rs = table->Init();
+    if (!rs.ok()) {
+        return CreateErrorIterator(rs);
+    }
+
+    Iterator *iter = new Table::Iterator(table.get());
+    if (global_version != 0) {
+        iter = new GlobalVersionIterator(iter, comparator_.delegated(),
+                                         global_version);
+    }
+    auto owned_table = table.release();
+    auto owned_file  = file.release();
+    iter->RegisterCleanup([owned_table, owned_file]() {
+        delete owned_table;
+        delete owned_file;
+    });
+    return iter;
+}
+
 base::Status TableCache::GetFileMetadata(uint64_t file_number, FileMetadata *rv) {
     auto file_name = TableFileName(db_name_, file_number);
 
@@ -59,7 +207,8 @@ base::Status TableCache::GetFileMetadata(uint64_t file_number, FileMetadata *rv)
     }
 
     std::unique_ptr<Iterator> iter(CreateIterator(ReadOptions(), file_number,
-                                                  rv->size));
+                                                  rv->size,
+                                                  rv->global_version));
     if (!iter->status().ok()) {
         return iter->status();
     }
@@ -79,6 +228,8 @@ TableCache::CacheEntry::~CacheEntry() {
         delete table;
     if (mmap)
         delete mmap;
+    if (file)
+        delete file;
 }
 
 } // namespace lsm
@@ -7,6 +7,7 @@
 #include "base/base.h"
 #include <stdint.h>
 #include <string>
+#include <mutex>
 #include <unordered_map>
 
 namespace yukino {
@@ -20,6 +21,7 @@ class Env;
 namespace base {
 
 class MappedMemory;
+class RandomAccessFile;
 
 } // namespace base
 
@@ -28,15 +30,35 @@ namespace lsm {
 class Table;
 struct FileMetadata;
 
+/**
+ * The table cache be thread-safe, the tables be read without the db mutex.
+ */
 class TableCache {
 public:
     TableCache(const std::string &db_name, const Options &options);
 
+    /**
+     * @param global_version non-zero: the file be ingested, all keys be read
+     *        with this version.
+     */
     Iterator *CreateIterator(const ReadOptions &options, uint64_t file_number,
-                             uint64_t file_size);
-
-    void Invalid(uint64_t file_number) { cached_.erase(file_number); }
-
+                             uint64_t file_size, uint64_t global_version = 0);
+
+    /**
+     * Create the iterator for the compaction input, it reads the file once.
+     * The file be read by direct I/O with readahead and not be cached, if
+     * use_direct_io_for_flush_and_compaction.
+     */
+    Iterator *CreateCompactionIterator(uint64_t file_number,
+                                       uint64_t file_size,
+                                       uint64_t global_version);
+
+    void Invalid(uint64_t file_number) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cached_.erase(file_number);
+    }
+
+    // Fill the size and key range of rv, rv->global_version be used.
     base::Status GetFileMetadata(uint64_t file_number, FileMetadata *rv);
 
     Env *env() const { return env_; }
@@ -45,14 +67,19 @@ private:
     Env *env_;
     std::string db_name_;
     InternalKeyComparator comparator_;
+    bool use_mmap_reads_;
+    bool use_direct_io_;
+    size_t compaction_readahead_size_;
 
-    struct CacheEntry : public base::ReferenceCounted<CacheEntry> {
+    struct CacheEntry : public base::AtomicReferenceCounted<CacheEntry> {
         std::string file_name;
         base::MappedMemory *mmap = nullptr;
+        base::RandomAccessFile *file = nullptr; // if not use_mmap_reads.
         Table *table = nullptr;
 
         ~CacheEntry();
     };
+    std::mutex mutex_;
     std::unordered_map<uint64_t, base::Handle<CacheEntry>> cached_;
 };
 
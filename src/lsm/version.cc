@@ -3,12 +3,16 @@
 #include "lsm/merger.h"
 #include "lsm/compaction.h"
 #include "util/log.h"
+#include "yukino/perf_context-inl.h"
 #include "yukino/options.h"
 #include "yukino/iterator.h"
 #include "yukino/env.h"
 #include "base/io-inl.h"
 #include "base/io.h"
 #include "glog/logging.h"
+#include <inttypes.h>
+#include <algorithm>
+#include <condition_variable>
 
 namespace yukino {
 
@@ -17,6 +21,7 @@ namespace lsm {
 VersionSet::VersionSet(const std::string &db_name, const Options &options,
                        TableCache *table_cache)
     : db_name_(db_name)
+    , max_manifest_file_size_(options.max_manifest_file_size)
     , env_(DCHECK_NOTNULL(options.env))
     , comparator_(InternalKeyComparator(DCHECK_NOTNULL(options.comparator)))
     , version_dummy_(this)
@@ -46,20 +51,21 @@ Version::~Version() {
 base::Status Version::Get(const ReadOptions &options, const InternalKey &key,
                  std::string *value) {
 
-    std::vector<base::Handle<FileMetadata>> maybe_file;
+    // The files be kept by this version, and the reference counting of
+    // them is not atomic, it may be called without the db mutex.
+    std::vector<const FileMetadata *> maybe_file;
     auto ucmp = owned_->comparator_.delegated();
     auto ukey = key.user_key_slice();
 
     for (const auto &metadata : file(0)) {
-        if (ucmp->Compare(ukey, metadata->smallest_key.user_key_slice()) >= 0 ||
+        if (ucmp->Compare(ukey, metadata->smallest_key.user_key_slice()) >= 0 &&
             ucmp->Compare(ukey, metadata->largest_key.user_key_slice()) <= 0) {
-            maybe_file.push_back(metadata);
+            maybe_file.push_back(metadata.get());
         }
     }
     // The newest file should be first.
     std::sort(maybe_file.begin(), maybe_file.end(),
-              [](const base::Handle<FileMetadata> &a,
-                 const base::Handle<FileMetadata> &b) {
+              [](const FileMetadata *a, const FileMetadata *b) {
                   return a->ctime > b->ctime;
               });
 
@@ -69,9 +75,9 @@ base::Status Version::Get(const ReadOptions &options, const InternalKey &key,
         }
 
         for (const auto &metadata : file(i)) {
-            if (ucmp->Compare(ukey, metadata->smallest_key.user_key_slice()) >= 0 ||
+            if (ucmp->Compare(ukey, metadata->smallest_key.user_key_slice()) >= 0 &&
                 ucmp->Compare(ukey, metadata->largest_key.user_key_slice()) <= 0) {
-                maybe_file.push_back(metadata);
+                maybe_file.push_back(metadata.get());
             }
         }
     }
@@ -79,15 +85,21 @@ base::Status Version::Get(const ReadOptions &options, const InternalKey &key,
     if (maybe_file.empty()) {
         return base::Status::NotFound("");
     }
+    PERF_COUNTER_ADD(table_probe_count, maybe_file.size());
 
     std::vector<Iterator*> iters;
     for (const auto &metadata : maybe_file) {
         auto iter = owned_->table_cache_->CreateIterator(options,
                                                          metadata->number,
-                                                         metadata->size);
+                                                         metadata->size,
+                                                metadata->global_version);
         if (!iter->status().ok()) {
+            auto rs = iter->status();
             delete iter;
-            return iter->status();
+            for (auto child : iters) {
+                delete child;
+            }
+            return rs;
         }
         iters.push_back(iter);
     }
@@ -113,6 +125,101 @@ base::Status Version::Get(const ReadOptions &options, const InternalKey &key,
     return base::Status::OK();
 }
 
+base::Status Version::MultiGet(const ReadOptions &options,
+                               KeyLookup **lookups, size_t n) {
+    const auto &icmp = owned_->comparator_;
+    auto ucmp = icmp.delegated();
+
+    // The files may be overlapped, so the newest version of each key must be
+    // chosen from all files in its range.
+    struct Candidate {
+        bool found = false;
+        Tag tag{0, 0};
+        std::string value;
+    };
+    std::vector<Candidate> candidates(n);
+
+    for (auto i = 0; i < kMaxLevel; ++i) {
+        for (const auto &metadata : file(i)) {
+            auto smallest = metadata->smallest_key.user_key_slice();
+            auto largest  = metadata->largest_key.user_key_slice();
+
+            size_t begin = std::lower_bound(lookups, lookups + n, smallest,
+                                            [ucmp](const KeyLookup *a,
+                                                   const base::Slice &b) {
+                return ucmp->Compare(a->key.user_key_slice(), b) < 0;
+            }) - lookups;
+            if (begin == n ||
+                ucmp->Compare(lookups[begin]->key.user_key_slice(),
+                              largest) > 0) {
+                continue; // No any key in this file's range.
+            }
+
+            std::unique_ptr<Iterator> iter(owned_->table_cache_->CreateIterator(
+                options, metadata->number, metadata->size,
+                metadata->global_version));
+            if (!iter->status().ok()) {
+                return iter->status();
+            }
+            PERF_COUNTER_ADD(table_probe_count, 1);
+
+            for (auto j = begin; j < n; ++j) {
+                auto lookup = lookups[j];
+                if (ucmp->Compare(lookup->key.user_key_slice(), largest) > 0) {
+                    break;
+                }
+                if (lookup->done) {
+                    continue;
+                }
+
+                // The keys are ascending, so the iterator can stay if it's
+                // already at or past the target.
+                auto target = lookup->key.key_slice();
+                if (!iter->Valid() || icmp.Compare(iter->key(), target) < 0) {
+                    iter->Seek(target);
+                }
+                if (!iter->Valid()) {
+                    break;
+                }
+
+                auto found_user_key = InternalKey::ExtractUserKey(iter->key());
+                if (ucmp->Compare(lookup->key.user_key_slice(),
+                                  found_user_key) != 0) {
+                    continue;
+                }
+
+                auto tag = InternalKey::ExtractTag(iter->key());
+                auto candidate = &candidates[j];
+                if (!candidate->found || tag.version > candidate->tag.version) {
+                    candidate->found = true;
+                    candidate->tag   = tag;
+                    candidate->value = iter->value().ToString();
+                }
+            }
+            if (!iter->status().ok()) {
+                return iter->status();
+            }
+        }
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+        auto lookup = lookups[j];
+        if (lookup->done) {
+            continue;
+        }
+
+        const auto &candidate = candidates[j];
+        if (candidate.found && candidate.tag.flag != kFlagDeletion) {
+            lookup->value->assign(candidate.value);
+            *lookup->status = base::Status::OK();
+        } else {
+            *lookup->status = base::Status::NotFound("");
+        }
+        lookup->done = true;
+    }
+    return base::Status::OK();
+}
+
 void VersionPatch::CreateFile(int level, uint64_t file_number,
                               const base::Slice &smallest_key,
                               const base::Slice &largest_key,
@@ -179,6 +286,24 @@ base::Status VersionPatch::Encode(std::string *buf) const {
         writer.WriteFixed64(metadata->ctime);
     }
 
+    // The global versions of ingested files are appended, the old patches
+    // have no this part.
+    uint32_t num_ingested = 0;
+    for (const auto &entry : creation_) {
+        if (entry.second->global_version != 0) {
+            num_ingested++;
+        }
+    }
+    if (num_ingested > 0) {
+        writer.WriteVarint32(num_ingested, nullptr);
+        for (const auto &entry : creation_) {
+            if (entry.second->global_version != 0) {
+                writer.WriteVarint64(entry.second->number, nullptr);
+                writer.WriteVarint64(entry.second->global_version, nullptr);
+            }
+        }
+    }
+
     buf->assign(writer.buf(), writer.len());
     return base::Status::OK();
 }
@@ -219,7 +344,9 @@ base::Status VersionPatch::Decode(const base::Slice &buf) {
 
     auto i = rd.ReadVarint32();
     while (i--) {
-        DeleteFile(static_cast<int>(rd.ReadVarint32()), rd.ReadVarint64());
+        // The order of evaluation of the arguments is unspecified.
+        auto level = static_cast<int>(rd.ReadVarint32());
+        DeleteFile(level, rd.ReadVarint64());
     }
 
     i = rd.ReadVarint32();
@@ -236,6 +363,18 @@ base::Status VersionPatch::Decode(const base::Slice &buf) {
         creation_.emplace_back(level, base::Handle<FileMetadata>(metadata));
     }
 
+    if (rd.active() > 0) {
+        i = rd.ReadVarint32();
+        while (i--) {
+            auto number = rd.ReadVarint64();
+            auto global_version = rd.ReadVarint64();
+            for (const auto &entry : creation_) {
+                if (entry.second->number == number) {
+                    entry.second->global_version = global_version;
+                }
+            }
+        }
+    }
     return base::Status::OK();
 }
 
@@ -266,8 +405,7 @@ base::Status VersionSet::GetCompaction(VersionPatch *patch, Compaction **rv) {
     std::unique_ptr<Compaction> compaction(new Compaction(db_name_, comparator_,
                                                           table_cache_));
 
-    compaction->set_target(GenerateFileNumber());
-
+    std::vector<base::Handle<FileMetadata>> inputs;
     if (current()->NumberLevelFiles(0) > kMaxNumberLevel0File) {
         auto num_should_compact = current()->NumberLevelFiles(0) / 2;
 
@@ -278,15 +416,8 @@ base::Status VersionSet::GetCompaction(VersionPatch *patch, Compaction **rv) {
                       return a->ctime > b->ctime;
                   });
 
-        for (auto i = 0; i < num_should_compact; ++i) {
-
-            auto rs = compaction->AddOriginFile(files[i]->number,
-                                                files[i]->size);
-            if (!rs.ok()) {
-                return rs;
-            }
-            patch->DeleteFile(0, files[i]->number);
-        }
+        inputs.assign(files.begin(), files.begin() + num_should_compact);
+        compaction->set_origin_level(0);
         compaction->set_target_level(1);
     } else if (current()->SizeLevelFiles(0) > kMaxSizeLevel0File) {
         std::vector<base::Handle<FileMetadata>> files(current()->file(0));
@@ -296,12 +427,8 @@ base::Status VersionSet::GetCompaction(VersionPatch *patch, Compaction **rv) {
                       return a->size > b->size;
                   });
 
-        auto rs = compaction->AddOriginFile(files[0]->number,
-                                            files[0]->size);
-        if (!rs.ok()) {
-            return rs;
-        }
-        patch->DeleteFile(0, files[0]->number);
+        inputs.push_back(files[0]);
+        compaction->set_origin_level(0);
         compaction->set_target_level(1);
     } else {
         auto found = 0;
@@ -315,21 +442,79 @@ base::Status VersionSet::GetCompaction(VersionPatch *patch, Compaction **rv) {
         DCHECK_GT(found, 0);
         DCHECK(!current()->file(found).empty());
         auto level = (found == (kMaxLevel - 1)) ? found : found + 1;
-        for (const auto &file : current()->file(found)) {
-            auto rs = compaction->AddOriginFile(file->number, file->size);
-            if (!rs.ok()) {
-                return rs;
-            }
-            patch->DeleteFile(found, file->number);
-        }
+        inputs = current()->file(found);
+        compaction->set_origin_level(found);
         compaction->set_target_level(level);
     }
 
+    if (IsTrivialMove(inputs, compaction->origin_level(),
+                      compaction->target_level())) {
+        for (const auto &file : inputs) {
+            patch->DeleteFile(compaction->origin_level(), file->number);
+            patch->CreateFile(compaction->target_level(), file.get());
+            compaction->AddMovedFile(file->number, file->size);
+        }
+        *rv = compaction.release();
+        return base::Status::OK();
+    }
+
+    compaction->set_target(GenerateFileNumber());
+    for (const auto &file : inputs) {
+        auto rs = compaction->AddOriginFile(file->number, file->size,
+                                            file->global_version);
+        if (!rs.ok()) {
+            return rs;
+        }
+        patch->DeleteFile(compaction->origin_level(), file->number);
+    }
+
     DCHECK_GT(compaction->target_level(), 0);
+
+    // The levels may be overlapped, any file out of this compaction may has
+    // the older versions of the compacted keys.
+    for (auto i = 0; i < kMaxLevel; i++) {
+        for (const auto &file : current()->file(i)) {
+            if (compaction->origin_files().count(file->number) > 0) {
+                continue;
+            }
+            compaction->AddUnderlyingRange(file->smallest_key.user_key_slice(),
+                                           file->largest_key.user_key_slice());
+        }
+    }
     *rv = compaction.release();
     return base::Status::OK();
 }
 
+bool VersionSet::IsTrivialMove(
+        const std::vector<base::Handle<FileMetadata>> &inputs,
+        int origin_level, int target_level) const {
+    if (origin_level == target_level) {
+        return false; // The last level, compact it for dropping old versions.
+    }
+
+    auto ucmp = comparator_.delegated();
+    auto overlapped = [ucmp] (const FileMetadata *a, const FileMetadata *b) {
+        return ucmp->Compare(a->largest_key.user_key_slice(),
+                             b->smallest_key.user_key_slice()) >= 0 &&
+               ucmp->Compare(b->largest_key.user_key_slice(),
+                             a->smallest_key.user_key_slice()) >= 0;
+    };
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        for (size_t j = i + 1; j < inputs.size(); j++) {
+            if (overlapped(inputs[i].get(), inputs[j].get())) {
+                return false;
+            }
+        }
+        for (const auto &file : current()->file(target_level)) {
+            if (overlapped(inputs[i].get(), file.get())) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 base::Status VersionSet::AddIterators(const ReadOptions &options,
                                       std::vector<Iterator *> *rv) const {
     base::Status rs;
@@ -339,7 +524,8 @@ base::Status VersionSet::AddIterators(const ReadOptions &options,
 
         for (const auto &file : files) {
             std::unique_ptr<Iterator> iter(table_cache_->CreateIterator(options,
-                                                     file->number, file->size));
+                                                     file->number, file->size,
+                                                     file->global_version));
             rs = iter->status();
             if (!rs.ok()) {
                 break;
@@ -397,70 +583,163 @@ base::Status VersionSet::Recovery(uint64_t file_number,
     return reader.status();
 }
 
-base::Status VersionSet::Apply(VersionPatch *patch, std::mutex *mutex) {
+struct VersionSet::Writer {
+    explicit Writer(VersionPatch *p) : patch(p) {}
 
-    if (patch->has_field(VersionPatch::kRedoLogNumber)) {
-        DCHECK_GE(patch->redo_log_number(), redo_log_number_);
-        DCHECK_LT(patch->redo_log_number(), next_file_number_);
-    } else {
-        patch->set_redo_log_number(redo_log_number_);
-    }
+    VersionPatch *patch;
+    bool done = false;
+    base::Status status;
+    std::condition_variable_any cv;
+};
 
-    if (!patch->has_field(VersionPatch::kPrevLogNumber)) {
-        patch->set_prev_log_number(prev_log_number_);
+base::Status VersionSet::Apply(VersionPatch *patch, std::mutex *mutex) {
+    Writer w(patch);
+    writers_.push_back(&w);
+    while (!w.done && &w != writers_.front()) {
+        // Only one thread without mutex, it is always the front.
+        DCHECK(mutex != nullptr);
+        w.cv.wait(*mutex);
+    }
+    if (w.done) {
+        return w.status;
+    }
+
+    // The leader writes all of the waiting patches, they are applied in order.
+    std::vector<Writer *> group(writers_.begin(), writers_.end());
+
+    // The new manifest takes a file number, it must be generated before the
+    // patches record the next file number. Its snapshot be built under the
+    // mutex, and be written with the patches without the mutex.
+    bool rollover = log_.get() == nullptr ||
+                    manifest_file_size_ >= max_manifest_file_size_;
+    std::string snapshot;
+    base::Status rs;
+    if (rollover) {
+        pending_manifest_file_number_ = GenerateFileNumber();
+        rs = EncodeSnapshot(&snapshot);
     }
 
-    patch->set_last_version(last_version_);
-    patch->set_next_file_number(next_file_number_);
-
-    if (log_.get() == nullptr) {
-        auto rs = CreateManifestFile();
-        if (!rs.ok()) {
-            return rs;
+    Builder builder(this, current());
+    auto redo_log_number = redo_log_number_;
+    auto prev_log_number = prev_log_number_;
+    std::vector<std::string> records(group.size());
+    for (size_t i = 0; rs.ok() && i < group.size(); ++i) {
+        auto p = group[i]->patch;
+
+        if (p->has_field(VersionPatch::kRedoLogNumber)) {
+            DCHECK_GE(p->redo_log_number(), redo_log_number);
+            DCHECK_LT(p->redo_log_number(), next_file_number_);
+        } else {
+            p->set_redo_log_number(redo_log_number);
         }
-        patch->set_next_file_number(next_file_number_);
-    }
+        if (!p->has_field(VersionPatch::kPrevLogNumber)) {
+            p->set_prev_log_number(prev_log_number);
+        }
+        p->set_last_version(last_version_);
+        p->set_next_file_number(next_file_number_);
 
-    auto rs = WritePatch(*patch);
-    if (!rs.ok()) {
-        return rs;
+        redo_log_number = p->redo_log_number();
+        prev_log_number = p->prev_log_number();
+        builder.Apply(*p);
+        rs = p->Encode(&records[i]);
     }
 
-    std::string buf;
-    rs = patch->Encode(&buf);
-    if (!rs.ok()) {
-        return rs;
+    std::unique_ptr<base::AppendFile> file;
+    std::unique_ptr<util::LogWriter> log;
+    size_t written = 0;
+    if (rs.ok()) {
+        if (mutex) {
+            mutex->unlock();
+        }
+        if (rollover) {
+            rs = CreateManifestFile(pending_manifest_file_number_, snapshot,
+                                    &file, &log, &written);
+        }
+        auto target_file = rollover ? file.get() : log_file_.get();
+        auto target_log  = rollover ? log.get()  : log_.get();
+        for (const auto &record : records) {
+            if (!rs.ok()) {
+                break;
+            }
+            rs = target_log->Append(record);
+            written += record.size();
+        }
+        if (rs.ok()) {
+            rs = target_file->Sync();
+        }
+        if (rs.ok() && rollover) {
+            rs = SetCurrentFile(pending_manifest_file_number_);
+        }
+        if (mutex) {
+            mutex->lock();
+        }
     }
 
-    Builder builder(this, current());
-    builder.Apply(*patch);
-    Append(builder.Build());
-
-    redo_log_number_ = patch->redo_log_number();
-    prev_log_number_ = patch->prev_log_number();
-
-    return base::Status::OK();
+    if (rs.ok()) {
+        if (rollover) {
+            // The old manifest be deleted as the obsolete file.
+            log_file_ = std::move(file);
+            log_ = std::move(log);
+            manifest_file_number_ = pending_manifest_file_number_;
+            manifest_file_size_ = 0;
+        }
+        manifest_file_size_ += written;
+
+        Append(builder.Build());
+        redo_log_number_ = redo_log_number;
+        prev_log_number_ = prev_log_number;
+    } else if (rollover) {
+        file.reset();
+        env_->DeleteFile(ManifestFileName(db_name_,
+                                          pending_manifest_file_number_),
+                         false);
+    } else {
+        // The manifest may end with a partial record, start a new one at the
+        // next time.
+        log_.reset();
+        log_file_.reset();
+    }
+    pending_manifest_file_number_ = 0;
+
+    for (auto writer : group) {
+        DCHECK_EQ(writer, writers_.front());
+        writers_.pop_front();
+        if (writer != &w) {
+            writer->status = rs;
+            writer->done = true;
+            writer->cv.notify_one();
+        }
+    }
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+    return rs;
 }
 
-base::Status VersionSet::CreateManifestFile() {
-    DCHECK(log_file_.get() == nullptr);
+base::Status VersionSet::CreateManifestFile(uint64_t file_number,
+                                            const std::string &snapshot,
+                                            std::unique_ptr<base::AppendFile> *file,
+                                            std::unique_ptr<util::LogWriter> *log,
+                                            size_t *written) {
+    auto file_name = ManifestFileName(db_name_, file_number);
 
-    manifest_file_number_ = GenerateFileNumber();
-    auto file_name = ManifestFileName(db_name_, manifest_file_number_);
-
-    base::AppendFile *file = nullptr;
-    auto rs = env_->CreateAppendFile(file_name, &file);
+    base::AppendFile *rv = nullptr;
+    auto rs = env_->CreateAppendFile(file_name, &rv);
     if (!rs.ok()) {
         return rs;
     }
-    log_file_ = std::unique_ptr<base::AppendFile>(file);
-    log_ = std::unique_ptr<util::Log::Writer>(new util::Log::Writer(log_file_.get(),
-                                                util::Log::kDefaultBlockSize));
+    file->reset(rv);
+    log->reset(new util::Log::Writer(rv, util::Log::kDefaultBlockSize));
 
-    return WriteSnapshot();
+    rs = (*log)->Append(snapshot);
+    if (!rs.ok()) {
+        return rs;
+    }
+    *written += snapshot.size();
+    return base::Status::OK();
 }
 
-base::Status VersionSet::WriteSnapshot() {
+base::Status VersionSet::EncodeSnapshot(std::string *buf) {
     VersionPatch patch(comparator_.delegated()->Name());
 
     patch.set_last_version(last_version_);
@@ -475,32 +754,21 @@ base::Status VersionSet::WriteSnapshot() {
             patch.CreateFile(i, metadata.get());
         }
     }
-
-    std::string current_manifest = base::Strings::Sprintf("%llu\n",
-                                                          manifest_file_number_);
-    auto rs = base::WriteAll(CurrentFileName(db_name_), current_manifest,
-                             nullptr);
-    if (!rs.ok()) {
-        return rs;
-    }
-
-    return WritePatch(patch);
+    return patch.Encode(buf);
 }
 
-base::Status VersionSet::WritePatch(const VersionPatch &patch) {
-    std::string buf;
-
-    auto rs = patch.Encode(&buf);
+base::Status VersionSet::SetCurrentFile(uint64_t manifest_file_number) {
+    std::string current_manifest = base::Strings::Sprintf("%" PRIu64 "\n",
+                                                          manifest_file_number);
+    // Write a new one and rename it to CURRENT, the reader never sees the
+    // half written one. The temporary file be synced before the renaming, or
+    // a crash may leave an empty CURRENT.
+    auto tmp_file_name = CurrentFileName(db_name_) + ".tmp";
+    auto rs = WriteStringToFile(env_, current_manifest, tmp_file_name);
     if (!rs.ok()) {
         return rs;
     }
-
-    rs = log_->Append(buf);
-    if (!rs.ok()) {
-        return rs;
-    }
-
-    return log_file_->Sync();
+    return env_->RenameFile(tmp_file_name, CurrentFileName(db_name_));
 }
 
 VersionBuilder::VersionBuilder(VersionSet *versions, Version *current)
@@ -520,6 +788,16 @@ void VersionBuilder::Apply(const VersionPatch &patch) {
 
     for (const auto &entry : patch.deletion()) {
         levels_[entry.first].deletion.insert(entry.second);
+
+        // The file may be created by the previous patches in recovery.
+        auto *creation = &levels_[entry.first].creation;
+        for (auto iter = creation->begin(); iter != creation->end();) {
+            if ((*iter)->number == entry.second) {
+                iter = creation->erase(iter);
+            } else {
+                ++iter;
+            }
+        }
     }
 
     for (const auto &entry : patch.creation()) {
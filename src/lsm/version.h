@@ -12,6 +12,8 @@
 #include <vector>
 #include <numeric>
 #include <set>
+#include <deque>
+#include <mutex>
 
 namespace yukino {
 
@@ -49,6 +51,10 @@ struct FileMetadata : public base::ReferenceCounted<FileMetadata> {
     uint64_t size = 0;
     uint64_t ctime = 0;
 
+    // Non-zero: the file be ingested, all keys in it have this version,
+    // instead of kExternalFileVersion in the file.
+    uint64_t global_version = 0;
+
     FileMetadata(uint64_t file_number) : number(file_number) {}
 };
 
@@ -199,6 +205,14 @@ public:
     base::Status Get(const ReadOptions &options, const InternalKey &key,
                      std::string *value);
 
+    /**
+     * Probe each file once for all the not done keys in its range.
+     *
+     * @param lookups sorted by user key.
+     */
+    base::Status MultiGet(const ReadOptions &options, KeyLookup **lookups,
+                          size_t n);
+
     Version *next() const { return next_; }
     Version *prev() const { return prev_; }
 
@@ -280,6 +294,13 @@ public:
         return next_file_number_ ++;
     }
 
+    // The file found in the db directory, it may be not in the manifest.
+    void MarkFileNumberUsed(uint64_t number) {
+        if (next_file_number_ <= number) {
+            next_file_number_ = number + 1;
+        }
+    }
+
     bool NeedsCompaction() const;
 
     base::Status GetCompaction(VersionPatch *patch, Compaction **rv);
@@ -289,13 +310,43 @@ public:
 
     base::Status Recovery(uint64_t file_number, std::vector<uint64_t> *logs);
 
+    /**
+     * Write the patch to manifest and install the new version. The patches of
+     * the concurrent callers be written by the first one (the leader) with one
+     * sync, the others just wait for it. The manifest be switched to a new one
+     * started by the snapshot of current version, if it is missing or larger
+     * than max_manifest_file_size.
+     *
+     * REQUIRES: mutex held, it be released during the writing. The mutex can
+     * be nullptr if there is only one thread.
+     */
     base::Status Apply(VersionPatch *patch, std::mutex *mutex);
 
-    base::Status CreateManifestFile();
-
-    base::Status WriteSnapshot();
-
-    base::Status WritePatch(const VersionPatch &patch);
+    /**
+     * Create a new manifest file, and write the snapshot as its first record.
+     * The CURRENT file is not changed.
+     *
+     * @param snapshot the encoded snapshot from EncodeSnapshot().
+     */
+    base::Status CreateManifestFile(uint64_t file_number,
+                                    const std::string &snapshot,
+                                    std::unique_ptr<base::AppendFile> *file,
+                                    std::unique_ptr<util::LogWriter> *log,
+                                    size_t *written);
+
+    /**
+     * Encode the current version as one patch, the first record of a new
+     * manifest.
+     *
+     * REQUIRES: mutex held
+     */
+    base::Status EncodeSnapshot(std::string *buf);
+
+    /**
+     * Point the CURRENT file to the manifest, it be renamed from a temporary
+     * file, the reader never sees the half written one.
+     */
+    base::Status SetCurrentFile(uint64_t manifest_file_number);
 
     uint64_t last_version() const { return last_version_; }
 
@@ -305,18 +356,34 @@ public:
 
     uint64_t manifest_file_number() const { return manifest_file_number_; }
 
+    // The new manifest be writing by Apply(), zero if none. It must not be
+    // deleted as the obsolete file.
+    uint64_t pending_manifest_file_number() const {
+        return pending_manifest_file_number_;
+    }
+
+    uint64_t manifest_file_size() const { return manifest_file_size_; }
+
     Version *current() const { return current_; }
 
     friend class Version;
     friend class VersionBuilder;
 private:
+    // The inputs can be moved to the target level without rewriting, if they
+    // are not overlapped with each other or the files in the target level.
+    bool IsTrivialMove(const std::vector<base::Handle<FileMetadata>> &inputs,
+                       int origin_level, int target_level) const;
+
     uint64_t last_version_ = 0;
     uint64_t next_file_number_ = 0;
     uint64_t redo_log_number_ = 0;
     uint64_t prev_log_number_ = 0;
     uint64_t manifest_file_number_ = 0;
+    uint64_t pending_manifest_file_number_ = 0;
+    uint64_t manifest_file_size_ = 0;
 
     const std::string db_name_;
+    const uint64_t max_manifest_file_size_;
     Env *env_;
     InternalKeyComparator comparator_;
 
@@ -327,6 +394,9 @@ private:
 
     std::unique_ptr<base::AppendFile> log_file_;
     std::unique_ptr<util::LogWriter> log_;
+
+    struct Writer;
+    std::deque<Writer *> writers_; // The waiting callers of Apply().
 };
 
 class VersionBuilder : public base::DisableCopyAssign {
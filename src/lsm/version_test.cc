@@ -12,6 +12,7 @@
 #include "base/base.h"
 #include "gtest/gtest.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 namespace yukino {
 
@@ -118,12 +119,57 @@ TEST_F(VersionTest, VersionPatchCodec) {
     EXPECT_EQ(99, metadata->ctime);
 }
 
-TEST_F(VersionTest, VersionSet) {
+TEST_F(VersionTest, VersionPatchDecodeDeletion) {
+    VersionPatch patch("test");
+
+    // The level and the number be different, or a swapped reading passes.
+    patch.DeleteFile(1, 100);
+    patch.DeleteFile(3, 7);
+
+    std::string buf;
+    patch.Encode(&buf);
+
+    VersionPatch other("");
+    other.Decode(buf);
+
+    ASSERT_EQ(2, other.deletion().size());
+    EXPECT_EQ(1, other.deletion().count(std::make_pair(1, 100)));
+    EXPECT_EQ(1, other.deletion().count(std::make_pair(3, 7)));
+}
+
+TEST_F(VersionTest, VersionBuilderMoveFile) {
     auto kDBName = "demo";
     Options opt;
     TableCache cache(kDBName, opt);
     VersionSet versions(kDBName, opt, &cache);
 
+    VersionPatch creation("test");
+    creation.CreateFile(0, 9, "aaaa", "eeee", 19, 8);
+
+    // The file be moved to the next level by a later patch, as replaying
+    // a manifest.
+    VersionPatch moving("test");
+    moving.DeleteFile(0, 9);
+    moving.CreateFile(1, 9, "aaaa", "eeee", 19, 8);
+
+    VersionSet::Builder builder(&versions, versions.current());
+    builder.Apply(creation);
+    builder.Apply(moving);
+    base::Handle<Version> version(builder.Build());
+
+    EXPECT_EQ(0, version->NumberLevelFiles(0));
+    ASSERT_EQ(1, version->NumberLevelFiles(1));
+    EXPECT_EQ(9, version->file(1)[0]->number);
+}
+
+TEST_F(VersionTest, VersionSet) {
+    // Unique directory, the tests can be run in parallel.
+    char db_name[] = "/tmp/yukino_version_test.XXXXXX";
+    ASSERT_TRUE(::mkdtemp(db_name) != nullptr);
+    Options opt;
+    TableCache cache(db_name, opt);
+    VersionSet versions(db_name, opt, &cache);
+
     EXPECT_EQ(0, versions.last_version());
     EXPECT_NE(nullptr, versions.current());
     versions.AdvanceVersion(9);
@@ -133,9 +179,8 @@ TEST_F(VersionTest, VersionSet) {
     patch.CreateFile(0, 9, "aaaa", "eeee", 19, 8);
     patch.CreateFile(1, 10, "ffff", "hhhh", 19, 9);
 
-    opt.env->CreateDir(kDBName);
-    auto defer = base::Defer([&opt, &kDBName]() {
-        opt.env->DeleteFile(kDBName, true);
+    auto defer = base::Defer([&opt, &db_name]() {
+        opt.env->DeleteFile(db_name, true);
     });
 
     auto rs = versions.Apply(&patch, nullptr);
@@ -158,6 +203,45 @@ TEST_F(VersionTest, VersionSet) {
     EXPECT_EQ(9, metadata->ctime);
 }
 
+TEST_F(VersionTest, VersionSetRecoveryMoveFile) {
+    char db_name[] = "/tmp/yukino_version_test.XXXXXX";
+    ASSERT_TRUE(::mkdtemp(db_name) != nullptr);
+    Options opt;
+    auto defer = base::Defer([&opt, &db_name]() {
+        opt.env->DeleteFile(db_name, true);
+    });
+
+    uint64_t manifest_file_number = 0;
+    {
+        TableCache cache(db_name, opt);
+        VersionSet versions(db_name, opt, &cache);
+
+        VersionPatch creation(opt.comparator->Name());
+        creation.CreateFile(0, 9, "aaaa", "eeee", 19, 8);
+        auto rs = versions.Apply(&creation, nullptr);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        // A trivial move be only a deletion and a creation in the manifest.
+        VersionPatch moving(opt.comparator->Name());
+        moving.DeleteFile(0, 9);
+        moving.CreateFile(1, 9, "aaaa", "eeee", 19, 8);
+        rs = versions.Apply(&moving, nullptr);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+        manifest_file_number = versions.manifest_file_number();
+    }
+
+    TableCache cache(db_name, opt);
+    VersionSet versions(db_name, opt, &cache);
+    std::vector<uint64_t> logs;
+    auto rs = versions.Recovery(manifest_file_number, &logs);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    EXPECT_EQ(0, versions.NumberLevelFiles(0));
+    ASSERT_EQ(1, versions.NumberLevelFiles(1));
+    EXPECT_EQ(9, versions.current()->file(1)[0]->number);
+}
+
 } // namespace lsm
 
 } // namespace yukino
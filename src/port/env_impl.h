@@ -20,6 +20,15 @@ public:
                                       base::FileIO **file) override;
     virtual base::Status CreateRandomAccessFile(const std::string &fname,
                                                 base::MappedMemory **file) override;
+    virtual base::Status CreateRandomAccessFile(const std::string &fname,
+                                                base::RandomAccessFile **file) override;
+    virtual base::Status CreateIOQueue(size_t depth,
+                                       base::IOQueue **queue) override;
+    virtual base::Status CreateDirectAppendFile(const std::string &fname,
+                                                base::AppendFile **file) override;
+    virtual base::Status CreateDirectRandomAccessFile(
+            const std::string &fname, size_t readahead_size,
+            base::RandomAccessFile **file) override;
 
     virtual bool FileExists(const std::string& fname) override;
     virtual base::Status DeleteFile(const std::string& fname, bool deep) override;
@@ -30,6 +39,8 @@ public:
                                      uint64_t* file_size) override;
     virtual base::Status RenameFile(const std::string& src,
                                     const std::string& target) override;
+    virtual base::Status LinkFile(const std::string& src,
+                                  const std::string& target) override;
     virtual base::Status LockFile(const std::string& fname,
                                   base::FileLock** lock) override;
 
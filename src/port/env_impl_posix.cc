@@ -30,6 +30,26 @@ base::Status EnvImpl::CreateRandomAccessFile(const std::string &fname,
     return port::CreateRandomAccessFile(fname.c_str(), file);
 }
 
+base::Status EnvImpl::CreateRandomAccessFile(const std::string &fname,
+                                             base::RandomAccessFile **file) {
+    return port::CreatePreadFile(fname.c_str(), file);
+}
+
+base::Status EnvImpl::CreateDirectAppendFile(const std::string &fname,
+                                             base::AppendFile **file) {
+    return port::CreateDirectAppendFile(fname.c_str(), file);
+}
+
+base::Status EnvImpl::CreateDirectRandomAccessFile(
+        const std::string &fname, size_t readahead_size,
+        base::RandomAccessFile **file) {
+    return port::CreateDirectReadFile(fname.c_str(), readahead_size, file);
+}
+
+base::Status EnvImpl::CreateIOQueue(size_t depth, base::IOQueue **queue) {
+    return port::CreateIOQueue(depth, queue);
+}
+
 bool EnvImpl::FileExists(const std::string& fname) {
     struct stat stub;
 
@@ -159,6 +179,16 @@ base::Status EnvImpl::RenameFile(const std::string& src,
     }
 }
 
+base::Status EnvImpl::LinkFile(const std::string& src,
+                               const std::string& target) {
+    auto rv = ::link(src.c_str(), target.c_str());
+    if (rv < 0) {
+        return Error();
+    } else {
+        return base::Status::OK();
+    }
+}
+
 base::Status EnvImpl::LockFile(const std::string& fname,
                                base::FileLock** lock) {
     return port::CreateFileLock(fname.c_str(), true, lock);
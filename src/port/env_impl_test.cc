@@ -6,10 +6,15 @@
 //
 //
 #include "yukino/env.h"
+#include "port/io_impl.h"
 #include "base/io-inl.h"
 #include "base/io.h"
+#include "base/mem_io.h"
 #include "gtest/gtest.h"
 #include <stdio.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <memory>
 
 namespace yukino {
 
@@ -58,6 +63,319 @@ TEST(EnvImplTest, FileReadWrite) {
     reader->Close();
 }
 
+TEST(EnvImplTest, FilePositionalIO) {
+    base::FileIO *file = nullptr;
+
+    static const auto file_name = "env_test.tmp";
+    auto rs = Env::Default()->CreateFileIO(file_name, &file);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto defer = base::Defer([&]() {
+        rs = Env::Default()->DeleteFile(file_name, false);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+    });
+
+    std::unique_ptr<base::FileIO> io(file);
+
+    // Buffered data must be seen by positional reading.
+    rs = io->WriteFixed32(199);
+    ASSERT_TRUE(rs.ok());
+
+    rs = io->Preallocate(0, 4096);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    uint64_t size = 0;
+    rs = Env::Default()->GetFileSize(file_name, &size);
+    ASSERT_TRUE(rs.ok());
+    EXPECT_EQ(4096, size);
+
+    rs = io->WriteAt(1024, "hello", 5);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    uint32_t value = 0;
+    rs = io->ReadAt(0, &value, sizeof(value));
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(199, value);
+
+    char buf[5];
+    rs = io->ReadAt(1024, buf, sizeof(buf));
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("hello", std::string(buf, sizeof(buf)));
+
+    rs = io->ReadAt(4095, buf, sizeof(buf));
+    EXPECT_FALSE(rs.ok());
+
+    rs = io->Close();
+    EXPECT_TRUE(rs.ok());
+}
+
+TEST(EnvImplTest, DirectIO) {
+    base::AppendFile *afile = nullptr;
+
+    static const auto file_name = "env_test.tmp";
+    auto rs = Env::Default()->CreateDirectAppendFile(file_name, &afile);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto defer = base::Defer([&]() {
+        rs = Env::Default()->DeleteFile(file_name, false);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+    });
+
+    std::unique_ptr<base::AppendFile> writer(afile);
+
+    // Unaligned writes, across the buffer.
+    std::string data;
+    for (int i = 0; data.size() < 3 * base::kMB; ++i) {
+        data.append(std::string(1000 + i % 100, 'a' + i % 26));
+    }
+    rs = writer->Write(data.data(), 10000, nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = writer->Sync();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    uint64_t size = 0;
+    rs = Env::Default()->GetFileSize(file_name, &size);
+    ASSERT_TRUE(rs.ok());
+    EXPECT_EQ(10000, size);
+
+    rs = writer->Write(data.data() + 10000, data.size() - 10000, nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = writer->Close();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    rs = Env::Default()->GetFileSize(file_name, &size);
+    ASSERT_TRUE(rs.ok());
+    EXPECT_EQ(data.size(), size);
+
+    base::RandomAccessFile *rv = nullptr;
+    rs = Env::Default()->CreateDirectRandomAccessFile(file_name, 64 * base::kKB,
+                                                      &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::RandomAccessFile> file(rv);
+    EXPECT_EQ(data.size(), file->size());
+
+    std::string scratch;
+    base::Slice result;
+    for (size_t offset = 0; offset < data.size(); offset += 4099) {
+        auto n = std::min(static_cast<size_t>(5000), data.size() - offset);
+        rs = file->Read(offset, n, &result, &scratch);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+        ASSERT_EQ(base::Slice(data.data() + offset, n), result) << offset;
+    }
+
+    // Backward.
+    rs = file->Read(1, 10, &result, &scratch);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(base::Slice(data.data() + 1, 10), result);
+
+    rs = file->Read(data.size() - 1, 2, &result, &scratch);
+    EXPECT_FALSE(rs.ok());
+}
+
+TEST(EnvImplTest, Preallocate) {
+    base::AppendFile *afile = nullptr;
+
+    static const auto file_name = "env_test.tmp";
+    auto rs = Env::Default()->CreateAppendFile(file_name, &afile);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto defer = base::Defer([&]() {
+        rs = Env::Default()->DeleteFile(file_name, false);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+    });
+    std::unique_ptr<base::AppendFile> file(
+            new base::IncrementalSyncFile(afile, 64 * base::kKB));
+
+    rs = file->Allocate(0, 4 * base::kMB);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string data(300 * base::kKB, 'x');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    rs = file->Write(data.data(), data.size(), nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // The size is not changed by the preallocation.
+    rs = file->Sync();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    uint64_t size = 0;
+    rs = Env::Default()->GetFileSize(file_name, &size);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(data.size(), size);
+
+    // The unused space be released on closing.
+    rs = file->Close();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    struct stat st;
+    ASSERT_EQ(0, ::stat(file_name, &st));
+    EXPECT_EQ(data.size(), st.st_size);
+    EXPECT_GT(base::kMB, st.st_blocks * 512);
+
+    std::string read;
+    rs = base::ReadAll(file_name, &read);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(data, read);
+}
+
+namespace {
+
+class RangeSyncRecorder : public base::StringIO {
+public:
+    virtual base::Status RangeSync(uint64_t offset, uint64_t n) override {
+        ranges.push_back(std::make_pair(offset, n));
+        return base::Status::OK();
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+};
+
+} // namespace
+
+TEST(EnvImplTest, IncrementalSync) {
+    auto recorder = new RangeSyncRecorder();
+    base::IncrementalSyncFile file(recorder, 16 * base::kKB);
+
+    std::string data(10 * base::kKB, 'x');
+    for (int i = 0; i < 5; ++i) {
+        auto rs = file.Write(data.data(), data.size(), nullptr);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    EXPECT_EQ(50 * base::kKB, file.active());
+
+    // Only the whole pages: [0, 20K), [20K, 40K)
+    ASSERT_EQ(2, recorder->ranges.size());
+    EXPECT_EQ(0, recorder->ranges[0].first);
+    EXPECT_EQ(20 * base::kKB, recorder->ranges[0].second);
+    EXPECT_EQ(20 * base::kKB, recorder->ranges[1].first);
+    EXPECT_EQ(20 * base::kKB, recorder->ranges[1].second);
+
+    // Sync() covers all.
+    auto rs = file.Sync();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = file.Skip(10 * base::kKB);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(2, recorder->ranges.size());
+    rs = file.Skip(8 * base::kKB);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    ASSERT_EQ(3, recorder->ranges.size());
+    EXPECT_EQ(50 * base::kKB, recorder->ranges[2].first);
+    EXPECT_EQ(18 * base::kKB, recorder->ranges[2].second);
+}
+
+namespace {
+
+void TestIOQueue(base::IOQueue *queue) {
+    static const auto file_name = "env_test.tmp";
+    static const size_t kChunkSize = 4096;
+    static const size_t kNumChunks = 16;
+
+    base::FileIO *io = nullptr;
+    auto rs = Env::Default()->CreateFileIO(file_name, &io);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    auto defer = base::Defer([&]() {
+        rs = Env::Default()->DeleteFile(file_name, false);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+    });
+    std::unique_ptr<base::FileIO> writer(io);
+
+    // More requests than the depth, the queuing must wait.
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < kNumChunks; ++i) {
+        chunks.emplace_back(kChunkSize, static_cast<char>('a' + i));
+    }
+    for (size_t i = 0; i < kNumChunks; ++i) {
+        rs = queue->WriteAsync(writer.get(), i * kChunkSize, chunks[i].data(),
+                               chunks[i].size(), &chunks[i]);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    rs = queue->Fsync(writer.get(), nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = queue->Submit();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::vector<base::IOQueue::Completion> completions;
+    rs = queue->Poll(queue->in_flight(), &completions);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    ASSERT_EQ(kNumChunks + 1, completions.size());
+    EXPECT_EQ(0, queue->in_flight());
+    for (const auto &completion : completions) {
+        if (completion.tag) {
+            EXPECT_EQ(kChunkSize, completion.result);
+        } else {
+            EXPECT_EQ(0, completion.result);
+        }
+    }
+
+    base::RandomAccessFile *rv = nullptr;
+    rs = Env::Default()->CreateRandomAccessFile(file_name, &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::RandomAccessFile> file(rv);
+
+    std::vector<std::string> bufs(kNumChunks, std::string(kChunkSize, '\0'));
+    for (size_t i = kNumChunks; i > 0; --i) {
+        rs = queue->ReadAsync(file.get(), (i - 1) * kChunkSize, kChunkSize,
+                              &bufs[i - 1][0], &bufs[i - 1]);
+        ASSERT_TRUE(rs.ok()) << rs.ToString();
+    }
+    rs = queue->Submit();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    completions.clear();
+    rs = queue->Poll(kNumChunks, &completions);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    ASSERT_EQ(kNumChunks, completions.size());
+    for (const auto &completion : completions) {
+        EXPECT_EQ(kChunkSize, completion.result);
+    }
+    EXPECT_EQ(chunks, bufs);
+
+    // The file without native handle.
+    base::MappedMemory *mmap = nullptr;
+    rs = Env::Default()->CreateRandomAccessFile(file_name, &mmap);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::MappedMemory> mapped(mmap);
+    base::MappedRandomAccessFile mapped_file(mapped.get());
+
+    std::string buf(10, '\0');
+    rs = queue->ReadAsync(&mapped_file, kChunkSize - 5, buf.size(), &buf[0],
+                          nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = queue->Submit();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    completions.clear();
+    rs = queue->Poll(1, &completions);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    ASSERT_EQ(1, completions.size());
+    EXPECT_EQ(buf.size(), completions[0].result);
+    EXPECT_EQ("aaaaabbbbb", buf);
+
+    // Nothing to wait.
+    rs = queue->Poll(1, &completions);
+    EXPECT_FALSE(rs.ok());
+}
+
+} // namespace
+
+TEST(EnvImplTest, IOQueue) {
+    base::IOQueue *rv = nullptr;
+    auto rs = Env::Default()->CreateIOQueue(4, &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::IOQueue> queue(rv);
+
+    EXPECT_LE(4, queue->depth());
+    TestIOQueue(queue.get());
+}
+
+TEST(EnvImplTest, SyncIOQueue) {
+    base::IOQueue *rv = nullptr;
+    auto rs = port::CreateSyncIOQueue(4, &rv);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::IOQueue> queue(rv);
+
+    EXPECT_FALSE(queue->asynchronous());
+    TestIOQueue(queue.get());
+}
+
 TEST(EnvImplTest, Directory) {
     static const auto root = "env_test_root";
 
@@ -86,6 +404,8 @@ TEST(EnvImplTest, Directory) {
     rs = Env::Default()->GetChildren(root, &children);
     ASSERT_TRUE(rs.ok());
 
+    // The order of the children be not specified.
+    std::sort(children.begin(), children.end());
     EXPECT_EQ(2, children.size());
     EXPECT_EQ("1", children[0]);
     EXPECT_EQ("2", children[1]);
@@ -2,6 +2,7 @@
 #define YUKINO_PORT_IO_IMPL_H_
 
 #include "base/status.h"
+#include <stddef.h>
 
 namespace yukino {
 
@@ -10,7 +11,9 @@ namespace base {
 class AppendFile;
 class FileIO;
 class MappedMemory;
+class RandomAccessFile;
 class FileLock;
+class IOQueue;
 
 } // namespace base
 
@@ -23,6 +26,23 @@ base::Status CreateFileIO(const char *file_name, base::FileIO **file);
 base::Status CreateRandomAccessFile(const char *file_name,
                                     base::MappedMemory **file);
 
+base::Status CreatePreadFile(const char *file_name,
+                             base::RandomAccessFile **file);
+
+base::Status CreateDirectAppendFile(const char *file_name,
+                                    base::AppendFile **file);
+
+base::Status CreateDirectReadFile(const char *file_name, size_t readahead_size,
+                                  base::RandomAccessFile **file);
+
+/**
+ * Create the asynchronous I/O queue on io_uring, or the synchronous queue if
+ * io_uring is not available.
+ */
+base::Status CreateIOQueue(size_t depth, base::IOQueue **queue);
+
+base::Status CreateSyncIOQueue(size_t depth, base::IOQueue **queue);
+
 base::Status CreateFileLock(const char *file_name, bool locked,
                             base::FileLock **file);
 
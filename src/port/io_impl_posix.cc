@@ -4,7 +4,12 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/file.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <algorithm>
+#include <memory>
 
 namespace yukino {
 
@@ -93,6 +98,18 @@ public:
     }
 
     virtual base::Status Close() override {
+        if (allocated_) {
+            // Release the preallocated space after the end of file.
+            struct stat st;
+            if (fflush(file_) < 0 || ::fstat(fileno(file_), &st) < 0 ||
+                ::ftruncate(fileno(file_), st.st_size) < 0) {
+                auto rs = Error();
+                fclose(file_);
+                file_ = nullptr;
+                return rs;
+            }
+            allocated_ = false;
+        }
         if (fclose(DCHECK_NOTNULL(file_)) < 0) {
             return Error();
         }
@@ -112,12 +129,45 @@ public:
         if (!rs.ok()) {
             return rs;
         }
-        if (fsync(fileno(file_)) < 0) {
+        // The size be synced too, the other metadata is not needed.
+#if defined(__linux__)
+        if (::fdatasync(fileno(file_)) < 0) {
+#else
+        if (::fsync(fileno(file_)) < 0) {
+#endif
             return Error();
         }
         return base::Status::OK();
     }
 
+    virtual base::Status RangeSync(uint64_t offset, uint64_t n) override {
+        if (fflush(file_) < 0) {
+            return Error();
+        }
+#if defined(__linux__)
+        if (::sync_file_range(fileno(file_), offset, n,
+                              SYNC_FILE_RANGE_WRITE) < 0) {
+            return Error();
+        }
+#endif
+        return base::Status::OK();
+    }
+
+    virtual base::Status Allocate(uint64_t offset, uint64_t len) override {
+#if defined(__linux__)
+        if (::fallocate(fileno(file_), FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+            allocated_ = true;
+            return base::Status::OK();
+        }
+        if (errno != EOPNOTSUPP) {
+            return Error();
+        }
+#endif
+        return base::Status::OK();
+    }
+
+    virtual int native_handle() const override { return fileno(file_); }
+
     virtual base::Status Truncate(uint64_t offset) {
         if (ftruncate(fileno(file_), offset) < 0) {
             return Error();
@@ -133,18 +183,90 @@ public:
         return base::Status::OK();
     }
 
+    virtual base::Status Preallocate(uint64_t offset, uint64_t len) override {
+        auto fd = fileno(file_);
+#if defined(__linux__)
+        if (::fallocate(fd, 0, offset, len) == 0) {
+            return base::Status::OK();
+        }
+        if (errno != EOPNOTSUPP) {
+            return Error();
+        }
+#endif
+        // Fallback: just extend the file.
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            return Error();
+        }
+        if (static_cast<uint64_t>(st.st_size) < offset + len) {
+            return Truncate(offset + len);
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status WriteAt(uint64_t offset, const void *data,
+                                 size_t size) override {
+        // Write the buffered data first.
+        if (fflush(file_) < 0) {
+            return Error();
+        }
+
+        auto fd = fileno(file_);
+        auto p  = static_cast<const uint8_t *>(data);
+        while (size > 0) {
+            auto rv = ::pwrite(fd, p, size, offset);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return Error();
+            }
+            p      += rv;
+            size   -= rv;
+            offset += rv;
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status ReadAt(uint64_t offset, void *buf,
+                                size_t size) const override {
+        if (fflush(file_) < 0) {
+            return Error();
+        }
+
+        auto fd = fileno(file_);
+        auto p  = static_cast<uint8_t *>(buf);
+        while (size > 0) {
+            auto rv = ::pread(fd, p, size, offset);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return Error();
+            }
+            if (rv == 0) {
+                return base::Status::IOError("EOF");
+            }
+            p      += rv;
+            size   -= rv;
+            offset += rv;
+        }
+        return base::Status::OK();
+    }
+
 private:
     FileIOImpl(FILE *file) : file_(DCHECK_NOTNULL(file)) {}
 
-    base::Status Error() {
+    static base::Status Error() {
         return Error(errno);
     }
 
-    base::Status Error(int err) {
+    static base::Status Error(int err) {
         return base::Status::IOError(strerror(err));
     }
     
     FILE *file_ = nullptr;
+    bool allocated_ = false;
 
     enum { kFillingSize = 128 };
     static const uint8_t kFillingZero[kFillingSize];
@@ -235,6 +357,77 @@ private:
     int fd_ = -1;
 };
 
+class PreadFileImpl : public base::RandomAccessFile {
+public:
+    virtual ~PreadFileImpl() override {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    virtual base::Status Read(uint64_t offset, size_t n, base::Slice *result,
+                              std::string *scratch) const override {
+        if (offset + n > size_) {
+            return base::Status::IOError("Read out of the file.");
+        }
+        scratch->resize(n);
+
+        auto p = &(*scratch)[0];
+        auto done = size_t(0);
+        while (done < n) {
+            auto rv = ::pread(fd_, p + done, n - done, offset + done);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return base::Status::IOError(strerror(errno));
+            }
+            if (rv == 0) {
+                return base::Status::IOError("EOF");
+            }
+            done += rv;
+        }
+        *result = base::Slice(p, n);
+        return base::Status::OK();
+    }
+
+    virtual uint64_t size() const override { return size_; }
+
+    virtual const std::string &file_name() const override {
+        return file_name_;
+    }
+
+    virtual int native_handle() const override { return fd_; }
+
+    static base::Status Open(const char *file_name, PreadFileImpl **impl) {
+        auto fd = ::open(file_name, O_RDONLY);
+        if (fd < 0) {
+            return base::Status::IOError(strerror(errno));
+        }
+
+        struct stat stub;
+        if (::fstat(fd, &stub) < 0) {
+            auto rs = base::Status::IOError(strerror(errno));
+            ::close(fd);
+            return rs;
+        }
+
+        *impl = new PreadFileImpl(file_name, fd, stub.st_size);
+        return base::Status::OK();
+    }
+
+private:
+    PreadFileImpl(const std::string &file_name, int fd, uint64_t size)
+        : file_name_(file_name)
+        , fd_(fd)
+        , size_(size) {
+    }
+
+    const std::string file_name_;
+    int fd_;
+    const uint64_t size_;
+};
+
 class FileLockImpl : public base::FileLock {
 public:
 
@@ -254,14 +447,23 @@ public:
     static base::Status CreateFileLock(const char *name, bool locked,
                                        FileLockImpl **rv) {
         auto flags = O_CREAT | O_TRUNC | O_EXCL | O_WRONLY;
+#if defined(O_EXLOCK)
         if (locked) {
             flags |= O_EXLOCK;
         }
+#endif
 
-        auto fd = ::open(name, flags);
+        auto fd = ::open(name, flags, 0644);
         if (fd < 0) {
             return Error();
         }
+#if !defined(O_EXLOCK)
+        if (locked && ::flock(fd, LOCK_EX | LOCK_NB) < 0) {
+            auto rs = Error();
+            ::close(fd);
+            return rs;
+        }
+#endif
 
         *rv = new FileLockImpl(name, fd, locked);
         return base::Status::OK();
@@ -301,12 +503,357 @@ private:
     mutable bool locked_;
 };
     
+// The alignment of the buffers, offsets and sizes for O_DIRECT, the
+// logical block size of the most devices.
+static const size_t kDirectIOAlignment = 4096;
+
+inline size_t AlignDown(uint64_t n) {
+    return static_cast<size_t>(n & ~(kDirectIOAlignment - 1));
+}
+
+inline size_t AlignUp(uint64_t n) {
+    return AlignDown(n + kDirectIOAlignment - 1);
+}
+
+class AlignedBuffer : public base::DisableCopyAssign {
+public:
+    AlignedBuffer() {}
+
+    ~AlignedBuffer() { ::free(buf_); }
+
+    bool Reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return true;
+        }
+        void *buf = nullptr;
+        if (::posix_memalign(&buf, kDirectIOAlignment, capacity) != 0) {
+            return false;
+        }
+        ::free(buf_);
+        buf_ = static_cast<char *>(buf);
+        capacity_ = capacity;
+        return true;
+    }
+
+    char *buf() const { return buf_; }
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    char *buf_ = nullptr;
+    size_t capacity_ = 0;
+};
+
+// Open by O_DIRECT, or with the nearest hint of the platform. Some file
+// systems (e.g. tmpfs) do not support O_DIRECT, the page cache be used.
+int OpenDirect(const char *file_name, int flags) {
+    int fd = -1;
+#if defined(O_DIRECT)
+    fd = ::open(file_name, flags | O_DIRECT, 0644);
+    if (fd >= 0 || errno != EINVAL) {
+        return fd;
+    }
+#endif
+    fd = ::open(file_name, flags, 0644);
+#if defined(F_NOCACHE)
+    if (fd >= 0) {
+        ::fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+    return fd;
+}
+
+base::Status PWriteAll(int fd, const char *buf, size_t size, uint64_t offset) {
+    while (size > 0) {
+        auto rv = ::pwrite(fd, buf, size, offset);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return base::Status::IOError(strerror(errno));
+        }
+        buf    += rv;
+        size   -= rv;
+        offset += rv;
+    }
+    return base::Status::OK();
+}
+
+// Read up to size bytes, less only at the end of file.
+base::Status PReadAll(int fd, char *buf, size_t size, uint64_t offset,
+                      size_t *read) {
+    *read = 0;
+    while (*read < size) {
+        auto rv = ::pread(fd, buf + *read, size - *read, offset + *read);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return base::Status::IOError(strerror(errno));
+        }
+        if (rv == 0) {
+            break;
+        }
+        *read += rv;
+    }
+    return base::Status::OK();
+}
+
+/**
+ * The data be copied into the aligned buffer, and be written by blocks of
+ * the buffer size. The tail be padded to the alignment on Sync() and
+ * Close(), then the file be truncated to the real size.
+ */
+class DirectAppendFileImpl : public base::AppendFile {
+public:
+    static const size_t kBufferSize = 1 * base::kMB;
+
+    virtual ~DirectAppendFileImpl() override {
+        if (fd_ >= 0) {
+            auto rs = Close();
+            if (!rs.ok()) {
+                DLOG(ERROR) << rs.ToString();
+            }
+        }
+    }
+
+    static base::Status Open(const char *file_name,
+                             DirectAppendFileImpl **impl) {
+        std::unique_ptr<DirectAppendFileImpl> file(new DirectAppendFileImpl);
+        if (!file->buf_.Reserve(kBufferSize)) {
+            return base::Status::IOError("Not enough memory.");
+        }
+        file->fd_ = OpenDirect(file_name, O_WRONLY | O_CREAT | O_TRUNC);
+        if (file->fd_ < 0) {
+            return base::Status::IOError(strerror(errno));
+        }
+        *impl = file.release();
+        return base::Status::OK();
+    }
+
+    virtual base::Status Write(const void *data, size_t size,
+                               size_t *written) override {
+        auto p = static_cast<const char *>(data);
+        auto left = size;
+        while (left > 0) {
+            auto n = std::min(left, kBufferSize - len_);
+            ::memcpy(buf_.buf() + len_, p, n);
+            len_ += n;
+            p    += n;
+            left -= n;
+
+            if (len_ == kBufferSize) {
+                auto rs = Flush();
+                if (!rs.ok()) {
+                    return rs;
+                }
+            }
+        }
+        if (written) {
+            *written = size;
+        }
+        active_ += size;
+        return base::Status::OK();
+    }
+
+    virtual base::Status Skip(size_t count) override {
+        static const char kZero[128] = {0};
+        while (count > 0) {
+            auto n = std::min(count, sizeof(kZero));
+            auto rs = Write(kZero, n, nullptr);
+            if (!rs.ok()) {
+                return rs;
+            }
+            count -= n;
+        }
+        return base::Status::OK();
+    }
+
+    // Write the aligned part of the buffer.
+    virtual base::Status Flush() override {
+        auto n = AlignDown(len_);
+        if (n == 0) {
+            return base::Status::OK();
+        }
+        auto rs = PWriteAll(fd_, buf_.buf(), n, file_offset_);
+        if (!rs.ok()) {
+            return rs;
+        }
+        file_offset_ += n;
+        len_ -= n;
+        ::memmove(buf_.buf(), buf_.buf() + n, len_);
+        return base::Status::OK();
+    }
+
+    virtual base::Status Sync() override {
+        auto rs = WriteTail();
+        if (!rs.ok()) {
+            return rs;
+        }
+#if defined(__linux__)
+        if (::fdatasync(fd_) < 0) {
+#else
+        if (::fsync(fd_) < 0) {
+#endif
+            return base::Status::IOError(strerror(errno));
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status Allocate(uint64_t offset, uint64_t len) override {
+#if defined(__linux__)
+        if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, len) == 0) {
+            allocated_ = true;
+            return base::Status::OK();
+        }
+        if (errno != EOPNOTSUPP) {
+            return base::Status::IOError(strerror(errno));
+        }
+#endif
+        return base::Status::OK();
+    }
+
+    virtual base::Status Close() override {
+        auto rs = WriteTail();
+        if (rs.ok() && allocated_ &&
+            ::ftruncate(fd_, file_offset_ + len_) < 0) {
+            rs = base::Status::IOError(strerror(errno));
+        }
+        if (::close(fd_) < 0 && rs.ok()) {
+            rs = base::Status::IOError(strerror(errno));
+        }
+        fd_ = -1;
+        return rs;
+    }
+
+private:
+    DirectAppendFileImpl() {}
+
+    // The tail be kept in the buffer for the next writing, its padded block
+    // will be rewritten.
+    base::Status WriteTail() {
+        auto rs = Flush();
+        if (!rs.ok() || len_ == 0) {
+            return rs;
+        }
+        auto padded = AlignUp(len_);
+        ::memset(buf_.buf() + len_, 0, padded - len_);
+        rs = PWriteAll(fd_, buf_.buf(), padded, file_offset_);
+        if (!rs.ok()) {
+            return rs;
+        }
+        if (::ftruncate(fd_, file_offset_ + len_) < 0) {
+            return base::Status::IOError(strerror(errno));
+        }
+        return base::Status::OK();
+    }
+
+    int fd_ = -1;
+    bool allocated_ = false;
+    AlignedBuffer buf_;
+    size_t len_ = 0;           // of the buffered data.
+    uint64_t file_offset_ = 0; // of the buffer, aligned.
+};
+
+/**
+ * Every read fetches the aligned blocks at least readahead size into the
+ * buffer, the following sequential reads be served by the buffer.
+ */
+class DirectReadFileImpl : public base::RandomAccessFile {
+public:
+    virtual ~DirectReadFileImpl() override {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    static base::Status Open(const char *file_name, size_t readahead_size,
+                             DirectReadFileImpl **impl) {
+        auto fd = OpenDirect(file_name, O_RDONLY);
+        if (fd < 0) {
+            return base::Status::IOError(strerror(errno));
+        }
+
+        struct stat stub;
+        if (::fstat(fd, &stub) < 0) {
+            auto rs = base::Status::IOError(strerror(errno));
+            ::close(fd);
+            return rs;
+        }
+
+        *impl = new DirectReadFileImpl(file_name, fd, stub.st_size,
+                                       AlignUp(std::max(readahead_size,
+                                                        kDirectIOAlignment)));
+        return base::Status::OK();
+    }
+
+    virtual base::Status Read(uint64_t offset, size_t n, base::Slice *result,
+                              std::string *scratch) const override {
+        if (offset + n > size_) {
+            return base::Status::IOError("Read out of the file.");
+        }
+
+        if (offset < buf_offset_ || offset + n > buf_offset_ + buf_len_) {
+            // The buffer be invalid until the reading is done, a failed
+            // reading must not leave a partial buffer for the later reads.
+            buf_offset_ = 0;
+            buf_len_ = 0;
+
+            auto start = AlignDown(offset);
+            auto end = AlignUp(std::max(offset + n, start + readahead_size_));
+            if (!buf_.Reserve(end - start)) {
+                return base::Status::IOError("Not enough memory.");
+            }
+
+            size_t len = 0;
+            auto rs = PReadAll(fd_, buf_.buf(), end - start, start, &len);
+            if (!rs.ok()) {
+                return rs;
+            }
+            buf_offset_ = start;
+            buf_len_ = len;
+            if (offset + n > buf_offset_ + buf_len_) {
+                return base::Status::IOError("EOF");
+            }
+        }
+
+        scratch->assign(buf_.buf() + (offset - buf_offset_), n);
+        *result = base::Slice(*scratch);
+        return base::Status::OK();
+    }
+
+    virtual uint64_t size() const override { return size_; }
+
+    virtual const std::string &file_name() const override {
+        return file_name_;
+    }
+
+private:
+    DirectReadFileImpl(const std::string &file_name, int fd, uint64_t size,
+                       size_t readahead_size)
+        : file_name_(file_name)
+        , fd_(fd)
+        , size_(size)
+        , readahead_size_(readahead_size) {
+    }
+
+    const std::string file_name_;
+    int fd_;
+    const uint64_t size_;
+    const size_t readahead_size_;
+
+    mutable AlignedBuffer buf_;
+    mutable uint64_t buf_offset_ = 0;
+    mutable size_t buf_len_ = 0;
+};
+
 } // namespace
 
 base::Status CreateAppendFile(const char *file_name, base::AppendFile **file) {
     FileIOImpl *impl = nullptr;
 
-    auto rs = FileIOImpl::CreateFile(file_name, "a", &impl);
+    // A new file, the existing one be truncated.
+    auto rs = FileIOImpl::CreateFile(file_name, "w", &impl);
     if (!rs.ok()) {
         return rs;
     }
@@ -343,6 +890,45 @@ base::Status CreateRandomAccessFile(const char *file_name,
     return rs;
 }
 
+base::Status CreatePreadFile(const char *file_name,
+                             base::RandomAccessFile **file) {
+    PreadFileImpl *impl = nullptr;
+
+    auto rs = PreadFileImpl::Open(file_name, &impl);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    *DCHECK_NOTNULL(file) = impl;
+    return rs;
+}
+
+base::Status CreateDirectAppendFile(const char *file_name,
+                                    base::AppendFile **file) {
+    DirectAppendFileImpl *impl = nullptr;
+
+    auto rs = DirectAppendFileImpl::Open(file_name, &impl);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    *DCHECK_NOTNULL(file) = impl;
+    return rs;
+}
+
+base::Status CreateDirectReadFile(const char *file_name, size_t readahead_size,
+                                  base::RandomAccessFile **file) {
+    DirectReadFileImpl *impl = nullptr;
+
+    auto rs = DirectReadFileImpl::Open(file_name, readahead_size, &impl);
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    *DCHECK_NOTNULL(file) = impl;
+    return rs;
+}
+
 base::Status CreateFileLock(const char *file_name, bool locked,
                             base::FileLock **file) {
     FileLockImpl *impl = nullptr;
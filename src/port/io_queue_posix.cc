@@ -0,0 +1,515 @@
+#include "port/io_impl.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "glog/logging.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define YUKINO_PORT_IO_URING 1
+#endif
+#endif
+#endif
+
+namespace yukino {
+
+namespace port {
+
+namespace {
+
+/**
+ * The request be executed by the caller thread.
+ */
+struct SyncRequest {
+    enum Op {
+        kRead,
+        kWrite,
+        kFsync,
+    };
+
+    Op op;
+    const base::RandomAccessFile *reading;
+    base::AppendFile *writing;
+    uint64_t offset;
+    char *buf;
+    const void *data;
+    size_t n;
+    void *tag;
+
+    int64_t Execute() const {
+        base::Status rs;
+
+        switch (op) {
+        case kRead: {
+            std::string scratch;
+            base::Slice result;
+            rs = reading->Read(offset, n, &result, &scratch);
+            if (rs.ok()) {
+                ::memcpy(buf, result.data(), result.size());
+                return static_cast<int64_t>(result.size());
+            }
+        } break;
+
+        case kWrite:
+            rs = static_cast<base::FileIO *>(writing)->WriteAt(offset, data, n);
+            if (rs.ok()) {
+                return static_cast<int64_t>(n);
+            }
+            break;
+
+        case kFsync:
+            rs = writing->Sync();
+            if (rs.ok()) {
+                return 0;
+            }
+            break;
+
+        default:
+            DLOG(FATAL) << "Noreached!";
+            break;
+        }
+        return -EIO;
+    }
+};
+
+/**
+ * The fallback queue: requests be executed one by one in Submit().
+ */
+class SyncIOQueue : public base::IOQueue {
+public:
+    explicit SyncIOQueue(size_t depth) : depth_(depth) {}
+
+    virtual ~SyncIOQueue() override {}
+
+    virtual base::Status ReadAsync(const base::RandomAccessFile *file,
+                                   uint64_t offset, size_t n, char *buf,
+                                   void *tag) override {
+        queued_.push_back({SyncRequest::kRead, DCHECK_NOTNULL(file), nullptr,
+                           offset, buf, nullptr, n, tag});
+        return base::Status::OK();
+    }
+
+    virtual base::Status WriteAsync(base::FileIO *file, uint64_t offset,
+                                    const void *data, size_t n,
+                                    void *tag) override {
+        queued_.push_back({SyncRequest::kWrite, nullptr, DCHECK_NOTNULL(file),
+                           offset, nullptr, data, n, tag});
+        return base::Status::OK();
+    }
+
+    virtual base::Status Fsync(base::AppendFile *file, void *tag) override {
+        queued_.push_back({SyncRequest::kFsync, nullptr, DCHECK_NOTNULL(file),
+                           0, nullptr, nullptr, 0, tag});
+        return base::Status::OK();
+    }
+
+    virtual base::Status Submit() override {
+        for (const auto &request : queued_) {
+            done_.push_back({request.tag, request.Execute()});
+        }
+        queued_.clear();
+        return base::Status::OK();
+    }
+
+    virtual base::Status Poll(size_t min_completions,
+                              std::vector<Completion> *completions) override {
+        if (min_completions > done_.size()) {
+            return base::Status::InvalidArgument("Not enough submitted "
+                                                 "requests.");
+        }
+        completions->insert(completions->end(), done_.begin(), done_.end());
+        done_.clear();
+        return base::Status::OK();
+    }
+
+    virtual size_t in_flight() const override {
+        return queued_.size() + done_.size();
+    }
+
+    virtual size_t depth() const override { return depth_; }
+
+    virtual bool asynchronous() const override { return false; }
+
+private:
+    const size_t depth_;
+    std::vector<SyncRequest> queued_;
+    std::vector<Completion> done_;
+};
+
+#if defined(YUKINO_PORT_IO_URING)
+
+/**
+ * The queue on Linux io_uring. The submission and completion rings be
+ * shared with the kernel, so Submit() costs one io_uring_enter() for all
+ * queued requests.
+ *
+ * The requests on the files without native handle be executed at queuing.
+ */
+class UringIOQueue : public base::IOQueue {
+public:
+    virtual ~UringIOQueue() override {
+        if (ring_fd_ < 0) {
+            return;
+        }
+
+        // The kernel may still write the buffers of unfinished requests.
+        std::vector<Completion> dummy;
+        Poll(in_flight(), &dummy);
+
+        if (sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, num_slots_ * sizeof(struct io_uring_sqe));
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            ::munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            ::munmap(sq_ring_, sq_ring_size_);
+        }
+        ::close(ring_fd_);
+    }
+
+    static base::Status Open(size_t depth, UringIOQueue **queue) {
+        struct io_uring_params params;
+        ::memset(&params, 0, sizeof(params));
+
+        auto fd = static_cast<int>(::syscall(__NR_io_uring_setup,
+                                             static_cast<unsigned>(depth),
+                                             &params));
+        if (fd < 0) {
+            return Error();
+        }
+
+        std::unique_ptr<UringIOQueue> impl(new UringIOQueue(fd));
+        auto rs = impl->Map(params);
+        if (!rs.ok()) {
+            return rs;
+        }
+        *queue = impl.release();
+        return rs;
+    }
+
+    virtual base::Status ReadAsync(const base::RandomAccessFile *file,
+                                   uint64_t offset, size_t n, char *buf,
+                                   void *tag) override {
+        auto fd = DCHECK_NOTNULL(file)->native_handle();
+        if (fd < 0) {
+            SyncRequest request = {SyncRequest::kRead, file, nullptr, offset,
+                                   buf, nullptr, n, tag};
+            done_.push_back({tag, request.Execute()});
+            return base::Status::OK();
+        }
+
+        struct io_uring_sqe *sqe = nullptr;
+        auto rs = Prepare(IORING_OP_READV, fd, buf, n, tag, &sqe);
+        if (!rs.ok()) {
+            return rs;
+        }
+        sqe->off = offset;
+        Commit();
+        return rs;
+    }
+
+    virtual base::Status WriteAsync(base::FileIO *file, uint64_t offset,
+                                    const void *data, size_t n,
+                                    void *tag) override {
+        // The data buffered by stdio must be written before.
+        auto rs = DCHECK_NOTNULL(file)->Flush();
+        if (!rs.ok()) {
+            return rs;
+        }
+
+        auto fd = file->native_handle();
+        if (fd < 0) {
+            SyncRequest request = {SyncRequest::kWrite, nullptr, file, offset,
+                                   nullptr, data, n, tag};
+            done_.push_back({tag, request.Execute()});
+            return base::Status::OK();
+        }
+
+        struct io_uring_sqe *sqe = nullptr;
+        rs = Prepare(IORING_OP_WRITEV, fd, const_cast<void *>(data), n, tag,
+                     &sqe);
+        if (!rs.ok()) {
+            return rs;
+        }
+        sqe->off = offset;
+        Commit();
+        return rs;
+    }
+
+    virtual base::Status Fsync(base::AppendFile *file, void *tag) override {
+        auto rs = DCHECK_NOTNULL(file)->Flush();
+        if (!rs.ok()) {
+            return rs;
+        }
+
+        auto fd = file->native_handle();
+        if (fd < 0) {
+            SyncRequest request = {SyncRequest::kFsync, nullptr, file, 0,
+                                   nullptr, nullptr, 0, tag};
+            done_.push_back({tag, request.Execute()});
+            return base::Status::OK();
+        }
+
+        struct io_uring_sqe *sqe = nullptr;
+        rs = Prepare(IORING_OP_FSYNC, fd, nullptr, 0, tag, &sqe);
+        if (!rs.ok()) {
+            return rs;
+        }
+        // Start after all previous requests finished.
+        sqe->flags |= IOSQE_IO_DRAIN;
+        Commit();
+        return rs;
+    }
+
+    virtual base::Status Submit() override {
+        while (to_submit_ > 0) {
+            auto rv = Enter(to_submit_, 0, 0);
+            if (rv < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return Error();
+            }
+            to_submit_ -= static_cast<unsigned>(rv);
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status Poll(size_t min_completions,
+                              std::vector<Completion> *completions) override {
+        Reap();
+        while (done_.size() < min_completions) {
+            if (free_slots_.size() == num_slots_) {
+                return base::Status::InvalidArgument("Not enough submitted "
+                                                     "requests.");
+            }
+            auto rs = Wait();
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        completions->insert(completions->end(), done_.begin(), done_.end());
+        done_.clear();
+        return base::Status::OK();
+    }
+
+    virtual size_t in_flight() const override {
+        return num_slots_ - free_slots_.size() + done_.size();
+    }
+
+    virtual size_t depth() const override { return num_slots_; }
+
+    virtual bool asynchronous() const override { return true; }
+
+private:
+    // The request in the kernel. The iovec must be valid until the request
+    // finished.
+    struct Slot {
+        struct iovec iov;
+        void *tag;
+    };
+
+    explicit UringIOQueue(int ring_fd) : ring_fd_(ring_fd) {}
+
+    base::Status Map(const struct io_uring_params &params) {
+        sq_ring_size_ = params.sq_off.array +
+                        params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes +
+                        params.cq_entries * sizeof(struct io_uring_cqe);
+
+        auto single_mmap = false;
+#if defined(IORING_FEAT_SINGLE_MMAP)
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+            cq_ring_size_ = sq_ring_size_;
+            single_mmap = true;
+        }
+#endif
+
+        sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE, ring_fd_,
+                          IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return Error();
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ|PROT_WRITE,
+                              MAP_SHARED|MAP_POPULATE, ring_fd_,
+                              IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                return Error();
+            }
+        }
+        num_slots_ = params.sq_entries;
+        auto sqes = ::mmap(nullptr, num_slots_ * sizeof(struct io_uring_sqe),
+                           PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                           ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            num_slots_ = 0;
+            return Error();
+        }
+        sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+        auto sq = static_cast<uint8_t *>(sq_ring_);
+        sq_tail_  = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        sq_mask_  = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+
+        auto cq = static_cast<uint8_t *>(cq_ring_);
+        cq_head_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+        cqes_    = reinterpret_cast<struct io_uring_cqe *>(
+                cq + params.cq_off.cqes);
+
+        // At most num_slots_ requests in the kernel, so the completion
+        // ring (2 * sq_entries) never overflows.
+        slots_.reset(new Slot[num_slots_]);
+        for (size_t i = 0; i < num_slots_; ++i) {
+            free_slots_.push_back(&slots_[i]);
+        }
+        return base::Status::OK();
+    }
+
+    base::Status Prepare(uint8_t opcode, int fd, void *buf, size_t n,
+                         void *tag, struct io_uring_sqe **rv) {
+        while (free_slots_.empty()) {
+            // The queue is full, wait for some requests finished.
+            auto rs = Wait();
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        auto slot = free_slots_.back();
+        free_slots_.pop_back();
+        slot->iov.iov_base = buf;
+        slot->iov.iov_len  = n;
+        slot->tag          = tag;
+
+        auto sqe = &sqes_[*sq_tail_ & sq_mask_];
+        ::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = opcode;
+        sqe->fd        = fd;
+        sqe->user_data = reinterpret_cast<uint64_t>(slot);
+        if (buf) {
+            sqe->addr = reinterpret_cast<uint64_t>(&slot->iov);
+            sqe->len  = 1;
+        }
+        *rv = sqe;
+        return base::Status::OK();
+    }
+
+    void Commit() {
+        auto tail = *sq_tail_;
+        sq_array_[tail & sq_mask_] = tail & sq_mask_;
+        // The kernel must see the entry before the new tail.
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        to_submit_++;
+    }
+
+    base::Status Wait() {
+        auto rs = Submit();
+        if (!rs.ok()) {
+            return rs;
+        }
+        for (;;) {
+            auto rv = Enter(0, 1, IORING_ENTER_GETEVENTS);
+            if (rv >= 0) {
+                break;
+            }
+            if (errno != EINTR) {
+                return Error();
+            }
+        }
+        Reap();
+        return rs;
+    }
+
+    void Reap() {
+        auto head = *cq_head_;
+        auto tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            auto cqe  = &cqes_[head & cq_mask_];
+            auto slot = reinterpret_cast<Slot *>(cqe->user_data);
+            done_.push_back({slot->tag, cqe->res});
+            free_slots_.push_back(slot);
+            head++;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_,
+                                          to_submit, min_complete, flags,
+                                          nullptr, 0));
+    }
+
+    static base::Status Error() {
+        return base::Status::IOError(strerror(errno));
+    }
+
+    int ring_fd_;
+
+    void  *sq_ring_ = MAP_FAILED;
+    size_t sq_ring_size_ = 0;
+    void  *cq_ring_ = MAP_FAILED;
+    size_t cq_ring_size_ = 0;
+    struct io_uring_sqe *sqes_ = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+
+    uint32_t *sq_tail_ = nullptr;
+    uint32_t  sq_mask_ = 0;
+    uint32_t *sq_array_ = nullptr;
+    uint32_t *cq_head_ = nullptr;
+    uint32_t *cq_tail_ = nullptr;
+    uint32_t  cq_mask_ = 0;
+    struct io_uring_cqe *cqes_ = nullptr;
+
+    unsigned to_submit_ = 0;
+
+    size_t num_slots_ = 0;
+    std::unique_ptr<Slot[]> slots_;
+    std::vector<Slot *> free_slots_;
+    std::vector<Completion> done_;
+};
+
+#endif // defined(YUKINO_PORT_IO_URING)
+
+} // namespace
+
+base::Status CreateIOQueue(size_t depth, base::IOQueue **queue) {
+#if defined(YUKINO_PORT_IO_URING)
+    UringIOQueue *impl = nullptr;
+
+    auto rs = UringIOQueue::Open(depth, &impl);
+    if (rs.ok()) {
+        *DCHECK_NOTNULL(queue) = impl;
+        return rs;
+    }
+    // The kernel has no io_uring, or it's disabled. Fall back to the
+    // synchronous queue.
+#endif
+    return CreateSyncIOQueue(depth, queue);
+}
+
+base::Status CreateSyncIOQueue(size_t depth, base::IOQueue **queue) {
+    *DCHECK_NOTNULL(queue) = new SyncIOQueue(depth);
+    return base::Status::OK();
+}
+
+} // namespace port
+
+} // namespace yukino
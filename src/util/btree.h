@@ -158,6 +158,19 @@ struct Page : public base::ReferenceCounted<Page<Key, Comparator>> {
 
     inline uint64_t GetLChild(int i) { return child(i); }
 
+    /**
+     * @return the index of child: [0, size()) for entries, size() for link,
+     *         -1 for not found.
+     */
+    inline int IndexOfChild(uint64_t id) const {
+        for (auto i = 0; i < static_cast<int>(size()); ++i) {
+            if (child(i) == id) {
+                return i;
+            }
+        }
+        return link == id ? static_cast<int>(size()) : -1;
+    }
+
     inline uint64_t GetRChild(int i) {
         if (i == size() - 1) {
             return link;
@@ -312,7 +325,12 @@ private:
     void SplitNonLeaf(Page *page);
 
     void RemoveLeaf(const Key &hint, Page *page);
-    void RemoveNonLeaf(const Entry &hint, Page *page);
+    void RemoveNonLeaf(Page *page);
+
+    /**
+     * Remove the child from non-leaf page, the child page will not be freed.
+     */
+    inline void RemoveChild(Page *page, uint64_t child);
 
     /**
      * Move owned entries to target node.
@@ -360,13 +378,18 @@ public:
 
     void SeekToFirst() {
         page_ = GetFirstLeaf();
-        DCHECK_GT(page_->size(), 0);
+        if (page_->size() == 0) { // empty tree
+            page_ = nullptr;
+        }
         local_ = 0;
     }
 
     void SeekToLast() {
         page_ = GetLastLeaf();
-        DCHECK_GT(page_->size(), 0);
+        if (page_->size() == 0) { // empty tree
+            page_ = nullptr;
+            return;
+        }
         local_ = static_cast<int>(page_->size()) - 1;
     }
 
@@ -377,6 +400,19 @@ public:
         direction_ = kForward;
     }
 
+    // Seek for the ascending keys: if the key is in the current leaf, find it
+    // in the leaf without descending from the root.
+    void SeekForward(const Key &key) {
+        if (Valid() && page_->size() > 0 &&
+            owns_->comparator_(key, page_->key(0)) >= 0 &&
+            owns_->comparator_(key, page_->key(page_->size() - 1)) <= 0) {
+            local_ = page_->FindGreaterOrEqual(key, owns_->comparator_);
+            direction_ = kForward;
+            return;
+        }
+        Seek(key);
+    }
+
     // [0][1][2] [3][4][5]
     void Next() {
         DCHECK(Valid());
@@ -463,23 +499,33 @@ inline bool BTree<Key, Comparator, Allocator>::Delete(const Key &key, Key *old)
 template<class Key, class Comparator, class Allocator>
 std::tuple<typename BTree<Key, Comparator, Allocator>::Page*, int>
 BTree<Key, Comparator, Allocator>::FindLessThan(const Key &key) const {
+    // Walk down the path of key, and remember the nearest left subtree. The
+    // entry key of non-leaf page is only the upper bound of its child, so
+    // the less key may be in the leaf of key or the last leaf of that subtree.
+    uint64_t left = 0;
     auto page = root_.get();
     while (!page->is_leaf()) {
-        auto i = page->FindLessThan(key, comparator_);
-        if (i == static_cast<int>(page->size()) - 1) {
-            auto rv = comparator_(key, GetPage(page->link)->key(0));
-            if (rv <= 0) {
-                page = GetPage(page->child(i));
-            } else if (rv > 0) {
-                page = GetPage(page->link);
-            }
+        auto i = page->FindGreaterOrEqual(key, comparator_);
+        if (i < 0) {
+            left = page->child(static_cast<int>(page->size()) - 1);
+            page = GetPage(page->link);
         } else {
-            page = GetPage(page->child(i < 0 ? 0 : i));
+            if (i > 0) {
+                left = page->child(i - 1);
+            }
+            page = GetPage(page->child(i));
         }
     }
 
-    int i = -1;
-    if (page) {
+    auto i = page->FindLessThan(key, comparator_);
+    if (i < 0) {
+        if (!left) {
+            return {nullptr, -1};
+        }
+        page = GetPage(left);
+        while (!page->is_leaf()) {
+            page = GetPage(page->link);
+        }
         i = page->FindLessThan(key, comparator_);
         if (i < 0) {
             page = nullptr;
@@ -519,6 +565,8 @@ BTree<Key, Comparator, Allocator>::Insert(const Key &key, Page *node,
         SplitLeaf(page.get());
         return Insert(key, root_.get(), is_new);
     }
+    // The new or replaced entry must be written back too.
+    page->dirty++;
     return page->FindOrInsert(key, comparator_, is_new);
 }
 
@@ -533,6 +581,7 @@ BTree<Key, Comparator, Allocator>::Erase(const Key &key, Page *node,
     if (entry) {
         rv = *entry;
         page->Delete(entry);
+        page->dirty++;
         if (page->size() == 0) {
             RemoveLeaf(rv.key, page.get());
         }
@@ -640,36 +689,18 @@ void BTree<Key, Comparator, Allocator>::RemoveLeaf(const Key &hint, Page *page)
     }
 
     base::Handle<Page> parent(DCHECK_NOTNULL(GetPage(page->parent)));
-    auto i = parent->FindGreaterOrEqual(hint, comparator_);
-    if (i < 0) {
-        i = static_cast<int>(parent->size()) - 1;
-    }
-
-    base::Handle<Page> link(GetPage(parent->GetLChild(i) == page->id
-                                    ? parent->GetRChild(i)
-                                    : parent->GetRChild(i)));
-    Entry old{parent->key(i), link->id};
-
-    if (i == parent->size() - 1) {
-        parent->link = parent->child(i);
-    }
-    parent->DeleteAt(i);
-    parent->dirty++;
+    RemoveChild(parent.get(), page->id);
 
     if (parent->size() == 0) {
-        if (parent == root_) {
-            root_ = link;
-            root_->parent = 0;
-            root_->dirty++;
-            FreePage(parent.get());
-        } else {
-            RemoveNonLeaf(old, parent.get());
-        }
+        RemoveNonLeaf(parent.get());
     }
 
     FreePage(page);
 }
 
+// The page has no entries, only one child in link, move the child to the
+// sibling, then remove page from it's parent:
+//
 // Remove first:
 //
 //                    [3][7]
@@ -705,53 +736,67 @@ void BTree<Key, Comparator, Allocator>::RemoveLeaf(const Key &hint, Page *page)
 //[0][1]   [2][3]   [4][5] [8][9] [a][b]
 //-----------------------------------------------
 template<class Key, class Comparator, class Allocator>
-void BTree<Key, Comparator, Allocator>::RemoveNonLeaf(const Entry &hint,
-                                                      Page *page) {
+void BTree<Key, Comparator, Allocator>::RemoveNonLeaf(Page *page) {
+    DCHECK_EQ(0, page->size());
+
+    base::Handle<Page> child(DCHECK_NOTNULL(GetPage(page->link)));
     if (page == root_.get()) {
+        root_ = child;
+        root_->parent = 0;
+        root_->dirty++;
+        FreePage(page);
         return;
     }
 
-    base::Handle<Page> parent(GetPage(page->parent));
-    auto i = parent->FindGreaterOrEqual(hint.key, comparator_);
-    if (i < 0) {
+    base::Handle<Page> parent(DCHECK_NOTNULL(GetPage(page->parent)));
+    auto i = parent->IndexOfChild(page->id);
+    DCHECK_GE(i, 0);
+
+    base::Handle<Page> sibling;
+    if (i < static_cast<int>(parent->size())) {
+        // The right sibling: child be the first one, bounded by key(i).
+        sibling = GetPage(parent->GetRChild(i));
+        sibling->entries.insert(sibling->entries.begin(),
+                                Entry{parent->key(i), child->id});
+    } else {
+        // The left sibling: child be the last one, it's link.
         i = static_cast<int>(parent->size()) - 1;
+        sibling = GetPage(parent->child(i));
+        sibling->entries.push_back(Entry{parent->key(i), sibling->link});
+        sibling->link = child->id;
     }
+    child->parent = sibling->id;
+    child->dirty++;
+    sibling->dirty++;
 
-    base::Handle<Page> sibling(GetPage(parent->GetLChild(i) == page->id
-                                       ? parent->GetRChild(i)
-                                       : parent->GetLChild(i)));
-
-    auto put = sibling->Put(parent->key(i), 0, comparator_);
-    if (sibling->index_of(put) == sibling->size() - 1) {
-        sibling->SetLChild(put, sibling->link);
-        sibling->SetRChild(put, hint.link);
-    } else {
-        sibling->Put(parent->key(i), hint.link, comparator_);
+    RemoveChild(parent.get(), page->id);
+    if (sibling->size() > static_cast<size_t>(PageMaxSize(sibling.get()))) {
+        SplitNonLeaf(sibling.get());
     }
-    GetPage(hint.link)->parent = sibling->id;
-
-    auto link = GetPage(parent->GetLChild(i) == page->id ? parent->GetRChild(i)
-                        : parent->GetRChild(i));
-    Entry old{parent->key(i), link->id};
-
-    parent->DeleteAt(i);
-    sibling->dirty++;
-    parent->dirty++;
 
     if (parent->size() == 0) {
-        if (parent == root_) {
-            root_ = sibling;
-            root_->dirty++;
-            root_->parent = 0;
-            FreePage(parent.get());
-        } else {
-            RemoveNonLeaf(old, parent.get());
-        }
+        RemoveNonLeaf(parent.get());
     }
 
     FreePage(page);
 }
 
+template<class Key, class Comparator, class Allocator>
+inline void BTree<Key, Comparator, Allocator>::RemoveChild(Page *page,
+                                                           uint64_t child) {
+    DCHECK(!page->is_leaf());
+
+    auto i = page->IndexOfChild(child);
+    DCHECK_GE(i, 0);
+    if (i == static_cast<int>(page->size())) {
+        // Remove the link, the last child of entries be the new link.
+        i--;
+        page->link = page->child(i);
+    }
+    page->entries.erase(page->entries.begin() + i);
+    page->dirty++;
+}
+
 template<class Key, class Comparator, class Allocator>
 inline
 typename BTree<Key, Comparator, Allocator>::Page *
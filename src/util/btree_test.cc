@@ -284,6 +284,28 @@ TEST_F(BTreeTest, FindLessThan) {
     EXPECT_EQ(5, std::get<0>(rv)->key(std::get<1>(rv)));
 }
 
+TEST_F(BTreeTest, FindLessThanInSubtrees) {
+    IntTree tree(3, int_comparator);
+
+    // The odd keys be deleted, so the separator keys of non-leaf pages may
+    // be gone, only the upper bounds of their children.
+    static const auto k = 300;
+    int dummy = 0;
+    for (auto i = 0; i < k; ++i) {
+        ASSERT_FALSE(tree.Put(i, &dummy)) << i;
+    }
+    for (auto i = 1; i < k; i += 2) {
+        ASSERT_TRUE(tree.Delete(i, &dummy)) << i;
+    }
+
+    EXPECT_EQ(nullptr, std::get<0>(tree.FindLessThan(0)));
+    for (auto i = 1; i <= k; ++i) {
+        auto rv = tree.FindLessThan(i);
+        ASSERT_NE(nullptr, std::get<0>(rv)) << i;
+        EXPECT_EQ((i - 1) & ~1, std::get<0>(rv)->key(std::get<1>(rv))) << i;
+    }
+}
+
 TEST_F(BTreeTest, IteratorNext) {
     IntTree tree(3, int_comparator);
 
@@ -552,6 +574,135 @@ TEST_F(BTreeTest, SequenceDeletion) {
     }
 }
 
+TEST_F(BTreeTest, FuzzyDeletion) {
+    IntTree tree(3, int_comparator);
+
+    static const auto k = 1000;
+    std::vector<int> arr(k);
+    for (auto i = 0; i < k; ++i) {
+        arr[i] = i;
+    }
+    int dummy = 0;
+    for (auto i : arr) {
+        ASSERT_FALSE(tree.Put(i, &dummy)) << i;
+    }
+
+    // Delete the even keys in random order, the leaf links must be kept.
+    ShuffleArray(&arr);
+    for (auto i : arr) {
+        if (i % 2 == 0) {
+            ASSERT_TRUE(tree.Delete(i, &dummy)) << i;
+        }
+    }
+
+    IntTree::Iterator iter(&tree);
+    auto expected = 1;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        ASSERT_EQ(expected, iter.key());
+        expected += 2;
+    }
+    ASSERT_EQ(k + 1, expected);
+
+    expected = k - 1;
+    for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+        ASSERT_EQ(expected, iter.key());
+        expected -= 2;
+    }
+    ASSERT_EQ(-1, expected);
+
+    // Delete all of the rest, the tree be collapsed to a empty leaf.
+    for (auto i : arr) {
+        if (i % 2 != 0) {
+            ASSERT_TRUE(tree.Delete(i, &dummy)) << i;
+        }
+    }
+    iter.SeekToFirst();
+    EXPECT_FALSE(iter.Valid());
+    EXPECT_TRUE(tree.TEST_GetRoot()->is_leaf());
+}
+
+TEST_F(BTreeTest, EmptyIterator) {
+    IntTree tree(3, int_comparator);
+
+    IntTree::Iterator iter(&tree);
+    iter.SeekToFirst();
+    EXPECT_FALSE(iter.Valid());
+    iter.SeekToLast();
+    EXPECT_FALSE(iter.Valid());
+
+    int dummy = 0;
+    ASSERT_FALSE(tree.Put(1, &dummy));
+    ASSERT_TRUE(tree.Delete(1, &dummy));
+    iter.SeekToFirst();
+    EXPECT_FALSE(iter.Valid());
+    iter.SeekToLast();
+    EXPECT_FALSE(iter.Valid());
+}
+
+TEST_F(BTreeTest, RangeDeletion) {
+    IntTree tree(3, int_comparator);
+
+    static const auto k = 300;
+    int dummy = 0;
+    for (auto i = 0; i < k; ++i) {
+        ASSERT_FALSE(tree.Put(i, &dummy)) << i;
+    }
+
+    // Whole leaves and their parents be removed, the less key of the range
+    // must be found in the left subtree.
+    for (auto i = 100; i < 200; ++i) {
+        ASSERT_TRUE(tree.Delete(i, &dummy)) << i;
+    }
+
+    IntTree::Iterator iter(&tree);
+    auto expected = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        ASSERT_EQ(expected, iter.key());
+        expected = (expected == 99) ? 200 : expected + 1;
+    }
+    ASSERT_EQ(k, expected);
+
+    expected = k - 1;
+    for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+        ASSERT_EQ(expected, iter.key());
+        expected = (expected == 200) ? 99 : expected - 1;
+    }
+    ASSERT_EQ(-1, expected);
+}
+
+TEST_F(BTreeTest, DirtyLeaf) {
+    IntTree tree(3, int_comparator);
+
+    int old = 0;
+    //       [3]
+    // [1][3]   [4][5]
+    BatchPut({1, 5, 3, 4}, &tree);
+
+    // As the checkpoint flushed every page.
+    auto root = tree.TEST_GetRoot();
+    auto left = tree.GetPage(root->entries[0].link);
+    auto right = tree.GetPage(root->link);
+    root->dirty = 0;
+    left->dirty = 0;
+    right->dirty = 0;
+
+    // Insert, replace and erase in a leaf without splitting or merging.
+    ASSERT_FALSE(tree.Put(2, &old));
+    EXPECT_GT(left->dirty, 0);
+    EXPECT_EQ(0, right->dirty);
+
+    left->dirty = 0;
+    ASSERT_TRUE(tree.Put(5, &old));
+    EXPECT_GT(right->dirty, 0);
+    EXPECT_EQ(0, left->dirty);
+
+    right->dirty = 0;
+    ASSERT_TRUE(tree.Delete(1, &old));
+    EXPECT_GT(left->dirty, 0);
+    EXPECT_EQ(0, right->dirty);
+    EXPECT_EQ(0, root->dirty);
+}
+
 } // namespace util
 
 } // namespace yukino
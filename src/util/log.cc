@@ -1,16 +1,37 @@
 #include "util/log.h"
 #include "glog/logging.h"
+#include <algorithm>
 
 namespace yukino {
 
 namespace util {
 
-LogWriter::LogWriter(base::Writer *writer, size_t block_size)
+namespace {
+
+const uint8_t kZeroes[Log::kRecyclableHeaderSize] = {0};
+
+inline bool IsRecyclable(int type) {
+    return type >= Log::kRecyclableFullType &&
+           type <= Log::kRecyclableLastType;
+}
+
+} // namespace
+
+LogWriter::LogWriter(base::Writer *writer, size_t block_size, bool recyclable,
+                     uint64_t log_number, uint64_t offset)
     : block_size_(block_size)
+    , block_offset_(static_cast<int>(offset % block_size))
+    , recyclable_(recyclable)
+    , header_size_(recyclable ? Log::kRecyclableHeaderSize : Log::kHeaderSize)
+    , log_number_(static_cast<uint32_t>(log_number))
     , writer_(writer) {
     for (auto i = 0; i <= Log::kMaxRecordType; i++) {
         auto c = static_cast<uint8_t>(i);
         typed_checksums_[i] = ::crc32(0, &c, 1);
+        if (IsRecyclable(i)) {
+            typed_checksums_[i] = ::crc32(typed_checksums_[i], &log_number_,
+                                          sizeof(log_number_));
+        }
     }
 }
 
@@ -24,10 +45,9 @@ base::Status LogWriter::Append(const base::Slice &record) {
         auto left_over = block_size_ - block_offset_;
         DCHECK_GE(left_over, 0);
 
-        if (left_over < Log::kHeaderSize) {
+        if (left_over < header_size_) {
             if (left_over > 0) {
-                rs = writer_->Write("\x00\x00\x00\x00\x00\x00\x00",
-                                    left_over, nullptr);
+                rs = writer_->Write(kZeroes, left_over, nullptr);
                 if (!rs.ok()) {
                     break;
                 }
@@ -35,9 +55,9 @@ base::Status LogWriter::Append(const base::Slice &record) {
             block_offset_ = 0;
         }
 
-        DCHECK_GE(block_size_ - block_offset_ - Log::kHeaderSize, 0);
+        DCHECK_GE(block_size_ - block_offset_ - header_size_, 0);
 
-        const size_t avail = block_size_ - block_offset_ - Log::kHeaderSize;
+        const size_t avail = block_size_ - block_offset_ - header_size_;
         const size_t fragment_length = (left < avail) ? left : avail;
 
         Log::RecordType type;
@@ -51,6 +71,10 @@ base::Status LogWriter::Append(const base::Slice &record) {
         } else {
             type = Log::kMiddleType;
         }
+        if (recyclable_) {
+            type = static_cast<Log::RecordType>(type + Log::kRecyclableFullType -
+                                                Log::kFullType);
+        }
 
         rs = EmitPhysicalRecord(p, fragment_length, type);
         p += fragment_length;
@@ -64,7 +88,7 @@ base::Status LogWriter::Append(const base::Slice &record) {
 base::Status LogWriter::EmitPhysicalRecord(const void *buf, size_t len,
                                    Log::RecordType type) {
     DCHECK_LE(len, UINT16_MAX);
-    DCHECK_LE(block_offset_ + Log::kHeaderSize + len, block_size_);
+    DCHECK_LE(block_offset_ + header_size_ + len, block_size_);
 
     auto checksum = ::crc32(typed_checksums_[type], buf, len);
     auto rs = writer_->WriteFixed32(checksum);
@@ -79,89 +103,164 @@ base::Status LogWriter::EmitPhysicalRecord(const void *buf, size_t len,
     if (!rs.ok()) {
         return rs;
     }
+    if (recyclable_) {
+        rs = writer_->WriteFixed32(log_number_);
+        if (!rs.ok()) {
+            return rs;
+        }
+    }
 
     rs = writer_->Write(buf, len, nullptr);
     if (!rs.ok()) {
         return rs;
     }
 
-    block_offset_ += (Log::kHeaderSize + len);
+    block_offset_ += (header_size_ + len);
     return base::Status::OK();
 }
 
 LogReader::LogReader(const void *buf, size_t len, bool checksum,
-                     size_t block_size)
+                     size_t block_size, uint64_t log_number)
     : block_size_(block_size)
+    , len_(len)
+    , log_number_(static_cast<uint32_t>(log_number))
     , checksum_(checksum)
     , reader_(buf, len) {
 }
 
 bool LogReader::Read(base::Slice *slice, std::string* scratch) {
-    if (reader_.active() == 0) {
-        return false;
-    }
-    DCHECK_GT(reader_.active(), Log::kHeaderSize);
+    status_ = base::Status::OK();
 
-    auto fail = 0, segment = 0;
-    Log::RecordType type = Log::kZeroType;
-    do {
-        auto left_over = block_size_ - block_offset_;
-        DCHECK_GE(left_over, 0);
+    auto in_fragment = false;
+    base::Slice fragment;
+    while (true) {
+        auto type = ReadPhysicalRecord(&fragment);
+        switch (type) {
+        case Log::kFullType:
+            *slice = fragment;
+            offset_ = len_ - reader_.active();
+            return true;
 
-        if (left_over < Log::kHeaderSize) {
-            if (left_over > 0) {
-                reader_.Ignore(left_over);
-            }
-            block_offset_ = 0;
-        }
+        case Log::kFirstType:
+            scratch->assign(fragment.data(), fragment.size());
+            in_fragment = true;
+            break;
 
-        if (segment > 0) {
-            if (segment == 1) {
-                scratch->clear();
+        case Log::kMiddleType:
+        case Log::kLastType:
+            if (!in_fragment) {
+                // The tail of a record, its head had be overwritten.
+                if (recycled_) {
+                    return false;
+                }
+                status_ = base::Status::Corruption("missing start of "
+                                                   "fragmented record.");
+                return true;
             }
-            scratch->append(slice->data(), slice->size());
-        }
+            scratch->append(fragment.data(), fragment.size());
+            if (type == Log::kLastType) {
+                *slice = *scratch;
+                offset_ = len_ - reader_.active();
+                return true;
+            }
+            break;
 
-        type = ReadPhysicalRecord(slice, &fail);
-        segment++;
-    } while (type == Log::kMiddleType ||
-             type == Log::kFirstType);
+        case kBadRecord:
+            if (recycled_) {
+                return false;
+            }
+            status_ = base::Status::IOError("crc32 checksum fail.");
+            return true;
 
-    if (fail > 0) {
-        status_ = base::Status::IOError("crc32 checksum fail.");
-    } else {
-        status_ = base::Status::OK();
-    }
+        case kStaleRecord:
+        case kEof:
+            // The partial fragmented record be dropped.
+            return false;
 
-    if (segment > 1) {
-        scratch->append(slice->data(), slice->size());
-        *slice = *scratch;
+        default:
+            DLOG(FATAL) << "noreached: " << type;
+            return false;
+        }
     }
-    return true;
 }
 
-Log::RecordType LogReader::ReadPhysicalRecord(base::Slice *slice, int *fail) {
+int LogReader::ReadPhysicalRecord(base::Slice *slice) {
+    while (true) {
+        auto left_over = block_size_ - block_offset_;
+        if (left_over < Log::kHeaderSize) {
+            reader_.Ignore(std::min(left_over, reader_.active()));
+            block_offset_ = 0;
+            continue;
+        }
+        if (reader_.active() < Log::kHeaderSize) {
+            return kEof;
+        }
+
+        auto header = reader_.current();
+        auto checksum = reader_.ReadFixed32();
+        auto len = reader_.ReadFixed16();
+        auto type = reader_.ReadByte();
+        auto header_size = Log::kHeaderSize;
+
+        if (type == Log::kZeroType && len == 0) {
+            // The padding at the end of block, or the preallocated space.
+            reader_.Ignore(std::min(left_over - Log::kHeaderSize,
+                                    reader_.active()));
+            block_offset_ = 0;
+            continue;
+        }
+        if (type > Log::kMaxRecordType) {
+            block_offset_ += header_size;
+            return kBadRecord;
+        }
+
+        uint32_t log_number = 0;
+        if (IsRecyclable(type)) {
+            header_size = Log::kRecyclableHeaderSize;
+            if (reader_.active() < sizeof(log_number)) {
+                return kEof;
+            }
+            log_number = reader_.ReadFixed32();
+        }
+        if (reader_.active() < len) {
+            // The record be truncated at the end of file.
+            return kEof;
+        }
+        if (block_offset_ + header_size + len > block_size_) {
+            return recycled_ ? kEof : kBadRecord;
+        }
 
-    auto checksum = reader_.ReadFixed32();
-    auto len = reader_.ReadFixed16();
-    auto type = reader_.ReadByte();
+        *slice = reader_.Read(len);
+        block_offset_ += (header_size + len);
 
-    *slice = reader_.Read(len);
+        if (checksum_) {
+            base::CRC32 crc32;
 
-    if (checksum_) {
-        base::CRC32 crc32;
+            // The type and log number.
+            crc32.Update(header + 4 + 2, header_size - 4 - 2);
+            crc32.Update(slice->data(), slice->size());
 
-        crc32.Update(&type, 1);
-        crc32.Update(slice->data(), slice->size());
+            if (crc32.digest() != checksum) {
+                return kBadRecord;
+            }
+        }
 
-        if (crc32.digest() != checksum) {
-            (*fail)++;
+        if (IsRecyclable(type)) {
+            if (log_number != log_number_) {
+                return kStaleRecord;
+            }
+            recycled_ = true;
+            return type - Log::kRecyclableFullType + Log::kFullType;
+        }
+        // The legacy records after the recyclable ones be written by the
+        // previous owner of recycled file.
+        if (recycled_) {
+            return kStaleRecord;
         }
+        return type;
     }
-    block_offset_ += (Log::kHeaderSize + len);
-    return static_cast<Log::RecordType>(type);
 }
 
 } // namespace util
     
-} // namespace yukino
\ No newline at end of file
+} // namespace yukino
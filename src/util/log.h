@@ -32,13 +32,21 @@ struct Log {
         // For fragments
         kFirstType = 2,
         kMiddleType = 3,
-        kLastType = 4
+        kLastType = 4,
+
+        // For recycled log files, the header has the log number
+        kRecyclableFullType = 5,
+        kRecyclableFirstType = 6,
+        kRecyclableMiddleType = 7,
+        kRecyclableLastType = 8,
     };
 
-    static const int kMaxRecordType = kLastType;
+    static const int kMaxRecordType = kRecyclableLastType;
 
     static const auto kHeaderSize = 4 + 2 + 1;
 
+    static const auto kRecyclableHeaderSize = kHeaderSize + 4;
+
     static const int kDefaultBlockSize = 32768;
 };
 
@@ -52,11 +60,32 @@ struct Log {
  * +---------+-------+
  * | payload | data  | len bytes
  * +---------+-------+
+ *
+ * The recyclable record has the low 32 bits of log number after the type,
+ * it's in the checksum. A recycled log file has the records of the previous
+ * log after the new ones, they be told by the log number.
+ *
+ * +---------+---------+
+ * |         | crc32   | 4 bytes
+ * |         +---------+
+ * |         | len     | 2 bytes
+ * | header  +---------+
+ * |         | type    | 1 bytes
+ * |         +---------+
+ * |         | log num | 4 bytes
+ * +---------+---------+
+ * | payload | data    | len bytes
+ * +---------+---------+
  */
 
 class LogWriter {
 public:
-    LogWriter(base::Writer *writer, size_t block_size);
+    /**
+     * @param recyclable write the recyclable records with the log number.
+     * @param offset the writer continues the log file at this offset.
+     */
+    LogWriter(base::Writer *writer, size_t block_size, bool recyclable = false,
+              uint64_t log_number = 0, uint64_t offset = 0);
 
     base::Status Append(const base::Slice &record);
 
@@ -66,6 +95,10 @@ private:
     const size_t block_size_;
     int block_offset_ = 0;
 
+    const bool recyclable_;
+    const size_t header_size_;
+    const uint32_t log_number_;
+
     base::CRC32::DigestTy typed_checksums_[Log::kMaxRecordType + 1];
     base::Writer *writer_;
 
@@ -73,17 +106,46 @@ private:
 
 class LogReader {
 public:
-    LogReader(const void *buf, size_t len, bool checksum, size_t block_size);
-
+    /**
+     * @param log_number the recyclable records of other log number be the
+     *        stale records of the recycled file, reading stops at them.
+     */
+    LogReader(const void *buf, size_t len, bool checksum, size_t block_size,
+              uint64_t log_number = 0);
+
+    /**
+     * Read the next record. A truncated record at the end be ignored. After
+     * any recyclable record, the stale or broken records be the end of the
+     * log, they are not error.
+     *
+     * @return false if no more records.
+     */
     bool Read(base::Slice *slice, std::string* scratch);
 
     const base::Status &status() const { return status_; }
 
+    // The recyclable records be read.
+    bool recycled() const { return recycled_; }
+
+    // The end offset of last read record, the log can be continued at it.
+    uint64_t offset() const { return offset_; }
+
 private:
-    Log::RecordType ReadPhysicalRecord(base::Slice *slice, int *fail);
+    enum {
+        kEof = Log::kMaxRecordType + 1,
+        kBadRecord,
+        kStaleRecord,
+    };
+
+    int ReadPhysicalRecord(base::Slice *slice);
 
     const size_t block_size_;
-    int block_offset_ = 0;
+    size_t block_offset_ = 0;
+
+    const size_t len_;
+    const uint32_t log_number_;
+    bool recycled_ = false;
+    uint64_t offset_ = 0;
 
     bool checksum_;
     base::Status status_;
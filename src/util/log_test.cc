@@ -102,6 +102,97 @@ TEST_F(LogTest, BlockFilling) {
     EXPECT_FALSE(rd.Read(&slice, &scratch_));
 }
 
+TEST_F(LogTest, Recyclable) {
+    std::string record(kBlockSize, 'a');
+
+    Log::Writer log(writer_, kBlockSize, true, 7);
+    log.Append("aaaa");
+    log.Append(record);
+
+    Log::Reader rd(buf().data(), buf().size(), true, kBlockSize, 7);
+    base::Slice slice;
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_TRUE(rd.status().ok());
+    EXPECT_EQ("aaaa", slice.ToString());
+    EXPECT_TRUE(rd.recycled());
+
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_TRUE(rd.status().ok());
+    EXPECT_EQ(record, slice.ToString());
+
+    EXPECT_FALSE(rd.Read(&slice, &scratch_));
+    EXPECT_EQ(buf().size(), rd.offset());
+}
+
+TEST_F(LogTest, RecycledFile) {
+    Log::Writer old_log(writer_, kBlockSize, true, 1);
+    for (auto i = 0; i < 10; i++) {
+        old_log.Append(std::string(kBlockSize / 2, 'o'));
+    }
+    std::string old_file(buf());
+
+    // Nothing be written to the recycled file.
+    Log::Reader empty(old_file.data(), old_file.size(), true, kBlockSize, 2);
+    base::Slice slice;
+    EXPECT_FALSE(empty.Read(&slice, &scratch_));
+    EXPECT_TRUE(empty.status().ok());
+
+    // Overwrite the head of old file.
+    base::StringWriter writer;
+    Log::Writer log(&writer, kBlockSize, true, 2);
+    log.Append("aaaa");
+    log.Append("bbbb");
+    auto file = writer.buf() + old_file.substr(writer.buf().size());
+
+    Log::Reader rd(file.data(), file.size(), true, kBlockSize, 2);
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_EQ("aaaa", slice.ToString());
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_EQ("bbbb", slice.ToString());
+
+    // Stop at the stale records, it's not error.
+    EXPECT_FALSE(rd.Read(&slice, &scratch_));
+    EXPECT_TRUE(rd.status().ok());
+    EXPECT_EQ(writer.buf().size(), rd.offset());
+}
+
+TEST_F(LogTest, TruncatedTail) {
+    std::string record(kBlockSize, 'a');
+
+    Log::Writer log(writer_, kBlockSize);
+    log.Append("aaaa");
+    log.Append(record);
+
+    auto file = buf().substr(0, buf().size() - 3);
+    Log::Reader rd(file.data(), file.size(), true, kBlockSize);
+    base::Slice slice;
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_EQ("aaaa", slice.ToString());
+
+    EXPECT_FALSE(rd.Read(&slice, &scratch_));
+    EXPECT_TRUE(rd.status().ok());
+    EXPECT_EQ(Log::kHeaderSize + 4, rd.offset());
+}
+
+TEST_F(LogTest, Continue) {
+    // Left 8 bytes in the block, less than the recyclable header.
+    Log::Writer log(writer_, kBlockSize, true, 3);
+    log.Append(std::string(13, 'a'));
+
+    // The second writer continues the same log.
+    Log::Writer next(writer_, kBlockSize, true, 3, buf().size());
+    next.Append(std::string(kBlockSize / 2, 'b'));
+
+    Log::Reader rd(buf().data(), buf().size(), true, kBlockSize, 3);
+    base::Slice slice;
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_EQ(std::string(13, 'a'), slice.ToString());
+    EXPECT_TRUE(rd.Read(&slice, &scratch_));
+    EXPECT_TRUE(rd.status().ok());
+    EXPECT_EQ(std::string(kBlockSize / 2, 'b'), slice.ToString());
+    EXPECT_FALSE(rd.Read(&slice, &scratch_));
+}
+
 } // namespace util
 
 } // namespace yukino
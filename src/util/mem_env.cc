@@ -0,0 +1,522 @@
+#include "yukino/env.h"
+#include "base/ref_counted.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "glog/logging.h"
+#include <string.h>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+
+namespace yukino {
+
+namespace util {
+
+namespace {
+
+/**
+ * The content of a in-memory file. The buffer be shared by the readers and
+ * mappings opened on it, it be copied before the writing if it is shared, so
+ * they never see the changing, like the size be fixed at opening of the
+ * posix pread file.
+ */
+class FileState : public base::AtomicReferenceCounted<FileState> {
+public:
+    FileState() : data_(std::make_shared<std::string>()) {}
+
+    uint64_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return data_->size();
+    }
+
+    std::shared_ptr<const std::string> Snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return data_;
+    }
+
+    void Append(const void *data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        MutableData()->append(static_cast<const char *>(data), size);
+    }
+
+    void WriteAt(uint64_t offset, const void *data, size_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto buf = MutableData();
+        if (offset + size > buf->size()) {
+            buf->resize(offset + size);
+        }
+        ::memcpy(&(*buf)[offset], data, size);
+    }
+
+    base::Status ReadAt(uint64_t offset, void *buf, size_t size) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (offset + size > data_->size()) {
+            return base::Status::IOError("EOF");
+        }
+        ::memcpy(buf, data_->data() + offset, size);
+        return base::Status::OK();
+    }
+
+    void Truncate(uint64_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        MutableData()->resize(size);
+    }
+
+    // The file be extended to the size, if it's smaller.
+    void Extend(uint64_t size) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (data_->size() < size) {
+            MutableData()->resize(size);
+        }
+    }
+
+private:
+    // REQUIRES: mutex_ held.
+    std::string *MutableData() {
+        // The sharing be added only in Snapshot() with mutex_ held, so the
+        // buffer can not be shared after the checking.
+        if (data_.use_count() > 1) {
+            data_ = std::make_shared<std::string>(*data_);
+        }
+        return data_.get();
+    }
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<std::string> data_;
+};
+
+class MemAppendFile : public base::AppendFile {
+public:
+    explicit MemAppendFile(FileState *file) : file_(file) {}
+
+    virtual ~MemAppendFile() override {}
+
+    virtual base::Status Write(const void *data, size_t size,
+                               size_t *written) override {
+        file_->Append(data, size);
+        active_ += size;
+        if (written) {
+            *written = size;
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status Skip(size_t count) override {
+        std::string zero(count, 0);
+        return Write(zero.data(), zero.size(), nullptr);
+    }
+
+    virtual base::Status Close() override { return base::Status::OK(); }
+    virtual base::Status Flush() override { return base::Status::OK(); }
+    virtual base::Status Sync() override { return base::Status::OK(); }
+
+private:
+    base::Handle<FileState> file_;
+};
+
+class MemFileIO : public base::FileIO {
+public:
+    explicit MemFileIO(FileState *file) : file_(file) {}
+
+    virtual ~MemFileIO() override {}
+
+    virtual base::Status Write(const void *data, size_t size,
+                               size_t *written) override {
+        file_->WriteAt(active_, data, size);
+        active_ += size;
+        if (written) {
+            *written = size;
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status Skip(size_t count) override {
+        std::string zero(count, 0);
+        return Write(zero.data(), zero.size(), nullptr);
+    }
+
+    virtual base::Status Read(void *buf, size_t size) override {
+        auto rs = file_->ReadAt(active_, buf, size);
+        if (rs.ok()) {
+            active_ += size;
+        }
+        return rs;
+    }
+
+    virtual int ReadByte() override {
+        uint8_t byte = 0;
+        auto rs = Read(&byte, sizeof(byte));
+        if (!rs.ok()) {
+            return EOF; // The short read be at the end of file.
+        }
+        return byte;
+    }
+
+    virtual base::Status Ignore(size_t count) override {
+        active_ += count;
+        return base::Status::OK();
+    }
+
+    virtual base::Status Close() override { return base::Status::OK(); }
+    virtual base::Status Flush() override { return base::Status::OK(); }
+    virtual base::Status Sync() override { return base::Status::OK(); }
+
+    virtual base::Status Truncate(uint64_t offset) override {
+        file_->Truncate(offset);
+        return base::Status::OK();
+    }
+
+    virtual base::Status Seek(uint64_t offset) override {
+        active_ = offset;
+        return base::Status::OK();
+    }
+
+    virtual base::Status Preallocate(uint64_t offset, uint64_t len) override {
+        file_->Extend(offset + len);
+        return base::Status::OK();
+    }
+
+    virtual base::Status WriteAt(uint64_t offset, const void *data,
+                                 size_t size) override {
+        file_->WriteAt(offset, data, size);
+        return base::Status::OK();
+    }
+
+    virtual base::Status ReadAt(uint64_t offset, void *buf,
+                                size_t size) const override {
+        return file_->ReadAt(offset, buf, size);
+    }
+
+private:
+    base::Handle<FileState> file_;
+};
+
+/**
+ * The mapping be on the buffer snapshot, no copying.
+ */
+class MemMappedMemory : public base::MappedMemory {
+public:
+    MemMappedMemory(const std::string &file_name,
+                    std::shared_ptr<const std::string> data)
+        : base::MappedMemory(file_name, const_cast<char *>(data->data()),
+                             data->size())
+        , data_(data) {}
+
+    virtual ~MemMappedMemory() override {}
+
+private:
+    std::shared_ptr<const std::string> data_;
+};
+
+class MemRandomAccessFile : public base::RandomAccessFile {
+public:
+    MemRandomAccessFile(const std::string &file_name,
+                        std::shared_ptr<const std::string> data)
+        : file_name_(file_name)
+        , data_(data) {}
+
+    virtual ~MemRandomAccessFile() override {}
+
+    virtual base::Status Read(uint64_t offset, size_t n, base::Slice *result,
+                              std::string *scratch) const override {
+        if (offset + n > data_->size()) {
+            return base::Status::IOError("Read out of the file.");
+        }
+        *result = base::Slice(data_->data() + offset, n);
+        return base::Status::OK();
+    }
+
+    virtual uint64_t size() const override { return data_->size(); }
+
+    virtual const std::string &file_name() const override {
+        return file_name_;
+    }
+
+private:
+    const std::string file_name_;
+    std::shared_ptr<const std::string> data_;
+};
+
+class MemEnv;
+
+class MemFileLock : public base::FileLock {
+public:
+    MemFileLock(MemEnv *env, const std::string &name)
+        : env_(env)
+        , name_(name) {}
+
+    virtual ~MemFileLock() override;
+
+    virtual base::Status Lock() const override;
+    virtual base::Status Unlock() const override;
+
+    virtual std::string name() const override { return name_; }
+
+    virtual bool locked() const override { return locked_; }
+
+private:
+    MemEnv * const env_;
+    const std::string name_;
+    mutable bool locked_ = true;
+};
+
+/**
+ * All of the files and directories be kept in memory, the operations be
+ * thread safe. The I/O queue be created by the base env, the requests on
+ * the files without native handle be executed synchronously.
+ */
+class MemEnv : public Env {
+public:
+    explicit MemEnv(Env *base) : base_(DCHECK_NOTNULL(base)) {}
+
+    virtual ~MemEnv() override {}
+
+    virtual base::Status CreateAppendFile(const std::string &fname,
+                                          base::AppendFile **file) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        *file = new MemAppendFile(OpenFile(fname, true));
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateFileIO(const std::string &fname,
+                                      base::FileIO **file) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        *file = new MemFileIO(OpenFile(fname, false));
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateRandomAccessFile(const std::string &fname,
+                                                base::MappedMemory **file) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = files_.find(fname);
+        if (iter == files_.end()) {
+            return NotFound(fname);
+        }
+        *file = new MemMappedMemory(fname, iter->second->Snapshot());
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateRandomAccessFile(const std::string &fname,
+                                                base::RandomAccessFile **file) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = files_.find(fname);
+        if (iter == files_.end()) {
+            return NotFound(fname);
+        }
+        *file = new MemRandomAccessFile(fname, iter->second->Snapshot());
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateDirectAppendFile(const std::string &fname,
+                                                base::AppendFile **file) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        *file = new MemAppendFile(OpenFile(fname, true));
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateDirectRandomAccessFile(
+            const std::string &fname, size_t /*readahead_size*/,
+            base::RandomAccessFile **file) override {
+        return CreateRandomAccessFile(fname, file);
+    }
+
+    virtual base::Status CreateIOQueue(size_t depth,
+                                       base::IOQueue **queue) override {
+        return base_->CreateIOQueue(depth, queue);
+    }
+
+    virtual bool FileExists(const std::string& fname) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return files_.find(fname) != files_.end() ||
+               dirs_.find(fname) != dirs_.end();
+    }
+
+    virtual base::Status DeleteFile(const std::string& fname,
+                                    bool deep) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (files_.erase(fname) > 0) {
+            return base::Status::OK();
+        }
+        if (dirs_.find(fname) == dirs_.end()) {
+            return NotFound(fname);
+        }
+
+        auto prefix = fname + "/";
+        auto files_end = PrefixEnd(&files_, prefix);
+        auto dirs_end  = PrefixEnd(&dirs_, prefix);
+        auto files_begin = files_.lower_bound(prefix);
+        auto dirs_begin  = dirs_.lower_bound(prefix);
+        if (!deep && (files_begin != files_end || dirs_begin != dirs_end)) {
+            return base::Status::IOError(fname + ": Directory not empty");
+        }
+        files_.erase(files_begin, files_end);
+        dirs_.erase(dirs_begin, dirs_end);
+        dirs_.erase(fname);
+        return base::Status::OK();
+    }
+
+    virtual base::Status GetChildren(const std::string& dir,
+                                     std::vector<std::string>* result) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        result->clear();
+
+        auto prefix = dir + "/";
+        auto child = [&prefix, result](const std::string &name) {
+            if (name.find('/', prefix.size()) == std::string::npos) {
+                result->push_back(name.substr(prefix.size()));
+            }
+        };
+        for (auto iter = files_.lower_bound(prefix);
+             iter != PrefixEnd(&files_, prefix); ++iter) {
+            child(iter->first);
+        }
+        for (auto iter = dirs_.lower_bound(prefix);
+             iter != PrefixEnd(&dirs_, prefix); ++iter) {
+            child(*iter);
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status CreateDir(const std::string& dirname) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (files_.find(dirname) != files_.end() ||
+            !dirs_.insert(dirname).second) {
+            return base::Status::IOError(dirname + ": File exists");
+        }
+        return base::Status::OK();
+    }
+
+    virtual base::Status GetFileSize(const std::string& fname,
+                                     uint64_t* file_size) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = files_.find(fname);
+        if (iter != files_.end()) {
+            *file_size = iter->second->size();
+            return base::Status::OK();
+        }
+        if (dirs_.find(fname) != dirs_.end()) {
+            *file_size = 0;
+            return base::Status::OK();
+        }
+        return NotFound(fname);
+    }
+
+    virtual base::Status RenameFile(const std::string& src,
+                                    const std::string& target) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = files_.find(src);
+        if (iter != files_.end()) {
+            auto file = iter->second;
+            files_.erase(iter);
+            files_[target] = file;
+            return base::Status::OK();
+        }
+        if (dirs_.find(src) == dirs_.end()) {
+            return NotFound(src);
+        }
+
+        // Move all of the children to the new directory.
+        auto prefix = src + "/";
+        std::map<std::string, base::Handle<FileState>> files;
+        std::set<std::string> dirs;
+        auto files_end = PrefixEnd(&files_, prefix);
+        auto dirs_end  = PrefixEnd(&dirs_, prefix);
+        for (auto i = files_.lower_bound(prefix); i != files_end;) {
+            files.emplace(target + i->first.substr(src.size()), i->second);
+            i = files_.erase(i);
+        }
+        for (auto i = dirs_.lower_bound(prefix); i != dirs_end;) {
+            dirs.insert(target + i->substr(src.size()));
+            i = dirs_.erase(i);
+        }
+        dirs_.erase(src);
+        dirs_.insert(target);
+        files_.insert(files.begin(), files.end());
+        dirs_.insert(dirs.begin(), dirs.end());
+        return base::Status::OK();
+    }
+
+    virtual base::Status LinkFile(const std::string& src,
+                                  const std::string& target) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = files_.find(src);
+        if (iter == files_.end()) {
+            return NotFound(src);
+        }
+        if (files_.find(target) != files_.end() ||
+            dirs_.find(target) != dirs_.end()) {
+            return base::Status::IOError(target + ": File exists");
+        }
+        files_[target] = iter->second;
+        return base::Status::OK();
+    }
+
+    virtual base::Status LockFile(const std::string& fname,
+                                  base::FileLock** lock) override {
+        std::lock_guard<std::mutex> guard(mutex_);
+        // Same as the posix lock file, it's created exclusively, and be
+        // deleted by the lock.
+        if (files_.find(fname) != files_.end()) {
+            return base::Status::IOError(fname + ": File exists");
+        }
+        OpenFile(fname, true);
+        *lock = new MemFileLock(this, fname);
+        return base::Status::OK();
+    }
+
+private:
+    // REQUIRES: mutex_ held.
+    FileState *OpenFile(const std::string &fname, bool truncate) {
+        auto *file = &files_[fname];
+        if (file->is_null() || truncate) {
+            *file = new FileState();
+        }
+        return file->get();
+    }
+
+    // The end of the names with the prefix in the ordered container.
+    template<class T>
+    static typename T::iterator PrefixEnd(T *container,
+                                          const std::string &prefix) {
+        auto limit = prefix;
+        DCHECK(!limit.empty());
+        limit.back()++; // '/' + 1
+        return container->lower_bound(limit);
+    }
+
+    static base::Status NotFound(const std::string &fname) {
+        return base::Status::IOError(fname + ": No such file or directory");
+    }
+
+    Env * const base_;
+    std::mutex mutex_;
+    std::map<std::string, base::Handle<FileState>> files_;
+    std::set<std::string> dirs_;
+};
+
+MemFileLock::~MemFileLock() {
+    env_->DeleteFile(name_, false);
+}
+
+base::Status MemFileLock::Lock() const {
+    DCHECK(!locked());
+    locked_ = true;
+    return base::Status::OK();
+}
+
+base::Status MemFileLock::Unlock() const {
+    DCHECK(locked());
+    locked_ = false;
+    return base::Status::OK();
+}
+
+} // namespace
+
+} // namespace util
+
+Env *NewMemEnv(Env *base) {
+    return new util::MemEnv(base);
+}
+
+} // namespace yukino
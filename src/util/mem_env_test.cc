@@ -0,0 +1,261 @@
+// The YukinoDB Unit Test Suite
+//
+//  mem_env_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "lsm/db_impl.h"
+#include "balance/db_impl.h"
+#include "yukino/env.h"
+#include "yukino/db.h"
+#include "yukino/options.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace util {
+
+class MemEnvTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        env_.reset(NewMemEnv(Env::Default()));
+    }
+
+    std::unique_ptr<Env> env_;
+};
+
+TEST_F(MemEnvTest, FileReadWrite) {
+    ASSERT_TRUE(env_->CreateDir("demo").ok());
+    EXPECT_TRUE(env_->FileExists("demo"));
+    EXPECT_FALSE(env_->FileExists("demo/a"));
+
+    base::AppendFile *afile = nullptr;
+    auto rs = env_->CreateAppendFile("demo/a", &afile);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::AppendFile> writer(afile);
+
+    ASSERT_TRUE(writer->WriteFixed32(199).ok());
+    ASSERT_TRUE(writer->WriteFixed32(201).ok());
+    ASSERT_TRUE(writer->Sync().ok());
+
+    uint64_t size = 0;
+    ASSERT_TRUE(env_->GetFileSize("demo/a", &size).ok());
+    EXPECT_EQ(8, size);
+
+    base::MappedMemory *mfile = nullptr;
+    rs = env_->CreateRandomAccessFile("demo/a", &mfile);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::MappedMemory> mapped(mfile);
+
+    // The mapping never sees the later writing.
+    ASSERT_TRUE(writer->WriteFixed32(301).ok());
+    ASSERT_EQ(8, mapped->size());
+    base::BufferedReader reader(mapped->buf(), mapped->size());
+    EXPECT_EQ(199, reader.ReadFixed32());
+    EXPECT_EQ(201, reader.ReadFixed32());
+
+    base::RandomAccessFile *rfile = nullptr;
+    rs = env_->CreateRandomAccessFile("demo/a", &rfile);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::RandomAccessFile> pread(rfile);
+    ASSERT_EQ(12, pread->size());
+
+    base::Slice result;
+    std::string scratch;
+    rs = pread->Read(8, 4, &result, &scratch);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(301, *reinterpret_cast<const uint32_t *>(result.data()));
+    EXPECT_FALSE(pread->Read(10, 4, &result, &scratch).ok());
+
+    base::MappedMemory *missing = nullptr;
+    EXPECT_FALSE(env_->CreateRandomAccessFile("demo/b", &missing).ok());
+}
+
+TEST_F(MemEnvTest, FileIO) {
+    base::FileIO *file = nullptr;
+    auto rs = env_->CreateFileIO("data", &file);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::FileIO> io(file);
+
+    ASSERT_TRUE(io->Preallocate(0, 4096).ok());
+    ASSERT_TRUE(io->WriteAt(1024, "hello", 5).ok());
+
+    uint64_t size = 0;
+    ASSERT_TRUE(env_->GetFileSize("data", &size).ok());
+    EXPECT_EQ(4096, size);
+
+    char buf[5];
+    ASSERT_TRUE(io->ReadAt(1024, buf, sizeof(buf)).ok());
+    EXPECT_EQ("hello", std::string(buf, sizeof(buf)));
+    EXPECT_FALSE(io->ReadAt(4095, buf, sizeof(buf)).ok());
+
+    ASSERT_TRUE(io->Seek(1024).ok());
+    EXPECT_EQ('h', io->ReadByte());
+    ASSERT_TRUE(io->Write("E", 1, nullptr).ok());
+    ASSERT_TRUE(io->ReadAt(1024, buf, sizeof(buf)).ok());
+    EXPECT_EQ("hEllo", std::string(buf, sizeof(buf)));
+
+    ASSERT_TRUE(io->Truncate(1025).ok());
+    ASSERT_TRUE(env_->GetFileSize("data", &size).ok());
+    EXPECT_EQ(1025, size);
+    ASSERT_TRUE(io->Seek(1025).ok());
+    EXPECT_EQ(EOF, io->ReadByte());
+
+    // Reopen keeps the content.
+    io.reset();
+    rs = env_->CreateFileIO("data", &file);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    io.reset(file);
+    ASSERT_TRUE(io->ReadAt(1024, buf, 1).ok());
+    EXPECT_EQ('h', buf[0]);
+}
+
+TEST_F(MemEnvTest, Directory) {
+    ASSERT_TRUE(env_->CreateDir("demo").ok());
+    EXPECT_FALSE(env_->CreateDir("demo").ok());
+    ASSERT_TRUE(env_->CreateDir("demo/sub").ok());
+    ASSERT_TRUE(WriteStringToFile(env_.get(), "1\n", "demo/CURRENT").ok());
+    ASSERT_TRUE(WriteStringToFile(env_.get(), "2", "demo/sub/x").ok());
+    ASSERT_TRUE(WriteStringToFile(env_.get(), "3", "demo.x").ok());
+
+    std::vector<std::string> children;
+    ASSERT_TRUE(env_->GetChildren("demo", &children).ok());
+    std::sort(children.begin(), children.end());
+    ASSERT_EQ(2, children.size());
+    EXPECT_EQ("CURRENT", children[0]);
+    EXPECT_EQ("sub", children[1]);
+
+    // Replace, not append.
+    ASSERT_TRUE(WriteStringToFile(env_.get(), "9\n", "demo/CURRENT.tmp").ok());
+    ASSERT_TRUE(env_->RenameFile("demo/CURRENT.tmp", "demo/CURRENT").ok());
+    std::string buf;
+    ASSERT_TRUE(ReadFileToString(env_.get(), "demo/CURRENT", &buf).ok());
+    EXPECT_EQ("9\n", buf);
+    EXPECT_FALSE(env_->FileExists("demo/CURRENT.tmp"));
+
+    ASSERT_TRUE(env_->LinkFile("demo/CURRENT", "demo/LINK").ok());
+    EXPECT_FALSE(env_->LinkFile("demo/CURRENT", "demo/LINK").ok());
+    ASSERT_TRUE(ReadFileToString(env_.get(), "demo/LINK", &buf).ok());
+    EXPECT_EQ("9\n", buf);
+
+    ASSERT_TRUE(env_->RenameFile("demo", "other").ok());
+    EXPECT_FALSE(env_->FileExists("demo/sub/x"));
+    ASSERT_TRUE(ReadFileToString(env_.get(), "other/sub/x", &buf).ok());
+    EXPECT_EQ("2", buf);
+
+    EXPECT_FALSE(env_->DeleteFile("other", false).ok());
+    ASSERT_TRUE(env_->DeleteFile("other", true).ok());
+    EXPECT_FALSE(env_->FileExists("other"));
+    EXPECT_FALSE(env_->FileExists("other/sub/x"));
+    EXPECT_TRUE(env_->FileExists("demo.x"));
+}
+
+TEST_F(MemEnvTest, LockFile) {
+    base::FileLock *lock = nullptr;
+    auto rs = env_->LockFile("LOCK", &lock);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    std::unique_ptr<base::FileLock> holder(lock);
+    EXPECT_TRUE(lock->locked());
+
+    base::FileLock *other = nullptr;
+    EXPECT_FALSE(env_->LockFile("LOCK", &other).ok());
+
+    holder.reset();
+    EXPECT_FALSE(env_->FileExists("LOCK"));
+    rs = env_->LockFile("LOCK", &other);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    delete other;
+}
+
+TEST_F(MemEnvTest, ConcurrentAppend) {
+    static const auto kNumThreads = 4;
+    static const auto kNumWrites  = 1000;
+
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([this, i]() {
+            auto file_name = base::Strings::Sprintf("file.%d", i);
+
+            base::AppendFile *file = nullptr;
+            ASSERT_TRUE(env_->CreateAppendFile(file_name, &file).ok());
+            std::unique_ptr<base::AppendFile> writer(file);
+            for (auto j = 0; j < kNumWrites; ++j) {
+                ASSERT_TRUE(writer->WriteFixed32(j).ok());
+
+                // The readers see the prefix.
+                base::MappedMemory *mapped = nullptr;
+                ASSERT_TRUE(env_->CreateRandomAccessFile(file_name,
+                                                         &mapped).ok());
+                EXPECT_EQ((j + 1) * 4, mapped->size());
+                delete mapped;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto i = 0; i < kNumThreads; ++i) {
+        uint64_t size = 0;
+        auto file_name = base::Strings::Sprintf("file.%d", i);
+        ASSERT_TRUE(env_->GetFileSize(file_name, &size).ok());
+        EXPECT_EQ(kNumWrites * 4, size);
+    }
+}
+
+TEST_F(MemEnvTest, InMemoryDB) {
+    static const char *kEngines[] = {
+        lsm::DBImpl::kName,
+        balance::DBImpl::kName,
+    };
+    static const auto kName = "mem_env_test_db";
+
+    for (auto engine : kEngines) {
+        Options options;
+        options.engine_name = engine;
+        options.env = env_.get();
+        options.create_if_missing = true;
+        options.write_buffer_size = 64 * base::kKB;
+
+        char key[32];
+        std::string value(100, 'v');
+        DB *db = nullptr;
+        auto rs = DB::Open(options, kName, &db);
+        ASSERT_TRUE(rs.ok()) << engine << ": " << rs.ToString();
+        for (auto i = 0; i < 3000; ++i) {
+            ::snprintf(key, sizeof(key), "key.%05d", i);
+            rs = db->Put(WriteOptions(), key, value);
+            ASSERT_TRUE(rs.ok()) << rs.ToString();
+        }
+        delete db;
+
+        // Nothing be written to the disk.
+        EXPECT_FALSE(Env::Default()->FileExists(kName));
+
+        rs = DB::Open(options, kName, &db);
+        ASSERT_TRUE(rs.ok()) << engine << ": " << rs.ToString();
+        std::string found;
+        for (auto i = 0; i < 3000; ++i) {
+            ::snprintf(key, sizeof(key), "key.%05d", i);
+            rs = db->Get(ReadOptions(), key, &found);
+            ASSERT_TRUE(rs.ok()) << engine << ": " << key << ", "
+                                 << rs.ToString();
+            EXPECT_EQ(value, found);
+        }
+        delete db;
+
+        ASSERT_TRUE(env_->DeleteFile(kName, true).ok());
+    }
+}
+
+} // namespace util
+
+} // namespace yukino
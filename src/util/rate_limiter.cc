@@ -0,0 +1,207 @@
+#include "util/rate_limiter.h"
+#include "base/io-inl.h"
+#include "glog/logging.h"
+#include <algorithm>
+#include <chrono>
+
+namespace yukino {
+
+namespace {
+
+inline uint64_t NowMicros() {
+    using namespace std::chrono;
+
+    auto now = steady_clock::now();
+    return duration_cast<microseconds>(now.time_since_epoch()).count();
+}
+
+} // namespace
+
+RateLimiter::~RateLimiter() {
+}
+
+RateLimiter *NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_us,
+                                   int32_t fairness,
+                                   bool auto_tuned) {
+    return new util::GenericRateLimiter(bytes_per_second, refill_period_us,
+                                        fairness, auto_tuned);
+}
+
+namespace util {
+
+GenericRateLimiter::GenericRateLimiter(int64_t bytes_per_second,
+                                       int64_t refill_period_us,
+                                       int32_t fairness,
+                                       bool auto_tuned)
+    : refill_period_us_(refill_period_us)
+    , fairness_(fairness)
+    , auto_tuned_(auto_tuned)
+    , max_bytes_per_second_(bytes_per_second)
+    , bytes_per_second_(bytes_per_second)
+    , next_refill_us_(NowMicros() + refill_period_us) {
+    DCHECK_GT(bytes_per_second, 0);
+    DCHECK_GT(refill_period_us, 0);
+
+    refill_bytes_ = RefillBytes(bytes_per_second_);
+    available_    = refill_bytes_;
+    for (int i = 0; i < kNumPriorities; ++i) {
+        total_bytes_[i]   = 0;
+        total_blocked_[i] = 0;
+    }
+}
+
+GenericRateLimiter::~GenericRateLimiter() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto &queue : queues_) {
+        DCHECK(queue.empty()) << "Limiter be deleted with waiting requests.";
+    }
+}
+
+void GenericRateLimiter::Request(int64_t bytes, Priority priority) {
+    DCHECK_GE(bytes, 0);
+    DCHECK_LT(priority, kNumPriorities);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    total_bytes_[priority] += bytes;
+
+    auto now = NowMicros();
+    if (now >= next_refill_us_) {
+        Refill(now);
+    }
+
+    auto idle = queues_[kPriorityLow].empty() &&
+                queues_[kPriorityHigh].empty();
+    if (idle) {
+        if (available_ >= bytes) {
+            available_ -= bytes;
+            return;
+        }
+        // Take the rest of this period, wait for the others.
+        bytes -= available_;
+        available_ = 0;
+    }
+
+    Waiting req = {bytes, false};
+    total_blocked_[priority]++;
+    queues_[priority].push_back(&req);
+    while (!req.granted) {
+        now = NowMicros();
+        if (now >= next_refill_us_) {
+            Refill(now);
+            cv_.notify_all();
+            continue;
+        }
+        cv_.wait_for(lock, std::chrono::microseconds(next_refill_us_ - now));
+    }
+}
+
+void GenericRateLimiter::SetBytesPerSecond(int64_t bytes_per_second) {
+    DCHECK_GT(bytes_per_second, 0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    max_bytes_per_second_ = bytes_per_second;
+    if (auto_tuned_) {
+        bytes_per_second_ = std::min(bytes_per_second_, max_bytes_per_second_);
+        bytes_per_second_ = std::max(bytes_per_second_,
+                                     max_bytes_per_second_ / kTuneRange);
+    } else {
+        bytes_per_second_ = bytes_per_second;
+    }
+    refill_bytes_ = RefillBytes(bytes_per_second_);
+}
+
+int64_t GenericRateLimiter::GetBytesPerSecond() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return bytes_per_second_;
+}
+
+int64_t GenericRateLimiter::GetTotalBytesThrough(Priority priority) const {
+    DCHECK_LT(priority, kNumPriorities);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    return total_bytes_[priority];
+}
+
+int64_t GenericRateLimiter::GetTotalRequestsBlocked(Priority priority) const {
+    DCHECK_LT(priority, kNumPriorities);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    return total_blocked_[priority];
+}
+
+/**
+ * Refill the bucket, then grant the waiting requests: the high priority
+ * first, but the low priority first once every fairness_ refillings.
+ *
+ * REQUIRES: mutex_ be held.
+ */
+void GenericRateLimiter::Refill(uint64_t now) {
+    next_refill_us_ = now + refill_period_us_;
+    available_      = refill_bytes_;
+    num_refills_++;
+
+    Priority order[kNumPriorities] = {kPriorityHigh, kPriorityLow};
+    if (fairness_ > 0 && num_refills_ % fairness_ == 0) {
+        std::swap(order[0], order[1]);
+    }
+    for (auto priority : order) {
+        auto queue = &queues_[priority];
+        while (!queue->empty() && available_ > 0) {
+            auto req = queue->front();
+            if (req->bytes > available_) {
+                req->bytes -= available_;
+                available_ = 0;
+                break;
+            }
+            available_  -= req->bytes;
+            req->granted = true;
+            queue->pop_front();
+        }
+    }
+
+    // All bytes be granted, or the requests still be waiting.
+    if (available_ == 0) {
+        num_drains_++;
+    }
+    if (auto_tuned_ && num_refills_ % kTuneRefills == 0) {
+        Tune();
+    }
+}
+
+/**
+ * REQUIRES: mutex_ be held.
+ */
+void GenericRateLimiter::Tune() {
+    auto drained_percent = num_drains_ * 100 / kTuneRefills;
+    num_drains_ = 0;
+
+    auto bytes_per_second = bytes_per_second_;
+    if (drained_percent > kTuneHighPercent) {
+        bytes_per_second = std::max(bytes_per_second * 105 / 100,
+                                    bytes_per_second + 1);
+    } else if (drained_percent < kTuneLowPercent) {
+        bytes_per_second = bytes_per_second * 100 / 105;
+    }
+    bytes_per_second = std::min(bytes_per_second, max_bytes_per_second_);
+    bytes_per_second = std::max(bytes_per_second,
+                                max_bytes_per_second_ / kTuneRange);
+    if (bytes_per_second != bytes_per_second_) {
+        DLOG(INFO) << "Rate limiter be tuned: " << bytes_per_second_ << " -> "
+                   << bytes_per_second << " bytes/s";
+        bytes_per_second_ = bytes_per_second;
+        refill_bytes_     = RefillBytes(bytes_per_second_);
+    }
+}
+
+int64_t GenericRateLimiter::RefillBytes(int64_t bytes_per_second) const {
+    auto bytes = bytes_per_second * refill_period_us_ / 1000000;
+    return std::max(bytes, static_cast<int64_t>(1));
+}
+
+RateLimitedFile::~RateLimitedFile() {
+}
+
+} // namespace util
+
+} // namespace yukino
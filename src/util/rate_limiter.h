@@ -0,0 +1,131 @@
+#ifndef YUKINO_UTIL_RATE_LIMITER_H_
+#define YUKINO_UTIL_RATE_LIMITER_H_
+
+#include "yukino/rate_limiter.h"
+#include "base/io.h"
+#include "base/base.h"
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace yukino {
+
+namespace util {
+
+/**
+ * The token bucket limiter. The bucket be refilled in every refill period,
+ * the waiting requests be granted in order of priority at refilling. A
+ * large request may be granted by several refillings.
+ */
+class GenericRateLimiter : public RateLimiter {
+public:
+    // Tune the bandwidth after every kTuneRefills refillings.
+    static const int kTuneRefills = 100;
+
+    // Increase the bandwidth if the bucket be drained in more than
+    // kTuneHighPercent of the refillings, decrease it if less than
+    // kTuneLowPercent.
+    static const int kTuneHighPercent = 90;
+    static const int kTuneLowPercent = 50;
+
+    // The tuned bandwidth is not less than max / kTuneRange.
+    static const int kTuneRange = 20;
+
+    GenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_us,
+                       int32_t fairness, bool auto_tuned);
+    virtual ~GenericRateLimiter() override;
+
+    virtual void Request(int64_t bytes, Priority priority) override;
+
+    virtual void SetBytesPerSecond(int64_t bytes_per_second) override;
+
+    virtual int64_t GetBytesPerSecond() const override;
+
+    virtual int64_t GetTotalBytesThrough(Priority priority) const override;
+
+    virtual int64_t GetTotalRequestsBlocked(Priority priority) const override;
+
+    int64_t refill_bytes() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return refill_bytes_;
+    }
+
+private:
+    struct Waiting {
+        int64_t bytes;
+        bool granted;
+    };
+
+    void Refill(uint64_t now);
+    void Tune();
+    int64_t RefillBytes(int64_t bytes_per_second) const;
+
+    const int64_t refill_period_us_;
+    const int32_t fairness_;
+    const bool auto_tuned_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    int64_t max_bytes_per_second_;
+    int64_t bytes_per_second_;
+    int64_t refill_bytes_;
+    int64_t available_;
+    uint64_t next_refill_us_;
+    uint64_t num_refills_ = 0;
+    int num_drains_ = 0;
+
+    std::deque<Waiting *> queues_[kNumPriorities];
+    int64_t total_bytes_[kNumPriorities];
+    int64_t total_blocked_[kNumPriorities];
+};
+
+/**
+ * The file be written through the rate limiter, every writing requests its
+ * bytes first.
+ */
+class RateLimitedFile : public base::AppendFile {
+public:
+    RateLimitedFile(base::AppendFile *file, RateLimiter *limiter,
+                    RateLimiter::Priority priority)
+        : file_(DCHECK_NOTNULL(file))
+        , limiter_(DCHECK_NOTNULL(limiter))
+        , priority_(priority) {
+    }
+
+    virtual ~RateLimitedFile() override;
+
+    virtual base::Status Write(const void *data, size_t size,
+                               size_t *written) override {
+        limiter_->Request(static_cast<int64_t>(size), priority_);
+        return file_->Write(data, size, written);
+    }
+
+    virtual base::Status Skip(size_t count) override {
+        limiter_->Request(static_cast<int64_t>(count), priority_);
+        return file_->Skip(count);
+    }
+
+    virtual size_t active() const override { return file_->active(); }
+
+    virtual base::Status Close() override { return file_->Close(); }
+    virtual base::Status Flush() override { return file_->Flush(); }
+    virtual base::Status Sync() override { return file_->Sync(); }
+
+    virtual int native_handle() const override {
+        return file_->native_handle();
+    }
+
+private:
+    std::unique_ptr<base::AppendFile> file_;
+    RateLimiter *limiter_;
+    const RateLimiter::Priority priority_;
+};
+
+} // namespace util
+
+} // namespace yukino
+
+#endif // YUKINO_UTIL_RATE_LIMITER_H_
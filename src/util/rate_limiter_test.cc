@@ -0,0 +1,137 @@
+// The YukinoDB Unit Test Suite
+//
+//  rate_limiter_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "util/rate_limiter.h"
+#include "base/mem_io.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace util {
+
+namespace {
+
+inline uint64_t NowMillis() {
+    using namespace std::chrono;
+
+    auto now = steady_clock::now();
+    return duration_cast<milliseconds>(now.time_since_epoch()).count();
+}
+
+} // namespace
+
+TEST(RateLimiterTest, Sanity) {
+    // 1MB/s, 10KB per 10ms.
+    std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(base::kMB,
+                                                               10 * 1000));
+    EXPECT_EQ(base::kMB, limiter->GetBytesPerSecond());
+
+    auto start = NowMillis();
+    for (int i = 0; i < 20; ++i) {
+        limiter->Request(10 * base::kKB, RateLimiter::kPriorityHigh);
+    }
+    auto elapsed = NowMillis() - start;
+
+    // The first 10KB be granted at once.
+    EXPECT_LE(150, elapsed);
+    EXPECT_GT(2000, elapsed);
+    EXPECT_EQ(200 * base::kKB,
+              limiter->GetTotalBytesThrough(RateLimiter::kPriorityHigh));
+    EXPECT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::kPriorityLow));
+    EXPECT_LT(0, limiter->GetTotalRequestsBlocked(RateLimiter::kPriorityHigh));
+
+    // The large request be granted by several refillings.
+    start = NowMillis();
+    limiter->Request(100 * base::kKB, RateLimiter::kPriorityLow);
+    elapsed = NowMillis() - start;
+    EXPECT_LE(80, elapsed);
+    EXPECT_EQ(100 * base::kKB,
+              limiter->GetTotalBytesThrough(RateLimiter::kPriorityLow));
+}
+
+TEST(RateLimiterTest, Priority) {
+    // No fairness, the high priority requests always be granted first.
+    std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(base::kMB,
+                                                               10 * 1000, 0));
+    // Drain the bucket.
+    limiter->Request(10 * base::kKB, RateLimiter::kPriorityHigh);
+
+    std::mutex mutex;
+    std::vector<RateLimiter::Priority> finished;
+    auto worker = [&](RateLimiter::Priority priority) {
+        for (int i = 0; i < 10; ++i) {
+            limiter->Request(10 * base::kKB, priority);
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.push_back(priority);
+    };
+
+    std::thread low(worker, RateLimiter::kPriorityLow);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    std::thread high(worker, RateLimiter::kPriorityHigh);
+    low.join();
+    high.join();
+
+    ASSERT_EQ(2, finished.size());
+    EXPECT_EQ(RateLimiter::kPriorityHigh, finished[0]);
+    EXPECT_EQ(RateLimiter::kPriorityLow, finished[1]);
+}
+
+TEST(RateLimiterTest, AutoTuned) {
+    // 1ms refill period, tuning after every 100 refillings.
+    std::unique_ptr<GenericRateLimiter> limiter(
+            new GenericRateLimiter(10 * base::kMB, 1000, 10, true));
+
+    // The bucket is never drained, the bandwidth be decreased.
+    for (int i = 0; i < 250; ++i) {
+        limiter->Request(1, RateLimiter::kPriorityHigh);
+        std::this_thread::sleep_for(std::chrono::microseconds(1100));
+    }
+    auto idle = limiter->GetBytesPerSecond();
+    EXPECT_GT(10 * base::kMB, idle);
+    EXPECT_LE(10 * base::kMB / GenericRateLimiter::kTuneRange, idle);
+
+    // The bucket be drained in every refilling, the bandwidth be increased.
+    for (int i = 0; i < 150; ++i) {
+        limiter->Request(limiter->refill_bytes() * 2,
+                         RateLimiter::kPriorityLow);
+    }
+    EXPECT_LT(idle, limiter->GetBytesPerSecond());
+    EXPECT_GE(10 * base::kMB, limiter->GetBytesPerSecond());
+
+    // Bounded by the new max bandwidth.
+    limiter->SetBytesPerSecond(base::kMB);
+    EXPECT_GE(base::kMB, limiter->GetBytesPerSecond());
+}
+
+TEST(RateLimiterTest, RateLimitedFile) {
+    std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(base::kMB));
+
+    auto io = new base::StringIO();
+    RateLimitedFile file(io, limiter.get(), RateLimiter::kPriorityLow);
+
+    auto rs = file.Write("abcd", 4, nullptr);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = file.Skip(4);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = file.WriteFixed32(1);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    rs = file.Flush();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    EXPECT_EQ(12, file.active());
+    EXPECT_EQ(12, io->buf().size());
+    EXPECT_EQ(12, limiter->GetTotalBytesThrough(RateLimiter::kPriorityLow));
+}
+
+} // namespace util
+
+} // namespace yukino
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <random>
 #include <atomic>
+#include <functional>
 
 namespace yukino {
 
@@ -2,7 +2,12 @@
 #include "lsm/db_impl.h"
 #include "balance/db_impl.h"
 #include "yukino/options.h"
+#include "yukino/listener.h"
+#include "yukino/iterator.h"
+#include "yukino/env.h"
 #include "base/slice.h"
+#include "glog/logging.h"
+#include <functional>
 #include <memory>
 
 namespace yukino {
@@ -34,12 +39,137 @@ namespace yukino {
     }
 }
 
+DB::DB()
+    : tracing_(false) {
+}
+
 /*virtual*/ DB::~DB() {
+    EndTrace();
+}
+
+/*virtual*/ void DB::MultiGet(const ReadOptions& options,
+                             const std::vector<base::Slice>& keys,
+                             std::vector<std::string>* values,
+                             std::vector<base::Status>* status) {
+    values->resize(keys.size());
+    status->resize(keys.size());
+
+    // Without the batching, a snapshot keeps the view consistent at least.
+    ReadOptions read_options(options);
+    const Snapshot *snapshot = nullptr;
+    if (!read_options.snapshot) {
+        snapshot = GetSnapshot();
+        read_options.snapshot = snapshot;
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        (*status)[i] = Get(read_options, keys[i], &(*values)[i]);
+    }
+    if (snapshot) {
+        ReleaseSnapshot(snapshot);
+    }
+}
+
+/*virtual*/
+base::Status DB::IngestExternalFile(const std::vector<std::string>& files,
+                                    const IngestExternalFileOptions& options) {
+    return base::Status::NotSupported("IngestExternalFile()");
+}
+
+/*virtual*/
+base::Status DB::Flush(const FlushOptions& options) {
+    return base::Status::NotSupported("Flush()");
+}
+
+/*virtual*/
+base::Status DB::BulkLoad(Iterator* sorted_input,
+                          const BulkLoadOptions& options) {
+    return base::Status::NotSupported("BulkLoad()");
+}
+
+base::Status DB::StartTrace(const std::string &path, Env *env) {
+    std::unique_ptr<Tracer> tracer(new Tracer(env ? env : Env::Default(),
+                                              path));
+    auto rs = tracer->Open();
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    std::unique_lock<std::mutex> lock(trace_mutex_);
+    if (tracer_) {
+        return base::Status::InvalidArgument("Tracing is already started.");
+    }
+    tracer_ = std::move(tracer);
+    tracing_.store(true, std::memory_order_release);
+    return rs;
+}
+
+base::Status DB::EndTrace() {
+    std::unique_lock<std::mutex> lock(trace_mutex_);
+    if (!tracer_) {
+        return base::Status::OK();
+    }
+    tracing_.store(false, std::memory_order_release);
+
+    auto rs = tracer_->Close();
+    tracer_.reset();
+    return rs;
+}
+
+void DB::AddTrace(TraceType type, const base::Slice &data) {
+    std::unique_lock<std::mutex> lock(trace_mutex_);
+    if (tracer_) {
+        // Tracing is best effort, an error should not fail the operation.
+        auto rs = tracer_->Add(type, data);
+        if (!rs.ok()) {
+            LOG(ERROR) << "Trace fail: " << rs.ToString();
+        }
+    }
+}
+
+namespace {
+
+class TracingIterator : public Iterator {
+public:
+    TracingIterator(Iterator *iter,
+                    const std::function<void (const base::Slice &)> &trace)
+        : iter_(iter)
+        , trace_(trace) {
+    }
+
+    virtual ~TracingIterator() override {}
+
+    virtual bool Valid() const override { return iter_->Valid(); }
+    virtual void SeekToFirst() override { iter_->SeekToFirst(); }
+    virtual void SeekToLast() override { iter_->SeekToLast(); }
+    virtual void Seek(const base::Slice& target) override {
+        trace_(target);
+        iter_->Seek(target);
+    }
+    virtual void Next() override { iter_->Next(); }
+    virtual void Prev() override { iter_->Prev(); }
+    virtual base::Slice key() const override { return iter_->key(); }
+    virtual base::Slice value() const override { return iter_->value(); }
+    virtual base::Status status() const override { return iter_->status(); }
+
+private:
+    std::unique_ptr<Iterator> iter_;
+    std::function<void (const base::Slice &)> trace_;
+};
+
+} // namespace
+
+Iterator *DB::NewTracingIterator(Iterator *iter) {
+    return new TracingIterator(iter, [this] (const base::Slice &target) {
+        TraceSeek(target);
+    });
 }
 
 /*virtual*/ Snapshot::~Snapshot() {
 }
 
+/*virtual*/ EventListener::~EventListener() {
+}
+
 // auto tx = db->BeginTransaction(write_options);
 //     writing...
 // db->Commit(tx);
@@ -1,8 +1,14 @@
 #ifndef YUKINO_API_DB_H_
 #define YUKINO_API_DB_H_
 
+#include "yukino/trace.h"
 #include "base/status.h"
 #include "base/base.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace yukino {
 
@@ -15,6 +21,9 @@ class Slice;
 class Iterator;
 class ReadOptions;
 class WriteOptions;
+class IngestExternalFileOptions;
+class FlushOptions;
+class BulkLoadOptions;
 class WriteBatch;
 class Options;
 class Snapshot;
@@ -30,7 +39,7 @@ public:
                              const std::string& name,
                              DB** dbptr);
 
-    DB() { }
+    DB();
     virtual ~DB();
 
     // Set the database entry for "key" to "value".  Returns OK on success,
@@ -63,6 +72,42 @@ public:
     virtual base::Status Get(const ReadOptions& options,
                              const base::Slice& key, std::string* value) = 0;
 
+    // Lookup all the "keys" in one consistent view of the database, the
+    // result of keys[i] be stored in (*values)[i] and (*status)[i] like Get().
+    // Both vectors will be resized to keys.size().
+    //
+    // The engines batch the lookups: the keys be sorted and every table be
+    // probed once, it's cheaper than calling Get() for each key.
+    virtual void MultiGet(const ReadOptions& options,
+                          const std::vector<base::Slice>& keys,
+                          std::vector<std::string>* values,
+                          std::vector<base::Status>* status);
+
+    // Load the sst files built by SstFileWriter into the database, without
+    // writing the redo log or rewriting the files. All the keys in "files"
+    // become visible at once, and newer than all keys had be written.
+    //
+    // The files must not overlap each other.
+    // Returns NotSupported if the engine can not ingest files.
+    virtual base::Status IngestExternalFile(
+            const std::vector<std::string>& files,
+            const IngestExternalFileOptions& options);
+
+    // Persist the data in memory: the "yukino.lsm" engine writes the memory
+    // tables to level-0 files, the "yukino.balance" engine makes a
+    // checkpoint. The redo log before it need not be replayed at next open.
+    //
+    // Returns NotSupported if the engine can not flush.
+    virtual base::Status Flush(const FlushOptions& options);
+
+    // Load the sorted key-value pairs into the empty database, the pages be
+    // built bottom-up without writing the redo log, and be persisted at once
+    // at the end. The keys of "sorted_input" must be ascending and unique.
+    //
+    // Returns NotSupported if the engine can not bulk load.
+    virtual base::Status BulkLoad(Iterator* sorted_input,
+                                  const BulkLoadOptions& options);
+
     // Return a heap-allocated iterator over the contents of the database.
     // The result of NewIterator() is initially invalid (caller must
     // call one of the Seek methods on the iterator before using it).
@@ -80,6 +125,52 @@ public:
     // Release a previously acquired snapshot.  The caller must not
     // use "snapshot" after this call.
     virtual void ReleaseSnapshot(const Snapshot* snapshot) = 0;
+
+    // Start recording every Put/Delete/Write/Get and iterator Seek into the
+    // trace file "path", see yukino/trace.h for the format and the replay.
+    // If "env" is NULL, the Env::Default() will be used.
+    base::Status StartTrace(const std::string &path, Env *env = nullptr);
+
+    // Stop recording and close the trace file.
+    base::Status EndTrace();
+
+protected:
+    // Hooks for the engines, cheap when the tracing is off.
+    void TraceWrite(const base::Slice &batch) {
+        if (tracing_.load(std::memory_order_relaxed)) {
+            AddTrace(kTraceWrite, batch);
+        }
+    }
+
+    void TraceGet(const base::Slice &key) {
+        if (tracing_.load(std::memory_order_relaxed)) {
+            AddTrace(kTraceGet, key);
+        }
+    }
+
+    void TraceSeek(const base::Slice &target) {
+        if (tracing_.load(std::memory_order_relaxed)) {
+            AddTrace(kTraceSeek, target);
+        }
+    }
+
+    // Wrap the iterator for tracing its Seek(), only the iterators created
+    // in tracing be wrapped.
+    Iterator *TraceIterator(Iterator *iter) {
+        if (iter && tracing_.load(std::memory_order_relaxed)) {
+            return NewTracingIterator(iter);
+        }
+        return iter;
+    }
+
+private:
+    void AddTrace(TraceType type, const base::Slice &data);
+
+    Iterator *NewTracingIterator(Iterator *iter);
+
+    std::atomic<bool> tracing_;
+    std::mutex trace_mutex_;
+    std::unique_ptr<Tracer> tracer_;
 };
 
 class Snapshot : public base::DisableCopyAssign {
@@ -1,5 +1,7 @@
 #include "yukino/env.h"
 #include "port/env_impl.h"
+#include "base/io-inl.h"
+#include "base/io.h"
 #include "glog/logging.h"
 #include <mutex>
 
@@ -19,4 +21,44 @@ Env *Env::Default() {
     return DCHECK_NOTNULL(env);
 }
 
+base::Status WriteStringToFile(Env *env, const base::Slice &data,
+                               const std::string &fname) {
+    base::AppendFile *file = nullptr;
+    auto rs = env->CreateAppendFile(fname, &file);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::AppendFile> writer(file);
+
+    rs = writer->Write(data, nullptr);
+    if (!rs.ok()) {
+        return rs;
+    }
+    rs = writer->Sync();
+    if (!rs.ok()) {
+        return rs;
+    }
+    return writer->Close();
+}
+
+base::Status ReadFileToString(Env *env, const std::string &fname,
+                              std::string *data) {
+    base::RandomAccessFile *file = nullptr;
+    auto rs = env->CreateRandomAccessFile(fname, &file);
+    if (!rs.ok()) {
+        return rs;
+    }
+    std::unique_ptr<base::RandomAccessFile> reader(file);
+
+    base::Slice result;
+    rs = reader->Read(0, reader->size(), &result, data);
+    if (!rs.ok()) {
+        return rs;
+    }
+    if (result.data() != data->data()) {
+        data->assign(result.data(), result.size());
+    }
+    return base::Status::OK();
+}
+
 } // namespace yukino
\ No newline at end of file
@@ -14,7 +14,10 @@ class Writer;
 class AppendFile;
 class FileIO;
 class MappedMemory;
+class RandomAccessFile;
 class FileLock;
+class IOQueue;
+class Slice;
 
 } // namespace base
 
@@ -60,6 +63,38 @@ public:
     virtual base::Status CreateRandomAccessFile(const std::string &fname,
                                                 base::MappedMemory **file) = 0;
 
+    // Same as the above, but the file be read by pread(), instead of
+    // mapping the whole file into memory.
+    //
+    // The returned file may be concurrently accessed by multiple threads.
+    virtual base::Status CreateRandomAccessFile(const std::string &fname,
+                                                base::RandomAccessFile **file) = 0;
+
+    // Same as CreateAppendFile(), but the data be written by O_DIRECT
+    // through an aligned buffer, bypassing the OS page cache.
+    //
+    // The returned file will only be accessed by one thread at a time.
+    virtual base::Status CreateDirectAppendFile(const std::string &fname,
+                                                base::AppendFile **file) = 0;
+
+    // Same as CreateRandomAccessFile(), but the file be read by O_DIRECT.
+    // Every read fetches at least readahead_size bytes, the following
+    // sequential reads in them need no I/O.
+    //
+    // The returned file will only be accessed by one thread at a time.
+    virtual base::Status CreateDirectRandomAccessFile(
+            const std::string &fname, size_t readahead_size,
+            base::RandomAccessFile **file) = 0;
+
+    // Create a queue for asynchronous file I/O, many requests in it can be
+    // submitted by one system call. At most depth requests can be in the
+    // queue. If the platform has no asynchronous I/O, the requests be
+    // executed synchronously in IOQueue::Submit().
+    //
+    // The returned queue will only be accessed by one thread at a time.
+    virtual base::Status CreateIOQueue(size_t depth,
+                                       base::IOQueue **queue) = 0;
+
     // Returns true iff the named file exists.
     virtual bool FileExists(const std::string& fname) = 0;
 
@@ -83,6 +118,11 @@ public:
     virtual base::Status RenameFile(const std::string& src,
                                     const std::string& target) = 0;
 
+    // Create a hard link "target" to file src. Returns non-OK if the file
+    // system can not link them, e.g. they are on different devices.
+    virtual base::Status LinkFile(const std::string& src,
+                                  const std::string& target) = 0;
+
     // Lock the specified file.  Used to prevent concurrent access to
     // the same db by multiple processes.  On failure, stores NULL in
     // *lock and returns non-OK.
@@ -102,6 +142,24 @@ public:
 
 }; // class Env
 
+// Write the data to the file named fname by the env, the old file be
+// replaced. The file be synced before returning, so it can be renamed to
+// replace another one safely.
+base::Status WriteStringToFile(Env *env, const base::Slice &data,
+                               const std::string &fname);
+
+// Read the whole file named fname by the env.
+base::Status ReadFileToString(Env *env, const std::string &fname,
+                              std::string *data);
+
+// Create an env keeps all of the files and directories in memory, for the
+// benchmarks without the disk noise, or the pure in-memory database. The
+// files are lost once the env be deleted. The I/O queues be created by the
+// base env. It's thread safe.
+//
+// The caller must delete the result after all of the DBs on it be closed.
+Env *NewMemEnv(Env *base);
+
 } // namespace yukino
 
 #endif // YUKINO_API_ENV_H_
@@ -0,0 +1,95 @@
+#ifndef YUKINO_API_LISTENER_H_
+#define YUKINO_API_LISTENER_H_
+
+#include "base/status.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace yukino {
+
+class DB;
+
+struct FlushJobInfo {
+    std::string db_name;
+    uint64_t    file_number = 0; // the level-0 table be built.
+    uint64_t    file_size   = 0;
+    uint64_t    num_entries = 0;
+    uint64_t    micros      = 0; // only valid in OnFlushCompleted().
+    base::Status status;         // only valid in OnFlushCompleted().
+};
+
+struct CompactionJobInfo {
+    std::string db_name;
+    int input_level  = 0;
+    int output_level = 0;
+    std::vector<uint64_t> input_files;  // table file numbers.
+    std::vector<uint64_t> output_files;
+
+    // The following fields are only valid in OnCompactionCompleted().
+    uint64_t bytes_read      = 0; // key and value bytes of the input.
+    uint64_t bytes_written   = 0; // size of the output files.
+    uint64_t records_in      = 0;
+    uint64_t records_dropped = 0; // deleted or shadowed by newer versions.
+    uint64_t micros          = 0;
+    base::Status status;
+};
+
+struct CheckpointJobInfo {
+    std::string db_name;
+    uint64_t log_file_number      = 0; // the new redo-log.
+    uint64_t prev_log_file_number = 0;
+    uint64_t last_tx_id           = 0;
+    uint64_t micros               = 0;
+    base::Status status;
+};
+
+enum WriteStallCondition {
+    kStallNormal,
+    kStallDelayed, // writes are slowed down.
+    kStallStopped, // writes are blocked until background work done.
+};
+
+struct WriteStallInfo {
+    std::string db_name;
+    WriteStallCondition condition      = kStallNormal;
+    WriteStallCondition prev_condition = kStallNormal;
+};
+
+enum BackgroundErrorReason {
+    kErrorFlush,
+    kErrorCompaction,
+    kErrorCheckpoint,
+    kErrorGarbageCollection,
+};
+
+/**
+ * Callbacks of the background work, set by Options::listeners.
+ *
+ * The callbacks are called from the background threads (the stall changes
+ * may be from the writer), without any db lock held, but the background
+ * work waits for them, so they should be quick. Do not delete the db in the
+ * callbacks.
+ */
+class EventListener {
+public:
+    EventListener() {}
+    virtual ~EventListener();
+
+    virtual void OnFlushBegin(DB *db, const FlushJobInfo &info) {}
+    virtual void OnFlushCompleted(DB *db, const FlushJobInfo &info) {}
+
+    virtual void OnCompactionBegin(DB *db, const CompactionJobInfo &info) {}
+    virtual void OnCompactionCompleted(DB *db, const CompactionJobInfo &info) {}
+
+    virtual void OnCheckpointCompleted(DB *db, const CheckpointJobInfo &info) {}
+
+    virtual void OnStallConditionsChanged(DB *db, const WriteStallInfo &info) {}
+
+    virtual void OnBackgroundError(DB *db, BackgroundErrorReason reason,
+                                   const base::Status &status) {}
+};
+
+} // namespace yukino
+
+#endif // YUKINO_API_LISTENER_H_
@@ -1,6 +1,7 @@
 #include "yukino/options.h"
 #include "yukino/comparator.h"
 #include "yukino/env.h"
+#include "yukino/rate_limiter.h"
 
 namespace yukino {
 
@@ -13,7 +14,17 @@ Options::Options()
     , write_buffer_size(4 * base::kMB)
     , block_size(4 * base::kKB)
     , block_restart_interval(16)
-    , max_open_files(1000) {
+    , max_open_files(1000)
+    , use_mmap_reads(true)
+    , use_direct_io_for_flush_and_compaction(false)
+    , compaction_readahead_size(2 * base::kMB)
+    , bytes_per_sync(0)
+    , wal_bytes_per_sync(0)
+    , allow_fallocate(true)
+    , recycle_log_file_num(0)
+    , max_manifest_file_size(64 * base::kMB)
+    , flush_on_close(false)
+    , gc_sweep_rate(10000) {
 }
 
 ReadOptions::ReadOptions()
@@ -26,4 +37,16 @@ WriteOptions::WriteOptions()
     : sync(false) {
 }
 
+IngestExternalFileOptions::IngestExternalFileOptions()
+    : move_files(false) {
+}
+
+FlushOptions::FlushOptions()
+    : wait(true) {
+}
+
+BulkLoadOptions::BulkLoadOptions()
+    : fill_factor(1.0) {
+}
+
 } // namespace yukino
@@ -2,11 +2,15 @@
 #define YUKINO_API_OPTION_H_
 
 #include <stddef.h>
+#include <memory>
+#include <vector>
 
 namespace yukino {
 
 class Env;
 class Comparator;
+class EventListener;
+class RateLimiter;
 
 // Options to control the behavior of a database (passed to DB::Open)
 struct Options {
@@ -37,6 +41,11 @@ struct Options {
     // Default: Env::Default()
     Env* env;
 
+    // Listeners be called back on the background flush, compaction,
+    // checkpoint, write stall and error events, see yukino/listener.h
+    // Default: empty
+    std::vector<std::shared_ptr<EventListener>> listeners;
+
     // -------------------
     // Parameters that affect performance
 
@@ -73,6 +82,92 @@ struct Options {
     //
     // Default: 1000
     int max_open_files;
+
+    // If true, the table files of "yukino.lsm" engine be mapped into memory
+    // entirely. Otherwise the blocks be read by pread() into the memory of
+    // the iterators, so the resident memory is bounded by the blocks in use,
+    // instead of the page cache of the huge mappings.
+    //
+    // Default: true
+    bool use_mmap_reads;
+
+    // If true, the flush and compaction of "yukino.lsm" engine write the
+    // table files by O_DIRECT, and compaction reads its input files by
+    // O_DIRECT, so the background rewriting does not evict the hot data
+    // from the OS page cache.
+    //
+    // Default: false
+    bool use_direct_io_for_flush_and_compaction;
+
+    // The size of every read of the compaction inputs, if the direct I/O be
+    // used. The large aligned reads keep the compaction sequential.
+    //
+    // Default: 2MB
+    size_t compaction_readahead_size;
+
+    // If non-zero, the table files of flushes and compactions of
+    // "yukino.lsm" engine be range synced in the background after every
+    // bytes_per_sync bytes written, so the dirty pages be written back
+    // smoothly, instead of by one long fsync at the end.
+    //
+    // Default: 0
+    size_t bytes_per_sync;
+
+    // Same as bytes_per_sync, but for the redo-log files of both engines.
+    //
+    // Default: 0
+    size_t wal_bytes_per_sync;
+
+    // If true, the disk space of the table files (the expected output size)
+    // and the redo-log files (write_buffer_size) of "yukino.lsm" engine be
+    // preallocated by fallocate(), so they are less fragmented and their
+    // writing does not update the file system metadata every time.
+    //
+    // Default: true
+    bool allow_fallocate;
+
+    // If non-zero, up to recycle_log_file_num obsolete redo-log files of
+    // "yukino.lsm" engine be kept, and the new redo-log be renamed from one
+    // of them and overwritten from the head, instead of creating a new file.
+    // The blocks of recycled file are allocated already, so the writing does
+    // not update the file size. The records of recycled redo-log have the
+    // log number, the stale records of the previous log be ignored at
+    // recovery.
+    //
+    // Default: 0
+    size_t recycle_log_file_num;
+
+    // The manifest be switched to a new file started by the snapshot of all
+    // live files, once it grows larger than this size. So the manifest of a
+    // long-running database is bounded, and the recovery need not replay all
+    // of the patches since its creation.
+    //
+    // Default: 64MB
+    uint64_t max_manifest_file_size;
+
+    // If true, the data in memory be flushed when the database is closing,
+    // like DB::Flush(), so the next open need not replay the redo log. The
+    // closing is slower.
+    //
+    // Default: false
+    bool flush_on_close;
+
+    // If not null, the writing of flushes, compactions and checkpoints be
+    // throttled by it, so they can not starve the foreground reads and the
+    // log syncing. It can be shared by several DB instances to bound their
+    // total background bandwidth, see yukino/rate_limiter.h
+    //
+    // Default: nullptr
+    std::shared_ptr<RateLimiter> rate_limiter;
+
+    // Max number of keys per second be swept by the background garbage
+    // collector of "yukino.balance" engine. The collector drops all old
+    // versions can not be seen by the oldest live snapshot. Zero disables
+    // the background collector, old versions will be purged only at
+    // checkpoint.
+    //
+    // Default: 10000
+    int gc_sweep_rate;
     
     // Create an Options object with default values for all fields.
     Options();
@@ -123,6 +218,37 @@ struct WriteOptions {
     WriteOptions();
     
 }; // struct WriteOptions
+
+struct IngestExternalFileOptions {
+    // If true, the files will be removed from their old paths after be
+    // ingested. Otherwise the files are kept, they're hard linked into the
+    // database if possible, or copied.
+    // Default: false
+    bool move_files;
+
+    IngestExternalFileOptions();
+
+}; // struct IngestExternalFileOptions
+
+struct FlushOptions {
+    // If true, the DB::Flush() will wait until the flush is done. Otherwise
+    // the flush runs in the background.
+    // Default: true
+    bool wait;
+
+    FlushOptions();
+
+}; // struct FlushOptions
+
+struct BulkLoadOptions {
+    // The ratio of used entries in each page, in (0, 1]. The lower one
+    // leaves room for the later insertions without splitting.
+    // Default: 1.0
+    float fill_factor;
+
+    BulkLoadOptions();
+
+}; // struct BulkLoadOptions
     
 } // namespace yukino
 
@@ -0,0 +1,68 @@
+#ifndef YUKINO_API_PERF_CONTEXT_INL_H_
+#define YUKINO_API_PERF_CONTEXT_INL_H_
+
+#include "yukino/perf_context.h"
+#include "base/base.h"
+#include <chrono>
+
+namespace yukino {
+
+// The perf level and context are in the function-local thread storage, with
+// constant initializers, so accessing them need no guard, the disabled cost
+// is only one branch.
+inline PerfLevel &ThreadPerfLevel() {
+    static thread_local PerfLevel level = kPerfDisable;
+    return level;
+}
+
+inline PerfContext &ThreadPerfContext() {
+    static thread_local PerfContext context;
+    return context;
+}
+
+/**
+ * Add the elapsed nanos to metric when it's destroyed or stopped.
+ */
+class PerfTimer : public base::DisableCopyAssign {
+public:
+    explicit PerfTimer(uint64_t *metric)
+        : metric_(metric) {
+        if (ThreadPerfLevel() >= kPerfEnableTime) {
+            start_ = NowNanos();
+        }
+    }
+
+    ~PerfTimer() { Stop(); }
+
+    void Stop() {
+        if (start_) {
+            *metric_ += NowNanos() - start_;
+            start_ = 0;
+        }
+    }
+
+private:
+    static uint64_t NowNanos() {
+        using namespace std::chrono;
+
+        auto now = steady_clock::now();
+        return duration_cast<nanoseconds>(now.time_since_epoch()).count();
+    }
+
+    uint64_t *metric_;
+    uint64_t start_ = 0;
+};
+
+} // namespace yukino
+
+#define PERF_COUNTER_ADD(metric, value)                                   \
+    do {                                                                  \
+        if (::yukino::ThreadPerfLevel() >= ::yukino::kPerfEnableCount) {  \
+            ::yukino::ThreadPerfContext().metric += (value);              \
+        }                                                                 \
+    } while (0)
+
+#define PERF_TIMER_GUARD(metric) \
+    ::yukino::PerfTimer perf_timer_##metric(&::yukino::ThreadPerfContext().metric)
+
+#endif // YUKINO_API_PERF_CONTEXT_INL_H_
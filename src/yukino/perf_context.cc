@@ -0,0 +1,59 @@
+#include "yukino/perf_context-inl.h"
+#include "yukino/perf_context.h"
+#include "base/base.h"
+#include <string.h>
+#include <inttypes.h>
+
+namespace yukino {
+
+void PerfContext::Reset() {
+    ::memset(this, 0, sizeof(*this));
+}
+
+std::string PerfContext::ToString(bool exclude_zero) const {
+    std::string buf;
+
+#define PERF_CONTEXT_OUTPUT(metric)                                       \
+    if (!exclude_zero || metric > 0) {                                    \
+        buf.append(base::Strings::Sprintf(#metric " = %" PRIu64 ", ",    \
+                                          metric));                       \
+    }
+
+    PERF_CONTEXT_OUTPUT(user_key_comparison_count)
+    PERF_CONTEXT_OUTPUT(memtable_probe_count)
+    PERF_CONTEXT_OUTPUT(table_probe_count)
+    PERF_CONTEXT_OUTPUT(table_cache_hit_count)
+    PERF_CONTEXT_OUTPUT(table_cache_miss_count)
+    PERF_CONTEXT_OUTPUT(merge_child_seek_count)
+    PERF_CONTEXT_OUTPUT(block_seek_count)
+    PERF_CONTEXT_OUTPUT(block_read_count)
+    PERF_CONTEXT_OUTPUT(block_read_byte)
+    PERF_CONTEXT_OUTPUT(block_decode_byte)
+    PERF_CONTEXT_OUTPUT(page_cache_hit_count)
+    PERF_CONTEXT_OUTPUT(page_cache_miss_count)
+    PERF_CONTEXT_OUTPUT(get_nanos)
+    PERF_CONTEXT_OUTPUT(db_mutex_wait_nanos)
+    PERF_CONTEXT_OUTPUT(checksum_nanos)
+    PERF_CONTEXT_OUTPUT(page_read_nanos)
+
+#undef PERF_CONTEXT_OUTPUT
+
+    if (buf.size() >= 2) {
+        buf.resize(buf.size() - 2); // the last ", "
+    }
+    return buf;
+}
+
+void SetPerfLevel(PerfLevel level) {
+    ThreadPerfLevel() = level;
+}
+
+PerfLevel GetPerfLevel() {
+    return ThreadPerfLevel();
+}
+
+PerfContext *GetPerfContext() {
+    return &ThreadPerfContext();
+}
+
+} // namespace yukino
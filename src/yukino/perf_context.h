@@ -0,0 +1,74 @@
+#ifndef YUKINO_API_PERF_CONTEXT_H_
+#define YUKINO_API_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace yukino {
+
+enum PerfLevel : int {
+    kPerfDisable     = 0, // No perf stats, the default.
+    kPerfEnableCount = 1, // Only counters.
+    kPerfEnableTime  = 2, // Counters and timers, timers read the clock.
+};
+
+/**
+ * The internal cost breakdown of operations in the calling thread.
+ *
+ * Usage:
+ *
+ *     SetPerfLevel(kPerfEnableTime);
+ *     GetPerfContext()->Reset();
+ *     db->Get(options, key, &value);
+ *     LOG(INFO) << GetPerfContext()->ToString();
+ *
+ * The counters only be increased, call Reset() before the operation.
+ */
+struct PerfContext {
+    //--------------------------------------------------------------------------
+    // Counters: kPerfEnableCount
+    //--------------------------------------------------------------------------
+    uint64_t user_key_comparison_count; // internal key comparisons
+    uint64_t memtable_probe_count;      // lsm: memory tables be looked up
+    uint64_t table_probe_count;         // lsm: sst tables be looked up
+    uint64_t table_cache_hit_count;     // lsm: opened tables in table cache
+    uint64_t table_cache_miss_count;    // lsm: tables need to be opened
+    uint64_t merge_child_seek_count;    // lsm: children seek in merging
+    uint64_t block_seek_count;          // lsm: seek in data blocks
+    uint64_t block_read_count;          // blocks be verified and read
+    uint64_t block_read_byte;
+    uint64_t block_decode_byte;         // lsm: block entries be decoded
+    uint64_t page_cache_hit_count;      // balance: b+tree pages in cache
+    uint64_t page_cache_miss_count;     // balance: b+tree pages be read
+
+    //--------------------------------------------------------------------------
+    // Timers: kPerfEnableTime
+    //--------------------------------------------------------------------------
+    uint64_t get_nanos;
+    uint64_t db_mutex_wait_nanos;
+    uint64_t checksum_nanos;
+    uint64_t page_read_nanos;           // balance: reading b+tree pages
+
+    void Reset();
+
+    /**
+     * @param exclude_zero skip the zero counters.
+     */
+    std::string ToString(bool exclude_zero = true) const;
+};
+
+/**
+ * Set the perf level for the calling thread.
+ */
+void SetPerfLevel(PerfLevel level);
+
+PerfLevel GetPerfLevel();
+
+/**
+ * @return the perf context of the calling thread.
+ */
+PerfContext *GetPerfContext();
+
+} // namespace yukino
+
+#endif // YUKINO_API_PERF_CONTEXT_H_
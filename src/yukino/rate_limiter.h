@@ -0,0 +1,63 @@
+#ifndef YUKINO_API_RATE_LIMITER_H_
+#define YUKINO_API_RATE_LIMITER_H_
+
+#include "base/base.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace yukino {
+
+// The limiter of the background writing bandwidth. Flushes, compactions
+// and checkpoints request the bytes before writing them, the requests be
+// blocked if the bandwidth is exhausted.
+//
+// A limiter may be shared by several DB instances, so they are bounded
+// together. It's thread safe.
+class RateLimiter : public base::DisableCopyAssign {
+public:
+    enum Priority {
+        kPriorityLow,  // compaction.
+        kPriorityHigh, // flush and checkpoint.
+        kNumPriorities,
+    };
+
+    RateLimiter() { }
+    virtual ~RateLimiter();
+
+    // Block until the bytes be granted. The high priority requests be
+    // granted first.
+    virtual void Request(int64_t bytes, Priority priority) = 0;
+
+    // Change the bandwidth dynamically. If it's auto-tuned, it's the upper
+    // bound of the tuning.
+    virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+    // The current bandwidth.
+    virtual int64_t GetBytesPerSecond() const = 0;
+
+    // Total bytes be granted for the priority.
+    virtual int64_t GetTotalBytesThrough(Priority priority) const = 0;
+
+    // Total requests be blocked for the priority.
+    virtual int64_t GetTotalRequestsBlocked(Priority priority) const = 0;
+}; // class RateLimiter
+
+// Create the token bucket limiter.
+//
+// @param bytes_per_second the max bandwidth of all requests.
+// @param refill_period_us the bucket be refilled in every period, the
+//        bytes of one refilling is bytes_per_second * refill_period_us / 1M.
+// @param fairness a low priority request be served first once every
+//        fairness refillings, so compactions are never starved by flushes.
+// @param auto_tuned if true, the bandwidth be tuned in
+//        [bytes_per_second / 20, bytes_per_second] by the backlog: be
+//        increased if requests are blocked in most of refillings, be
+//        decreased if the bucket is seldom drained.
+RateLimiter *NewGenericRateLimiter(int64_t bytes_per_second,
+                                   int64_t refill_period_us = 100 * 1000,
+                                   int32_t fairness = 10,
+                                   bool auto_tuned = false);
+
+} // namespace yukino
+
+#endif // YUKINO_API_RATE_LIMITER_H_
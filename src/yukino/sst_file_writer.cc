@@ -0,0 +1,121 @@
+#include "yukino/sst_file_writer.h"
+#include "yukino/comparator.h"
+#include "yukino/options.h"
+#include "yukino/env.h"
+#include "lsm/table_builder.h"
+#include "lsm/builtin.h"
+#include "lsm/chunk.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "glog/logging.h"
+
+namespace yukino {
+
+SstFileWriter::SstFileWriter(const Options &options)
+    : env_(DCHECK_NOTNULL(options.env))
+    , comparator_(DCHECK_NOTNULL(options.comparator))
+    , block_size_(options.block_size)
+    , block_restart_interval_(options.block_restart_interval) {
+}
+
+SstFileWriter::~SstFileWriter() {
+    if (file_) {
+        Abandon();
+    }
+}
+
+base::Status SstFileWriter::Open(const std::string &file_name) {
+    if (file_) {
+        return base::Status::InvalidArgument("Sst file writer is opened.");
+    }
+
+    // The append file keeps the old content.
+    if (env_->FileExists(file_name)) {
+        auto rs = env_->DeleteFile(file_name, false);
+        if (!rs.ok()) {
+            return rs;
+        }
+    }
+
+    base::AppendFile *file = nullptr;
+    auto rs = env_->CreateAppendFile(file_name, &file);
+    if (!rs.ok()) {
+        return rs;
+    }
+    file_.reset(file);
+    file_name_   = file_name;
+    num_entries_ = 0;
+    file_size_   = 0;
+    last_key_.clear();
+
+    lsm::TableOptions options;
+    options.block_size       = static_cast<uint32_t>(block_size_);
+    options.restart_interval = block_restart_interval_;
+    builder_.reset(new lsm::TableBuilder(options, file_.get()));
+    return rs;
+}
+
+base::Status SstFileWriter::Put(const base::Slice &key,
+                                const base::Slice &value) {
+    return Add(key, value, lsm::kFlagValue);
+}
+
+base::Status SstFileWriter::Delete(const base::Slice &key) {
+    return Add(key, "", lsm::kFlagDeletion);
+}
+
+base::Status SstFileWriter::Finish() {
+    if (!file_) {
+        return base::Status::InvalidArgument("Sst file writer is not opened.");
+    }
+    if (num_entries_ == 0) {
+        Abandon();
+        return base::Status::InvalidArgument("Can not finish an empty sst "
+                                             "file.");
+    }
+
+    auto rs = builder_->Finalize();
+    if (!rs.ok()) {
+        Abandon();
+        return rs;
+    }
+    builder_.reset();
+
+    rs = file_->Close();
+    file_.reset();
+    if (!rs.ok()) {
+        env_->DeleteFile(file_name_, false);
+        return rs;
+    }
+    return env_->GetFileSize(file_name_, &file_size_);
+}
+
+base::Status SstFileWriter::Add(const base::Slice &key,
+                                const base::Slice &value, uint8_t flag) {
+    if (!file_) {
+        return base::Status::InvalidArgument("Sst file writer is not opened.");
+    }
+    if (num_entries_ > 0 && comparator_->Compare(key, last_key_) <= 0) {
+        return base::Status::InvalidArgument("Keys must be added in strictly "
+                                             "increasing order.");
+    }
+
+    auto rs = builder_->Append(lsm::InternalKey::CreateKey(key, value,
+                                                    lsm::kExternalFileVersion,
+                                                    flag));
+    if (!rs.ok()) {
+        return rs;
+    }
+    last_key_.assign(key.data(), key.size());
+    num_entries_++;
+    return rs;
+}
+
+void SstFileWriter::Abandon() {
+    builder_.reset();
+    file_->Close();
+    file_.reset();
+    env_->DeleteFile(file_name_, false);
+}
+
+} // namespace yukino
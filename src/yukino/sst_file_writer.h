@@ -0,0 +1,84 @@
+#ifndef YUKINO_API_SST_FILE_WRITER_H_
+#define YUKINO_API_SST_FILE_WRITER_H_
+
+#include "base/status.h"
+#include "base/slice.h"
+#include "base/base.h"
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+namespace yukino {
+
+namespace base {
+
+class AppendFile;
+
+} // namespace base
+
+namespace lsm {
+
+class TableBuilder;
+
+} // namespace lsm
+
+class Options;
+class Env;
+class Comparator;
+
+/**
+ * Build a sst file of "yukino.lsm" engine offline, then load it by
+ * DB::IngestExternalFile(). The writers of different files can run in
+ * parallel, but one writer is not thread-safe.
+ *
+ * The keys must be added in strictly increasing order of
+ * Options::comparator, it must be the comparator of the db.
+ */
+class SstFileWriter : public base::DisableCopyAssign {
+public:
+    /**
+     * @param options use the env, comparator, block_size and
+     *        block_restart_interval.
+     */
+    explicit SstFileWriter(const Options &options);
+    ~SstFileWriter();
+
+    base::Status Open(const std::string &file_name);
+
+    base::Status Put(const base::Slice &key, const base::Slice &value);
+
+    base::Status Delete(const base::Slice &key);
+
+    /**
+     * Finish the file, an empty file can not be finished. The file be
+     * deleted if the writer is destroyed before finishing.
+     */
+    base::Status Finish();
+
+    uint64_t num_entries() const { return num_entries_; }
+
+    // REQUIRES: Finish()
+    uint64_t file_size() const { return file_size_; }
+
+private:
+    base::Status Add(const base::Slice &key, const base::Slice &value,
+                     uint8_t flag);
+    void Abandon();
+
+    Env *env_;
+    const Comparator *comparator_;
+    const size_t block_size_;
+    const int block_restart_interval_;
+
+    std::string file_name_;
+    std::string last_key_;
+    uint64_t num_entries_ = 0;
+    uint64_t file_size_ = 0;
+
+    std::unique_ptr<base::AppendFile> file_;
+    std::unique_ptr<lsm::TableBuilder> builder_;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_API_SST_FILE_WRITER_H_
@@ -0,0 +1,190 @@
+// The YukinoDB Unit Test Suite
+//
+//  sst_file_writer_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "yukino/sst_file_writer.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/options.h"
+#include "yukino/iterator.h"
+#include "lsm/db_impl.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace yukino {
+
+class SstFileWriterTest : public ::testing::Test {
+public:
+    SstFileWriterTest () {
+    }
+
+    virtual void SetUp() override {
+        // Unique directory, the tests can be run in parallel.
+        char dir[] = "/tmp/yukino_sst_file_writer_test.XXXXXX";
+        ASSERT_TRUE(::mkdtemp(dir) != nullptr);
+        dir_ = dir;
+        name_ = dir_ + "/db";
+        file_name_ = dir_ + "/external.sst";
+        other_file_name_ = dir_ + "/external-other.sst";
+    }
+
+    virtual void TearDown() override {
+        Env::Default()->DeleteFile(dir_, true);
+    }
+
+    DB *OpenDB() {
+        Options options;
+        options.create_if_missing = true;
+        options.engine_name = lsm::DBImpl::kName;
+
+        DB *db = nullptr;
+        auto rs = DB::Open(options, name_, &db);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+        return db;
+    }
+
+    base::Status WriteFile(const std::string &file_name, int begin, int end) {
+        SstFileWriter writer((Options()));
+        auto rs = writer.Open(file_name);
+        if (!rs.ok()) {
+            return rs;
+        }
+
+        char key[32];
+        for (int i = begin; i < end; ++i) {
+            ::snprintf(key, sizeof(key), "key.%04d", i);
+            rs = writer.Put(key, "external");
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        return writer.Finish();
+    }
+
+    std::string dir_;
+    std::string name_;
+    std::string file_name_;
+    std::string other_file_name_;
+};
+
+TEST_F(SstFileWriterTest, Sanity) {
+    SstFileWriter writer((Options()));
+    auto rs = writer.Open(file_name_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    ASSERT_TRUE(writer.Put("aaa", "1").ok());
+    ASSERT_TRUE(writer.Delete("bbb").ok());
+    EXPECT_TRUE(writer.Put("bbb", "2").IsInvalidArgument());
+    EXPECT_TRUE(writer.Put("aab", "2").IsInvalidArgument());
+    ASSERT_TRUE(writer.Put("ccc", "3").ok());
+    EXPECT_EQ(3, writer.num_entries());
+
+    rs = writer.Finish();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_LT(0, writer.file_size());
+    EXPECT_TRUE(Env::Default()->FileExists(file_name_));
+}
+
+TEST_F(SstFileWriterTest, EmptyFile) {
+    SstFileWriter writer((Options()));
+    auto rs = writer.Open(file_name_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    EXPECT_TRUE(writer.Finish().IsInvalidArgument());
+    EXPECT_FALSE(Env::Default()->FileExists(file_name_));
+}
+
+TEST_F(SstFileWriterTest, Ingest) {
+    ASSERT_TRUE(WriteFile(file_name_, 0, 1000).ok());
+    ASSERT_TRUE(WriteFile(other_file_name_, 1000, 2000).ok());
+
+    std::unique_ptr<DB> db(OpenDB());
+    ASSERT_NE(nullptr, db.get());
+
+    // Overwritten by the ingested files.
+    ASSERT_TRUE(db->Put(WriteOptions(), "key.0001", "old").ok());
+    auto snapshot = db->GetSnapshot();
+
+    IngestExternalFileOptions options;
+    auto rs = db->IngestExternalFile({file_name_, other_file_name_}, options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_TRUE(Env::Default()->FileExists(file_name_));
+
+    std::string value;
+    rs = db->Get(ReadOptions(), "key.0001", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("external", value);
+
+    rs = db->Get(ReadOptions(), "key.1999", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("external", value);
+
+    // Not be seen by the older snapshot.
+    ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    rs = db->Get(read_options, "key.0001", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("old", value);
+    EXPECT_TRUE(db->Get(read_options, "key.0002", &value).IsNotFound());
+    db->ReleaseSnapshot(snapshot);
+
+    // The newer writes overwrite the ingested keys.
+    ASSERT_TRUE(db->Put(WriteOptions(), "key.0002", "new").ok());
+    rs = db->Get(ReadOptions(), "key.0002", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("new", value);
+
+    std::unique_ptr<Iterator> iter(db->NewIterator(ReadOptions()));
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    EXPECT_EQ(2000, count);
+    iter.reset();
+
+    // Recovery
+    db.reset();
+    db.reset(OpenDB());
+    ASSERT_NE(nullptr, db.get());
+
+    rs = db->Get(ReadOptions(), "key.0001", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("external", value);
+    rs = db->Get(ReadOptions(), "key.0002", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("new", value);
+    rs = db->Get(ReadOptions(), "key.1500", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("external", value);
+}
+
+TEST_F(SstFileWriterTest, IngestOverlapFiles) {
+    ASSERT_TRUE(WriteFile(file_name_, 0, 100).ok());
+    ASSERT_TRUE(WriteFile(other_file_name_, 50, 150).ok());
+
+    std::unique_ptr<DB> db(OpenDB());
+    ASSERT_NE(nullptr, db.get());
+
+    IngestExternalFileOptions options;
+    options.move_files = true;
+    auto rs = db->IngestExternalFile({file_name_, other_file_name_}, options);
+    EXPECT_TRUE(rs.IsInvalidArgument()) << rs.ToString();
+
+    rs = db->IngestExternalFile({file_name_}, options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_FALSE(Env::Default()->FileExists(file_name_));
+
+    rs = db->IngestExternalFile({other_file_name_}, options);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    std::string value;
+    rs = db->Get(ReadOptions(), "key.0149", &value);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ("external", value);
+}
+
+} // namespace yukino
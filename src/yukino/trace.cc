@@ -0,0 +1,411 @@
+#include "yukino/trace.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/iterator.h"
+#include "yukino/options.h"
+#include "yukino/write_batch.h"
+#include "util/log.h"
+#include "base/io-inl.h"
+#include "base/io.h"
+#include "base/varint_encoding.h"
+#include "glog/logging.h"
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace {
+
+inline uint64_t NowMicros() {
+    using namespace std::chrono;
+
+    auto now = system_clock::now();
+    return duration_cast<microseconds>(now.time_since_epoch()).count();
+}
+
+} // namespace
+
+/*static*/ const char Tracer::kMagic[] = "yukino.trace";
+
+Tracer::Tracer(Env *env, const std::string &file_name)
+    : env_(DCHECK_NOTNULL(env))
+    , file_name_(file_name) {
+}
+
+Tracer::~Tracer() {
+    Close();
+}
+
+base::Status Tracer::Open() {
+    // The append file keeps the old content, but the trace must start with
+    // the header at a block boundary.
+    if (env_->FileExists(file_name_)) {
+        auto rs = env_->DeleteFile(file_name_, false);
+        if (!rs.ok()) {
+            return rs;
+        }
+    }
+
+    base::AppendFile *file = nullptr;
+    auto rs = env_->CreateAppendFile(file_name_, &file);
+    if (!rs.ok()) {
+        return rs;
+    }
+    file_.reset(file);
+    log_.reset(new util::Log::Writer(file_.get(), util::Log::kDefaultBlockSize));
+
+    start_micros_ = NowMicros();
+
+    base::BufferedWriter header;
+    header.Write(kMagic, sizeof(kMagic) - 1, nullptr);
+    header.WriteVarint32(kVersion, nullptr);
+    header.WriteFixed64(start_micros_);
+    return log_->Append(base::Slice(header.buf(), header.len()));
+}
+
+base::Status Tracer::Add(TraceType type, const base::Slice &data) {
+    if (!log_) {
+        return base::Status::IOError("Trace file is not opened.");
+    }
+
+    auto now = NowMicros();
+
+    scratch_.clear();
+    scratch_.push_back(static_cast<char>(type));
+
+    char buf[base::Varint64::kMaxLen];
+    auto len = base::Varint64::Encode(buf,
+                                      now > start_micros_ ? now - start_micros_
+                                                          : 0);
+    scratch_.append(buf, len);
+    scratch_.append(data.data(), data.size());
+    return log_->Append(scratch_);
+}
+
+base::Status Tracer::Close() {
+    base::Status rs;
+    if (file_) {
+        rs = file_->Close();
+    }
+    log_.reset();
+    file_.reset();
+    return rs;
+}
+
+TraceReader::TraceReader(Env *env, const std::string &file_name)
+    : env_(DCHECK_NOTNULL(env))
+    , file_name_(file_name) {
+}
+
+TraceReader::~TraceReader() {
+}
+
+base::Status TraceReader::Open() {
+    base::MappedMemory *file = nullptr;
+    auto rs = env_->CreateRandomAccessFile(file_name_, &file);
+    if (!rs.ok()) {
+        return rs;
+    }
+    file_.reset(file);
+    log_.reset(new util::Log::Reader(file_->buf(), file_->size(), true,
+                                     util::Log::kDefaultBlockSize));
+
+    base::Slice record;
+    if (!log_->Read(&record, &scratch_)) {
+        return base::Status::Corruption("Empty trace file.");
+    }
+    if (!log_->status().ok()) {
+        return log_->status();
+    }
+
+    static const size_t kMagicSize = sizeof(Tracer::kMagic) - 1;
+    if (record.size() < kMagicSize + 1 + sizeof(uint64_t) ||
+        ::memcmp(record.data(), Tracer::kMagic, kMagicSize) != 0) {
+        return base::Status::Corruption("Bad trace file magic.");
+    }
+
+    base::BufferedReader rd(record.data() + kMagicSize,
+                            record.size() - kMagicSize);
+    auto version = rd.ReadVarint32();
+    if (version != Tracer::kVersion) {
+        return base::Status::Corruption(base::Strings::Sprintf(
+            "Unsupported trace file version: %u", version));
+    }
+    start_micros_ = rd.ReadFixed64();
+    return rs;
+}
+
+bool TraceReader::Read(TraceRecord *record) {
+    base::Slice slice;
+    if (!status_.ok() || !log_->Read(&slice, &scratch_)) {
+        return false;
+    }
+    if (!log_->status().ok()) {
+        status_ = log_->status();
+        return false;
+    }
+    if (slice.size() < 2) {
+        status_ = base::Status::Corruption("Trace record too small.");
+        return false;
+    }
+
+    base::BufferedReader rd(slice.data(), slice.size());
+    record->type      = static_cast<TraceType>(rd.ReadByte());
+    record->timestamp = rd.ReadVarint64();
+    record->data.assign(reinterpret_cast<const char *>(rd.current()),
+                        rd.active());
+
+    switch (record->type) {
+        case kTraceWrite:
+        case kTraceGet:
+        case kTraceSeek:
+            return true;
+
+        default:
+            status_ = base::Status::Corruption(base::Strings::Sprintf(
+                "Unknown trace record type: %d", record->type));
+            return false;
+    }
+}
+
+namespace {
+
+class ReplayWorker : public base::DisableCopyAssign {
+public:
+    static const size_t kMaxQueued = 1024;
+
+    ReplayWorker(DB *db, double speed,
+                 std::chrono::steady_clock::time_point start)
+        : db_(db)
+        , speed_(speed)
+        , start_(start)
+        , thread_([this]() { Run(); }) {
+    }
+
+    ~ReplayWorker() {
+        Finish();
+    }
+
+    void Push(TraceRecord &&record) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (queue_.size() >= kMaxQueued) {
+            cv_.wait(lock);
+        }
+        queue_.push_back(std::move(record));
+        cv_.notify_all();
+    }
+
+    // Wait for all queued records be applied.
+    void Drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!queue_.empty() || busy_) {
+            cv_.wait(lock);
+        }
+    }
+
+    void Finish() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_ = true;
+            cv_.notify_all();
+        }
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    const ReplayStats &stats() const { return stats_; }
+
+private:
+    void Run() {
+        for (;;) {
+            TraceRecord record;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                busy_ = false;
+                cv_.notify_all();
+                while (queue_.empty() && !done_) {
+                    cv_.wait(lock);
+                }
+                if (queue_.empty()) {
+                    return;
+                }
+                record = std::move(queue_.front());
+                queue_.pop_front();
+                busy_ = true;
+                cv_.notify_all();
+            }
+
+            if (speed_ > 0) {
+                auto offset = static_cast<int64_t>(record.timestamp / speed_);
+                std::this_thread::sleep_until(start_ +
+                    std::chrono::microseconds(offset));
+            }
+            Apply(record);
+        }
+    }
+
+    void Apply(const TraceRecord &record) {
+        base::Status rs;
+        switch (record.type) {
+            case kTraceWrite: {
+                stats_.writes++;
+
+                // Rebuild the batch by its handler, the redo buffer is private.
+                WriteBatch batch;
+                struct Handler : public WriteBatch::Handler {
+                    WriteBatch *batch;
+                    virtual void Put(const base::Slice& key,
+                                     const base::Slice& value) override {
+                        batch->Put(key, value);
+                    }
+                    virtual void Delete(const base::Slice& key) override {
+                        batch->Delete(key);
+                    }
+                } handler;
+                handler.batch = &batch;
+                rs = WriteBatch::Iterate(record.data.data(), record.data.size(),
+                                         &handler);
+                if (rs.ok()) {
+                    rs = db_->Write(WriteOptions(), &batch);
+                }
+                if (!rs.ok()) {
+                    stats_.failed++;
+                }
+            } break;
+
+            case kTraceGet: {
+                stats_.gets++;
+
+                std::string value;
+                rs = db_->Get(ReadOptions(), record.data, &value);
+                if (rs.IsNotFound()) {
+                    stats_.not_found++;
+                } else if (!rs.ok()) {
+                    stats_.failed++;
+                }
+            } break;
+
+            case kTraceSeek: {
+                stats_.seeks++;
+
+                std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+                if (!iter) {
+                    stats_.failed++;
+                    break;
+                }
+                iter->Seek(record.data);
+                if (!iter->Valid()) {
+                    stats_.not_found++;
+                }
+            } break;
+
+            default:
+                DLOG(FATAL) << "noreached";
+                break;
+        }
+    }
+
+    DB *db_;
+    const double speed_;
+    const std::chrono::steady_clock::time_point start_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<TraceRecord> queue_;
+    bool done_ = false;
+    bool busy_ = false;
+
+    ReplayStats stats_;
+    std::thread thread_;
+};
+
+// The key for sharding, a write batch has more than one key has no key.
+bool ShardingKey(const TraceRecord &record, base::Slice *key) {
+    if (record.type != kTraceWrite) {
+        *key = record.data;
+        return true;
+    }
+
+    struct Handler : public WriteBatch::Handler {
+        base::Slice key;
+        int count = 0;
+        virtual void Put(const base::Slice& k, const base::Slice&) override {
+            Set(k);
+        }
+        virtual void Delete(const base::Slice& k) override { Set(k); }
+        void Set(const base::Slice& k) {
+            if (count++ == 0) {
+                key = k;
+            }
+        }
+    } handler;
+    WriteBatch::Iterate(record.data.data(), record.data.size(), &handler);
+    *key = handler.key;
+    return handler.count <= 1;
+}
+
+} // namespace
+
+base::Status ReplayTrace(DB *db, Env *env, const std::string &file_name,
+                         const ReplayOptions &options, ReplayStats *stats) {
+    DCHECK_GT(options.threads, 0);
+
+    TraceReader reader(env, file_name);
+    auto rs = reader.Open();
+    if (!rs.ok()) {
+        return rs;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<ReplayWorker>> workers;
+    for (auto i = 0; i < options.threads; ++i) {
+        workers.emplace_back(new ReplayWorker(db, options.speed, start));
+    }
+
+    TraceRecord record;
+    std::hash<std::string> hash;
+    while (reader.Read(&record)) {
+        if (workers.size() == 1) {
+            workers[0]->Push(std::move(record));
+            continue;
+        }
+
+        base::Slice key;
+        if (ShardingKey(record, &key)) {
+            auto i = hash(key.ToString()) % workers.size();
+            workers[i]->Push(std::move(record));
+            continue;
+        }
+
+        // The batch may touch keys in other shards, it's a barrier: all
+        // records before it must be applied first, and all after it wait.
+        for (const auto &worker : workers) {
+            worker->Drain();
+        }
+        workers[0]->Push(std::move(record));
+        workers[0]->Drain();
+    }
+
+    *stats = ReplayStats();
+    for (const auto &worker : workers) {
+        worker->Finish();
+
+        stats->writes    += worker->stats().writes;
+        stats->gets      += worker->stats().gets;
+        stats->seeks     += worker->stats().seeks;
+        stats->not_found += worker->stats().not_found;
+        stats->failed    += worker->stats().failed;
+    }
+    stats->micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return reader.status();
+}
+
+} // namespace yukino
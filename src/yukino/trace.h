@@ -0,0 +1,145 @@
+#ifndef YUKINO_API_TRACE_H_
+#define YUKINO_API_TRACE_H_
+
+#include "base/status.h"
+#include "base/slice.h"
+#include "base/base.h"
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+namespace yukino {
+
+namespace base {
+
+class AppendFile;
+class MappedMemory;
+
+} // namespace base
+
+namespace util {
+
+class LogWriter;
+class LogReader;
+
+} // namespace util
+
+class DB;
+class Env;
+
+enum TraceType : uint8_t {
+    kTraceWrite = 1, // Put, Delete and Write, data is the write batch.
+    kTraceGet   = 2, // data is the key.
+    kTraceSeek  = 3, // Iterator::Seek(), data is the target, the Next() and
+                     // Prev() are not recorded.
+};
+
+/*
+ * The trace file is a util::Log, the first record is the header:
+ *
+ * +---------+---------------------------+
+ * | magic   | "yukino.trace"            |
+ * | version | varint32                  |
+ * | start   | fixed64 micros since epoch|
+ * +---------+---------------------------+
+ *
+ * Then every operation is a record:
+ *
+ * +-----------+--------------------------------------+
+ * | type      | 1 byte                               |
+ * | timestamp | varint64 micros since the trace start|
+ * | data      | remaining bytes                      |
+ * +-----------+--------------------------------------+
+ */
+struct TraceRecord {
+    TraceType   type;
+    uint64_t    timestamp;
+    std::string data;
+};
+
+/**
+ * Record operations into the trace file, it's not thread-safe.
+ */
+class Tracer : public base::DisableCopyAssign {
+public:
+    Tracer(Env *env, const std::string &file_name);
+    ~Tracer();
+
+    base::Status Open();
+
+    base::Status Add(TraceType type, const base::Slice &data);
+
+    base::Status Close();
+
+    static const char kMagic[];
+    static const uint32_t kVersion = 1;
+
+private:
+    Env *env_;
+    std::string file_name_;
+    uint64_t start_micros_ = 0;
+
+    std::unique_ptr<base::AppendFile> file_;
+    std::unique_ptr<util::LogWriter> log_;
+    std::string scratch_;
+};
+
+class TraceReader : public base::DisableCopyAssign {
+public:
+    TraceReader(Env *env, const std::string &file_name);
+    ~TraceReader();
+
+    /**
+     * Open the trace file and read the header.
+     */
+    base::Status Open();
+
+    /**
+     * @return false if no more records or error, see status().
+     */
+    bool Read(TraceRecord *record);
+
+    const base::Status &status() const { return status_; }
+
+    uint64_t start_micros() const { return start_micros_; }
+
+private:
+    Env *env_;
+    std::string file_name_;
+    uint64_t start_micros_ = 0;
+
+    std::unique_ptr<base::MappedMemory> file_;
+    std::unique_ptr<util::LogReader> log_;
+    std::string scratch_;
+    base::Status status_;
+};
+
+struct ReplayOptions {
+    // The number of replay threads. Records are sharded by the key, so
+    // operations on the same key keep the recorded order. A write batch with
+    // more than one key is a barrier for all threads.
+    int threads = 1;
+
+    // Replay speed: 1.0 is the recorded speed, 2.0 is twice as fast, and
+    // 0 means as fast as possible.
+    double speed = 1.0;
+};
+
+struct ReplayStats {
+    uint64_t writes = 0;
+    uint64_t gets = 0;
+    uint64_t seeks = 0;
+    uint64_t not_found = 0; // Get not found or Seek to the end.
+    uint64_t failed = 0;    // errors, or the engine has no iterator.
+    uint64_t micros = 0;    // elapsed time of the replay.
+};
+
+/**
+ * Re-issue the operations in the trace against db.
+ */
+base::Status ReplayTrace(DB *db, Env *env, const std::string &file_name,
+                         const ReplayOptions &options, ReplayStats *stats);
+
+} // namespace yukino
+
+#endif // YUKINO_API_TRACE_H_
@@ -0,0 +1,149 @@
+// The YukinoDB Unit Test Suite
+//
+//  trace_test.cc
+//
+//  Created by Niko Bellic.
+//
+//
+#include "yukino/trace.h"
+#include "yukino/db.h"
+#include "yukino/env.h"
+#include "yukino/options.h"
+#include "yukino/write_batch.h"
+#include "yukino/iterator.h"
+#include "lsm/db_impl.h"
+#include "gtest/gtest.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace yukino {
+
+class TraceTest : public ::testing::Test {
+public:
+    TraceTest () {
+    }
+
+    virtual void SetUp() override {
+        // Unique directory, the tests can be run in parallel.
+        char dir[] = "/tmp/yukino_trace_test.XXXXXX";
+        ASSERT_TRUE(::mkdtemp(dir) != nullptr);
+        dir_ = dir;
+        name_ = dir_ + "/db";
+        replay_name_ = dir_ + "/db-replay";
+        trace_name_ = dir_ + "/db.trace";
+    }
+
+    virtual void TearDown() override {
+        Env::Default()->DeleteFile(dir_, true);
+    }
+
+    DB *OpenDB(const std::string &name) {
+        Options options;
+        options.create_if_missing = true;
+        options.engine_name = lsm::DBImpl::kName;
+
+        DB *db = nullptr;
+        auto rs = DB::Open(options, name, &db);
+        EXPECT_TRUE(rs.ok()) << rs.ToString();
+        return db;
+    }
+
+    std::string dir_;
+    std::string name_;
+    std::string replay_name_;
+    std::string trace_name_;
+};
+
+TEST_F(TraceTest, Sanity) {
+    Tracer tracer(Env::Default(), trace_name_);
+    auto rs = tracer.Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    ASSERT_TRUE(tracer.Add(kTraceGet, "aaa").ok());
+    ASSERT_TRUE(tracer.Add(kTraceSeek, "bbb").ok());
+    ASSERT_TRUE(tracer.Add(kTraceGet, std::string(100000, 'c')).ok());
+    ASSERT_TRUE(tracer.Close().ok());
+
+    TraceReader reader(Env::Default(), trace_name_);
+    rs = reader.Open();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    ASSERT_LT(0, reader.start_micros());
+
+    TraceRecord record;
+    ASSERT_TRUE(reader.Read(&record));
+    EXPECT_EQ(kTraceGet, record.type);
+    EXPECT_EQ("aaa", record.data);
+
+    uint64_t last = record.timestamp;
+    ASSERT_TRUE(reader.Read(&record));
+    EXPECT_EQ(kTraceSeek, record.type);
+    EXPECT_EQ("bbb", record.data);
+    EXPECT_LE(last, record.timestamp);
+
+    ASSERT_TRUE(reader.Read(&record));
+    EXPECT_EQ(kTraceGet, record.type);
+    EXPECT_EQ(std::string(100000, 'c'), record.data);
+
+    ASSERT_FALSE(reader.Read(&record));
+    EXPECT_TRUE(reader.status().ok()) << reader.status().ToString();
+}
+
+TEST_F(TraceTest, RecordAndReplay) {
+    std::unique_ptr<DB> db(OpenDB(name_));
+    ASSERT_NE(nullptr, db.get());
+
+    auto rs = db->StartTrace(trace_name_);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    char key[32];
+    for (int i = 0; i < 100; ++i) {
+        ::snprintf(key, sizeof(key), "key.%03d", i);
+        ASSERT_TRUE(db->Put(WriteOptions(), key, "value").ok());
+    }
+    ASSERT_TRUE(db->Delete(WriteOptions(), "key.000").ok());
+
+    WriteBatch batch;
+    batch.Put("key.100", "value");
+    batch.Delete("key.001");
+    ASSERT_TRUE(db->Write(WriteOptions(), &batch).ok());
+
+    std::string value;
+    ASSERT_TRUE(db->Get(ReadOptions(), "key.000", &value).IsNotFound());
+    ASSERT_TRUE(db->Get(ReadOptions(), "key.002", &value).ok());
+
+    std::unique_ptr<Iterator> iter(db->NewIterator(ReadOptions()));
+    iter->Seek("key.050");
+    ASSERT_TRUE(iter->Valid());
+    iter.reset();
+
+    rs = db->EndTrace();
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+
+    // Not be recorded.
+    ASSERT_TRUE(db->Put(WriteOptions(), "key.999", "value").ok());
+    db.reset();
+
+    std::unique_ptr<DB> replay(OpenDB(replay_name_));
+    ASSERT_NE(nullptr, replay.get());
+
+    ReplayOptions options;
+    options.threads = 4;
+    options.speed   = 0;
+
+    ReplayStats stats;
+    rs = ReplayTrace(replay.get(), Env::Default(), trace_name_, options,
+                     &stats);
+    ASSERT_TRUE(rs.ok()) << rs.ToString();
+    EXPECT_EQ(102, stats.writes);
+    EXPECT_EQ(2, stats.gets);
+    EXPECT_EQ(1, stats.seeks);
+    EXPECT_EQ(0, stats.failed);
+
+    ASSERT_TRUE(replay->Get(ReadOptions(), "key.000", &value).IsNotFound());
+    ASSERT_TRUE(replay->Get(ReadOptions(), "key.001", &value).IsNotFound());
+    ASSERT_TRUE(replay->Get(ReadOptions(), "key.100", &value).ok());
+    EXPECT_EQ("value", value);
+    ASSERT_TRUE(replay->Get(ReadOptions(), "key.999", &value).IsNotFound());
+}
+
+} // namespace yukino